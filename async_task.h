@@ -0,0 +1,206 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Minimal C++20 coroutine plumbing for the asynchronous frame API. Tasks are
+// lazy: nothing runs until the task is awaited, passed to when_all() or
+// driven by sync_wait(). Completion resumes the awaiting coroutine directly
+// on whichever thread finished the work.
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+struct FinalAwaiter {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> h) noexcept {
+        std::coroutine_handle<> next = h.promise().continuation;
+        return next ? next : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct PromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    FinalAwaiter final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : PromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    template <typename U>
+    void return_value(U &&v) { value.emplace(std::forward<U>(v)); }
+    T take() {
+        if (error) std::rethrow_exception(error);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : PromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (error) std::rethrow_exception(error);
+    }
+};
+
+} // namespace detail
+
+template <typename T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+    using Handle = std::coroutine_handle<promise_type>;
+
+    Task() = default;
+    explicit Task(Handle h) : handle(h) {}
+    Task(Task &&other) noexcept : handle(std::exchange(other.handle, {})) {}
+    Task &operator=(Task &&other) noexcept {
+        if (this != &other) {
+            if (handle) handle.destroy();
+            handle = std::exchange(other.handle, {});
+        }
+        return *this;
+    }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if (handle) handle.destroy();
+    }
+
+    bool await_ready() const noexcept { return !handle || handle.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+    T await_resume() { return handle.promise().take(); }
+
+private:
+    Handle handle;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+// Eagerly started, self-destroying coroutine used as a completion hook.
+struct DetachedTask {
+    struct promise_type {
+        DetachedTask get_return_object() { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+namespace detail {
+
+template <typename T>
+struct SyncWaitState {
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool done = false;
+    std::exception_ptr error;
+    std::optional<std::conditional_t<std::is_void_v<T>, bool, T>> result;
+};
+
+template <typename T>
+DetachedTask sync_wait_runner(Task<T> &task, SyncWaitState<T> &st) {
+    try {
+        if constexpr (std::is_void_v<T>) {
+            co_await task;
+            st.result.emplace(true);
+        } else {
+            st.result.emplace(co_await task);
+        }
+    } catch (...) {
+        st.error = std::current_exception();
+    }
+    std::lock_guard<std::mutex> lk(st.mtx);
+    st.done = true;
+    st.cv.notify_all();
+}
+
+} // namespace detail
+
+// Blocks the calling thread until `task` completes. Only for entry points
+// such as main(); library code should co_await instead.
+template <typename T>
+T sync_wait(Task<T> task) {
+    detail::SyncWaitState<T> st;
+    detail::sync_wait_runner(task, st);
+
+    std::unique_lock<std::mutex> lk(st.mtx);
+    st.cv.wait(lk, [&] { return st.done; });
+    if (st.error) std::rethrow_exception(st.error);
+    if constexpr (!std::is_void_v<T>) return std::move(*st.result);
+}
+
+// Starts every task concurrently and resumes the caller once all finished.
+// Results keep the order of `tasks`.
+template <typename T>
+Task<std::vector<T>> when_all(std::vector<Task<T>> tasks) {
+    struct State {
+        std::atomic<size_t> remaining{0};
+        std::coroutine_handle<> parent;
+    };
+
+    struct Awaiter {
+        std::vector<Task<T>> &tasks;
+        std::vector<std::optional<T>> &slots;
+        State &state;
+
+        bool await_ready() const noexcept { return tasks.empty(); }
+        bool await_suspend(std::coroutine_handle<> parent) {
+            state.parent = parent;
+            // One extra count held by the launcher so the parent cannot be
+            // resumed while children are still being started; if everything
+            // already finished, the parent simply does not suspend.
+            state.remaining = tasks.size() + 1;
+            for (size_t i = 0; i < tasks.size(); ++i) launch(tasks[i], slots[i], state);
+            return state.remaining.fetch_sub(1) != 1;
+        }
+        void await_resume() const noexcept {}
+
+        static detail::DetachedTask launch(Task<T> &task, std::optional<T> &slot, State &st) {
+            slot.emplace(co_await task);
+            if (st.remaining.fetch_sub(1) == 1) st.parent.resume();
+        }
+    };
+
+    State state;
+    std::vector<std::optional<T>> slots(tasks.size());
+    co_await Awaiter{tasks, slots, state};
+
+    std::vector<T> out;
+    out.reserve(slots.size());
+    for (auto &s : slots) out.push_back(std::move(*s));
+    co_return out;
+}
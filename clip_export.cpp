@@ -0,0 +1,407 @@
+#include "clip_export.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavutil/opt.h>
+}
+
+#include "ff_player.h"
+#include "frame_index.h"
+
+using namespace std;
+
+namespace {
+
+using Nal = pair<const uint8_t *, size_t>;
+using ParameterSets = vector<vector<uint8_t>>;
+
+// NAL units of an Annex-B buffer, without their start codes.
+vector<Nal> split_annexb(const uint8_t *p, size_t n) {
+    vector<Nal> nals;
+    auto next_start = [&](size_t i) {
+        for (; i + 3 <= n; ++i) {
+            if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1) return i;
+        }
+        return n;
+    };
+    size_t i = next_start(0);
+    while (i < n) {
+        const size_t begin = i + 3;
+        size_t end = next_start(begin);
+        const size_t next = end;
+        while (end > begin && p[end - 1] == 0) --end; // trailing zeros belong to the next 4-byte start code
+        if (end > begin) nals.emplace_back(p + begin, end - begin);
+        i = next;
+    }
+    return nals;
+}
+
+vector<Nal> split_length_prefixed(const uint8_t *p, size_t n, int len_size) {
+    vector<Nal> nals;
+    size_t i = 0;
+    while (i + static_cast<size_t>(len_size) <= n) {
+        size_t len = 0;
+        for (int k = 0; k < len_size; ++k) len = len << 8 | p[i + static_cast<size_t>(k)];
+        i += static_cast<size_t>(len_size);
+        if (len > n - i) break;
+        nals.emplace_back(p + i, len);
+        i += len;
+    }
+    return nals;
+}
+
+bool has_start_code(const uint8_t *p, size_t n) {
+    return (n >= 3 && p[0] == 0 && p[1] == 0 && p[2] == 1) || (n >= 4 && p[0] == 0 && p[1] == 0 && p[2] == 0 && p[3] == 1);
+}
+
+// Length-field size of the avcC/hvcC packets of a stream, 0 for Annex-B.
+int nal_length_size(AVCodecID id, const uint8_t *extra, int size) {
+    if (!extra || size < 1 || extra[0] != 1) return 0;
+    if (id == AV_CODEC_ID_H264 && size >= 7) return (extra[4] & 3) + 1;
+    if (id == AV_CODEC_ID_HEVC && size >= 23) return (extra[21] & 3) + 1;
+    return 0;
+}
+
+// The parameter sets (SPS, PPS, VPS) in extradata, from an avcC/hvcC record
+// or from Annex-B.
+ParameterSets parameter_sets(AVCodecID id, const uint8_t *extra, int size) {
+    ParameterSets out;
+    if (!extra || size <= 0) return out;
+    const size_t n = static_cast<size_t>(size);
+    if (extra[0] != 1) {
+        for (const Nal &nal : split_annexb(extra, n)) out.emplace_back(nal.first, nal.first + nal.second);
+        return out;
+    }
+    size_t i = 0;
+    auto take = [&]() {
+        if (i + 2 > n) return false;
+        const size_t len = static_cast<size_t>(extra[i] << 8 | extra[i + 1]);
+        i += 2;
+        if (len > n - i) return false;
+        out.emplace_back(extra + i, extra + i + len);
+        i += len;
+        return true;
+    };
+    if (id == AV_CODEC_ID_H264 && n >= 7) {
+        i = 5;
+        const int sps = extra[i++] & 0x1f;
+        for (int k = 0; k < sps; ++k) if (!take()) return out;
+        if (i >= n) return out;
+        const int pps = extra[i++];
+        for (int k = 0; k < pps; ++k) if (!take()) return out;
+    } else if (id == AV_CODEC_ID_HEVC && n >= 23) {
+        i = 22;
+        const int arrays = extra[i++];
+        for (int a = 0; a < arrays && i + 3 <= n; ++a) {
+            const int count = extra[i + 1] << 8 | extra[i + 2];
+            i += 3;
+            for (int k = 0; k < count; ++k) if (!take()) return out;
+        }
+    }
+    return out;
+}
+
+struct ClipWriter {
+    AVFormatContext *oc = nullptr;
+    AVStream *ost = nullptr;
+    int64_t last_dts = AV_NOPTS_VALUE;
+    uint64_t packets = 0;
+    uint64_t dts_fixes = 0;
+
+    // H.264/HEVC: edge packets carry their encoder's parameter sets in-band on
+    // every keyframe, converted to the copied stream's packet format, and the
+    // first copied keyframe after an edge gets the source's sets back, so
+    // every segment decodes with its own SPS/PPS.
+    bool inband_params = false;
+    int nal_size = 0;              // length-field bytes of the copied packets, 0 = Annex-B
+    ParameterSets source_params;
+    bool restore_params = false;   // an edge's sets are active; the next copied keyframe resets them
+
+    ~ClipWriter() {
+        if (!oc) return;
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) avio_closep(&oc->pb);
+        avformat_free_context(oc);
+    }
+
+    // Rebuilds `pkt` as `params` followed by its own NAL units, in the
+    // stream's packet format.
+    int rewrap(AVPacket *pkt, const ParameterSets &params, bool annexb_in, int in_len_size) {
+        const vector<Nal> nals = annexb_in ? split_annexb(pkt->data, static_cast<size_t>(pkt->size))
+                                           : split_length_prefixed(pkt->data, static_cast<size_t>(pkt->size), in_len_size);
+        const size_t prefix = nal_size ? static_cast<size_t>(nal_size) : 4;
+        size_t total = 0;
+        for (const vector<uint8_t> &ps : params) total += prefix + ps.size();
+        for (const Nal &nal : nals) total += prefix + nal.second;
+        unique_ptr<AVPacket, AVPacketDeleter> out(av_packet_alloc());
+        if (!out || total > INT_MAX || av_new_packet(out.get(), static_cast<int>(total)) < 0) return AVERROR(ENOMEM);
+        av_packet_copy_props(out.get(), pkt);
+        uint8_t *d = out->data;
+        auto put = [&](const uint8_t *src, size_t len) {
+            if (nal_size) {
+                for (int k = nal_size - 1; k >= 0; --k) *d++ = static_cast<uint8_t>(len >> (8 * k));
+            } else {
+                *d++ = 0; *d++ = 0; *d++ = 0; *d++ = 1;
+            }
+            memcpy(d, src, len);
+            d += len;
+        };
+        for (const vector<uint8_t> &ps : params) put(ps.data(), ps.size());
+        for (const Nal &nal : nals) put(nal.first, nal.second);
+        av_packet_unref(pkt);
+        av_packet_move_ref(pkt, out.get());
+        return 0;
+    }
+
+    // A packet of a re-encoded edge, in the encoder's time base.
+    int write_edge(AVPacket *pkt, AVRational tb, const ParameterSets &params) {
+        if (inband_params) {
+            const bool key = (pkt->flags & AV_PKT_FLAG_KEY) != 0;
+            const bool annexb = has_start_code(pkt->data, static_cast<size_t>(pkt->size));
+            if (key || annexb != (nal_size == 0)) {
+                const int ret = rewrap(pkt, key ? params : ParameterSets{}, annexb, 4);
+                if (ret < 0) return ret;
+            }
+            restore_params = true;
+        }
+        return write(pkt, tb);
+    }
+
+    // A stream-copied packet, in the source time base.
+    int write_copy(AVPacket *pkt, AVRational tb) {
+        if (restore_params && (pkt->flags & AV_PKT_FLAG_KEY)) {
+            const int ret = rewrap(pkt, source_params, nal_size == 0, nal_size);
+            if (ret < 0) return ret;
+            restore_params = false;
+        }
+        return write(pkt, tb);
+    }
+
+    // `pkt` is in `tb`; pts/dts already relative to the clip start.
+    int write(AVPacket *pkt, AVRational tb) {
+        pkt->stream_index = ost->index;
+        av_packet_rescale_ts(pkt, tb, ost->time_base);
+        // Edges are shifted by the source's reorder delay (see drain_encoder),
+        // so this only catches rounding and streams whose delay varies. DTS
+        // must strictly increase and may not pass PTS; when both cannot hold,
+        // PTS moves up with it by one tick of the output time base.
+        if (pkt->dts != AV_NOPTS_VALUE && last_dts != AV_NOPTS_VALUE && pkt->dts <= last_dts) {
+            pkt->dts = last_dts + 1;
+            if (pkt->pts != AV_NOPTS_VALUE && pkt->pts < pkt->dts) pkt->pts = pkt->dts;
+            ++dts_fixes;
+        }
+        if (pkt->dts != AV_NOPTS_VALUE) last_dts = pkt->dts;
+        ++packets;
+        return av_interleaved_write_frame(oc, pkt);
+    }
+};
+
+}
+
+static int open_clip_writer(ClipWriter &w, const string &output, const FFPlayer &p) {
+    int ret = avformat_alloc_output_context2(&w.oc, nullptr, nullptr, output.c_str());
+    if (ret < 0 || !w.oc) { print_error("Cannot create output for " + output, ret); return ret < 0 ? ret : AVERROR(EINVAL); }
+    w.ost = avformat_new_stream(w.oc, nullptr);
+    if (!w.ost) return AVERROR(ENOMEM);
+    const AVCodecParameters *par = p.video_stream->codecpar;
+    ret = avcodec_parameters_copy(w.ost->codecpar, par);
+    if (ret < 0) return ret;
+    w.ost->codecpar->codec_tag = 0; // let the muxer pick its tag for the codec
+    w.inband_params = par->codec_id == AV_CODEC_ID_H264 || par->codec_id == AV_CODEC_ID_HEVC;
+    if (w.inband_params) {
+        w.nal_size = nal_length_size(par->codec_id, par->extradata, par->extradata_size);
+        w.source_params = parameter_sets(par->codec_id, par->extradata, par->extradata_size);
+        // MP4/MOV only allow parameter sets inside samples with the avc3/hev1
+        // sample entries.
+        const unsigned tag = par->codec_id == AV_CODEC_ID_H264 ? MKTAG('a', 'v', 'c', '3') : MKTAG('h', 'e', 'v', '1');
+        if (w.oc->oformat->codec_tag && av_codec_get_id(w.oc->oformat->codec_tag, tag) == par->codec_id) w.ost->codecpar->codec_tag = tag;
+    }
+    w.ost->time_base = p.video_stream->time_base;
+    w.ost->avg_frame_rate = p.avg_frame_rate;
+    if (!(w.oc->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&w.oc->pb, output.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) { print_error("Cannot open " + output, ret); return ret; }
+    }
+    ret = avformat_write_header(w.oc, nullptr);
+    if (ret < 0) print_error("Cannot write header", ret);
+    return ret;
+}
+
+// Encoder for the re-encoded edges: the source codec, size and pixel format,
+// no B-frames, and a bit rate taken from the stream or from the index sizes.
+// With `global_header` its parameter sets go to extradata rather than into
+// the packets; ClipWriter::write_edge puts them back in the stream's format.
+static AVCodecContext *open_edge_encoder(const FFPlayer &p, const FrameIndex &index, bool global_header) {
+    const AVCodecParameters *par = p.video_stream->codecpar;
+    const AVCodec *codec = avcodec_find_encoder(par->codec_id);
+    if (!codec) {
+        cerr << "No " << avcodec_get_name(par->codec_id) << " encoder, cannot re-encode the partial GOPs\n";
+        return nullptr;
+    }
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    if (!enc) return nullptr;
+    enc->width = p.dec_ctx->width;
+    enc->height = p.dec_ctx->height;
+    enc->sample_aspect_ratio = p.dec_ctx->sample_aspect_ratio;
+    enc->pix_fmt = p.dec_ctx->pix_fmt;
+    if (codec->pix_fmts) {
+        const AVPixelFormat *f = codec->pix_fmts;
+        while (*f != AV_PIX_FMT_NONE && *f != p.dec_ctx->pix_fmt) ++f;
+        enc->pix_fmt = *f != AV_PIX_FMT_NONE ? *f : codec->pix_fmts[0];
+    }
+    enc->color_range = p.dec_ctx->color_range;
+    enc->colorspace = p.dec_ctx->colorspace;
+    enc->color_primaries = p.dec_ctx->color_primaries;
+    enc->color_trc = p.dec_ctx->color_trc;
+    const AVRational rate = p.avg_frame_rate.num > 0 ? p.avg_frame_rate : AVRational{25, 1};
+    enc->time_base = av_inv_q(rate); // one tick per frame
+    enc->framerate = rate;
+    enc->max_b_frames = 0;
+    enc->gop_size = 600;
+    enc->bit_rate = par->bit_rate;
+    if (enc->bit_rate <= 0 && !index.entries.empty()) {
+        int64_t bytes = 0;
+        for (const FrameIndexEntry &e : index.entries) bytes += e.size;
+        enc->bit_rate = static_cast<int64_t>(static_cast<double>(bytes) * 8.0 * av_q2d(rate) / static_cast<double>(index.entries.size()));
+    }
+    if (global_header) enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    const int ret = avcodec_open2(enc, codec, nullptr);
+    if (ret < 0) {
+        print_error("Cannot open the edge encoder", ret);
+        avcodec_free_context(&enc);
+    }
+    return enc;
+}
+
+// Edge packets come out with DTS == PTS. The copied GOPs decode `reorder`
+// frames ahead of their PTS, so the edges are moved back by as much to keep
+// DTS increasing across the splice.
+static int drain_encoder(AVCodecContext *enc, const ParameterSets &params, int64_t reorder, ClipWriter &w) {
+    unique_ptr<AVPacket, AVPacketDeleter> pkt(av_packet_alloc());
+    int ret;
+    while ((ret = avcodec_receive_packet(enc, pkt.get())) >= 0) {
+        if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= reorder;
+        ret = w.write_edge(pkt.get(), enc->time_base, params);
+        av_packet_unref(pkt.get());
+        if (ret < 0) return ret;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF ? 0 : ret;
+}
+
+// Decodes frames [first, last] and encodes them as a self-contained run
+// starting with a keyframe. Returns the number of frames encoded or a
+// negative AVERROR.
+static int64_t reencode_frames(FFPlayer &p, const FrameIndex &index, int64_t first, int64_t last, int64_t clip_in, ClipWriter &w) {
+    AVCodecContext *enc = open_edge_encoder(p, index, w.inband_params);
+    if (!enc) return AVERROR(ENOSYS);
+    const ParameterSets params = parameter_sets(enc->codec_id, enc->extradata, enc->extradata_size);
+    const int64_t reorder = max(p.video_stream->codecpar->video_delay, p.dec_ctx->has_b_frames);
+    SwsContext *sws = nullptr;
+    unique_ptr<AVFrame, AVFrameDeleter> converted;
+    int64_t encoded = 0;
+    int ret = 0;
+    for (int64_t n = first; n <= last && ret >= 0; ++n) {
+        unique_ptr<AVFrame, AVFrameDeleter> f = decode_frame_indexed(p, index, n);
+        if (!f) break;
+        AVFrame *src = f.get();
+        if (src->format != enc->pix_fmt || src->width != enc->width || src->height != enc->height) {
+            sws = sws_getCachedContext(sws, src->width, src->height, static_cast<AVPixelFormat>(src->format), enc->width,
+                                       enc->height, enc->pix_fmt, SWS_BICUBIC, nullptr, nullptr, nullptr);
+            if (!converted) {
+                converted.reset(av_frame_alloc());
+                converted->format = enc->pix_fmt;
+                converted->width = enc->width;
+                converted->height = enc->height;
+                if (!sws || av_frame_get_buffer(converted.get(), 0) < 0) { ret = AVERROR(ENOMEM); break; }
+            }
+            av_frame_make_writable(converted.get());
+            sws_scale(sws, src->data, src->linesize, 0, src->height, converted->data, converted->linesize);
+            src = converted.get();
+        }
+        src->pts = n - clip_in;
+        src->pict_type = n == first ? AV_PICTURE_TYPE_I : AV_PICTURE_TYPE_NONE;
+        ret = avcodec_send_frame(enc, src);
+        if (ret >= 0) ret = drain_encoder(enc, params, reorder, w);
+        if (ret >= 0) ++encoded;
+    }
+    if (ret >= 0 && avcodec_send_frame(enc, nullptr) >= 0) ret = drain_encoder(enc, params, reorder, w);
+    sws_freeContext(sws);
+    avcodec_free_context(&enc);
+    return ret < 0 ? ret : encoded;
+}
+
+// Copies the packets from the keyframe at `start_ts` up to (not including)
+// the keyframe at `end_ts`, or to the end of the stream.
+static int64_t copy_gops(FFPlayer &p, int64_t start_ts, int64_t end_ts, int64_t base_ts, ClipWriter &w) {
+    int ret = av_seek_frame(p.fmt_ctx, p.video_stream_idx, start_ts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) { print_error("Seek failed", ret); return ret; }
+    unique_ptr<AVPacket, AVPacketDeleter> pkt(av_packet_alloc());
+    int64_t copied = 0;
+    while ((ret = av_read_frame(p.fmt_ctx, pkt.get())) >= 0) {
+        if (pkt->stream_index != p.video_stream_idx) { av_packet_unref(pkt.get()); continue; }
+        const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (end_ts != AV_NOPTS_VALUE && (pkt->flags & AV_PKT_FLAG_KEY) && ts >= end_ts) { av_packet_unref(pkt.get()); break; }
+        if (ts == AV_NOPTS_VALUE || ts < start_ts) { av_packet_unref(pkt.get()); continue; }
+        if (pkt->pts != AV_NOPTS_VALUE) pkt->pts -= base_ts;
+        if (pkt->dts != AV_NOPTS_VALUE) pkt->dts -= base_ts;
+        ret = w.write_copy(pkt.get(), p.video_stream->time_base);
+        av_packet_unref(pkt.get());
+        if (ret < 0) { print_error("Write failed", ret); return ret; }
+        ++copied;
+    }
+    // The demuxer moved on without the decoder; make the next decode seek.
+    avcodec_flush_buffers(p.dec_ctx);
+    p.last_shown_pts = AV_NOPTS_VALUE;
+    return ret < 0 && ret != AVERROR_EOF ? ret : copied;
+}
+
+int run_clip_export(const string &input, int64_t in_frame, int64_t out_frame, const string &output) {
+    if (in_frame < 0 || out_frame < in_frame) { cerr << "Invalid clip range " << in_frame << '-' << out_frame << '\n'; return -1; }
+    FFPlayer p;
+    if (open_player(p, input) < 0) return -1;
+    FrameIndex index;
+    if (!build_frame_index(p, index)) { cerr << input << ": no keyframe index, cannot cut at GOP boundaries\n"; return -1; }
+    AVStream *st = p.video_stream;
+    const auto start = chrono::steady_clock::now();
+
+    // [in, copy_first) and (copy_last, out] are re-encoded, whole GOPs in
+    // between are copied. A cut exactly on a GOP boundary needs no encode.
+    const int64_t in_ts = frame_number_to_stream_ts(in_frame, st);
+    const int64_t out_ts = frame_number_to_stream_ts(out_frame, st);
+    const int64_t key_in = index.keyframe_at_or_before(in_ts);
+    const int64_t copy_start = key_in == in_ts ? in_ts : index.keyframe_after(in_ts);
+    const int64_t after_out = index.keyframe_after(out_ts);
+    int64_t last_frame = st->nb_frames > 0 ? st->nb_frames - 1 : -1;
+    if (index.entries.size() > index.keyframes.size()) last_frame = pts_to_frame_number(index.entries.back().ts, st);
+    const bool out_on_boundary = after_out == AV_NOPTS_VALUE ? last_frame >= 0 && out_frame >= last_frame
+                                                             : pts_to_frame_number(after_out, st) == out_frame + 1;
+    const int64_t copy_end = out_on_boundary ? after_out : index.keyframe_at_or_before(out_ts);
+    const bool has_copy = copy_start != AV_NOPTS_VALUE && (copy_end == AV_NOPTS_VALUE || copy_start < copy_end);
+    const int64_t head_last = has_copy ? pts_to_frame_number(copy_start, st) - 1 : out_frame;
+    const int64_t tail_first = has_copy && copy_end != AV_NOPTS_VALUE && !out_on_boundary ? pts_to_frame_number(copy_end, st) : out_frame + 1;
+
+    ClipWriter w;
+    if (open_clip_writer(w, output, p) < 0) return -1;
+
+    int64_t head = 0, copied = 0, tail = 0;
+    if (head_last >= in_frame) head = reencode_frames(p, index, in_frame, head_last, in_frame, w);
+    if (head >= 0 && has_copy) copied = copy_gops(p, copy_start, copy_end, in_ts, w);
+    if (head >= 0 && copied >= 0 && tail_first <= out_frame) tail = reencode_frames(p, index, tail_first, out_frame, in_frame, w);
+    if (head < 0 || copied < 0 || tail < 0) { cerr << "Clip export failed\n"; return -1; }
+    const int ret = av_write_trailer(w.oc);
+    if (ret < 0) { print_error("Cannot finish " + output, ret); return -1; }
+
+    const double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    const double clip_secs = static_cast<double>(out_frame - in_frame + 1) / (p.fps > 0.0 ? p.fps : 25.0);
+    cout << "Wrote frames " << in_frame << '-' << out_frame << " to " << output << ": " << copied << " packets copied, "
+         << head + tail << " frames re-encoded (" << head << " at the in point, " << tail << " at the out point) in " << secs
+         << " s (" << (secs > 0.0 ? clip_secs / secs : 0.0) << "x real time)\n";
+    if (w.dts_fixes) cout << "Adjusted " << w.dts_fixes << " timestamps to keep DTS increasing at the splices\n";
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// --clip: writes frames [in_frame, out_frame] of the video stream to
+// `output` (container chosen from its extension). Whole GOPs inside the range
+// are stream-copied packet for packet; only the partial GOPs at the two cuts
+// are decoded and re-encoded with the source codec, so the result is frame
+// accurate at a fraction of the cost of a transcode. Assumes closed GOPs.
+int run_clip_export(const std::string &input, int64_t in_frame, int64_t out_frame, const std::string &output);
@@ -0,0 +1,255 @@
+#include "compositor.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#include "pixel_kernels.h"
+
+using namespace std;
+
+enum RowClass : uint8_t { RowTransparent = 0, RowMixed = 1, RowOpaque = 2 };
+
+struct Compositor::Layer {
+    CompositorLayer spec;
+    FFPlayer player;
+    FrameIndex index;
+    SwsContext *sws = nullptr;
+    cv::Mat image;                 // premultiplied BGRA
+    vector<uint8_t> row_class;     // RowClass per image row
+    int64_t shown = -1;            // layer frame in `image`
+    int64_t ended_at = -1;         // first frame found past the end, -1 = none
+    bool visible = false;
+
+    ~Layer() {
+        if (sws) sws_freeContext(sws);
+    }
+};
+
+bool parse_layer(const string &text, CompositorLayer &out) {
+    out = CompositorLayer{};
+    const size_t at = text.rfind('@');
+    if (at != string::npos && at > 0) {
+        int x = 0, y = 0;
+        char tail = 0;
+        if (sscanf(text.c_str() + at + 1, "%d,%d%c", &x, &y, &tail) == 2) {
+            out.path = text.substr(0, at);
+            out.x = x;
+            out.y = y;
+            return true;
+        }
+    }
+    out.path = text;
+    return !out.path.empty();
+}
+
+Compositor::Compositor(vector<CompositorLayer> specs, TaskScheduler &sched) : sched(sched) {
+    for (CompositorLayer &s : specs) {
+        auto l = make_unique<Layer>();
+        l->spec = move(s);
+        layers.push_back(move(l));
+    }
+}
+
+Compositor::~Compositor() = default;
+
+bool Compositor::open() {
+    atomic<bool> ok{true};
+    {
+        TaskGroup group(sched, TaskClass::Prefetch);
+        for (auto &lp : layers) {
+            Layer *l = lp.get();
+            group.run([l, &ok] {
+                if (open_player(l->player, l->spec.path) < 0) {
+                    ok = false;
+                    return;
+                }
+                if (!build_frame_index(l->player, l->index)) cerr << l->spec.path << ": no keyframe index, every frame will seek\n";
+            });
+        }
+    }
+    if (!ok) return false;
+    for (size_t i = 0; i < layers.size(); ++i) {
+        const Layer &l = *layers[i];
+        const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(l.player.dec_ctx->pix_fmt);
+        const bool alpha = desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA);
+        cout << "Layer " << i + 1 << ": " << l.spec.path << " at " << l.spec.x << ',' << l.spec.y << ", "
+             << (desc ? desc->name : "?") << (alpha ? "" : " (no alpha, opaque)") << '\n';
+    }
+    return true;
+}
+
+void Compositor::update_layer(Layer &l, double seconds) {
+    const int64_t target = static_cast<int64_t>(floor(seconds * l.player.fps + 1e-6));
+    if (target < 0 || (l.ended_at >= 0 && target >= l.ended_at)) {
+        l.visible = false;
+        return;
+    }
+    if (target == l.shown) {
+        l.visible = true;
+        return;
+    }
+    unique_ptr<AVFrame, AVFrameDeleter> f = decode_frame_indexed(l.player, l.index, target);
+    if (!f) {
+        l.ended_at = target;
+        l.visible = false;
+        return;
+    }
+    l.ended_at = -1;
+    l.shown = pts_to_frame_number(l.player.last_shown_pts, l.player.video_stream);
+
+    const AVPixelFormat fmt = static_cast<AVPixelFormat>(f->format);
+    l.sws = sws_getCachedContext(l.sws, f->width, f->height, fmt, f->width, f->height, AV_PIX_FMT_BGRA, SWS_BILINEAR, nullptr,
+                                 nullptr, nullptr);
+    if (!l.sws) {
+        l.visible = false;
+        return;
+    }
+    if (l.image.rows != f->height || l.image.cols != f->width) l.image.create(f->height, f->width, CV_8UC4);
+    uint8_t *dst[4] = {l.image.data, nullptr, nullptr, nullptr};
+    int dst_linesize[4] = {static_cast<int>(l.image.step[0]), 0, 0, 0};
+    sws_scale(l.sws, f->data, f->linesize, 0, f->height, dst, dst_linesize);
+
+    l.row_class.assign(static_cast<size_t>(f->height), RowOpaque);
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    if (desc && (desc->flags & AV_PIX_FMT_FLAG_ALPHA)) {
+        for (int y = 0; y < l.image.rows; ++y) {
+            uint8_t lo = 0, hi = 0;
+            premultiply_row(l.image.ptr(y), l.image.cols, lo, hi);
+            l.row_class[y] = hi == 0 ? RowTransparent : lo == 255 ? RowOpaque : RowMixed;
+        }
+    }
+    l.visible = true;
+}
+
+void Compositor::apply(cv::Mat &image, double seconds) {
+    if (layers.empty()) return;
+    if (image.type() != CV_8UC4) {
+        if (!warned_format) cerr << "Compositor needs 4-channel frames, layers not drawn\n";
+        warned_format = true;
+        return;
+    }
+    const auto t0 = chrono::steady_clock::now();
+    {
+        TaskGroup group(sched, TaskClass::DisplayCritical);
+        for (auto &lp : layers) {
+            Layer *l = lp.get();
+            group.run([this, l, seconds] { update_layer(*l, seconds); });
+        }
+    }
+    const auto t1 = chrono::steady_clock::now();
+
+    // Bands of whole rows keep every layer's rows of a band in cache while
+    // all layers are blended over it.
+    const int bands = max(1, min(image.rows / 16, static_cast<int>(sched.worker_count()) * 2));
+    const int band_h = (image.rows + bands - 1) / bands;
+    {
+        TaskGroup group(sched, TaskClass::DisplayCritical);
+        for (int b = 0; b < bands; ++b) {
+            const int y0 = b * band_h;
+            const int y1 = min(image.rows, y0 + band_h);
+            if (y0 >= y1) break;
+            group.run([this, &image, y0, y1] {
+                for (auto &lp : layers) {
+                    const Layer &l = *lp;
+                    if (!l.visible) continue;
+                    const int x0 = max(0, l.spec.x);
+                    const int x1 = min(image.cols, l.spec.x + l.image.cols);
+                    if (x0 >= x1) continue;
+                    const int ly0 = max(y0, l.spec.y);
+                    const int ly1 = min(y1, l.spec.y + l.image.rows);
+                    for (int y = ly0; y < ly1; ++y) {
+                        const int src_y = y - l.spec.y;
+                        const uint8_t cls = l.row_class[src_y];
+                        if (cls == RowTransparent) continue;
+                        const uint8_t *src = l.image.ptr(src_y) + 4 * (x0 - l.spec.x);
+                        uint8_t *dst = image.ptr(y) + 4 * x0;
+                        if (cls == RowOpaque) memcpy(dst, src, static_cast<size_t>(x1 - x0) * 4);
+                        else blend_row(src, dst, x1 - x0);
+                    }
+                }
+            });
+        }
+    }
+    const auto t2 = chrono::steady_clock::now();
+    ++frames;
+    decode_ms += chrono::duration<double, milli>(t1 - t0).count();
+    blend_ms += chrono::duration<double, milli>(t2 - t1).count();
+    max_ms = max(max_ms, chrono::duration<double, milli>(t2 - t0).count());
+}
+
+void Compositor::print_stats(ostream &os) const {
+    if (!frames) return;
+    const double n = static_cast<double>(frames);
+    os << "Compositor: " << layers.size() << " layers, " << frames << " frames, " << (decode_ms + blend_ms) / n << " ms mean ("
+       << decode_ms / n << " layer decode, " << blend_ms / n << " blend), " << max_ms << " ms max\n";
+}
+
+// Runs fn(y0, y1) over all rows, or in bands on the scheduler as apply() does.
+template <typename Fn>
+static void for_rows(TaskScheduler &sched, int rows, bool banded, Fn fn) {
+    if (!banded) {
+        fn(0, rows);
+        return;
+    }
+    const int bands = max(1, min(rows / 16, static_cast<int>(sched.worker_count()) * 2));
+    const int band_h = (rows + bands - 1) / bands;
+    TaskGroup group(sched, TaskClass::DisplayCritical);
+    for (int y0 = 0; y0 < rows; y0 += band_h) group.run([fn, y0, y1 = min(rows, y0 + band_h)] { fn(y0, y1); });
+}
+
+int run_compositor_benchmark(double seconds) {
+    const int w = 1920, h = 1080;
+    // Worst case for the layer: alpha between 1 and 254 everywhere, so every
+    // row is mixed and nothing is skipped or copied.
+    cv::Mat layer(h, w, CV_8UC4), program(h, w, CV_8UC4);
+    cv::randu(layer, cv::Scalar::all(0), cv::Scalar::all(256));
+    cv::randu(program, cv::Scalar::all(0), cv::Scalar::all(256));
+    for (int y = 0; y < h; ++y) {
+        uint8_t *px = layer.ptr(y);
+        for (int x = 0; x < w; ++x) px[4 * x + 3] = static_cast<uint8_t>(1 + (x + y) % 254);
+    }
+    const double frame_bytes = static_cast<double>(w) * h * 4;
+
+    TaskScheduler &sched = TaskScheduler::global();
+    const double per_run = max(0.1, seconds / 4.0);
+    cout << "Compositor kernels, 1920x1080 BGRA, every row mixed, " << per_run << " s per run\n";
+    for (int kernel = 0; kernel < 2; ++kernel) {
+        for (int banded = 0; banded < 2; ++banded) {
+            uint64_t n = 0;
+            const auto start = chrono::steady_clock::now();
+            double elapsed = 0.0;
+            while (elapsed < per_run) {
+                // Premultiplying leaves alpha alone, so every pass does the same work.
+                for_rows(sched, h, banded != 0, [&](int y0, int y1) {
+                    for (int y = y0; y < y1; ++y) {
+                        if (kernel == 0) {
+                            uint8_t lo = 0, hi = 0;
+                            premultiply_row(layer.ptr(y), w, lo, hi);
+                        } else {
+                            blend_row(layer.ptr(y), program.ptr(y), w);
+                        }
+                    }
+                });
+                ++n;
+                elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            }
+            const double fps = static_cast<double>(n) / elapsed;
+            // Premultiply reads and writes the layer; blend reads the layer and
+            // reads and writes the program frame.
+            const double bytes = (kernel == 0 ? 2.0 : 3.0) * frame_bytes;
+            cout << "  " << (kernel == 0 ? "premultiply" : "blend") << (banded ? ", " : ", 1 thread, ")
+                 << (banded ? to_string(sched.worker_count()) + " workers: " : "") << 1000.0 / fps << " ms/frame, " << fps
+                 << " frames/s, " << fps * bytes / 1e9 << " GB/s" << (fps >= 60.0 ? "" : " (below 60 fps)") << '\n';
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+#include "data_loader.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+
+#include "task_scheduler.h"
+
+using namespace std;
+
+DataLoader::DataLoader(const DataLoaderOptions &opts) : opts(opts), files(max<size_t>(1, opts.max_files)) {
+    this->opts.batch = max<size_t>(1, opts.batch);
+    this->opts.prefetch_batches = max<size_t>(1, opts.prefetch_batches);
+    if (!this->opts.workers) this->opts.workers = max<size_t>(1, TaskScheduler::global().worker_count());
+}
+
+void DataLoader::plan_batch(size_t b) {
+    // One unit per file; map keeps the unit order independent of hashing.
+    map<string, vector<size_t>> by_file;
+    const size_t end = min(samples.size(), (b + 1) * opts.batch);
+    for (size_t s = b * opts.batch; s < end; ++s) by_file[samples[s].path].push_back(s);
+    for (auto &[path, list] : by_file) {
+        stable_sort(list.begin(), list.end(), [this](size_t x, size_t y) { return samples[x].frame < samples[y].frame; });
+        units.push_back({b, move(list)});
+    }
+}
+
+void DataLoader::start(vector<LoaderSample> list) {
+    stop();
+    samples = move(list);
+    units.clear();
+    batches.assign((samples.size() + opts.batch - 1) / opts.batch, Batch{});
+    for (size_t b = 0; b < batches.size(); ++b) {
+        const size_t n = min(opts.batch, samples.size() - b * opts.batch);
+        batches[b].frames.resize(n);
+        batches[b].remaining = n;
+        for (size_t i = 0; i < n; ++i) batches[b].frames[i].sample = b * opts.batch + i;
+        plan_batch(b);
+    }
+    next_unit = 0;
+    next_out = 0;
+    delivered = failed = 0;
+    finished_seconds = 0.0;
+    stopping = false;
+    started = Clock::now();
+    for (size_t i = 0; i < opts.workers; ++i) workers.emplace_back([this] { worker(); });
+}
+
+void DataLoader::stop() {
+    {
+        lock_guard<mutex> lk(mtx);
+        stopping = true;
+    }
+    window_cv.notify_all();
+    done_cv.notify_all();
+    for (thread &t : workers) t.join();
+    workers.clear();
+}
+
+DataLoader::SourcePtr DataLoader::source_for(const string &path) {
+    promise<SourcePtr> opened;
+    {
+        unique_lock<mutex> lk(files_mtx);
+        SourcePtr src;
+        if (files.get(path, src)) return src;
+        // Another worker is opening it: wait for that instead of opening twice.
+        auto it = opening.find(path);
+        if (it != opening.end()) {
+            shared_future<SourcePtr> pending = it->second;
+            lk.unlock();
+            return pending.get();
+        }
+        opening.emplace(path, opened.get_future().share());
+    }
+
+    const Clock::time_point t0 = Clock::now();
+    const size_t cache_bytes = opts.cache_mb * 1024 * 1024 / max<size_t>(1, opts.max_files);
+    SourcePtr src = make_shared<FrameSource>(path, opts.decoders_per_file, cache_bytes, &counters);
+    if (src->open() < 0) src.reset();
+    {
+        lock_guard<mutex> lk(files_mtx);
+        open_ns += static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - t0).count());
+        if (src) files.put(path, src);
+        opening.erase(path);
+    }
+    opened.set_value(src);
+    return src;
+}
+
+void DataLoader::worker() {
+    for (size_t u; (u = next_unit++) < units.size();) {
+        const Unit &unit = units[u];
+        {
+            unique_lock<mutex> lk(mtx);
+            window_cv.wait(lk, [&] { return stopping || unit.batch < next_out + opts.prefetch_batches; });
+            if (stopping) return;
+        }
+        Batch &batch = batches[unit.batch];
+        const size_t base = unit.batch * opts.batch;
+
+        size_t ok = 0;
+        if (SourcePtr src = source_for(samples[unit.samples.front()].path)) {
+            // Runs of frames in one GOP decode forward on one decoder; different
+            // GOPs of the file go to the source's other decoders in parallel.
+            vector<vector<size_t>> runs;
+            int last_gop = -2;
+            for (size_t s : unit.samples) {
+                const int gop = src->index().empty() ? -1 : src->index().gop_of(src->frame_ts(samples[s].frame));
+                if (runs.empty() || gop != last_gop) runs.emplace_back();
+                runs.back().push_back(s);
+                last_gop = gop;
+            }
+            atomic<size_t> good{0};
+            TaskGroup group(TaskScheduler::global(), TaskClass::Prefetch);
+            for (const vector<size_t> &run : runs) {
+                group.run([&, src] {
+                    for (size_t s : run) {
+                        GrabbedFrame g;
+                        LoadedFrame &out = batch.frames[s - base];
+                        if (!src->grab(samples[s].frame, g)) continue;
+                        out.frame_number = g.frame_number;
+                        out.pts = g.pts;
+                        out.image = move(g.image);
+                        out.ok = true;
+                        ++good;
+                    }
+                });
+            }
+            group.wait();
+            ok = good;
+        }
+
+        lock_guard<mutex> lk(mtx);
+        delivered += ok;
+        failed += unit.samples.size() - ok;
+        batch.remaining -= unit.samples.size();
+        if (batch.remaining == 0) done_cv.notify_all();
+    }
+}
+
+bool DataLoader::next_batch(vector<LoadedFrame> &out) {
+    unique_lock<mutex> lk(mtx);
+    if (next_out >= batches.size()) return false;
+    done_cv.wait(lk, [&] { return stopping || batches[next_out].remaining == 0; });
+    if (stopping) return false;
+    out = move(batches[next_out].frames);
+    if (++next_out == batches.size()) finished_seconds = chrono::duration<double>(Clock::now() - started).count();
+    lk.unlock();
+    window_cv.notify_all();
+    return true;
+}
+
+DataLoaderStats DataLoader::stats() const {
+    DataLoaderStats s;
+    {
+        lock_guard<mutex> lk(mtx);
+        s.frames = delivered;
+        s.failed = failed;
+        s.batches = next_out;
+        s.seconds = finished_seconds > 0.0 ? finished_seconds : chrono::duration<double>(Clock::now() - started).count();
+    }
+    lock_guard<mutex> lk(files_mtx);
+    s.file_hits = files.hit_count();
+    s.file_misses = files.miss_count();
+    s.open_ms = static_cast<double>(open_ns) / 1e6;
+    return s;
+}
+
+void DataLoader::print_stats(ostream &os) const {
+    const DataLoaderStats s = stats();
+    const uint64_t lookups = s.file_hits + s.file_misses;
+    os << "Loaded " << s.frames << " frames in " << s.batches << " batches in " << s.seconds << " s ("
+       << (s.seconds > 0.0 ? static_cast<double>(s.frames) / s.seconds : 0.0) << " frames/s), " << s.failed << " failed\n"
+       << "Open files: " << s.file_hits << " hits, " << s.file_misses << " misses ("
+       << (lookups ? 100.0 * static_cast<double>(s.file_hits) / static_cast<double>(lookups) : 0.0) << "% hit rate), "
+       << s.open_ms << " ms opening and indexing\n"
+       << "Decode: " << counters.seeks << " seeks, " << counters.forward_decodes << " forward, " << counters.decoded_hits
+       << " from cache, " << counters.frames_decoded << " frames decoded\n";
+}
+
+static bool read_sample_list(const string &list_file, vector<LoaderSample> &out) {
+    ifstream in(list_file);
+    if (!in) { cerr << "Cannot read " << list_file << '\n'; return false; }
+    string line;
+    for (size_t n = 1; getline(in, line); ++n) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty() || line[0] == '#') continue;
+        // The frame number is the last field, so paths may contain spaces.
+        const size_t sep = line.find_last_of(" \t");
+        char *end = nullptr;
+        const long long frame = sep == string::npos ? -1 : strtoll(line.c_str() + sep + 1, &end, 10);
+        if (frame < 0 || (end && *end)) { cerr << list_file << ':' << n << ": expected \"path frame\"\n"; return false; }
+        out.push_back({line.substr(0, line.find_last_not_of(" \t", sep) + 1), frame});
+    }
+    return true;
+}
+
+int run_data_loader(const string &list_file, const DataLoaderOptions &opts, int64_t seed) {
+    vector<LoaderSample> samples;
+    if (!read_sample_list(list_file, samples)) return -1;
+    if (samples.empty()) { cerr << list_file << ": no samples\n"; return -1; }
+    if (seed >= 0) shuffle(samples.begin(), samples.end(), mt19937_64(static_cast<uint64_t>(seed)));
+
+    DataLoader loader(opts);
+    loader.start(move(samples));
+    vector<LoadedFrame> batch;
+    while (loader.next_batch(batch)) {}
+    loader.print_stats(cout);
+    return loader.stats().failed ? -1 : 0;
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "frame_source.h"
+#include "lru_cache.h"
+
+struct LoaderSample {
+    std::string path;
+    int64_t frame = 0;
+};
+
+struct LoadedFrame {
+    size_t sample = 0;         // position in the sample list
+    int64_t frame_number = -1; // frame actually decoded
+    int64_t pts = AV_NOPTS_VALUE;
+    cv::Mat image;             // BGR24, empty when decoding failed
+    bool ok = false;
+};
+
+struct DataLoaderOptions {
+    size_t workers = 0;           // 0 = one per scheduler worker
+    size_t batch = 32;
+    size_t prefetch_batches = 4;  // how far workers may run ahead of next_batch()
+    size_t max_files = 64;        // open files kept in the LRU
+    size_t decoders_per_file = 2;
+    size_t cache_mb = 256;        // decoded-frame caches, split between open files
+};
+
+struct DataLoaderStats {
+    uint64_t frames = 0;
+    uint64_t failed = 0;
+    uint64_t batches = 0;
+    uint64_t file_hits = 0;
+    uint64_t file_misses = 0;
+    double open_ms = 0.0; // total time spent opening and indexing files
+    double seconds = 0.0;
+};
+
+// Random-access frame loader for training jobs. Files stay open in an LRU of
+// FrameSources (decoders plus keyframe index), so a request for a file seen
+// recently pays neither avformat_find_stream_info nor index building. Every
+// batch is split into one unit per file, sorted by frame, which N worker
+// threads take in turn. The file is only known to be indexed once a worker
+// has opened it, so the worker cuts its unit into runs of one GOP each; a
+// run decodes in one forward pass, and runs go to the file's decoders in
+// parallel on the task scheduler. Batches
+// are returned in order and their frames in sample order, whatever the worker
+// timing, so runs are reproducible.
+class DataLoader {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit DataLoader(const DataLoaderOptions &opts);
+    ~DataLoader() { stop(); }
+    DataLoader(const DataLoader &) = delete;
+    DataLoader &operator=(const DataLoader &) = delete;
+
+    // Starts an epoch over `samples`; workers begin decoding immediately.
+    void start(std::vector<LoaderSample> samples);
+    // Blocks until the next batch is complete. Returns false after the last one.
+    bool next_batch(std::vector<LoadedFrame> &out);
+    void stop();
+
+    DataLoaderStats stats() const;
+    void print_stats(std::ostream &os) const;
+
+private:
+    struct Unit {
+        size_t batch = 0;
+        std::vector<size_t> samples; // one file, ascending frame; split into GOP runs by the worker
+    };
+    struct Batch {
+        std::vector<LoadedFrame> frames;
+        size_t remaining = 0;
+    };
+    using SourcePtr = std::shared_ptr<FrameSource>;
+
+    void plan_batch(size_t b);
+    void worker();
+    SourcePtr source_for(const std::string &path);
+
+    DataLoaderOptions opts;
+    FrameSourceCounters counters;
+    std::vector<LoaderSample> samples;
+    std::vector<Unit> units;
+    std::vector<Batch> batches;
+    std::vector<std::thread> workers;
+    std::atomic<size_t> next_unit{0};
+    std::atomic<bool> stopping{false};
+    Clock::time_point started{};
+
+    mutable std::mutex mtx; // batches, next_out and the counters below
+    std::condition_variable done_cv;   // a batch completed
+    std::condition_variable window_cv; // next_out moved
+    size_t next_out = 0;
+    uint64_t delivered = 0;
+    uint64_t failed = 0;
+    double finished_seconds = 0.0;
+
+    mutable std::mutex files_mtx;
+    LruCache<std::string, SourcePtr> files;
+    std::unordered_map<std::string, std::shared_future<SourcePtr>> opening;
+    uint64_t open_ns = 0;
+};
+
+// --load: reads "path frame" lines, optionally shuffles them with `seed`,
+// loads them in batches and reports throughput and cache hit rates.
+int run_data_loader(const std::string &list_file, const DataLoaderOptions &opts, int64_t seed);
@@ -0,0 +1,369 @@
+#include "deinterlace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavfilter/buffersink.h>
+#include <libavfilter/buffersrc.h>
+#include <libavutil/mem.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "pixel_kernels.h"
+
+using namespace std;
+
+bool parse_deinterlace_mode(const string &name, DeinterlaceMode &out) {
+    if (name == "off") out = DeinterlaceMode::Off;
+    else if (name == "auto") out = DeinterlaceMode::Auto;
+    else if (name == "on") out = DeinterlaceMode::On;
+    else return false;
+    return true;
+}
+
+static bool frame_interlaced(const AVFrame *f) {
+#ifdef AV_FRAME_FLAG_INTERLACED
+    return (f->flags & AV_FRAME_FLAG_INTERLACED) != 0;
+#else
+    return f->interlaced_frame != 0;
+#endif
+}
+
+// Field order of the frame, else of the stream; top first when unknown.
+static bool top_field_first(const AVFrame *f, const AVCodecParameters *par) {
+    if (frame_interlaced(f)) {
+#ifdef AV_FRAME_FLAG_TOP_FIELD_FIRST
+        return (f->flags & AV_FRAME_FLAG_TOP_FIELD_FIRST) != 0;
+#else
+        return f->top_field_first != 0;
+#endif
+    }
+    return par->field_order != AV_FIELD_BB && par->field_order != AV_FIELD_BT;
+}
+
+// Formats the bob kernel handles: 8-bit planar, one sample per byte. Others
+// are shown as decoded until bwdif takes over.
+static bool bobbable(AVPixelFormat fmt) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    if (!desc || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR) || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL)))
+        return false;
+    for (int c = 0; c < desc->nb_components; ++c) {
+        if (desc->comp[c].depth != 8 || desc->comp[c].step != 1) return false;
+    }
+    return true;
+}
+
+// bwdif's slices run as display-critical tasks on the scheduler, like the
+// bob bands, rather than on a libavfilter thread pool of their own: that
+// pool would add a thread per core next to the workers, which are busy with
+// conversion and B's decoding in the same frame interval.
+static int run_slices(AVFilterContext *ctx, avfilter_action_func *func, void *arg, int *ret, int nb_jobs) {
+    TaskScheduler &sched = *static_cast<TaskScheduler *>(ctx->graph->opaque);
+    TaskGroup group(sched, TaskClass::DisplayCritical);
+    for (int j = 0; j < nb_jobs; ++j) {
+        group.run([=] {
+            const int r = func(ctx, arg, j, nb_jobs);
+            if (ret) ret[j] = r;
+        });
+    }
+    group.wait();
+    return 0;
+}
+
+Deinterlacer::Deinterlacer(FFPlayer &player, DeinterlaceMode mode, TaskScheduler &sched) : player(player), mode(mode), sched(sched) {}
+
+Deinterlacer::~Deinterlacer() {
+    close_graph();
+    av_frame_free(&bob_out);
+    av_frame_free(&filter_out);
+}
+
+bool Deinterlacer::needs(const AVFrame *frame) const {
+    if (mode == DeinterlaceMode::Off) return false;
+    if (mode == DeinterlaceMode::On || frame_interlaced(frame)) return true;
+    const AVFieldOrder order = player.video_stream->codecpar->field_order;
+    return order == AV_FIELD_TT || order == AV_FIELD_BB || order == AV_FIELD_TB || order == AV_FIELD_BT;
+}
+
+AVFrame *Deinterlacer::process(AVFrame *frame, int64_t frame_number, bool &draft, const function<AVFrame *()> &next) {
+    const bool sequential = frame_number == last_frame + 1;
+    last_frame = frame_number;
+    if (!needs(frame)) return frame;
+
+    // The pipeline decodes a draft frame again once scrubbing has settled.
+    const bool settled = frame_number == draft_frame;
+    draft_frame = -1;
+    if (sequential || settled) {
+        const auto t0 = chrono::steady_clock::now();
+        AVFrame *out = filter(frame, frame_number, next);
+        if (out) {
+            const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+            ++quality_frames;
+            quality_ms += ms;
+            max_quality_ms = max(max_quality_ms, ms);
+            return out;
+        }
+    }
+    const auto t0 = chrono::steady_clock::now();
+    AVFrame *out = bob(frame);
+    draft_ms += chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    ++draft_frames;
+    draft = true;
+    draft_frame = frame_number;
+    return out ? out : frame;
+}
+
+AVFrame *Deinterlacer::bob(const AVFrame *frame) {
+    const AVPixelFormat fmt = static_cast<AVPixelFormat>(frame->format);
+    if (!bobbable(fmt)) return nullptr;
+    if (!bob_out || bob_out->format != frame->format || bob_out->width != frame->width || bob_out->height != frame->height) {
+        av_frame_free(&bob_out);
+        bob_out = av_frame_alloc();
+        if (!bob_out) return nullptr;
+        bob_out->format = frame->format;
+        bob_out->width = frame->width;
+        bob_out->height = frame->height;
+        if (av_frame_get_buffer(bob_out, 64) < 0) {
+            av_frame_free(&bob_out);
+            return nullptr;
+        }
+    }
+    av_frame_copy_props(bob_out, frame);
+
+    // Interpolate the later field from the earlier one, so the picture is
+    // the first instant of the frame, like frame n of the bwdif output.
+    const int keep = top_field_first(frame, player.video_stream->codecpar) ? 0 : 1;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    const int planes = min(4, av_pix_fmt_count_planes(fmt));
+    const bool rgb = (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+    const int bands = max(1, min(frame->height / 64, static_cast<int>(sched.worker_count()) * 2));
+    TaskGroup group(sched, TaskClass::DisplayCritical);
+    for (int p = 0; p < planes; ++p) {
+        const bool chroma = !rgb && (p == 1 || p == 2);
+        const int w = chroma ? -((-frame->width) >> desc->log2_chroma_w) : frame->width;
+        const int h = chroma ? -((-frame->height) >> desc->log2_chroma_h) : frame->height;
+        const int band_h = ((h + bands - 1) / bands + 1) & ~1;
+        for (int r0 = 0; r0 < h; r0 += band_h) {
+            const int r1 = min(h, r0 + band_h);
+            const uint8_t *s = frame->data[p];
+            const int ss = frame->linesize[p];
+            uint8_t *d = bob_out->data[p];
+            const int ds = bob_out->linesize[p];
+            group.run([=] { bob_rows(s, ss, d, ds, w, h, keep, r0, r1); });
+        }
+    }
+    group.wait();
+    return bob_out;
+}
+
+bool Deinterlacer::open_graph(const AVFrame *frame) {
+    close_graph();
+    graph = avfilter_graph_alloc();
+    if (!graph) return false;
+    // bwdif splits every frame into one slice per worker; set before any
+    // filter is added, so libavfilter starts no threads of its own.
+    graph->opaque = &sched;
+    graph->execute = run_slices;
+    graph->nb_threads = static_cast<int>(sched.worker_count());
+    graph->thread_type = AVFILTER_THREAD_SLICE;
+
+    const AVRational tb = player.video_stream->time_base;
+    const AVRational sar = frame->sample_aspect_ratio.num > 0 ? frame->sample_aspect_ratio : AVRational{1, 1};
+    char args[256];
+    snprintf(args, sizeof(args), "video_size=%dx%d:pix_fmt=%d:time_base=%d/%d:pixel_aspect=%d/%d", frame->width, frame->height,
+             frame->format, tb.num, tb.den, sar.num, sar.den);
+    int ret = avfilter_graph_create_filter(&src, avfilter_get_by_name("buffer"), "in", args, nullptr, graph);
+    if (ret >= 0) ret = avfilter_graph_create_filter(&sink, avfilter_get_by_name("buffersink"), "out", nullptr, nullptr, graph);
+    AVFilterInOut *outputs = avfilter_inout_alloc();
+    AVFilterInOut *inputs = avfilter_inout_alloc();
+    if (ret >= 0 && outputs && inputs) {
+        outputs->name = av_strdup("in");
+        outputs->filter_ctx = src;
+        outputs->pad_idx = 0;
+        outputs->next = nullptr;
+        inputs->name = av_strdup("out");
+        inputs->filter_ctx = sink;
+        inputs->pad_idx = 0;
+        inputs->next = nullptr;
+        // Whether a frame needs it was decided in needs(), so deinterlace all.
+        ret = avfilter_graph_parse_ptr(graph, "bwdif=mode=send_frame:parity=auto:deint=all", &inputs, &outputs, nullptr);
+        if (ret >= 0) ret = avfilter_graph_config(graph, nullptr);
+    } else if (ret >= 0) {
+        ret = AVERROR(ENOMEM);
+    }
+    avfilter_inout_free(&inputs);
+    avfilter_inout_free(&outputs);
+    if (ret < 0) {
+        print_error("Cannot set up the bwdif deinterlacer", ret);
+        close_graph();
+        mode = DeinterlaceMode::Off;
+        return false;
+    }
+    graph_fmt = frame->format;
+    graph_w = frame->width;
+    graph_h = frame->height;
+    ++graph_builds;
+    return true;
+}
+
+void Deinterlacer::close_graph() {
+    avfilter_graph_free(&graph);
+    src = nullptr;
+    sink = nullptr;
+    graph_next = -1;
+}
+
+// bwdif emits frame n once n + 1 has arrived. Frames that follow the
+// previous one are already in the graph as its lookahead; any other frame
+// starts a new graph. The lookahead comes from the caller's `next`.
+AVFrame *Deinterlacer::filter(AVFrame *frame, int64_t frame_number, const function<AVFrame *()> &next) {
+    if (!graph || graph_next != frame_number || frame->format != graph_fmt || frame->width != graph_w || frame->height != graph_h) {
+        if (!open_graph(frame)) return nullptr;
+        if (av_buffersrc_add_frame_flags(src, frame, AV_BUFFERSRC_FLAG_KEEP_REF) < 0) {
+            close_graph();
+            return nullptr;
+        }
+    }
+    AVFrame *ahead = next ? next() : nullptr;
+    int ret;
+    if (ahead) {
+        ret = av_buffersrc_add_frame_flags(src, ahead, AV_BUFFERSRC_FLAG_KEEP_REF);
+        graph_next = frame_number + 1;
+    } else {
+        ret = av_buffersrc_add_frame_flags(src, nullptr, 0); // end of file: bwdif flushes the last frame
+        graph_next = -1;
+    }
+    if (ret < 0) {
+        close_graph();
+        return nullptr;
+    }
+
+    if (!filter_out) filter_out = av_frame_alloc();
+    if (!filter_out) return nullptr;
+    av_frame_unref(filter_out);
+    ret = av_buffersink_get_frame(sink, filter_out);
+    if (ret < 0) {
+        close_graph();
+        return nullptr;
+    }
+    if (graph_next < 0) close_graph();
+    return filter_out;
+}
+
+void Deinterlacer::print_stats(ostream &os) const {
+    if (!quality_frames && !draft_frames) return;
+    os << "Deinterlacing: " << quality_frames << " frames through bwdif ("
+       << (quality_frames ? quality_ms / static_cast<double>(quality_frames) : 0.0) << " ms mean, " << max_quality_ms << " ms max, "
+       << graph_builds << " graph builds), " << draft_frames << " scrub drafts by bob ("
+       << (draft_frames ? draft_ms / static_cast<double>(draft_frames) : 0.0) << " ms mean)\n";
+}
+
+int run_deinterlace_benchmark(double seconds) {
+    const int w = 1920, h = 1080;
+    // A stand-in stream, as 1080i50 sources have: 25 frames/s, top field first.
+    FFPlayer player;
+    player.fmt_ctx = avformat_alloc_context();
+    player.video_stream = player.fmt_ctx ? avformat_new_stream(player.fmt_ctx, nullptr) : nullptr;
+    if (!player.video_stream) return -1;
+    player.video_stream->time_base = AVRational{1, 25};
+    player.video_stream->codecpar->field_order = AV_FIELD_TT;
+
+    // A few frames of noise in turn, so that no frame repeats its predecessor.
+    const int kSources = 4;
+    vector<unique_ptr<AVFrame, AVFrameDeleter>> frames;
+    mt19937 rng(1);
+    for (int i = 0; i < kSources; ++i) {
+        unique_ptr<AVFrame, AVFrameDeleter> f(av_frame_alloc());
+        if (!f) return -1;
+        f->format = AV_PIX_FMT_YUV420P;
+        f->width = w;
+        f->height = h;
+        if (av_frame_get_buffer(f.get(), 64) < 0) return -1;
+        for (int p = 0; p < 3; ++p) {
+            const int pw = p ? w / 2 : w, ph = p ? h / 2 : h;
+            for (int r = 0; r < ph; ++r) {
+                for (int x = 0; x < pw; ++x) f->data[p][r * f->linesize[p] + x] = static_cast<uint8_t>(rng());
+            }
+        }
+#ifdef AV_FRAME_FLAG_INTERLACED
+        f->flags |= AV_FRAME_FLAG_INTERLACED | AV_FRAME_FLAG_TOP_FIELD_FIRST;
+#else
+        f->interlaced_frame = 1;
+        f->top_field_first = 1;
+#endif
+        frames.push_back(move(f));
+    }
+    auto frame_at = [&](int64_t n) {
+        AVFrame *f = frames[static_cast<size_t>(n % kSources)].get();
+        f->pts = n;
+        return f;
+    };
+
+    TaskScheduler &sched = TaskScheduler::global();
+    Deinterlacer d(player, DeinterlaceMode::On, sched);
+    const double per_run = max(0.1, seconds / 3.0);
+    cout << "Deinterlacing, 1920x1080 yuv420p, " << per_run << " s per run; 1080i50 needs 25 frames/s (50 fields/s)\n";
+    auto report = [&](const char *what, int64_t n, double elapsed) {
+        const double fps = static_cast<double>(n) / elapsed;
+        cout << "  " << what << ": " << 1000.0 / fps << " ms/frame, " << fps << " frames/s, " << fps / 25.0 << "x real time"
+             << (fps >= 25.0 ? "" : " (below 25 frames/s)") << '\n';
+    };
+
+    // Playback: every frame in order, with the next one as lookahead.
+    int64_t n = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0.0;
+    while (elapsed < per_run) {
+        bool draft = false;
+        const AVFrame *out = d.process(frame_at(n), n, draft, [&] { return frame_at(n + 1); });
+        if (!out || draft) {
+            cerr << "bwdif is not available in this FFmpeg build\n";
+            return -1;
+        }
+        ++n;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    report(("bwdif, " + to_string(sched.worker_count()) + " workers").c_str(), n, elapsed);
+
+    // Scrubbing: every frame a jump, so every frame is a bob draft.
+    n = 0;
+    start = chrono::steady_clock::now();
+    elapsed = 0.0;
+    while (elapsed < per_run) {
+        bool draft = false;
+        d.process(frame_at(2 * n), 2 * n, draft, nullptr);
+        ++n;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    report(("bob, " + to_string(sched.worker_count()) + " workers").c_str(), n, elapsed);
+
+    // The bob kernel alone, on one thread.
+    unique_ptr<AVFrame, AVFrameDeleter> dst(av_frame_alloc());
+    if (!dst) return -1;
+    dst->format = AV_PIX_FMT_YUV420P;
+    dst->width = w;
+    dst->height = h;
+    if (av_frame_get_buffer(dst.get(), 64) < 0) return -1;
+    n = 0;
+    start = chrono::steady_clock::now();
+    elapsed = 0.0;
+    while (elapsed < per_run) {
+        const AVFrame *f = frames[static_cast<size_t>(n % kSources)].get();
+        for (int p = 0; p < 3; ++p) {
+            const int pw = p ? w / 2 : w, ph = p ? h / 2 : h;
+            bob_rows(f->data[p], f->linesize[p], dst->data[p], dst->linesize[p], pw, ph, 0, 0, ph);
+        }
+        ++n;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    }
+    report("bob, 1 thread", n, elapsed);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+
+extern "C" {
+#include <libavfilter/avfilter.h>
+#include <libavutil/frame.h>
+}
+
+#include "ff_player.h"
+#include "task_scheduler.h"
+
+enum class DeinterlaceMode { Off, Auto, On };
+
+// "off", "auto" (frames flagged interlaced, or streams whose field order
+// says so) or "on" (every frame).
+bool parse_deinterlace_mode(const std::string &name, DeinterlaceMode &out);
+
+// Deinterlacing frame stage for PlaybackPipeline, between decode and
+// conversion. Frames reached in order (playback, steps forward) go through
+// a libavfilter bwdif graph, yadif's successor, whose slices run on the task
+// scheduler; its one frame of lookahead is the caller's next frame, so output
+// stays frame-accurate. Frames reached by a jump (seeks,
+// scrubbing, steps back) get a cheap bob instead, interpolating the second
+// field from the first with a vectorised line average in row bands on the
+// task scheduler, and are marked as drafts: once scrubbing settles the
+// pipeline decodes the frame again and it goes through bwdif.
+class Deinterlacer {
+public:
+    Deinterlacer(FFPlayer &player, DeinterlaceMode mode, TaskScheduler &sched = TaskScheduler::global());
+    ~Deinterlacer();
+    Deinterlacer(const Deinterlacer &) = delete;
+    Deinterlacer &operator=(const Deinterlacer &) = delete;
+
+    // Frame stage (see PlaybackPipeline::set_frame_stage). `next` returns
+    // frame_number + 1 without consuming it, or nullptr at the end; it is
+    // only called for frames that go through bwdif. `player` supplies the
+    // stream's time base and field order.
+    AVFrame *process(AVFrame *frame, int64_t frame_number, bool &draft, const std::function<AVFrame *()> &next);
+
+    void print_stats(std::ostream &os) const;
+
+private:
+    bool needs(const AVFrame *frame) const;
+    AVFrame *bob(const AVFrame *frame);
+    AVFrame *filter(AVFrame *frame, int64_t frame_number, const std::function<AVFrame *()> &next);
+    bool open_graph(const AVFrame *frame);
+    void close_graph();
+
+    FFPlayer &player;
+    DeinterlaceMode mode;
+    TaskScheduler &sched;
+
+    AVFilterGraph *graph = nullptr;
+    AVFilterContext *src = nullptr;
+    AVFilterContext *sink = nullptr;
+    int graph_fmt = -1;
+    int graph_w = 0;
+    int graph_h = 0;
+    int64_t graph_next = -1;  // frame already queued in the graph as lookahead, -1 = none
+    int64_t last_frame = -1;  // frame of the previous call
+    int64_t draft_frame = -1; // frame last shown as a draft
+    AVFrame *bob_out = nullptr;
+    AVFrame *filter_out = nullptr;
+
+    uint64_t quality_frames = 0;
+    uint64_t draft_frames = 0;
+    uint64_t graph_builds = 0;
+    double quality_ms = 0.0;
+    double max_quality_ms = 0.0;
+    double draft_ms = 0.0;
+};
+
+// --bench-deinterlace: times bwdif and the bob on synthetic 1080i yuv420p
+// frames against the 25 frames/s (50 fields/s) that 1080i50 needs.
+int run_deinterlace_benchmark(double seconds);
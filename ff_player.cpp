@@ -0,0 +1,307 @@
+#include "ff_player.h"
+
+#include <cstring>
+#include <iostream>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "task_scheduler.h"
+#include "thread_policy.h"
+
+using namespace std;
+
+void print_error(const string &msg, int err) {
+    char buf[1024] = {0};
+    av_strerror(err, buf, sizeof(buf));
+    cerr << msg << " : " << buf << '\n';
+}
+
+// Frames at least this large are converted in horizontal bands on the task
+// scheduler, in the player's convert_class.
+static const int kSliceMinPixels = 1280 * 720;
+static const int kSliceMinRows = 64;
+
+static void free_slice_contexts(FFPlayer &p) {
+    for (SwsContext *c : p.slice_sws) sws_freeContext(c);
+    p.slice_sws.clear();
+    p.slice_rows.clear();
+}
+
+// Band boundaries must fall on chroma rows; paletted and hardware formats are
+// never split.
+static int slice_count_for(const AVPixFmtDescriptor *desc, int width, int height) {
+    if (!desc || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM))) return 1;
+    if (width * height < kSliceMinPixels) return 1;
+    const int workers = static_cast<int>(TaskScheduler::global().worker_count()) + 1;
+    return max(1, min(workers, height / kSliceMinRows));
+}
+
+static void setup_slice_contexts(FFPlayer &p, const AVPixFmtDescriptor *desc, int width, int height,
+                                 AVPixelFormat src_fmt, AVPixelFormat dst_fmt, int slices) {
+    free_slice_contexts(p);
+    const int align = 1 << desc->log2_chroma_h;
+    int rows = (height / slices + align - 1) / align * align;
+    for (int y = 0; y < height; y += rows) {
+        const int h = min(rows, height - y);
+        p.slice_sws.push_back(sws_getContext(width, h, src_fmt, width, h, dst_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr));
+        p.slice_rows.push_back(h);
+    }
+}
+
+void convert_frame_into(AVFrame *frame, FFPlayer &p, cv::Mat &img) {
+    const int width = frame->width;
+    const int height = frame->height;
+    const AVPixelFormat src_fmt = (AVPixelFormat)frame->format;
+    const AVPixelFormat dst_pix_fmt = p.out_fmt;
+    const int dst_type = dst_pix_fmt == AV_PIX_FMT_BGR24 ? CV_8UC3 : CV_8UC4;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(src_fmt);
+    const int slices = slice_count_for(desc, width, height);
+
+    if (p.sws_src_w != width || p.sws_src_h != height || p.sws_src_fmt != src_fmt || p.sws_dst_fmt != dst_pix_fmt
+        || (slices == 1 && !p.sws_ctx) || (slices > 1 && p.slice_sws.empty())) {
+        if (p.sws_ctx) {
+            sws_freeContext(p.sws_ctx);
+            p.sws_ctx = nullptr;
+        }
+        free_slice_contexts(p);
+        if (slices > 1) setup_slice_contexts(p, desc, width, height, src_fmt, dst_pix_fmt, slices);
+        else p.sws_ctx = sws_getContext(width, height, src_fmt, width, height, dst_pix_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        p.sws_src_w = width;
+        p.sws_src_h = height;
+        p.sws_src_fmt = src_fmt;
+        p.sws_dst_fmt = dst_pix_fmt;
+    }
+
+    if (img.rows != height || img.cols != width || img.type() != dst_type) {
+        img.create(height, width, dst_type);
+        place_buffer_on_node(img.data, img.step[0] * static_cast<size_t>(height), p.buffer_numa_node);
+    }
+    int dst_linesize[4] = { static_cast<int>(img.step[0]), 0, 0, 0 };
+
+    if (p.slice_sws.empty()) {
+        uint8_t *dst_data[4] = { img.data, nullptr, nullptr, nullptr };
+        sws_scale(p.sws_ctx, frame->data, frame->linesize, 0, height, dst_data, dst_linesize);
+        return;
+    }
+
+    // Each band is converted as an independent image by its own context.
+    const int planes = av_pix_fmt_count_planes(src_fmt);
+    const bool is_rgb = (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+    TaskGroup group(TaskScheduler::global(), p.convert_class);
+    int y = 0;
+    for (size_t i = 0; i < p.slice_sws.size(); ++i) {
+        const int band_y = y;
+        const int band_h = p.slice_rows[i];
+        SwsContext *ctx = p.slice_sws[i];
+        group.run([=, &img] {
+            const uint8_t *src[4] = { nullptr, nullptr, nullptr, nullptr };
+            for (int pl = 0; pl < planes && pl < 4; ++pl) {
+                const bool chroma = !is_rgb && (pl == 1 || pl == 2);
+                const int row = chroma ? (band_y >> desc->log2_chroma_h) : band_y;
+                src[pl] = frame->data[pl] + static_cast<ptrdiff_t>(row) * frame->linesize[pl];
+            }
+            uint8_t *dst[4] = { img.ptr(band_y), nullptr, nullptr, nullptr };
+            sws_scale(ctx, src, frame->linesize, 0, band_h, dst, dst_linesize);
+        });
+        y += band_h;
+    }
+    group.wait();
+}
+
+cv::Mat avframe_to_cvmat(AVFrame *frame, FFPlayer &p) {
+    cv::Mat img;
+    convert_frame_into(frame, p, img);
+    return img;
+}
+
+int64_t frame_number_to_stream_ts(int64_t frame_number, AVStream *st) {
+    AVRational afr = st->avg_frame_rate.num != 0 ? st->avg_frame_rate : st->r_frame_rate;
+    if (afr.num == 0 || afr.den == 0) afr = {25,1};
+    AVRational frame_time = av_inv_q(afr);
+    return av_rescale_q(frame_number, frame_time, st->time_base);
+}
+
+int64_t pts_to_frame_number(int64_t pts, AVStream *st) {
+    AVRational afr = st->avg_frame_rate.num != 0 ? st->avg_frame_rate : st->r_frame_rate;
+    if (afr.num == 0 || afr.den == 0) afr = {25,1};
+    AVRational frame_time = av_inv_q(afr);
+    return av_rescale_q(pts, st->time_base, frame_time);
+}
+
+// Receives the next frame from p's decoder into `frame`, feeding it packets
+// as needed. At the end of the file the decoder gets the end-of-stream
+// signal, so it gives up the frames it still holds for B-frame reordering or
+// frame threads; the last frames of the file come out that way. With
+// p.hold_at_eof it keeps them for the packets still to be written instead.
+// If the file grows after a drain, the decoder is flushed and continues.
+// Returns false at the end.
+static bool receive_next_frame(FFPlayer &p, AVPacket *packet, AVFrame *frame) {
+    while (true) {
+        int ret = avcodec_receive_frame(p.dec_ctx, frame);
+        if (ret >= 0) return true;
+        if (ret != AVERROR(EAGAIN) && ret != AVERROR_EOF) print_error("Error while decoding", ret);
+        const bool drained = ret == AVERROR_EOF;
+        ret = av_read_frame(p.fmt_ctx, packet);
+        if (ret < 0) {
+            if (drained || p.hold_at_eof) return false;
+            avcodec_send_packet(p.dec_ctx, nullptr);
+            continue;
+        }
+        if (packet->stream_index == p.video_stream_idx) {
+            if (drained) avcodec_flush_buffers(p.dec_ctx);
+            avcodec_send_packet(p.dec_ctx, packet);
+        }
+        av_packet_unref(packet);
+    }
+}
+
+unique_ptr<AVFrame, AVFrameDeleter> seek_and_decode_frame(FFPlayer &p, int64_t target_frame_number) {
+    if (!p.fmt_ctx || !p.dec_ctx || !p.video_stream) return nullptr;
+
+    p.primed.clear();
+    const int64_t target_ts = frame_number_to_stream_ts(target_frame_number, p.video_stream);
+    int ret = av_seek_frame(p.fmt_ctx, p.video_stream_idx, target_ts, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) {
+        print_error("av_seek_frame failed", ret);
+        return nullptr;
+    }
+
+    avcodec_flush_buffers(p.dec_ctx);
+
+    unique_ptr<AVPacket, AVPacketDeleter> packet(av_packet_alloc());
+    unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+    while (receive_next_frame(p, packet.get(), frame.get())) {
+        int64_t pts = (frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : frame->pts;
+        if (pts == AV_NOPTS_VALUE) pts = p.last_shown_pts + 1;
+        if (pts >= target_ts) {
+            p.last_shown_pts = pts;
+            return frame;
+        }
+        av_frame_unref(frame.get());
+    }
+    return nullptr;
+}
+
+unique_ptr<AVFrame, AVFrameDeleter> decode_next_frame(FFPlayer &p) {
+    if (!p.primed.empty()) {
+        unique_ptr<AVFrame, AVFrameDeleter> f = move(p.primed.front());
+        p.primed.pop_front();
+        p.last_shown_pts = f->pts;
+        return f;
+    }
+    if (!p.fmt_ctx || !p.dec_ctx) return nullptr;
+
+    unique_ptr<AVPacket, AVPacketDeleter> packet(av_packet_alloc());
+    unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+    if (!receive_next_frame(p, packet.get(), frame.get())) return nullptr;
+    int64_t pts = (frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : frame->pts;
+    if (pts == AV_NOPTS_VALUE) pts = p.last_shown_pts + 1;
+    p.last_shown_pts = pts;
+    return frame;
+}
+
+static bool decoder_matches(const AVCodecContext *ctx, const AVCodecParameters *par) {
+    if (ctx->codec_id != par->codec_id || ctx->width != par->width || ctx->height != par->height) return false;
+    if (ctx->pix_fmt != static_cast<AVPixelFormat>(par->format) || ctx->extradata_size != par->extradata_size) return false;
+    return par->extradata_size == 0 || memcmp(ctx->extradata, par->extradata, static_cast<size_t>(par->extradata_size)) == 0;
+}
+
+// Applies parameters cached from an earlier analysis instead of running
+// avformat_find_stream_info. False if they do not fit the file.
+static bool apply_known_params(FFPlayer &p, const OpenOptions &o) {
+    if (o.known_stream < 0 || static_cast<unsigned>(o.known_stream) >= p.fmt_ctx->nb_streams) return false;
+    AVStream *st = p.fmt_ctx->streams[o.known_stream];
+    if (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO && st->codecpar->codec_type != AVMEDIA_TYPE_UNKNOWN) return false;
+    if (avcodec_parameters_copy(st->codecpar, o.known_params) < 0) return false;
+    if (o.known_frame_rate.num > 0) st->avg_frame_rate = o.known_frame_rate;
+    return true;
+}
+
+int open_player(FFPlayer &p, const string &filename, AVCodecContext **reuse_decoder, const OpenOptions *open_opts) {
+    AVDictionary *fmt_opts = nullptr;
+    if (open_opts && open_opts->probesize > 0) av_dict_set_int(&fmt_opts, "probesize", open_opts->probesize, 0);
+    if (open_opts && open_opts->analyzeduration > 0) av_dict_set_int(&fmt_opts, "analyzeduration", open_opts->analyzeduration, 0);
+    int ret = avformat_open_input(&p.fmt_ctx, filename.c_str(), nullptr, &fmt_opts);
+    av_dict_free(&fmt_opts);
+    if (ret < 0) { print_error("Could not open input", ret); return ret; }
+
+    if (!open_opts || !open_opts->known_params || !apply_known_params(p, *open_opts)) {
+        ret = avformat_find_stream_info(p.fmt_ctx, nullptr);
+        if (ret < 0) { print_error("Failed to retrieve stream info", ret); return ret; }
+    }
+
+    for (unsigned i = 0; i < p.fmt_ctx->nb_streams; ++i) {
+        if (p.fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
+            p.video_stream_idx = static_cast<int>(i);
+            p.video_stream = p.fmt_ctx->streams[i];
+            break;
+        }
+    }
+    if (p.video_stream_idx < 0) { cerr << "No video stream found\n"; return AVERROR_STREAM_NOT_FOUND; }
+
+    AVCodecParameters *codecpar = p.video_stream->codecpar;
+    if (reuse_decoder && *reuse_decoder && decoder_matches(*reuse_decoder, codecpar)) {
+        p.dec_ctx = *reuse_decoder;
+        *reuse_decoder = nullptr;
+        avcodec_flush_buffers(p.dec_ctx);
+        p.dec_ctx->pkt_timebase = p.video_stream->time_base;
+    }
+    if (!p.dec_ctx) {
+        const AVCodec *dec = avcodec_find_decoder(codecpar->codec_id);
+        if (!dec) { cerr << "Decoder not found for codec id " << codecpar->codec_id << '\n'; return AVERROR_DECODER_NOT_FOUND; }
+
+        p.dec_ctx = avcodec_alloc_context3(dec);
+        if (!p.dec_ctx) { cerr << "Failed to allocate codec context\n"; return AVERROR(ENOMEM); }
+
+        ret = avcodec_parameters_to_context(p.dec_ctx, codecpar);
+        if (ret < 0) { print_error("avcodec_parameters_to_context failed", ret); return ret; }
+        if (open_opts && open_opts->display_width > 0 && open_opts->display_height > 0) {
+            int lowres = 0;
+            while (lowres < dec->max_lowres && (codecpar->width >> (lowres + 1)) >= open_opts->display_width
+                   && (codecpar->height >> (lowres + 1)) >= open_opts->display_height)
+                ++lowres;
+            p.dec_ctx->lowres = lowres;
+        }
+        if (open_opts && open_opts->decoder_threads > 0) p.dec_ctx->thread_count = open_opts->decoder_threads;
+
+        ret = avcodec_open2(p.dec_ctx, dec, nullptr);
+        if (ret < 0) { print_error("Failed to open codec", ret); return ret; }
+    }
+
+    AVRational afr = p.video_stream->avg_frame_rate.num != 0 ? p.video_stream->avg_frame_rate : p.video_stream->r_frame_rate;
+    if (afr.num == 0 || afr.den == 0) afr = {25,1};
+    p.avg_frame_rate = afr;
+    p.fps = av_q2d(afr);
+    return 0;
+}
+
+void swap_media(FFPlayer &a, FFPlayer &b) {
+    swap(a.fmt_ctx, b.fmt_ctx);
+    swap(a.dec_ctx, b.dec_ctx);
+    swap(a.video_stream_idx, b.video_stream_idx);
+    swap(a.video_stream, b.video_stream);
+    swap(a.fps, b.fps);
+    swap(a.avg_frame_rate, b.avg_frame_rate);
+    swap(a.current_target_ts, b.current_target_ts);
+    swap(a.last_shown_pts, b.last_shown_pts);
+    swap(a.primed, b.primed);
+}
+
+int prime_frames(FFPlayer &p, int count) {
+    // Frames primed earlier stay in front; new ones come from the decoder.
+    deque<unique_ptr<AVFrame, AVFrameDeleter>> ready;
+    swap(ready, p.primed);
+    int n = 0;
+    for (; n < count; ++n) {
+        unique_ptr<AVFrame, AVFrameDeleter> f = decode_next_frame(p);
+        if (!f) break;
+        f->pts = p.last_shown_pts;
+        ready.push_back(move(f));
+    }
+    swap(ready, p.primed);
+    p.last_shown_pts = AV_NOPTS_VALUE;
+    return n;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+#include <libswscale/swscale.h>
+#include <libavutil/avutil.h>
+}
+
+#include <opencv2/opencv.hpp>
+
+#include "task_scheduler.h"
+
+struct AVFrameDeleter { void operator()(AVFrame* f) const { av_frame_free(&f); } };
+struct AVPacketDeleter { void operator()(AVPacket* p) const { av_packet_free(&p); } };
+
+struct FFPlayer {
+    AVFormatContext *fmt_ctx = nullptr;
+    AVCodecContext *dec_ctx = nullptr;
+    int video_stream_idx = -1;
+    AVStream *video_stream = nullptr;
+    SwsContext *sws_ctx = nullptr;
+    int sws_src_w = -1;
+    int sws_src_h = -1;
+    AVPixelFormat sws_src_fmt = AV_PIX_FMT_NONE;
+    AVPixelFormat sws_dst_fmt = AV_PIX_FMT_NONE;
+    std::vector<SwsContext*> slice_sws;
+    std::vector<int> slice_rows;
+    double fps = 0.0;
+    AVRational avg_frame_rate{0,1};
+    int64_t current_target_ts = 0;
+    int64_t last_shown_pts = AV_NOPTS_VALUE;
+    int buffer_numa_node = -1;
+    TaskClass convert_class = TaskClass::DisplayCritical;
+    AVPixelFormat out_fmt = AV_PIX_FMT_BGR24; // BGR24 (CV_8UC3) or BGR0/BGRA (CV_8UC4)
+    // Frames decoded ahead of time (pts in frame->pts); decode_next_frame()
+    // returns these first, seeks drop them.
+    std::deque<std::unique_ptr<AVFrame, AVFrameDeleter>> primed;
+    // The file may still grow (--follow): at its current end, keep the
+    // decoder's delayed frames for the packets still to come instead of
+    // draining them.
+    bool hold_at_eof = false;
+    ~FFPlayer() {
+        for (SwsContext *c : slice_sws) sws_freeContext(c);
+        if (sws_ctx) sws_freeContext(sws_ctx);
+        if (dec_ctx) avcodec_free_context(&dec_ctx);
+        if (fmt_ctx) avformat_close_input(&fmt_ctx);
+    }
+};
+
+void print_error(const std::string &msg, int err);
+
+// Startup tuning for open_player(). Zero limits keep FFmpeg's defaults.
+struct OpenOptions {
+    int64_t probesize = 0;       // bytes avformat_find_stream_info may read
+    int64_t analyzeduration = 0; // microseconds of stream it may analyse
+    // Parameters of the video stream from an earlier full analysis (see
+    // sidecar_index.h); when set, avformat_find_stream_info is skipped.
+    const AVCodecParameters *known_params = nullptr;
+    int known_stream = -1;
+    AVRational known_frame_rate{0, 1};
+    // Decode no larger than needed for this display size: the largest
+    // lowres factor the codec supports that stays at or above it.
+    int display_width = 0;
+    int display_height = 0;
+    int decoder_threads = 0; // 0 = FFmpeg default
+};
+
+// Opens the first video stream of `filename` and its decoder. Returns 0 or a
+// negative AVERROR after printing the reason. If `reuse_decoder` points to an
+// open decoder for the same codec parameters, it is flushed and taken over
+// (*reuse_decoder becomes null) instead of opening a new one.
+int open_player(FFPlayer &p, const std::string &filename, AVCodecContext **reuse_decoder = nullptr,
+                const OpenOptions *open_opts = nullptr);
+
+// Exchanges the open file, decoder and position of two players; output
+// settings and conversion contexts stay where they are.
+void swap_media(FFPlayer &a, FFPlayer &b);
+
+// Decodes the next `count` frames into p.primed.
+int prime_frames(FFPlayer &p, int count);
+
+// Converts to p.out_fmt into `img`, reallocating it only when the size or
+// type changes.
+void convert_frame_into(AVFrame *frame, FFPlayer &p, cv::Mat &img);
+cv::Mat avframe_to_cvmat(AVFrame *frame, FFPlayer &p);
+
+int64_t frame_number_to_stream_ts(int64_t frame_number, AVStream *st);
+int64_t pts_to_frame_number(int64_t pts, AVStream *st);
+
+std::unique_ptr<AVFrame, AVFrameDeleter> seek_and_decode_frame(FFPlayer &p, int64_t target_frame_number);
+std::unique_ptr<AVFrame, AVFrameDeleter> decode_next_frame(FFPlayer &p);
@@ -0,0 +1,46 @@
+#include "file_fingerprint.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+using namespace std;
+
+static uint64_t fnv1a(const char *data, size_t n, uint64_t h) {
+    for (size_t i = 0; i < n; ++i) {
+        h ^= static_cast<unsigned char>(data[i]);
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+string file_fingerprint(const string &path) {
+    error_code ec;
+    const uintmax_t size = filesystem::file_size(path, ec);
+    if (ec) return {};
+    const auto mtime = filesystem::last_write_time(path, ec);
+    if (ec) return {};
+    ifstream in(path, ios::binary);
+    if (!in) return {};
+
+    // Hashing the whole file would cost as much as reading it; the ends plus
+    // size and mtime tell different recordings apart.
+    constexpr size_t kSpan = 1 << 20;
+    vector<char> buf(kSpan);
+    uint64_t h = 14695981039346656037ull;
+    in.read(buf.data(), static_cast<streamsize>(min<uintmax_t>(kSpan, size)));
+    h = fnv1a(buf.data(), static_cast<size_t>(in.gcount()), h);
+    if (size > kSpan) {
+        in.clear();
+        in.seekg(static_cast<streamoff>(size - min<uintmax_t>(kSpan, size - kSpan)));
+        in.read(buf.data(), static_cast<streamsize>(kSpan));
+        h = fnv1a(buf.data(), static_cast<size_t>(in.gcount()), h);
+    }
+    char out[64];
+    snprintf(out, sizeof(out), "%016llx%012llx%016llx", static_cast<unsigned long long>(h), static_cast<unsigned long long>(size),
+             static_cast<unsigned long long>(mtime.time_since_epoch().count()));
+    return out;
+}
@@ -0,0 +1,8 @@
+#pragma once
+
+#include <string>
+
+// Size, modification time and hashes of the first and last MiB, as hex.
+// Empty if the file cannot be read. Keys caches derived from a file (proxies,
+// sidecar indexes) that go stale when it is rewritten or appended to.
+std::string file_fingerprint(const std::string &path);
@@ -0,0 +1,104 @@
+#include "frame_index.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+int64_t FrameIndex::keyframe_at_or_before(int64_t ts) const {
+    auto it = upper_bound(keyframes.begin(), keyframes.end(), ts);
+    if (it == keyframes.begin()) return AV_NOPTS_VALUE;
+    return *(it - 1);
+}
+
+int64_t FrameIndex::keyframe_after(int64_t ts) const {
+    auto it = upper_bound(keyframes.begin(), keyframes.end(), ts);
+    return it == keyframes.end() ? AV_NOPTS_VALUE : *it;
+}
+
+int FrameIndex::gop_of(int64_t ts) const {
+    auto it = upper_bound(keyframes.begin(), keyframes.end(), ts);
+    return static_cast<int>(it - keyframes.begin()) - 1;
+}
+
+void FrameIndex::finalize() {
+    stable_sort(entries.begin(), entries.end(), [](const FrameIndexEntry &a, const FrameIndexEntry &b) { return a.ts < b.ts; });
+    keyframes.clear();
+    for (const FrameIndexEntry &e : entries) {
+        if (e.key && (keyframes.empty() || keyframes.back() != e.ts)) keyframes.push_back(e.ts);
+    }
+}
+
+static bool index_from_container(AVStream *st, FrameIndex &index) {
+    const int n = avformat_index_get_entries_count(st);
+    index.entries.clear();
+    index.entries.reserve(static_cast<size_t>(max(0, n)));
+    for (int i = 0; i < n; ++i) {
+        const AVIndexEntry *e = avformat_index_get_entry(st, i);
+        if (!e) continue;
+        index.entries.push_back({e->timestamp, e->pos, e->size, (e->flags & AVINDEX_KEYFRAME) != 0});
+    }
+    index.finalize();
+    // Some demuxers index keyframes only; that is still enough to find GOPs.
+    return !index.keyframes.empty();
+}
+
+bool build_frame_index(FFPlayer &p, FrameIndex &index) {
+    if (!p.fmt_ctx || !p.video_stream) return false;
+    index.time_base = p.video_stream->time_base;
+    if (index_from_container(p.video_stream, index)) {
+        index.from_container = true;
+        return true;
+    }
+
+    index.from_container = false;
+    index.entries.clear();
+    unique_ptr<AVPacket, AVPacketDeleter> packet(av_packet_alloc());
+    while (av_read_frame(p.fmt_ctx, packet.get()) >= 0) {
+        if (packet->stream_index == p.video_stream_idx) {
+            const int64_t ts = packet->pts != AV_NOPTS_VALUE ? packet->pts : packet->dts;
+            if (ts != AV_NOPTS_VALUE) index.entries.push_back({ts, packet->pos, packet->size, (packet->flags & AV_PKT_FLAG_KEY) != 0});
+        }
+        av_packet_unref(packet.get());
+    }
+    index.finalize();
+
+    const int ret = av_seek_frame(p.fmt_ctx, p.video_stream_idx, 0, AVSEEK_FLAG_BACKWARD);
+    if (ret < 0) print_error("av_seek_frame after index scan failed", ret);
+    avcodec_flush_buffers(p.dec_ctx);
+    p.last_shown_pts = AV_NOPTS_VALUE;
+    return !index.keyframes.empty();
+}
+
+unique_ptr<AVFrame, AVFrameDeleter> decode_frame_indexed(FFPlayer &p, const FrameIndex &index, int64_t frame_number,
+                                                         const function<void(const AVFrame *, int64_t)> &on_frame, bool *seeked) {
+    if (!p.fmt_ctx || !p.dec_ctx || !p.video_stream) return nullptr;
+    const int64_t target_ts = frame_number_to_stream_ts(frame_number, p.video_stream);
+
+    // Same GOP and ahead of the decoder: decoding forward is never more work
+    // than seeking back to the keyframe.
+    const int64_t last = p.last_shown_pts;
+    bool forward = !index.empty() && last != AV_NOPTS_VALUE && last < target_ts;
+    if (forward) {
+        const int64_t key = index.keyframe_at_or_before(target_ts);
+        forward = key != AV_NOPTS_VALUE && key <= last;
+    }
+    if (seeked) *seeked = !forward;
+
+    if (!forward) {
+        p.primed.clear();
+        const int ret = av_seek_frame(p.fmt_ctx, p.video_stream_idx, target_ts, AVSEEK_FLAG_BACKWARD);
+        if (ret < 0) {
+            print_error("av_seek_frame failed", ret);
+            return nullptr;
+        }
+        avcodec_flush_buffers(p.dec_ctx);
+    }
+
+    while (true) {
+        unique_ptr<AVFrame, AVFrameDeleter> f = decode_next_frame(p);
+        if (!f) return nullptr;
+        if (on_frame) on_frame(f.get(), p.last_shown_pts);
+        if (p.last_shown_pts >= target_ts) return f;
+    }
+}
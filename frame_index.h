@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+extern "C" {
+#include <libavformat/avformat.h>
+}
+
+#include "ff_player.h"
+
+struct FrameIndexEntry {
+    int64_t ts = AV_NOPTS_VALUE; // stream time base
+    int64_t pos = -1;            // byte offset in the file, -1 if unknown
+    int size = 0;
+    bool key = false;
+};
+
+// Packet index of a file's video stream, sorted by timestamp. Timestamps are
+// the demuxer's seek timestamps (PTS, or DTS for containers that index by
+// DTS), so they are only used to find GOP boundaries, never as frame times.
+struct FrameIndex {
+    AVRational time_base{0, 1};
+    std::vector<FrameIndexEntry> entries;
+    std::vector<int64_t> keyframes; // timestamps of key entries, ascending
+    bool from_container = false;    // taken from the container's own index
+
+    bool empty() const { return keyframes.empty(); }
+    size_t gop_count() const { return keyframes.size(); }
+
+    // Last keyframe at or before `ts`, AV_NOPTS_VALUE if there is none.
+    int64_t keyframe_at_or_before(int64_t ts) const;
+    // First keyframe after `ts`, AV_NOPTS_VALUE in the last GOP.
+    int64_t keyframe_after(int64_t ts) const;
+    // GOP containing `ts`, -1 before the first keyframe.
+    int gop_of(int64_t ts) const;
+
+    // Sorts `entries` and rebuilds `keyframes`.
+    void finalize();
+};
+
+// Uses the container's index (AVI idx1, MP4 sample tables, ...) when it lists
+// keyframes, otherwise scans every packet with `p`'s demuxer and seeks back
+// to the start. Returns false if no keyframe was found.
+bool build_frame_index(FFPlayer &p, FrameIndex &index);
+
+// Decodes `frame_number`. When the decoder is already positioned earlier in
+// the same GOP it keeps decoding forward instead of seeking back to the
+// keyframe. `on_frame` sees every frame decoded on the way, with its PTS.
+std::unique_ptr<AVFrame, AVFrameDeleter> decode_frame_indexed(
+    FFPlayer &p, const FrameIndex &index, int64_t frame_number,
+    const std::function<void(const AVFrame *, int64_t pts)> &on_frame = {}, bool *seeked = nullptr);
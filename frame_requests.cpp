@@ -0,0 +1,188 @@
+#include "frame_requests.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+void CancellationToken::cancel() const {
+    if (state->flag.exchange(true)) return;
+    lock_guard<recursive_mutex> lk(state->mtx);
+    // A copy, since callbacks may remove themselves or add others.
+    const auto callbacks = state->callbacks;
+    for (const auto &c : callbacks) c.second();
+}
+
+uint64_t CancellationToken::add_callback(function<void()> fn) const {
+    lock_guard<recursive_mutex> lk(state->mtx);
+    const uint64_t id = state->next_id++;
+    state->callbacks.emplace_back(id, move(fn));
+    return id;
+}
+
+void CancellationToken::remove_callback(uint64_t id) const {
+    lock_guard<recursive_mutex> lk(state->mtx);
+    auto &cbs = state->callbacks;
+    cbs.erase(remove_if(cbs.begin(), cbs.end(), [id](const auto &c) { return c.first == id; }), cbs.end());
+}
+
+// The callback is registered before the request is queued, so a cancel that
+// comes after enqueue() always finds it; one that came before is caught by
+// enqueue() itself, and the coroutine then does not suspend at all.
+bool FrameAwaiter::await_suspend(coroutine_handle<> h) {
+    handle = h;
+    cancel_callback = token.add_callback([e = &engine] { e->drop_cancelled(); });
+    if (engine.enqueue(this)) return true;
+    token.remove_callback(cancel_callback);
+    result.cancelled = true;
+    return false;
+}
+
+FrameEngine::FrameEngine(size_t max_decoders, TaskScheduler &sched)
+    : sched(sched), max_decoders(max_decoders ? max_decoders : max<size_t>(1, sched.worker_count())) {}
+
+unique_ptr<FFPlayer> FrameEngine::open_decoder() {
+    unique_ptr<FFPlayer> p = make_unique<FFPlayer>();
+    p->convert_class = TaskClass::Prefetch;
+    if (open_player(*p, filename) < 0) return nullptr;
+    return p;
+}
+
+int FrameEngine::open(const string &fn) {
+    filename = fn;
+    unique_ptr<FFPlayer> p = open_decoder();
+    if (!p) return -1;
+    stream_fps = p->fps;
+    lock_guard<mutex> lk(mtx);
+    idle.push_back(move(p));
+    decoders_open = 1;
+    return 0;
+}
+
+Task<FrameResult> FrameEngine::fetch(int64_t frame, CancellationToken token) {
+    co_return co_await frame_at(frame, move(token));
+}
+
+// Returns false, without queueing, for a request that was cancelled before
+// it had to wait for a decoder.
+bool FrameEngine::enqueue(FrameAwaiter *req) {
+    FFPlayer *decoder = nullptr;
+    bool open_new = false;
+    {
+        lock_guard<mutex> lk(mtx);
+        if (!idle.empty()) {
+            decoder = idle.back().release();
+            idle.pop_back();
+        } else if (decoders_open < max_decoders) {
+            ++decoders_open;
+            open_new = true;
+        } else if (req->token.cancelled()) {
+            return false;
+        } else {
+            waiting.push_back(req);
+            return true;
+        }
+    }
+    // std::function needs a copyable callable, so the decoder travels as a raw pointer.
+    sched.submit(TaskClass::Prefetch, [this, req, decoder, open_new] {
+        unique_ptr<FFPlayer> owned(decoder);
+        if (open_new) owned = open_decoder();
+        run(req, move(owned));
+    });
+    return true;
+}
+
+// Cancellation callback: queued requests whose token is cancelled are
+// completed now rather than when a decoder next comes free, which may be
+// never if nothing else is in flight.
+void FrameEngine::drop_cancelled() {
+    vector<FrameAwaiter *> dropped;
+    {
+        lock_guard<mutex> lk(mtx);
+        for (auto it = waiting.begin(); it != waiting.end();) {
+            if ((*it)->token.cancelled()) {
+                dropped.push_back(*it);
+                it = waiting.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+    for (FrameAwaiter *w : dropped) finish(w);
+}
+
+void FrameEngine::run(FrameAwaiter *req, unique_ptr<FFPlayer> decoder) {
+    FrameResult &r = req->result;
+    if (decoder && !req->token.cancelled()) {
+        unique_ptr<AVFrame, AVFrameDeleter> f = seek_and_decode_frame(*decoder, r.requested);
+        if (f && !req->token.cancelled()) {
+            convert_frame_into(f.get(), *decoder, r.image);
+            r.pts = decoder->last_shown_pts;
+            r.frame_number = pts_to_frame_number(decoder->last_shown_pts, decoder->video_stream);
+            r.ok = true;
+        }
+    }
+    r.cancelled = !r.ok && req->token.cancelled();
+
+    // Hand the decoder straight to the next live request; cancelled ones
+    // are completed here without decoding.
+    vector<FrameAwaiter *> dropped;
+    FrameAwaiter *next = nullptr;
+    {
+        lock_guard<mutex> lk(mtx);
+        if (!decoder) --decoders_open;
+        while (!waiting.empty()) {
+            FrameAwaiter *w = waiting.front();
+            if (!w->token.cancelled() && decoder) {
+                waiting.pop_front();
+                next = w;
+                break;
+            }
+            if (!w->token.cancelled() && decoders_open > 0) break;
+            // Cancelled, or no decoder can ever serve it.
+            waiting.pop_front();
+            dropped.push_back(w);
+        }
+        if (decoder && !next) idle.push_back(move(decoder));
+    }
+
+    if (next) {
+        FFPlayer *d = decoder.release();
+        sched.submit(TaskClass::Prefetch, [this, next, d] { run(next, unique_ptr<FFPlayer>(d)); });
+    }
+    for (FrameAwaiter *w : dropped) finish(w);
+    finish(req);
+}
+
+void FrameEngine::finish(FrameAwaiter *req) {
+    if (!req->result.ok) req->result.cancelled = req->token.cancelled();
+    req->token.remove_callback(req->cancel_callback);
+    req->handle.resume();
+}
+
+static Task<vector<FrameResult>> fetch_all(FrameEngine &engine, const vector<int64_t> &frames) {
+    vector<Task<FrameResult>> requests;
+    requests.reserve(frames.size());
+    for (int64_t f : frames) requests.push_back(engine.fetch(f));
+    co_return co_await when_all(move(requests));
+}
+
+int run_frame_fetch(const string &filename, const vector<int64_t> &frames, size_t decoders) {
+    FrameEngine engine(decoders);
+    if (engine.open(filename) < 0) return -1;
+
+    const auto start = chrono::steady_clock::now();
+    vector<FrameResult> results = sync_wait(fetch_all(engine, frames));
+    const double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int failed = 0;
+    for (const FrameResult &r : results) {
+        if (r.ok) cout << "frame " << r.requested << " -> " << r.frame_number << " (" << r.image.cols << "x" << r.image.rows << ")\n";
+        else { cout << "frame " << r.requested << " -> failed\n"; ++failed; }
+    }
+    cout << results.size() << " requests in " << secs * 1000.0 << " ms ("
+         << (secs > 0.0 ? static_cast<double>(results.size()) / secs : 0.0) << " frames/s), "
+         << failed << " failed\n";
+    return failed ? -1 : 0;
+}
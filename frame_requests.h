@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "async_task.h"
+#include "ff_player.h"
+#include "task_scheduler.h"
+
+struct FrameResult {
+    int64_t requested = 0;
+    int64_t frame_number = -1;
+    int64_t pts = AV_NOPTS_VALUE;
+    cv::Mat image;
+    bool ok = false;
+    bool cancelled = false;
+};
+
+// Shared cancel flag; copies observe the same state.
+class CancellationToken {
+public:
+    CancellationToken() : state(std::make_shared<State>()) {}
+    // Sets the flag and runs the registered callbacks on this thread.
+    void cancel() const;
+    bool cancelled() const { return state->flag.load(); }
+
+    // `fn` runs on cancel() until remove_callback(id) has returned; a token
+    // cancelled before it was registered does not run it.
+    uint64_t add_callback(std::function<void()> fn) const;
+    void remove_callback(uint64_t id) const;
+
+private:
+    struct State {
+        std::atomic<bool> flag{false};
+        // Recursive: a callback may complete a request, which removes its
+        // own callback from within cancel().
+        std::recursive_mutex mtx;
+        uint64_t next_id = 1;
+        std::vector<std::pair<uint64_t, std::function<void()>>> callbacks;
+    };
+    std::shared_ptr<State> state;
+};
+
+class FrameEngine;
+
+// Returned by FrameEngine::frame_at(); co_await it to get the frame.
+class FrameAwaiter {
+public:
+    FrameAwaiter(FrameEngine &engine, int64_t frame, CancellationToken token)
+        : engine(engine), token(std::move(token)) { result.requested = frame; }
+
+    bool await_ready() const noexcept { return false; }
+    bool await_suspend(std::coroutine_handle<> h);
+    FrameResult await_resume() { return std::move(result); }
+
+private:
+    friend class FrameEngine;
+    FrameEngine &engine;
+    CancellationToken token;
+    FrameResult result;
+    std::coroutine_handle<> handle;
+    uint64_t cancel_callback = 0;
+};
+
+// Asynchronous random access to one file. Requests are decoded on the
+// prefetch class of the task scheduler by a bounded pool of decoder
+// instances; a request suspends only its own coroutine, never a thread.
+// Cancelling a request that is still queued for a decoder completes it at
+// once, on the cancelling thread.
+class FrameEngine {
+public:
+    explicit FrameEngine(size_t max_decoders = 0, TaskScheduler &sched = TaskScheduler::global());
+
+    // Opens the first decoder; further ones are opened on demand.
+    int open(const std::string &filename);
+
+    FrameAwaiter frame_at(int64_t frame, CancellationToken token = {}) { return FrameAwaiter(*this, frame, std::move(token)); }
+    Task<FrameResult> fetch(int64_t frame, CancellationToken token = {});
+
+    const std::string &path() const { return filename; }
+    double fps() const { return stream_fps; }
+
+private:
+    friend class FrameAwaiter;
+
+    bool enqueue(FrameAwaiter *req);
+    void drop_cancelled();
+    void run(FrameAwaiter *req, std::unique_ptr<FFPlayer> decoder);
+    void finish(FrameAwaiter *req);
+    std::unique_ptr<FFPlayer> open_decoder();
+
+    TaskScheduler &sched;
+    size_t max_decoders;
+    std::string filename;
+    double stream_fps = 0.0;
+
+    std::mutex mtx;
+    std::vector<std::unique_ptr<FFPlayer>> idle;
+    size_t decoders_open = 0;
+    std::deque<FrameAwaiter *> waiting;
+};
+
+// --fetch: requests all `frames` concurrently and prints what came back.
+int run_frame_fetch(const std::string &filename, const std::vector<int64_t> &frames, size_t decoders);
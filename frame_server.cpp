@@ -0,0 +1,382 @@
+#include "frame_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define VMIX_HAVE_UNIX_SOCKETS 1
+#endif
+
+#include "frame_source.h"
+#include "lru_cache.h"
+#include "player_options.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+#ifdef VMIX_HAVE_UNIX_SOCKETS
+
+using Clock = chrono::steady_clock;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static volatile sig_atomic_t stop_requested = 0;
+static void on_stop_signal(int) { stop_requested = 1; }
+
+struct OutputFormat {
+    string name;  // jpeg, png or raw
+    int quality = 90;
+};
+
+struct EncodedImage {
+    int64_t frame_number = -1;
+    int64_t pts = AV_NOPTS_VALUE;
+    int width = 0;
+    int height = 0;
+    vector<unsigned char> bytes;
+};
+using EncodedPtr = shared_ptr<const EncodedImage>;
+
+static bool parse_format(const string &text, int default_quality, OutputFormat &out) {
+    const size_t colon = text.find(':');
+    out.name = text.substr(0, colon);
+    if (out.name == "jpg") out.name = "jpeg";
+    out.quality = colon == string::npos ? default_quality : clamp(atoi(text.c_str() + colon + 1), 1, 100);
+    return out.name == "jpeg" || out.name == "png" || out.name == "raw";
+}
+
+static bool encode_image(const cv::Mat &bgr, const OutputFormat &fmt, vector<unsigned char> &out) {
+    if (fmt.name == "raw") {
+        const size_t row = static_cast<size_t>(bgr.cols) * bgr.elemSize();
+        out.resize(row * static_cast<size_t>(bgr.rows));
+        for (int y = 0; y < bgr.rows; ++y) memcpy(out.data() + y * row, bgr.ptr(y), row);
+        return true;
+    }
+    if (fmt.name == "png") return cv::imencode(".png", bgr, out, {cv::IMWRITE_PNG_COMPRESSION, 1});
+    return cv::imencode(".jpg", bgr, out, {cv::IMWRITE_JPEG_QUALITY, fmt.quality});
+}
+
+static bool send_all(int fd, const void *data, size_t size) {
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        const ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        size -= static_cast<size_t>(n);
+    }
+    return true;
+}
+
+static bool send_text(int fd, const string &s) { return send_all(fd, s.data(), s.size()); }
+
+// Buffered line reader for one connection.
+class LineReader {
+public:
+    explicit LineReader(int fd) : fd(fd) {}
+
+    bool next(string &line) {
+        while (true) {
+            const size_t nl = buf.find('\n');
+            if (nl != string::npos) {
+                line = buf.substr(0, nl);
+                buf.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                return true;
+            }
+            if (buf.size() > kMaxLine) return false;
+            char chunk[4096];
+            const ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buf.append(chunk, static_cast<size_t>(n));
+        }
+    }
+
+private:
+    static constexpr size_t kMaxLine = 64 * 1024;
+    int fd;
+    string buf;
+};
+
+class FrameServer {
+public:
+    explicit FrameServer(const FrameServerOptions &opts)
+        : opts(opts), sources(max<size_t>(1, opts.max_files)), encoded(opts.cache_mb * 1024 * 1024 / 4) {}
+
+    void serve(int fd);
+    string stats_text();
+
+private:
+    shared_ptr<FrameSource> source_for(const string &path);
+    bool handle_grab(int fd, const string &args);
+    void record_latency(Clock::time_point start);
+
+    FrameServerOptions opts;
+    FrameSourceCounters counters;
+    atomic<uint64_t> encoded_hits{0};
+    atomic<uint64_t> encodes{0};
+    atomic<uint64_t> errors{0};
+
+    mutex mtx;
+    LruCache<string, shared_ptr<FrameSource>> sources;
+    LruCache<string, EncodedPtr> encoded; // "path\nframe\nformat:quality", cost in bytes
+
+    mutex latency_mtx;
+    vector<double> latency_ms; // ring of the most recent per-frame latencies
+    size_t latency_next = 0;
+};
+
+shared_ptr<FrameSource> FrameServer::source_for(const string &path) {
+    shared_ptr<FrameSource> src;
+    {
+        lock_guard<mutex> lk(mtx);
+        if (sources.get(path, src)) return src;
+    }
+    // Opened outside the lock so one slow file does not stall other clients;
+    // two clients racing on the same new file just open it twice.
+    const size_t per_file = opts.cache_mb * 1024 * 1024 * 3 / 4 / max<size_t>(1, opts.max_files);
+    src = make_shared<FrameSource>(path, opts.decoders_per_file, per_file, &counters);
+    if (src->open() < 0) return nullptr;
+    lock_guard<mutex> lk(mtx);
+    sources.put(path, src);
+    return src;
+}
+
+void FrameServer::record_latency(Clock::time_point start) {
+    const double ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    lock_guard<mutex> lk(latency_mtx);
+    if (latency_ms.size() < 4096) latency_ms.push_back(ms);
+    else latency_ms[latency_next++ % latency_ms.size()] = ms;
+}
+
+bool FrameServer::handle_grab(int fd, const string &args) {
+    istringstream in(args);
+    string frames_text, format_text, path;
+    in >> frames_text >> format_text;
+    getline(in, path);
+    path.erase(0, path.find_first_not_of(' '));
+
+    vector<int64_t> frames;
+    OutputFormat fmt;
+    if (path.empty() || !parse_int_list(frames_text, frames, opts.max_request_frames)) {
+        return send_text(fd, "ERR - usage: GRAB <frames> <jpeg[:Q]|png|raw> <path>, at most " + to_string(opts.max_request_frames) +
+                                 " frames\n");
+    }
+    if (!parse_format(format_text, opts.jpeg_quality, fmt)) return send_text(fd, "ERR - unknown format " + format_text + "\n");
+
+    shared_ptr<FrameSource> src = source_for(path);
+    if (!src) {
+        ++errors;
+        return send_text(fd, "ERR - cannot open " + path + "\n");
+    }
+
+    // Frames are decoded in order on this thread and encoded in parallel, a
+    // chunk at a time so long lists do not hold every image in memory.
+    TaskScheduler &sched = TaskScheduler::global();
+    const size_t chunk = max<size_t>(4, 2 * sched.worker_count());
+    const string key_prefix = path + '\n';
+    const string key_suffix = '\n' + fmt.name + ':' + to_string(fmt.name == "jpeg" ? fmt.quality : 0);
+
+    for (size_t begin = 0; begin < frames.size(); begin += chunk) {
+        const size_t end = min(frames.size(), begin + chunk);
+        vector<EncodedPtr> results(end - begin);
+        TaskGroup group(sched, TaskClass::Prefetch);
+        for (size_t i = begin; i < end; ++i) {
+            const Clock::time_point start = Clock::now();
+            const string key = key_prefix + to_string(frames[i]) + key_suffix;
+            EncodedPtr hit;
+            {
+                lock_guard<mutex> lk(mtx);
+                encoded.get(key, hit);
+            }
+            if (hit) {
+                ++encoded_hits;
+                results[i - begin] = hit;
+                record_latency(start);
+                continue;
+            }
+            auto grabbed = make_shared<GrabbedFrame>();
+            if (!src->grab(frames[i], *grabbed)) continue;
+            group.run([this, grabbed, fmt, key, start, slot = &results[i - begin]] {
+                auto img = make_shared<EncodedImage>();
+                img->frame_number = grabbed->frame_number;
+                img->pts = grabbed->pts;
+                img->width = grabbed->image.cols;
+                img->height = grabbed->image.rows;
+                if (!encode_image(grabbed->image, fmt, img->bytes)) return;
+                ++encodes;
+                {
+                    lock_guard<mutex> lk(mtx);
+                    encoded.put(key, img, img->bytes.size() + key.size());
+                }
+                *slot = img;
+                record_latency(start);
+            });
+        }
+        group.wait();
+
+        for (size_t i = begin; i < end; ++i) {
+            const EncodedPtr &r = results[i - begin];
+            if (!r) {
+                ++errors;
+                if (!send_text(fd, "ERR " + to_string(frames[i]) + " cannot decode frame\n")) return false;
+                continue;
+            }
+            ostringstream head;
+            head << "OK " << frames[i] << ' ' << r->frame_number << ' ' << r->pts << ' ' << r->width << ' ' << r->height
+                 << ' ' << fmt.name << ' ' << r->bytes.size() << '\n';
+            if (!send_text(fd, head.str()) || !send_all(fd, r->bytes.data(), r->bytes.size())) return false;
+        }
+    }
+    return true;
+}
+
+void FrameServer::serve(int fd) {
+    LineReader reader(fd);
+    string line;
+    while (reader.next(line)) {
+        const string cmd = line.substr(0, line.find(' '));
+        bool ok = true;
+        if (cmd == "GRAB") {
+            ok = handle_grab(fd, line.size() > 4 ? line.substr(5) : string());
+        } else if (cmd == "STATS") {
+            const string text = stats_text();
+            ok = send_text(fd, "STATS " + to_string(text.size()) + "\n" + text);
+        } else if (!cmd.empty()) {
+            ok = send_text(fd, "ERR - unknown command " + cmd + "\n");
+        }
+        if (!ok) break;
+    }
+}
+
+string FrameServer::stats_text() {
+    const uint64_t frames = counters.requests + encoded_hits;
+    auto pct = [frames](uint64_t n) { return frames ? 100.0 * static_cast<double>(n) / static_cast<double>(frames) : 0.0; };
+    vector<double> lat;
+    {
+        lock_guard<mutex> lk(latency_mtx);
+        lat = latency_ms;
+    }
+    size_t open_files = 0;
+    {
+        lock_guard<mutex> lk(mtx);
+        open_files = sources.size();
+    }
+
+    ostringstream os;
+    os.setf(ios::fixed);
+    os.precision(1);
+    os << "frames served: " << frames << ", errors " << errors << '\n'
+       << "encoded cache hits: " << encoded_hits << " (" << pct(encoded_hits) << "%)\n"
+       << "decoded cache hits: " << counters.decoded_hits << " (" << pct(counters.decoded_hits) << "%)\n"
+       << "decodes: " << counters.forward_decodes << " forward within GOP, " << counters.seeks << " seeks, "
+       << counters.frames_decoded << " frames decoded\n"
+       << "encodes: " << encodes << ", open files: " << open_files << '\n';
+    if (!lat.empty()) {
+        sort(lat.begin(), lat.end());
+        os.precision(3);
+        os << "latency ms: p50 " << lat[lat.size() / 2] << ", p99 " << lat[min(lat.size() - 1, lat.size() * 99 / 100)]
+           << ", max " << lat.back() << " (last " << lat.size() << " frames)\n";
+    }
+    return os.str();
+}
+
+int run_frame_server(const string &socket_path, const FrameServerOptions &opts) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Socket path too long: " << socket_path << '\n';
+        return -1;
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    const int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (lfd < 0) { cerr << "socket failed : " << strerror(errno) << '\n'; return -1; }
+    unlink(socket_path.c_str());
+    if (bind(lfd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(lfd, 64) != 0) {
+        cerr << "Cannot listen on " << socket_path << " : " << strerror(errno) << '\n';
+        close(lfd);
+        return -1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, on_stop_signal);
+    signal(SIGTERM, on_stop_signal);
+    cout << "Serving frames on " << socket_path << " (Ctrl+C to stop)\n";
+
+    FrameServer server(opts);
+    struct Client {
+        int fd = -1;
+        thread worker;
+        atomic<bool> done{false};
+    };
+    vector<unique_ptr<Client>> clients;
+    const size_t max_clients = max<size_t>(1, opts.max_connections);
+    auto reap = [&clients] {
+        for (auto it = clients.begin(); it != clients.end();) {
+            if (!(*it)->done.load()) { ++it; continue; }
+            (*it)->worker.join();
+            close((*it)->fd);
+            it = clients.erase(it);
+        }
+    };
+
+    while (!stop_requested) {
+        pollfd pfd{lfd, POLLIN, 0};
+        const int ready = poll(&pfd, 1, 250);
+        reap();
+        if (ready <= 0) continue;
+        const int cfd = accept(lfd, nullptr, nullptr);
+        if (cfd < 0) continue;
+        if (clients.size() >= max_clients) {
+            send_text(cfd, "ERR - busy, " + to_string(max_clients) + " connections open\n");
+            close(cfd);
+            continue;
+        }
+        auto c = make_unique<Client>();
+        Client *cp = c.get();
+        cp->fd = cfd;
+        cp->worker = thread([&server, cp] {
+            server.serve(cp->fd);
+            cp->done = true;
+        });
+        clients.push_back(move(c));
+    }
+
+    close(lfd);
+    unlink(socket_path.c_str());
+    // Wake connection threads blocked in recv, then join them all.
+    for (auto &c : clients) shutdown(c->fd, SHUT_RDWR);
+    for (auto &c : clients) {
+        c->worker.join();
+        close(c->fd);
+    }
+    clients.clear();
+    cout << server.stats_text();
+    return 0;
+}
+
+#else
+
+int run_frame_server(const string &, const FrameServerOptions &) {
+    cerr << "The frame server needs Unix domain sockets, which this build does not support\n";
+    return -1;
+}
+
+#endif
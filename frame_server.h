@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+struct FrameServerOptions {
+    size_t decoders_per_file = 2;
+    size_t max_files = 8;       // open files kept, least recently used closed first
+    size_t cache_mb = 512;      // decoded frames get 3/4, encoded images 1/4
+    int jpeg_quality = 90;
+    size_t max_connections = 64;     // further clients get "ERR - busy" and are closed
+    size_t max_request_frames = 100000; // frames one GRAB may list
+};
+
+// --serve: frame-grab daemon on a Unix domain socket. Each line is a request:
+//
+//   GRAB <frames> <jpeg[:Q]|png|raw> <path>
+//   STATS
+//
+// <frames> uses the --fetch syntax (0,10,20-30). Every frame is answered, in
+// request order, by
+//
+//   OK <requested> <frame> <pts> <width> <height> <format> <bytes>\n<bytes of data>
+//   ERR <requested> <reason>
+//
+// raw is packed BGR24. STATS is answered by `STATS <bytes>` and that much
+// text. Up to max_connections connections are served concurrently, each on
+// its own thread, all joined on shutdown; the frames of one request are
+// decoded in order and encoded in parallel on the task scheduler. Runs until
+// SIGINT/SIGTERM.
+int run_frame_server(const std::string &socket_path, const FrameServerOptions &opts);
@@ -0,0 +1,144 @@
+#include "frame_source.h"
+
+#include <algorithm>
+#include <iostream>
+
+extern "C" {
+#include <libavutil/imgutils.h>
+}
+
+using namespace std;
+
+static size_t frame_bytes(const AVFrame *f) {
+    const int n = av_image_get_buffer_size(static_cast<AVPixelFormat>(f->format), f->width, f->height, 1);
+    return n > 0 ? static_cast<size_t>(n) : 1;
+}
+
+static void free_frame(AVFrame *f) { av_frame_free(&f); }
+
+FrameSource::FrameSource(string path, size_t max_decoders, size_t cache_bytes, FrameSourceCounters *counters)
+    : filename(move(path)), max_decoders(max<size_t>(1, max_decoders)), counters(counters), decoded(cache_bytes) {}
+
+unique_ptr<FFPlayer> FrameSource::open_decoder() {
+    unique_ptr<FFPlayer> p = make_unique<FFPlayer>();
+    p->convert_class = TaskClass::Prefetch;
+    if (open_player(*p, filename) < 0) return nullptr;
+    return p;
+}
+
+int FrameSource::open() {
+    unique_ptr<FFPlayer> p = open_decoder();
+    if (!p) return -1;
+    if (!build_frame_index(*p, frame_index)) cerr << filename << ": no keyframe index, every request will seek\n";
+    stream = p->video_stream;
+    stream_fps = p->fps;
+    frame_w = p->dec_ctx->width;
+    frame_h = p->dec_ctx->height;
+    lock_guard<mutex> lk(mtx);
+    idle.push_back(move(p));
+    decoders_open = 1;
+    return 0;
+}
+
+// Prefers an idle decoder that can reach `target_ts` by decoding forward
+// within its current GOP, the closest one if several can.
+unique_ptr<FFPlayer> FrameSource::lease(int64_t target_ts) {
+    unique_lock<mutex> lk(mtx);
+    while (true) {
+        if (!idle.empty()) {
+            size_t best = idle.size() - 1;
+            const int64_t key = target_ts != AV_NOPTS_VALUE ? frame_index.keyframe_at_or_before(target_ts) : AV_NOPTS_VALUE;
+            int64_t best_last = AV_NOPTS_VALUE;
+            for (size_t i = 0; key != AV_NOPTS_VALUE && i < idle.size(); ++i) {
+                const int64_t last = idle[i]->last_shown_pts;
+                if (last == AV_NOPTS_VALUE || last >= target_ts || last < key) continue;
+                if (best_last == AV_NOPTS_VALUE || last > best_last) {
+                    best = i;
+                    best_last = last;
+                }
+            }
+            unique_ptr<FFPlayer> p = move(idle[best]);
+            idle.erase(idle.begin() + static_cast<ptrdiff_t>(best));
+            return p;
+        }
+        if (decoders_open < max_decoders) {
+            ++decoders_open;
+            lk.unlock();
+            unique_ptr<FFPlayer> p = open_decoder();
+            if (!p) {
+                lk.lock();
+                --decoders_open;
+                cv.notify_one();
+            }
+            return p;
+        }
+        cv.wait(lk);
+    }
+}
+
+void FrameSource::release(unique_ptr<FFPlayer> p) {
+    {
+        lock_guard<mutex> lk(mtx);
+        idle.push_back(move(p));
+    }
+    cv.notify_one();
+}
+
+bool FrameSource::grab(int64_t frame, GrabbedFrame &out) {
+    if (!stream) return false;
+    if (counters) ++counters->requests;
+
+    FramePtr f;
+    unique_ptr<FFPlayer> converter;
+    {
+        lock_guard<mutex> lk(mtx);
+        decoded.get(frame, f);
+        if (f && !idle_converters.empty()) {
+            converter = move(idle_converters.back());
+            idle_converters.pop_back();
+        }
+    }
+    if (f) {
+        // Hits only convert, so they never wait for a decoder.
+        if (counters) ++counters->decoded_hits;
+        if (!converter) {
+            converter = make_unique<FFPlayer>();
+            converter->convert_class = TaskClass::Prefetch;
+        }
+        out.pts = f->pts;
+        out.frame_number = pts_to_frame_number(f->pts, stream);
+        out.cached = true;
+        convert_frame_into(f.get(), *converter, out.image);
+        lock_guard<mutex> lk(mtx);
+        idle_converters.push_back(move(converter));
+        return true;
+    }
+
+    unique_ptr<FFPlayer> p = lease(frame_number_to_stream_ts(frame, stream));
+    if (!p) return false;
+    bool seeked = false;
+    unique_ptr<AVFrame, AVFrameDeleter> target = decode_frame_indexed(*p, frame_index, frame,
+        [&](const AVFrame *d, int64_t pts) {
+            if (counters) ++counters->frames_decoded;
+            FramePtr c(av_frame_clone(d), free_frame);
+            if (!c) return;
+            c->pts = pts;
+            const int64_t n = pts_to_frame_number(pts, stream);
+            lock_guard<mutex> lk(mtx);
+            decoded.put(n, move(c), frame_bytes(d));
+        },
+        &seeked);
+    if (counters) ++(seeked ? counters->seeks : counters->forward_decodes);
+    if (!target) {
+        release(move(p));
+        return false;
+    }
+    target->pts = p->last_shown_pts;
+
+    out.pts = target->pts;
+    out.frame_number = pts_to_frame_number(target->pts, stream);
+    out.cached = false;
+    convert_frame_into(target.get(), *p, out.image);
+    release(move(p));
+    return true;
+}
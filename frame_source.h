@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "ff_player.h"
+#include "frame_index.h"
+#include "lru_cache.h"
+
+// Counters shared by all sources of a service; any of them may be null.
+struct FrameSourceCounters {
+    std::atomic<uint64_t> requests{0};
+    std::atomic<uint64_t> decoded_hits{0};   // served from the decoded-frame cache
+    std::atomic<uint64_t> forward_decodes{0}; // continued within the GOP without a seek
+    std::atomic<uint64_t> seeks{0};
+    std::atomic<uint64_t> frames_decoded{0};
+};
+
+struct GrabbedFrame {
+    int64_t frame_number = -1;
+    int64_t pts = AV_NOPTS_VALUE;
+    cv::Mat image; // BGR24
+    bool cached = false;
+};
+
+// One open file for random access: its keyframe index, a bounded pool of
+// decoders and an LRU of recently decoded frames. Every frame decoded on the
+// way to a target is cached, so requests near recent ones skip decoding.
+// Thread-safe; concurrent grabs use different decoders, and cache hits
+// only convert, without waiting for one.
+class FrameSource {
+public:
+    FrameSource(std::string path, size_t max_decoders, size_t cache_bytes, FrameSourceCounters *counters = nullptr);
+
+    // Opens the first decoder and builds the index. Returns 0 or a negative AVERROR.
+    int open();
+
+    bool grab(int64_t frame, GrabbedFrame &out);
+
+    const std::string &path() const { return filename; }
+    const FrameIndex &index() const { return frame_index; }
+    double fps() const { return stream_fps; }
+    int width() const { return frame_w; }
+    int height() const { return frame_h; }
+    // Stream timestamp of a frame number, for grouping requests by GOP.
+    int64_t frame_ts(int64_t frame) const { return stream ? frame_number_to_stream_ts(frame, stream) : AV_NOPTS_VALUE; }
+
+private:
+    using FramePtr = std::shared_ptr<AVFrame>;
+
+    std::unique_ptr<FFPlayer> lease(int64_t target_ts);
+    void release(std::unique_ptr<FFPlayer> p);
+    std::unique_ptr<FFPlayer> open_decoder();
+
+    std::string filename;
+    size_t max_decoders;
+    FrameSourceCounters *counters;
+    FrameIndex frame_index;
+    double stream_fps = 0.0;
+    int frame_w = 0;
+    int frame_h = 0;
+    AVStream *stream = nullptr; // of the first decoder, for timestamp maths
+
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::vector<std::unique_ptr<FFPlayer>> idle;
+    // Players without a file, only their conversion contexts, for cache hits.
+    std::vector<std::unique_ptr<FFPlayer>> idle_converters;
+    size_t decoders_open = 0;
+    LruCache<int64_t, FramePtr> decoded; // by frame number, cost in bytes
+};
@@ -0,0 +1,199 @@
+#include "gop_sampler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+
+using namespace std;
+
+GopSampler::GopSampler(string path, size_t decoders, TaskScheduler &sched)
+    : filename(move(path)), max_decoders(decoders ? decoders : max<size_t>(1, sched.worker_count())), sched(sched) {}
+
+unique_ptr<FFPlayer> GopSampler::open_decoder() {
+    unique_ptr<FFPlayer> p = make_unique<FFPlayer>();
+    p->convert_class = TaskClass::Prefetch;
+    if (open_player(*p, filename) < 0) return nullptr;
+    return p;
+}
+
+int GopSampler::open() {
+    unique_ptr<FFPlayer> p = open_decoder();
+    if (!p) return -1;
+    if (!build_frame_index(*p, frame_index)) cerr << filename << ": no keyframe index, sampling sequentially\n";
+    stream_fps = p->fps;
+    if (frame_index.entries.size() > frame_index.keyframes.size()) {
+        frames_in_file = static_cast<int64_t>(frame_index.entries.size());
+    } else if (p->video_stream->nb_frames > 0) {
+        frames_in_file = p->video_stream->nb_frames;
+    } else if (p->fmt_ctx->duration > 0) {
+        frames_in_file = static_cast<int64_t>(static_cast<double>(p->fmt_ctx->duration) / AV_TIME_BASE * stream_fps);
+    }
+    decoders.push_back(move(p));
+    return 0;
+}
+
+SamplerStats GopSampler::run(vector<int64_t> targets, const function<void(const SampledFrame &)> &on_frame) {
+    SamplerStats stats;
+    if (decoders.empty()) return stats;
+    AVStream *st = decoders[0]->video_stream;
+    sort(targets.begin(), targets.end());
+    targets.erase(unique(targets.begin(), targets.end()), targets.end());
+    stats.targets = targets.size();
+    stats.gops_total = max<size_t>(1, frame_index.gop_count());
+
+    // One plan entry per GOP that has targets, in file order.
+    struct GopPlan {
+        int gop;
+        vector<int64_t> targets;
+    };
+    vector<GopPlan> plan;
+    for (int64_t t : targets) {
+        const int64_t ts = frame_number_to_stream_ts(t, st);
+        const int gop = frame_index.empty() ? 0 : max(0, frame_index.gop_of(ts));
+        if (plan.empty() || plan.back().gop != gop) plan.push_back({gop, {}});
+        plan.back().targets.push_back(t);
+        const int64_t key = frame_index.keyframe_at_or_before(ts);
+        const int64_t from = key == AV_NOPTS_VALUE ? 0 : pts_to_frame_number(key, st);
+        stats.naive_frames += static_cast<uint64_t>(max<int64_t>(1, t - from + 1));
+    }
+    stats.gops_decoded = plan.size();
+    if (plan.empty()) return stats;
+    if (frame_index.empty()) {
+        run_sequential(targets, on_frame, stats);
+        return stats;
+    }
+
+    const size_t want = min(max_decoders, plan.size());
+    while (decoders.size() < want) {
+        unique_ptr<FFPlayer> p = open_decoder();
+        if (!p) break;
+        decoders.push_back(move(p));
+    }
+    const size_t n_dec = min(want, decoders.size());
+
+    // A few chunks per decoder keep them busy when GOPs differ in cost;
+    // chunks are runs of consecutive GOPs so each decoder reads forward.
+    const size_t chunk_count = min(plan.size(), n_dec * 4);
+    atomic<size_t> next_chunk{0};
+    atomic<uint64_t> frames_decoded{0}, seeks{0}, delivered{0};
+
+    const auto start = chrono::steady_clock::now();
+    {
+        TaskGroup group(sched, TaskClass::Prefetch);
+        for (size_t d = 0; d < n_dec; ++d) {
+            FFPlayer *dec = decoders[d].get();
+            group.run([&, dec] {
+                for (size_t c; (c = next_chunk++) < chunk_count;) {
+                    const size_t first = c * plan.size() / chunk_count;
+                    const size_t last = (c + 1) * plan.size() / chunk_count;
+                    for (size_t g = first; g < last; ++g) {
+                        for (int64_t t : plan[g].targets) {
+                            bool seeked = false;
+                            unique_ptr<AVFrame, AVFrameDeleter> f = decode_frame_indexed(
+                                *dec, frame_index, t, [&](const AVFrame *, int64_t) { ++frames_decoded; }, &seeked);
+                            if (seeked) ++seeks;
+                            if (!f) continue;
+                            SampledFrame sf;
+                            sf.requested = t;
+                            sf.pts = dec->last_shown_pts;
+                            sf.frame_number = pts_to_frame_number(sf.pts, st);
+                            sf.frame = f.get();
+                            sf.decoder = dec;
+                            if (on_frame) on_frame(sf);
+                            ++delivered;
+                        }
+                    }
+                }
+            });
+        }
+        group.wait();
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    stats.frames_decoded = frames_decoded;
+    stats.seeks = seeks;
+    stats.delivered = delivered;
+    return stats;
+}
+
+// No keyframes to seek to: one pass from the start, handing out each frame
+// that reaches the next target (targets are sorted).
+void GopSampler::run_sequential(const vector<int64_t> &targets, const function<void(const SampledFrame &)> &on_frame,
+                                SamplerStats &stats) {
+    FFPlayer *dec = decoders[0].get();
+    AVStream *st = dec->video_stream;
+    const auto start = chrono::steady_clock::now();
+    if (dec->last_shown_pts != AV_NOPTS_VALUE) {
+        dec->primed.clear();
+        if (av_seek_frame(dec->fmt_ctx, dec->video_stream_idx, 0, AVSEEK_FLAG_BACKWARD) >= 0) avcodec_flush_buffers(dec->dec_ctx);
+        dec->last_shown_pts = AV_NOPTS_VALUE;
+        ++stats.seeks;
+    }
+    size_t next = 0;
+    while (next < targets.size()) {
+        unique_ptr<AVFrame, AVFrameDeleter> f = decode_next_frame(*dec);
+        if (!f) break;
+        ++stats.frames_decoded;
+        const int64_t pts = dec->last_shown_pts;
+        for (; next < targets.size() && pts >= frame_number_to_stream_ts(targets[next], st); ++next) {
+            SampledFrame sf;
+            sf.requested = targets[next];
+            sf.pts = pts;
+            sf.frame_number = pts_to_frame_number(pts, st);
+            sf.frame = f.get();
+            sf.decoder = dec;
+            if (on_frame) on_frame(sf);
+            ++stats.delivered;
+        }
+    }
+    stats.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+vector<int64_t> stride_targets(int64_t frame_count, double fps, int64_t stride, double seconds) {
+    vector<int64_t> out;
+    if (frame_count <= 0) return out;
+    if (seconds > 0.0) {
+        const double step = max(1.0, seconds * fps);
+        for (int64_t k = 0;; ++k) {
+            const int64_t f = llround(static_cast<double>(k) * step);
+            if (f >= frame_count) break;
+            out.push_back(f);
+        }
+    } else {
+        for (int64_t f = 0; f < frame_count; f += max<int64_t>(1, stride)) out.push_back(f);
+    }
+    return out;
+}
+
+int run_gop_sampler(const string &filename, const vector<int64_t> &targets, int64_t stride, double seconds,
+                    const string &out_dir, size_t decoders) {
+    GopSampler sampler(filename, decoders);
+    if (sampler.open() < 0) return -1;
+    const vector<int64_t> wanted = targets.empty() ? stride_targets(sampler.frame_count(), sampler.fps(), stride, seconds) : targets;
+    if (wanted.empty()) { cerr << "No frames to sample (unknown frame count?)\n"; return -1; }
+
+    if (!out_dir.empty()) {
+        error_code ec;
+        filesystem::create_directories(out_dir, ec);
+        if (ec) { cerr << "Cannot create " << out_dir << '\n'; return -1; }
+    }
+
+    const SamplerStats s = sampler.run(wanted, [&](const SampledFrame &f) {
+        if (out_dir.empty()) return;
+        cv::Mat img;
+        convert_frame_into(f.frame, *f.decoder, img);
+        char name[48];
+        snprintf(name, sizeof(name), "frame_%08lld.jpg", static_cast<long long>(f.frame_number));
+        cv::imwrite((filesystem::path(out_dir) / name).string(), img);
+    });
+
+    cout << "Sampled " << s.delivered << " of " << s.targets << " frames from " << s.gops_decoded << " of " << s.gops_total
+         << " GOPs in " << s.seconds << " s (" << (s.seconds > 0.0 ? static_cast<double>(s.delivered) / s.seconds : 0.0)
+         << " frames/s)\n"
+         << "Decoded " << s.frames_decoded << " frames with " << s.seeks << " seeks; one seek per frame would decode "
+         << s.naive_frames << '\n';
+    return s.delivered == s.targets ? 0 : -1;
+}
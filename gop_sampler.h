@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ff_player.h"
+#include "frame_index.h"
+#include "task_scheduler.h"
+
+struct SampledFrame {
+    int64_t requested = 0;
+    int64_t frame_number = -1;
+    int64_t pts = AV_NOPTS_VALUE;
+    AVFrame *frame = nullptr;
+    FFPlayer *decoder = nullptr; // owner of `frame`, e.g. for convert_frame_into()
+};
+
+struct SamplerStats {
+    size_t gops_total = 0;
+    size_t gops_decoded = 0;
+    size_t targets = 0;
+    size_t delivered = 0;
+    uint64_t frames_decoded = 0;
+    uint64_t seeks = 0;
+    uint64_t naive_frames = 0;  // what one seek_and_decode_frame() per target would decode
+    double seconds = 0.0;
+};
+
+// Decodes a sparse set of frames with a minimal schedule: targets are grouped
+// by GOP using the keyframe index, every GOP with targets is decoded once from
+// its keyframe up to its last target, and GOPs without targets are never
+// touched. Runs of consecutive GOPs are spread over several decoder instances
+// on the task scheduler.
+class GopSampler {
+public:
+    explicit GopSampler(std::string path, size_t decoders = 0, TaskScheduler &sched = TaskScheduler::global());
+
+    // Opens the first decoder and builds the index. Returns 0 or a negative AVERROR.
+    int open();
+
+    const FrameIndex &index() const { return frame_index; }
+    double fps() const { return stream_fps; }
+    // From the packet index when it lists every frame, else from the stream header.
+    int64_t frame_count() const { return frames_in_file; }
+
+    // Decodes every target. `on_frame` runs on scheduler threads: in frame
+    // order within a GOP, concurrently for different decoders. Without an
+    // index the file is decoded once from the start on the calling thread.
+    SamplerStats run(std::vector<int64_t> targets, const std::function<void(const SampledFrame &)> &on_frame);
+
+private:
+    std::unique_ptr<FFPlayer> open_decoder();
+    void run_sequential(const std::vector<int64_t> &targets, const std::function<void(const SampledFrame &)> &on_frame,
+                        SamplerStats &stats);
+
+    std::string filename;
+    size_t max_decoders;
+    TaskScheduler &sched;
+    FrameIndex frame_index;
+    double stream_fps = 0.0;
+    int64_t frames_in_file = 0;
+    std::vector<std::unique_ptr<FFPlayer>> decoders;
+};
+
+// Targets every `stride` frames, or every `seconds` of video when seconds > 0.
+std::vector<int64_t> stride_targets(int64_t frame_count, double fps, int64_t stride, double seconds);
+
+// --sample: decodes the targets, optionally writing them as JPEGs to `out_dir`,
+// and reports how much decoding the schedule saved.
+int run_gop_sampler(const std::string &filename, const std::vector<int64_t> &targets, int64_t stride, double seconds,
+                    const std::string &out_dir, size_t decoders);
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+// Least-recently-used map with a cost budget (bytes, frames, open files...).
+// Not thread-safe; owners guard it with their own mutex. Values are usually
+// shared_ptrs so an evicted entry stays valid for whoever still uses it.
+template <typename K, typename V>
+class LruCache {
+public:
+    explicit LruCache(size_t capacity) : capacity(capacity) {}
+
+    // Copies the value into `out` and marks it most recently used.
+    bool get(const K &key, V &out) {
+        auto it = map.find(key);
+        if (it == map.end()) { ++misses; return false; }
+        items.splice(items.begin(), items, it->second);
+        out = it->second->value;
+        ++hits;
+        return true;
+    }
+
+    bool contains(const K &key) const { return map.count(key) != 0; }
+
+    // Inserts or replaces `key`, then evicts from the cold end until the
+    // total cost fits. An entry costing more than the whole budget is not kept.
+    void put(const K &key, V value, size_t cost = 1) {
+        erase(key);
+        if (cost > capacity) return;
+        items.push_front(Item{key, std::move(value), cost});
+        map[key] = items.begin();
+        total += cost;
+        while (total > capacity) evict_one();
+    }
+
+    void erase(const K &key) {
+        auto it = map.find(key);
+        if (it == map.end()) return;
+        total -= it->second->cost;
+        items.erase(it->second);
+        map.erase(it);
+    }
+
+    void clear() {
+        items.clear();
+        map.clear();
+        total = 0;
+    }
+
+    void set_capacity(size_t c) {
+        capacity = c;
+        while (total > capacity) evict_one();
+    }
+
+    size_t size() const { return map.size(); }
+    size_t cost() const { return total; }
+    size_t max_cost() const { return capacity; }
+    uint64_t hit_count() const { return hits; }
+    uint64_t miss_count() const { return misses; }
+
+private:
+    struct Item {
+        K key;
+        V value;
+        size_t cost;
+    };
+
+    void evict_one() {
+        const Item &last = items.back();
+        total -= last.cost;
+        map.erase(last.key);
+        items.pop_back();
+    }
+
+    size_t capacity;
+    size_t total = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    std::list<Item> items;
+    std::unordered_map<K, typename std::list<Item>::iterator> map;
+};
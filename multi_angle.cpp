@@ -0,0 +1,355 @@
+#include "multi_angle.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include "presenter.h"
+#include "program_recorder.h"
+#include "thread_policy.h"
+
+using namespace std;
+
+bool parse_angle(const string &text, AngleSource &out) {
+    out = AngleSource{};
+    const size_t at = text.rfind('@');
+    if (at != string::npos && at > 0) {
+        char *end = nullptr;
+        const double offset = strtod(text.c_str() + at + 1, &end);
+        if (end != text.c_str() + at + 1 && *end == '\0') {
+            out.path = text.substr(0, at);
+            out.offset = offset;
+            return true;
+        }
+    }
+    out.path = text;
+    return !out.path.empty();
+}
+
+MultiAnglePipeline::MultiAnglePipeline(vector<AngleSource> sources, TaskScheduler &sched) : sched(sched) {
+    for (AngleSource &s : sources) {
+        auto a = make_unique<Angle>();
+        a->source = move(s);
+        angles.push_back(move(a));
+    }
+}
+
+MultiAnglePipeline::~MultiAnglePipeline() {
+    stop();
+    for (auto &a : angles) {
+        if (a->sws) sws_freeContext(a->sws);
+    }
+}
+
+bool MultiAnglePipeline::open(int width, int height) {
+    if (angles.empty()) return false;
+    atomic<bool> ok{true};
+    {
+        TaskGroup group(sched, TaskClass::Prefetch);
+        for (auto &ap : angles) {
+            Angle *a = ap.get();
+            group.run([a, &ok] {
+                if (open_player(a->player, a->source.path) < 0) {
+                    ok = false;
+                    return;
+                }
+                if (!build_frame_index(a->player, a->index)) cerr << a->source.path << ": no keyframe index, every frame will seek\n";
+            });
+        }
+    }
+    if (!ok) return false;
+
+    const FFPlayer &first = angles.front()->player;
+    timeline_fps = first.fps > 0.0 ? first.fps : 25.0;
+    if (width <= 0 || height <= 0) {
+        width = first.dec_ctx->width;
+        height = first.dec_ctx->height;
+    }
+    const int n = static_cast<int>(angles.size());
+    const int cols = static_cast<int>(ceil(sqrt(static_cast<double>(n))));
+    const int rows = (n + cols - 1) / cols;
+    const int tile_w = max(2, (width / cols) & ~1);
+    const int tile_h = max(2, (height / rows) & ~1);
+    mosaic_w = tile_w * cols;
+    mosaic_h = tile_h * rows;
+    for (int i = 0; i < n; ++i) {
+        Angle &a = *angles[i];
+        a.rect = cv::Rect((i % cols) * tile_w, (i / cols) * tile_h, tile_w, tile_h);
+        a.tile = cv::Mat::zeros(tile_h, tile_w, CV_8UC3);
+        cout << "Angle " << i + 1 << ": " << a.source.path << " at " << a.source.offset << " s, " << a.player.fps << " fps\n";
+    }
+    for (int i = 0; i < 3; ++i) frames.slot(i).image = cv::Mat::zeros(mosaic_h, mosaic_w, CV_8UC3);
+    return true;
+}
+
+// Angles whose file has not started yet show black; angles past their end
+// keep their last frame. A timeline frame that maps to the frame already in
+// the tile (different frame rates) decodes nothing.
+void MultiAnglePipeline::update_angle(Angle &a, int64_t timeline_frame) {
+    const auto t0 = chrono::steady_clock::now();
+    const double secs = static_cast<double>(timeline_frame) / timeline_fps + a.source.offset;
+    const int64_t target = static_cast<int64_t>(floor(secs * a.player.fps + 1e-6));
+    a.decode_ms = 0.0;
+    if (target < 0) {
+        if (a.shown != -1) a.tile.setTo(cv::Scalar::all(0));
+        a.shown = -1;
+        a.ended = false;
+        return;
+    }
+    if (target == a.shown || (a.ended && target > a.shown)) return;
+
+    unique_ptr<AVFrame, AVFrameDeleter> f = decode_frame_indexed(a.player, a.index, target);
+    if (!f) {
+        a.ended = true;
+        return;
+    }
+    a.ended = false;
+    a.shown = pts_to_frame_number(a.player.last_shown_pts, a.player.video_stream);
+    a.sws = sws_getCachedContext(a.sws, f->width, f->height, static_cast<AVPixelFormat>(f->format), a.tile.cols, a.tile.rows,
+                                 AV_PIX_FMT_BGR24, SWS_BILINEAR, nullptr, nullptr, nullptr);
+    if (a.sws) {
+        uint8_t *dst[4] = {a.tile.data, nullptr, nullptr, nullptr};
+        int dst_linesize[4] = {static_cast<int>(a.tile.step[0]), 0, 0, 0};
+        sws_scale(a.sws, f->data, f->linesize, 0, f->height, dst, dst_linesize);
+    }
+    a.decode_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+}
+
+bool MultiAnglePipeline::decode_into_back(int64_t timeline_frame) {
+    const auto t0 = chrono::steady_clock::now();
+    PresentFrame &slot = frames.write_slot();
+    {
+        // The decode thread takes one angle itself while waiting.
+        TaskGroup group(sched, TaskClass::DisplayCritical);
+        for (auto &ap : angles) {
+            Angle *a = ap.get();
+            group.run([this, a, &slot, timeline_frame] {
+                update_angle(*a, timeline_frame);
+                cv::Mat dst = slot.image(a->rect);
+                a->tile.copyTo(dst);
+            });
+        }
+    }
+    const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    ++ticks;
+    tick_ms_total += ms;
+    tick_ms_max = max(tick_ms_max, ms);
+    bool live = false;
+    for (auto &a : angles) {
+        serial_ms_total += a->decode_ms;
+        live = live || !a->ended;
+    }
+    slot.frame_number = timeline_frame;
+    slot.pts = frame_number_to_stream_ts(timeline_frame, angles.front()->player.video_stream);
+    slot.proxy = false;
+    return live;
+}
+
+void MultiAnglePipeline::publish_back(bool paced, chrono::steady_clock::time_point deadline) {
+    PresentFrame &slot = frames.write_slot();
+    slot.seq = ++next_seq;
+    slot.paced = paced;
+    slot.deadline = paced ? deadline : chrono::steady_clock::now();
+    slot.speed = speed;
+    shown_frame = slot.frame_number;
+    frames.publish();
+    {
+        lock_guard<mutex> lk(frame_mtx);
+        published_seq.store(slot.seq);
+    }
+    frame_cv.notify_all();
+}
+
+bool MultiAnglePipeline::wait_for_frame(chrono::milliseconds timeout) {
+    const uint64_t shown = frames.read_slot().seq;
+    unique_lock<mutex> lk(frame_mtx);
+    return frame_cv.wait_for(lk, timeout, [&] { return published_seq.load() != shown; });
+}
+
+bool MultiAnglePipeline::start(int64_t first_frame) {
+    if (!decode_into_back(first_frame)) return false;
+    publish_back();
+    thread = std::thread([this] { decode_loop(); });
+    return true;
+}
+
+void MultiAnglePipeline::stop() {
+    {
+        lock_guard<mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void MultiAnglePipeline::post(PlaybackCommand cmd) {
+    {
+        lock_guard<mutex> lk(mtx);
+        commands.push_back(cmd);
+    }
+    cv.notify_all();
+}
+
+void MultiAnglePipeline::handle(const PlaybackCommand &cmd, bool &have_pending) {
+    const int64_t distance = max<int64_t>(1, cmd.frame);
+    switch (cmd.type) {
+    case PlaybackCommandType::Play:
+        is_playing = true;
+        break;
+    case PlaybackCommandType::Pause:
+        is_playing = false;
+        break;
+    case PlaybackCommandType::Toggle:
+        is_playing = !is_playing;
+        break;
+    case PlaybackCommandType::StepForward:
+        is_playing = false;
+        have_pending = false;
+        if (!decode_into_back(shown_frame + distance)) cout << "Could not decode next frame (maybe EOF)\n";
+        else publish_back();
+        break;
+    case PlaybackCommandType::StepBackward:
+        is_playing = false;
+        have_pending = false;
+        decode_into_back(max<int64_t>(0, shown_frame - distance));
+        publish_back();
+        break;
+    case PlaybackCommandType::Seek:
+        have_pending = false;
+        clock_reset = true;
+        decode_into_back(max<int64_t>(0, cmd.frame));
+        publish_back();
+        break;
+    case PlaybackCommandType::SetSpeed:
+        speed = clamp(cmd.speed, 0.05, 16.0);
+        clock_reset = true;
+        break;
+    case PlaybackCommandType::SetLoop:
+        loop = cmd.loop;
+        loop_in = max<int64_t>(0, cmd.loop_in);
+        loop_out = cmd.loop_out >= loop_in ? cmd.loop_out : -1;
+        break;
+    }
+}
+
+// Next timeline frame, wrapping to loop_in at the loop end or when every
+// angle has ended, as PlaybackPipeline does for a single file.
+bool MultiAnglePipeline::decode_next_in_range() {
+    const int64_t next = shown_frame + 1;
+    if (loop && loop_out >= 0 && next > loop_out) return decode_into_back(loop_in);
+    return decode_into_back(next) || (loop && decode_into_back(loop_in));
+}
+
+void MultiAnglePipeline::decode_loop() {
+    using Clock = chrono::steady_clock;
+    apply_thread_policy(ThreadRole::Decode);
+
+    auto frame_period = [this] {
+        return chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / (timeline_fps * speed)));
+    };
+    Clock::time_point deadline = Clock::now();
+    bool have_pending = false;
+    bool was_playing = false;
+
+    while (true) {
+        PlaybackCommand cmd{PlaybackCommandType::Pause};
+        bool got = false;
+        {
+            unique_lock<mutex> lk(mtx);
+            auto woken = [this] { return quit || !commands.empty(); };
+            if (!is_playing) cv.wait(lk, woken);
+            else if (have_pending) cv.wait_until(lk, deadline, woken);
+            if (quit) break;
+            if (!commands.empty()) {
+                cmd = commands.front();
+                commands.pop_front();
+                got = true;
+            }
+        }
+        if (got) {
+            handle(cmd, have_pending);
+            if (!is_playing) was_playing = false;
+            continue;
+        }
+        if (!is_playing) continue;
+
+        const Clock::time_point now = Clock::now();
+        const Clock::duration period = frame_period();
+        if (!was_playing || clock_reset) {
+            deadline = now + period;
+            was_playing = true;
+            clock_reset = false;
+        }
+        if (!have_pending) {
+            if (!decode_next_in_range()) {
+                cout << "End of all angles reached\n";
+                is_playing = false;
+                was_playing = false;
+                continue;
+            }
+            have_pending = true;
+            continue;
+        }
+        if (now < deadline) continue;
+
+        publish_back(true, deadline);
+        have_pending = false;
+        if (now > deadline + period) ++late;
+        deadline += period;
+        if (deadline + period < now) deadline = now + period;
+    }
+}
+
+void MultiAnglePipeline::print_stats(ostream &os) const {
+    if (!ticks) return;
+    const double n = static_cast<double>(ticks);
+    os << "Angles: " << angles.size() << ", " << ticks << " timeline frames, " << tick_ms_total / n << " ms mean / " << tick_ms_max
+       << " ms max per frame (" << serial_ms_total / n << " ms if decoded one angle after another), " << late
+       << " frames shown late\n";
+}
+
+int run_multi_angle(const vector<AngleSource> &sources, const string &present_backend, bool print_stats,
+                    ProgramRecorder *recorder) {
+    MultiAnglePipeline pipeline(sources);
+    if (!pipeline.open()) return -1;
+    if (recorder && !recorder->open(pipeline.width(), pipeline.height(), pipeline.fps())) return -1;
+
+    unique_ptr<Presenter> presenter = make_presenter(present_backend, "vMix AVI Player - angles (q to quit)", pipeline.width(),
+                                                     pipeline.height());
+    if (!pipeline.start(0)) {
+        cerr << "Could not decode the first frame of any angle\n";
+        return -1;
+    }
+
+    bool should_quit = false;
+    while (!should_quit) {
+        if (pipeline.acquire()) {
+            const PresentFrame &f = pipeline.front();
+            presenter->present(f.image);
+            if (recorder) recorder->submit(f.image, f.paced ? f.deadline : chrono::steady_clock::now());
+        }
+        int key = presenter->poll_key(1);
+        if (key == -1) {
+            if (!pipeline.playing()) pipeline.wait_for_frame(chrono::milliseconds(9));
+            continue;
+        }
+        char c = static_cast<char>(key & 0xFF);
+        if (key == 27 || c == 'q') should_quit = true;
+        else if (c == ' ') { pipeline.post({PlaybackCommandType::Toggle}); cout << "Play/Pause\n"; }
+        else if (c == 'n' || key == 83) pipeline.post({PlaybackCommandType::StepForward});
+        else if (c == 'b' || key == 81) pipeline.post({PlaybackCommandType::StepBackward});
+        else if (c == 's') { pipeline.post({PlaybackCommandType::Play}); cout << "Play\n"; }
+        else if (c == 'p') { pipeline.post({PlaybackCommandType::Pause}); cout << "Pause\n"; }
+    }
+
+    pipeline.stop();
+    presenter.reset();
+    if (recorder) recorder->close();
+    if (print_stats) {
+        TaskScheduler::global().print_stats(cout);
+        pipeline.print_stats(cout);
+        if (recorder) recorder->print_stats(cout);
+    }
+    return 0;
+}
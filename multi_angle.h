@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "ff_player.h"
+#include "frame_index.h"
+#include "playback_pipeline.h"
+#include "task_scheduler.h"
+#include "triple_buffer.h"
+
+class ProgramRecorder;
+
+struct AngleSource {
+    std::string path;
+    double offset = 0.0; // position in this file, in seconds, at timeline 0
+};
+
+// Several camera angles of the same event on one timeline. The timeline runs
+// in frames of the first angle; every angle maps a timeline frame to its own
+// frame through its offset and frame rate. Each timeline frame is decoded on
+// all angles at once, one DisplayCritical task per angle, and every angle is
+// scaled straight from its decoder's planes into its tile of a mosaic, so a
+// step costs about the slowest angle's decode rather than the sum. Pacing
+// and the triple-buffer hand-off work as in PlaybackPipeline.
+class MultiAnglePipeline {
+public:
+    explicit MultiAnglePipeline(std::vector<AngleSource> sources, TaskScheduler &sched = TaskScheduler::global());
+    ~MultiAnglePipeline();
+    MultiAnglePipeline(const MultiAnglePipeline &) = delete;
+    MultiAnglePipeline &operator=(const MultiAnglePipeline &) = delete;
+
+    // Opens and indexes every angle in parallel and lays out the tiles in a
+    // mosaic of about width x height (0 = size of the first angle).
+    bool open(int width = 0, int height = 0);
+    int width() const { return mosaic_w; }
+    int height() const { return mosaic_h; }
+    double fps() const { return timeline_fps; }
+
+    // Decodes and publishes `first_frame` on the calling thread, then starts
+    // the decode thread.
+    bool start(int64_t first_frame);
+    void stop();
+
+    // Same commands as PlaybackPipeline; frames, including the loop range,
+    // are timeline frames.
+    void post(PlaybackCommand cmd);
+    bool playing() const { return is_playing.load(); }
+
+    bool acquire() { return frames.acquire(); }
+    PresentFrame &front() { return frames.read_slot(); }
+    bool wait_for_frame(std::chrono::milliseconds timeout);
+
+    void print_stats(std::ostream &os) const;
+
+private:
+    struct Angle {
+        AngleSource source;
+        FFPlayer player;
+        FrameIndex index;
+        SwsContext *sws = nullptr;
+        cv::Mat tile;
+        cv::Rect rect;
+        int64_t shown = -1; // frame of this file in `tile`, -1 = blank
+        bool ended = false;
+        double decode_ms = 0.0; // this tick
+    };
+
+    void update_angle(Angle &a, int64_t timeline_frame);
+    bool decode_into_back(int64_t timeline_frame);
+    bool decode_next_in_range();
+    void publish_back(bool paced = false, std::chrono::steady_clock::time_point deadline = {});
+    void handle(const PlaybackCommand &cmd, bool &have_pending);
+    void decode_loop();
+
+    TaskScheduler &sched;
+    std::vector<std::unique_ptr<Angle>> angles;
+    int mosaic_w = 0;
+    int mosaic_h = 0;
+    double timeline_fps = 25.0;
+
+    TripleBuffer<PresentFrame> frames;
+    uint64_t next_seq = 0;
+    int64_t shown_frame = 0;
+
+    // Decode thread only.
+    double speed = 1.0;
+    bool loop = false;
+    int64_t loop_in = 0;
+    int64_t loop_out = -1;
+    bool clock_reset = false;
+    uint64_t ticks = 0;
+    uint64_t late = 0;
+    double tick_ms_total = 0.0;
+    double tick_ms_max = 0.0;
+    double serial_ms_total = 0.0; // sum of per-angle decode times
+
+    std::mutex frame_mtx;
+    std::condition_variable frame_cv;
+    std::atomic<uint64_t> published_seq{0};
+
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<PlaybackCommand> commands;
+    std::atomic<bool> is_playing{false};
+    bool quit = false;
+};
+
+// "FILE" or "FILE@SECS".
+bool parse_angle(const std::string &text, AngleSource &out);
+
+// --angle: plays the angles in one tiled window with the usual keys.
+// `recorder`, if given, is opened at the mosaic's size and records it.
+int run_multi_angle(const std::vector<AngleSource> &sources, const std::string &present_backend, bool print_stats,
+                    ProgramRecorder *recorder = nullptr);
@@ -0,0 +1,100 @@
+#include "pixel_kernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+using namespace std;
+
+void normalise_plane(const uint8_t *__restrict src, float *__restrict dst, size_t n, float scale, float bias) {
+    for (size_t i = 0; i < n; ++i) dst[i] = static_cast<float>(src[i]) * scale + bias;
+}
+
+void normalise_packed(const uint8_t *__restrict src, float *__restrict dst, size_t n, const float *scale, const float *bias) {
+    // Loaded once: scale and bias may alias dst as far as the compiler knows.
+    const float sr = scale[0], sg = scale[1], sb = scale[2];
+    const float br = bias[0], bg = bias[1], bb = bias[2];
+    for (size_t i = 0; i < n; ++i) {
+        dst[3 * i + 0] = static_cast<float>(src[3 * i + 0]) * sr + br;
+        dst[3 * i + 1] = static_cast<float>(src[3 * i + 1]) * sg + bg;
+        dst[3 * i + 2] = static_cast<float>(src[3 * i + 2]) * sb + bb;
+    }
+}
+
+// BGRA pixels as little-endian 32-bit words: B in bits 0-7, alpha in 24-31.
+static_assert(endian::native == endian::little, "pixel kernels assume little-endian BGRA words");
+
+static inline uint32_t load_pixel(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline void store_pixel(uint8_t *p, uint32_t v) {
+    memcpy(p, &v, 4);
+}
+
+// Two channels held in bits 0-7 and 16-23, each times m / 255 with exact
+// rounding. Each product stays within its 16-bit half.
+static inline uint32_t mul_pair(uint32_t pair, uint32_t m) {
+    const uint32_t x = pair * m + 0x00800080u;
+    return ((x + ((x >> 8) & 0x00FF00FFu)) >> 8) & 0x00FF00FFu;
+}
+
+void premultiply_row(uint8_t *__restrict px, int n, uint8_t &min_a, uint8_t &max_a) {
+    uint8_t lo = 255, hi = 0;
+    for (int i = 0; i < n; ++i) {
+        const uint8_t a = px[4 * i + 3];
+        lo = min(lo, a);
+        hi = max(hi, a);
+    }
+    min_a = lo;
+    max_a = hi;
+    if (lo == 255 || hi == 0) return;
+    for (int i = 0; i < n; ++i) {
+        const uint32_t p = load_pixel(px + 4 * i);
+        const uint32_t a = p >> 24;
+        const uint32_t br = mul_pair(p & 0x00FF00FFu, a);
+        const uint32_t g = mul_pair((p >> 8) & 0xFFu, a);
+        store_pixel(px + 4 * i, (p & 0xFF000000u) | br | (g << 8));
+    }
+}
+
+void blend_row(const uint8_t *__restrict src, uint8_t *__restrict dst, int n) {
+    for (int i = 0; i < n; ++i) {
+        const uint32_t s = load_pixel(src + 4 * i);
+        const uint32_t d = load_pixel(dst + 4 * i);
+        const uint32_t inv = 255u - (s >> 24);
+        const uint32_t br = mul_pair(d & 0x00FF00FFu, inv);
+        const uint32_t ga = mul_pair((d >> 8) & 0x00FF00FFu, inv);
+        // No carries between channels: src <= alpha for premultiplied pixels.
+        store_pixel(dst + 4 * i, s + (br | (ga << 8)));
+    }
+}
+
+void mix_row(const uint8_t *__restrict a, const uint8_t *__restrict b, uint8_t *__restrict dst, int n, unsigned w) {
+    const unsigned iw = 256 - w;
+    for (int i = 0; i < n; ++i) dst[i] = static_cast<uint8_t>((a[i] * iw + b[i] * w + 128) >> 8);
+}
+
+void fade_row(const uint8_t *__restrict src, uint8_t *__restrict dst, int n, unsigned w, unsigned black) {
+    const unsigned base = black * (256 - w) + 128;
+    for (int i = 0; i < n; ++i) dst[i] = static_cast<uint8_t>((src[i] * w + base) >> 8);
+}
+
+void average_row(const uint8_t *__restrict a, const uint8_t *__restrict b, uint8_t *__restrict dst, int n) {
+    for (int i = 0; i < n; ++i) dst[i] = static_cast<uint8_t>((a[i] + b[i] + 1) >> 1);
+}
+
+void bob_rows(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height, int keep, int r0, int r1) {
+    for (int r = r0; r < r1; ++r) {
+        uint8_t *d = dst + static_cast<ptrdiff_t>(r) * dst_stride;
+        const int above = r > 0 ? r - 1 : r + 1;
+        const int below = r + 1 < height ? r + 1 : r - 1;
+        if ((r & 1) == keep || above >= height) {
+            memcpy(d, src + static_cast<ptrdiff_t>(r) * src_stride, static_cast<size_t>(width));
+            continue;
+        }
+        average_row(src + static_cast<ptrdiff_t>(above) * src_stride, src + static_cast<ptrdiff_t>(below) * src_stride, d, width);
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Row kernels of the frame stages, in their own translation unit so that
+// their code generation can be checked on its own: configure with
+// -DVMIX_VEC_REPORT=ON to get the compiler's report of which loops it
+// vectorised (GCC and Clang print one line per loop, MSVC per function).
+// Each loop has a trip count known at entry, no branches, and __restrict
+// pointers, which is what the vectorisers need. That takes the Release
+// build (-O3 for GCC and Clang, /O2 for MSVC): GCC 12 at -O2 vectorises
+// none of them.
+
+// Tensor extraction: dst[i] = src[i] * scale + bias. The bytes widen to
+// float four lanes at a time.
+void normalise_plane(const uint8_t *__restrict src, float *__restrict dst, size_t n, float scale, float bias);
+
+// Tensor extraction, NHWC: n packed RGB pixels to n * 3 floats, with a scale
+// and bias per channel. Loads and stores advance by the same three elements
+// per pixel, so the vectoriser treats the channels as one group. A planar
+// source written interleaved would not vectorise.
+void normalise_packed(const uint8_t *__restrict src, float *__restrict dst, size_t n, const float *scale, const float *bias);
+
+// Layer compositing, on BGRA rows of n pixels. Both kernels work on whole
+// pixels as 32-bit words, two channels per 16-bit pair, so each lane of a
+// vector is one pixel and no byte shuffles are needed; multiplying channels
+// by a per-pixel alpha byte by byte would need them, and without SSSE3 the
+// vectorised byte form was no faster than scalar code.
+
+// Premultiplies colour by alpha in place, exactly (x * a / 255 rounded),
+// and returns the row's lowest and highest alpha; a row that is fully opaque
+// or fully transparent is left as it is. The min/max pass is a vector
+// reduction.
+void premultiply_row(uint8_t *__restrict px, int n, uint8_t &min_a, uint8_t &max_a);
+
+// Premultiplied "over" of a BGRA row onto another, alpha included:
+// dst = src + dst * (255 - src_alpha) / 255. `src` must be premultiplied.
+void blend_row(const uint8_t *__restrict src, uint8_t *__restrict dst, int n);
+
+// Transitions, on one plane row of n samples; weights are 0..256.
+// dst = (a * (256 - w) + b * w + 128) >> 8. The sum never exceeds 16 bits,
+// so the vectoriser narrows the arithmetic to 16-bit lanes, eight samples
+// per multiply.
+void mix_row(const uint8_t *__restrict a, const uint8_t *__restrict b, uint8_t *__restrict dst, int n, unsigned w);
+
+// dst = (src * w + black * (256 - w) + 128) >> 8: src faded towards the
+// plane's black level. One multiply per sample, the rest folded into a
+// constant.
+void fade_row(const uint8_t *__restrict src, uint8_t *__restrict dst, int n, unsigned w, unsigned black);
+
+// Bob deinterlacing, on one plane row of n samples: dst = (a + b + 1) >> 1,
+// the mean of the kept-field rows above and below. That is exactly a
+// rounding byte average, which GCC and Clang emit as one pavgb (SSE2) or
+// urhadd (NEON) per 16 samples, with no widening.
+void average_row(const uint8_t *__restrict a, const uint8_t *__restrict b, uint8_t *__restrict dst, int n);
+
+// Rows [r0, r1) of a bobbed plane of width x height samples: rows of field
+// `keep` (0 top, 1 bottom) are copied, the others are average_row() of the
+// kept rows above and below, or a copy of the nearest one at the edges.
+// Bands of rows can run in parallel; each row only reads `src`.
+void bob_rows(const uint8_t *src, int src_stride, uint8_t *dst, int dst_stride, int width, int height, int keep, int r0, int r1);
@@ -0,0 +1,312 @@
+#include "playback_pipeline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+#include "tail_follow.h"
+#include "thread_policy.h"
+
+using namespace std;
+
+bool PlaybackPipeline::decode_into_back(bool seek, int64_t target) {
+    unique_ptr<AVFrame, AVFrameDeleter> f = seek ? seek_and_decode_frame(player, target) : decode_next_frame(player);
+    if (!f) return false;
+    PresentFrame &slot = frames.write_slot();
+    slot.pts = player.last_shown_pts;
+    slot.frame_number = pts_to_frame_number(player.last_shown_pts, player.video_stream);
+    bool draft = false;
+    AVFrame *out = frame_stage ? frame_stage(f.get(), slot.frame_number, draft, [this] { return peek_next_frame(); }) : f.get();
+    convert_frame_into(out ? out : f.get(), player, slot.image);
+    slot.proxy = draft;
+    if (frame_filter) frame_filter(slot);
+    return true;
+}
+
+// Lookahead for the frame stage: the next frame is decoded into the
+// player's primed queue, where the next decode_next_frame() takes it.
+AVFrame *PlaybackPipeline::peek_next_frame() {
+    if (player.primed.empty()) {
+        // Priming resets last_shown_pts, which the current slot has taken already.
+        const int64_t shown = player.last_shown_pts;
+        prime_frames(player, 1);
+        player.last_shown_pts = shown;
+    }
+    return player.primed.empty() ? nullptr : player.primed.front().get();
+}
+
+// The proxy is frame-aligned with the source, so its frame n stands in for
+// frame n, scaled up into the slot at the source size and format.
+bool PlaybackPipeline::decode_proxy_into_back(int64_t target) {
+    if (!proxy && proxy_source) {
+        proxy = proxy_source();
+        if (proxy) proxy->out_fmt = player.out_fmt;
+    }
+    if (!proxy) return false;
+    unique_ptr<AVFrame, AVFrameDeleter> f = seek_and_decode_frame(*proxy, target);
+    if (!f) return false;
+    PresentFrame &slot = frames.write_slot();
+    convert_frame_into(f.get(), *proxy, proxy_image);
+    cv::resize(proxy_image, slot.image, cv::Size(player.dec_ctx->width, player.dec_ctx->height), 0, 0, cv::INTER_LINEAR);
+    slot.frame_number = pts_to_frame_number(proxy->last_shown_pts, proxy->video_stream);
+    slot.pts = frame_number_to_stream_ts(slot.frame_number, player.video_stream);
+    slot.proxy = true;
+    if (frame_filter) frame_filter(slot);
+    return true;
+}
+
+// Seeks while paused go to the proxy when there is one.
+bool PlaybackPipeline::decode_scrub(int64_t target) {
+    if (!is_playing && decode_proxy_into_back(target)) return true;
+    return decode_into_back(true, target);
+}
+
+// Growing files: new keyframes become seekable and the target is kept
+// within what has been written.
+int64_t PlaybackPipeline::follow_target(int64_t target) {
+    if (!follower) return target;
+    follower->sync(player);
+    return min(target, max<int64_t>(0, follower->live_edge()));
+}
+
+void PlaybackPipeline::publish_back(bool paced, chrono::steady_clock::time_point deadline) {
+    PresentFrame &slot = frames.write_slot();
+    slot.seq = ++next_seq;
+    slot.paced = paced;
+    slot.deadline = paced ? deadline : chrono::steady_clock::now();
+    slot.speed = speed;
+    slot.command_id = tracked_id;
+    slot.command_issued = tracked_issued;
+    tracked_id = 0;
+    shown_frame = slot.frame_number;
+    showing_proxy = slot.proxy;
+    if (showing_proxy) proxy_shown = chrono::steady_clock::now();
+    if (frame_sink) frame_sink(slot);
+    frames.publish();
+    {
+        lock_guard<mutex> lk(frame_mtx);
+        published_seq.store(slot.seq);
+    }
+    frame_cv.notify_all();
+    notify_state();
+}
+
+bool PlaybackPipeline::wait_for_frame(chrono::milliseconds timeout) {
+    const uint64_t shown = frames.read_slot().seq;
+    unique_lock<mutex> lk(frame_mtx);
+    return frame_cv.wait_for(lk, timeout, [&] { return published_seq.load() != shown; });
+}
+
+void PlaybackPipeline::notify_state(const PlaybackCommand *applied) {
+    if (!state_listener) return;
+    PlaybackState st;
+    st.playing = is_playing;
+    st.frame = shown_frame;
+    st.speed = speed;
+    st.loop = loop;
+    st.loop_in = loop_in;
+    st.loop_out = loop_out;
+    if (applied) {
+        st.applied_command = applied->id;
+        st.applied_issued = applied->issued;
+    }
+    state_listener(st);
+}
+
+void PlaybackPipeline::set_surfaces(const vector<cv::Mat> &surfaces) {
+    for (int i = 0; i < 3 && i < static_cast<int>(surfaces.size()); ++i) frames.slot(i).image = surfaces[i];
+}
+
+bool PlaybackPipeline::start(int64_t first_frame) {
+    if (!decode_into_back(true, first_frame)) return false;
+    publish_back();
+    thread = std::thread([this] { decode_loop(); });
+    return true;
+}
+
+void PlaybackPipeline::stop() {
+    {
+        lock_guard<mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    if (thread.joinable()) thread.join();
+}
+
+void PlaybackPipeline::post(PlaybackCommand cmd) {
+    {
+        lock_guard<mutex> lk(mtx);
+        commands.push_back(cmd);
+    }
+    cv.notify_all();
+}
+
+void PlaybackPipeline::handle(const PlaybackCommand &posted, bool &have_pending) {
+    // Resolved against the state left by the commands queued before it.
+    PlaybackCommand cmd = posted;
+    if (cmd.type == PlaybackCommandType::Toggle) cmd.type = is_playing ? PlaybackCommandType::Pause : PlaybackCommandType::Play;
+    // Commands that put a new frame on screen carry their id on that frame.
+    tracked_id = cmd.id;
+    tracked_issued = cmd.issued;
+    const int64_t distance = max<int64_t>(1, cmd.frame);
+    bool produces_frame = true;
+    switch (cmd.type) {
+    case PlaybackCommandType::Play:
+        is_playing = true;
+        // The full-resolution decoder is still where scrubbing started.
+        if (showing_proxy && decode_into_back(true, shown_frame)) publish_back();
+        break;
+    case PlaybackCommandType::Pause:
+    case PlaybackCommandType::Toggle: // resolved above
+        is_playing = false;
+        produces_frame = false;
+        break;
+    case PlaybackCommandType::StepForward:
+        is_playing = false;
+        have_pending = false;
+        if (decode_scrub(follow_target(shown_frame + distance))) {
+            publish_back();
+        } else {
+            cout << "Could not decode next frame (maybe EOF)\n";
+            produces_frame = false;
+        }
+        break;
+    case PlaybackCommandType::StepBackward:
+        is_playing = false;
+        have_pending = false;
+        if (decode_scrub(max<int64_t>(0, shown_frame - distance))) {
+            publish_back();
+        } else {
+            cout << "Could not decode backward frame\n";
+            produces_frame = false;
+        }
+        break;
+    case PlaybackCommandType::Seek:
+        have_pending = false;
+        clock_reset = true;
+        if (decode_scrub(follow_target(max<int64_t>(0, cmd.frame)))) {
+            publish_back();
+        } else {
+            cout << "Could not seek to frame " << cmd.frame << '\n';
+            produces_frame = false;
+        }
+        break;
+    case PlaybackCommandType::SetSpeed:
+        speed = clamp(cmd.speed, 0.05, 16.0);
+        clock_reset = true;
+        produces_frame = false;
+        break;
+    case PlaybackCommandType::SetLoop:
+        loop = cmd.loop;
+        loop_in = max<int64_t>(0, cmd.loop_in);
+        loop_out = cmd.loop_out >= loop_in ? cmd.loop_out : -1;
+        produces_frame = false;
+        break;
+    }
+    // Steps and seeks have published by now (or failed, and complete with the
+    // unchanged state); only Play waits for a later frame.
+    if (cmd.type != PlaybackCommandType::Play) tracked_id = 0;
+    if (!produces_frame) notify_state(&cmd);
+    else if (cmd.type == PlaybackCommandType::Play) notify_state();
+}
+
+// Next frame in playback order, wrapping to loop_in at the loop end or EOF,
+// or moving on to the next playlist item.
+bool PlaybackPipeline::decode_next_in_range() {
+    bool ok = decode_into_back(false, 0);
+    if (ok && loop && loop_out >= 0 && frames.write_slot().frame_number > loop_out) ok = false;
+    if (!ok && loop) ok = decode_into_back(true, loop_in);
+    if (!ok && !loop && next_item && next_item(player)) ok = decode_into_back(false, 0);
+    return ok;
+}
+
+void PlaybackPipeline::decode_loop() {
+    using Clock = chrono::steady_clock;
+    apply_thread_policy(ThreadRole::Decode);
+
+    auto frame_period = [this] {
+        return chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / (max(1.0, player.fps) * speed)));
+    };
+    Clock::time_point deadline = Clock::now();
+    // The back slot holds a decoded frame that is waiting for its deadline.
+    bool have_pending = false;
+    bool was_playing = false;
+
+    while (true) {
+        PlaybackCommand cmd{PlaybackCommandType::Pause};
+        bool got = false;
+        {
+            unique_lock<mutex> lk(mtx);
+            auto woken = [this] { return quit || !commands.empty(); };
+            if (!is_playing && showing_proxy) cv.wait_until(lk, proxy_shown + proxy_settle, woken);
+            else if (!is_playing) cv.wait(lk, woken);
+            else if (have_pending) cv.wait_until(lk, deadline, woken);
+            else if (at_live_edge) cv.wait_for(lk, chrono::milliseconds(20), woken);
+            if (quit) break;
+            if (!commands.empty()) {
+                cmd = commands.front();
+                commands.pop_front();
+                got = true;
+            }
+        }
+        if (got) {
+            handle(cmd, have_pending);
+            if (!is_playing) was_playing = false;
+            continue;
+        }
+        if (!is_playing) {
+            // Scrubbing stopped: replace the proxy frame with the real one.
+            if (showing_proxy && Clock::now() >= proxy_shown + proxy_settle) {
+                if (decode_into_back(true, shown_frame)) publish_back();
+                else showing_proxy = false;
+            }
+            continue;
+        }
+
+        const Clock::time_point now = Clock::now();
+        const Clock::duration period = frame_period();
+        if (!was_playing || clock_reset) {
+            // Resuming, seeking or changing speed: the next frame is due one period from now.
+            deadline = now + period;
+            was_playing = true;
+            clock_reset = false;
+        }
+        if (!have_pending) {
+            // Following a recording: hold at the playable edge, and treat
+            // running out of data as "not written yet" rather than EOF.
+            const bool live = follower && follower->growing();
+            player.hold_at_eof = live;
+            at_live_edge = live && shown_frame >= follower->playable_edge();
+            bool ok = false;
+            if (!at_live_edge) {
+                ok = decode_next_in_range();
+                if (!ok && follower) {
+                    follower->sync(player);
+                    ok = decode_next_in_range();
+                    at_live_edge = !ok && live;
+                }
+            }
+            if (at_live_edge) {
+                clock_reset = true;
+                continue;
+            }
+            if (!ok) {
+                cout << "End of file reached\n";
+                is_playing = false;
+                was_playing = false;
+                tracked_id = 0;
+                notify_state();
+                continue;
+            }
+            have_pending = true;
+            continue;
+        }
+        if (now < deadline) continue;
+
+        publish_back(true, deadline);
+        have_pending = false;
+        deadline += period;
+        // Do not try to catch up on a backlog after a stall.
+        if (deadline + period < now) deadline = now + period;
+    }
+}
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "ff_player.h"
+#include "triple_buffer.h"
+
+class TailFollower;
+
+struct PresentFrame {
+    cv::Mat image;
+    int64_t frame_number = 0;
+    int64_t pts = AV_NOPTS_VALUE;
+    uint64_t seq = 0;
+    // Set for frames released by playback pacing; deadline is when the frame
+    // was due on screen. Pacing is a fixed 1 / (fps * speed) cadence from the
+    // wall-clock moment playback (re)started, not the frame's PTS, so
+    // variable-frame-rate sources play at their nominal rate.
+    bool paced = false;
+    std::chrono::steady_clock::time_point deadline{};
+    double speed = 1.0; // playback speed the deadline was paced at
+    // First frame produced by a command that asked for latency tracking
+    // (see PlaybackCommand::id), 0 otherwise.
+    uint64_t command_id = 0;
+    std::chrono::steady_clock::time_point command_issued{};
+    bool proxy = false; // upscaled from the scrub proxy or a draft of the frame stage, the final frame follows
+};
+
+enum class PlaybackCommandType {
+    Play,
+    Pause,
+    Toggle,    // Play or Pause, decided on the decode thread when it is applied
+    StepForward,
+    StepBackward,
+    Seek,
+    SetSpeed,
+    SetLoop,
+};
+
+struct PlaybackCommand {
+    PlaybackCommandType type;
+    int64_t frame = 0;     // Seek target; distance for steps (0 = one frame)
+    double speed = 1.0;    // SetSpeed
+    bool loop = false;     // SetLoop, playing [loop_in, loop_out] repeatedly
+    int64_t loop_in = 0;
+    int64_t loop_out = -1; // -1 = end of file
+    // Non-zero ids are echoed on the first frame the command produces, or in
+    // PlaybackState::applied_command for commands that produce none.
+    uint64_t id = 0;
+    std::chrono::steady_clock::time_point issued{};
+};
+
+// Snapshot passed to the state listener on the decode thread.
+struct PlaybackState {
+    bool playing = false;
+    int64_t frame = 0;
+    double speed = 1.0;
+    bool loop = false;
+    int64_t loop_in = 0;
+    int64_t loop_out = -1;
+    uint64_t applied_command = 0; // tracked command applied without a new frame
+    std::chrono::steady_clock::time_point applied_issued{};
+};
+
+// Owns the decode thread. Decoding, conversion and pacing happen there; the
+// newest converted frame is handed to the display thread through a triple
+// buffer so neither side ever blocks on the other.
+class PlaybackPipeline {
+public:
+    explicit PlaybackPipeline(FFPlayer &player) : player(player) {}
+    ~PlaybackPipeline() { stop(); }
+
+    // Decodes and publishes `first_frame` on the calling thread, then starts
+    // the decode thread. Returns false if that frame cannot be decoded.
+    bool start(int64_t first_frame);
+    void stop();
+
+    // Optional presenter-owned memory for the three slots; call before start().
+    void set_surfaces(const std::vector<cv::Mat> &surfaces);
+
+    // Called on the decode thread with every decoded frame of the main
+    // player and its frame number before conversion. Returns the frame to
+    // convert instead, owned by the stage and valid until its next call, or
+    // `frame` itself. A stage that sets `draft` gets the frame again, like a
+    // proxy frame, once scrubbing has settled. `next` returns the frame that
+    // follows, decoded ahead and shown next, or nullptr at the end of the
+    // file (or of what a growing file has written so far); the stage must
+    // not modify it. Call before start().
+    using FrameStage = std::function<AVFrame *(AVFrame *frame, int64_t frame_number, bool &draft, const std::function<AVFrame *()> &next)>;
+    void set_frame_stage(FrameStage stage) { frame_stage = std::move(stage); }
+
+    // Called on the decode thread with every newly decoded frame, before
+    // pacing, to modify the image in place (e.g. compositing). Call before start().
+    void set_frame_filter(std::function<void(PresentFrame &)> filter) { frame_filter = std::move(filter); }
+
+    // Called on the decode thread with every frame just before it is handed
+    // to the display, e.g. to export it. Must not keep the image; call before start().
+    void set_frame_sink(std::function<void(const PresentFrame &)> sink) { frame_sink = std::move(sink); }
+
+    // Called on the decode thread after every command and every new frame.
+    // Call before start().
+    void set_state_listener(std::function<void(const PlaybackState &)> listener) { state_listener = std::move(listener); }
+
+    // Scrubbing proxy (see proxy.h). While paused, seeks and steps show the
+    // proxy frame first and replace it with the full-resolution frame once no
+    // command arrived for `settle`. `source` is polled on the decode thread
+    // until it returns a player. Call before start().
+    void set_proxy_source(std::function<std::unique_ptr<FFPlayer>()> source,
+                          std::chrono::milliseconds settle = std::chrono::milliseconds(150)) {
+        proxy_source = std::move(source);
+        proxy_settle = settle;
+    }
+
+    // Growing file (see tail_follow.h): playback holds at the follower's
+    // playable edge instead of stopping at the end, and seeks reach everything
+    // written so far. Call before start().
+    void set_tail_follower(TailFollower *follower) { this->follower = follower; }
+
+    // Called on the decode thread at the end of the file (outside loop mode);
+    // returning true means `player` now holds the next file and playback
+    // continues with its first frame, paced as if nothing changed. Call
+    // before start().
+    void set_next_item(std::function<bool(FFPlayer &)> advance) { next_item = std::move(advance); }
+
+    void post(PlaybackCommand cmd);
+    bool playing() const { return is_playing.load(); }
+
+    // Display side: true if a newer frame than front() is available.
+    bool acquire() { return frames.acquire(); }
+    PresentFrame &front() { return frames.read_slot(); }
+    // Display side: waits up to `timeout` for a frame newer than front().
+    bool wait_for_frame(std::chrono::milliseconds timeout);
+
+private:
+    bool decode_into_back(bool seek, int64_t target);
+    bool decode_proxy_into_back(int64_t target);
+    bool decode_scrub(int64_t target);
+    AVFrame *peek_next_frame();
+    int64_t follow_target(int64_t target);
+    void decode_loop();
+    void publish_back(bool paced = false, std::chrono::steady_clock::time_point deadline = {});
+    void handle(const PlaybackCommand &cmd, bool &have_pending);
+    bool decode_next_in_range();
+    void notify_state(const PlaybackCommand *applied = nullptr);
+
+    FFPlayer &player;
+    TripleBuffer<PresentFrame> frames;
+    FrameStage frame_stage;
+    std::function<void(PresentFrame &)> frame_filter;
+    std::function<void(const PresentFrame &)> frame_sink;
+    std::function<void(const PlaybackState &)> state_listener;
+    uint64_t next_seq = 0;
+    int64_t shown_frame = 0;
+
+    // Decode thread only.
+    double speed = 1.0;
+    bool loop = false;
+    int64_t loop_in = 0;
+    int64_t loop_out = -1;
+    bool clock_reset = false;  // restart pacing from now (after seek or speed change)
+    uint64_t tracked_id = 0;   // command waiting for its first frame
+    std::chrono::steady_clock::time_point tracked_issued{};
+    std::function<std::unique_ptr<FFPlayer>()> proxy_source;
+    std::unique_ptr<FFPlayer> proxy;
+    cv::Mat proxy_image;
+    std::chrono::milliseconds proxy_settle{150};
+    bool showing_proxy = false;
+    TailFollower *follower = nullptr;
+    std::function<bool(FFPlayer &)> next_item;
+    bool at_live_edge = false; // playing, waiting for the recording to grow
+    std::chrono::steady_clock::time_point proxy_shown{};
+
+    std::mutex frame_mtx;
+    std::condition_variable frame_cv;
+    std::atomic<uint64_t> published_seq{0};
+
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<PlaybackCommand> commands;
+    std::atomic<bool> is_playing{false};
+    bool quit = false;
+};
@@ -0,0 +1,334 @@
+#include "player_options.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+#include "thread_policy.h"
+
+using namespace std;
+
+void print_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " [options] <input.avi>\n"
+         << "  --stats                  print task scheduler statistics on exit\n"
+         << "  --affinity ROLE=CPUS     pin a role to CPUs, e.g. decode=0-3,8\n"
+         << "  --nice ROLE=N            set the nice value of a role\n"
+         << "  --fifo ROLE=PRIO         request SCHED_FIFO for a role (needs permission)\n"
+         << "  --bench-jitter [SECS]    measure frame wake-up jitter with and without pinning\n"
+         << "  --fetch FRAMES           decode a frame list (e.g. 0,100,200-210) concurrently and exit\n"
+         << "  --decoders N             decoder instances per file for --fetch\n"
+         << "  --present BACKEND        highgui (default) or xshm (X11 MIT-SHM, no HighGUI copies)\n"
+         << "  --overlay                draw late/repeated/dropped frame and judder counters\n"
+         << "  --present-log FILE       write a CSV of present times against PTS deadlines\n"
+         << "  --refresh-hz HZ          display refresh rate for cadence analysis\n"
+         << "  --shm-out NAME           publish every shown frame to a shared-memory ring\n"
+         << "  --shm-slots N            frames kept in the shared-memory ring (default 4)\n"
+         << "  --serve SOCKET           run as a frame-grab daemon on a Unix domain socket\n"
+         << "  --cache-mb N             frame cache of the daemon in MB (default 512)\n"
+         << "  --max-files N            files the daemon keeps open (default 8)\n"
+         << "  --control SOCKET         accept remote control commands on a Unix domain socket\n"
+         << "  --tensors FRAMES         export frames (e.g. 0-9999) as batched model input tensors and exit\n"
+         << "  --tensor-stride N        keep every Nth frame of the --tensors list\n"
+         << "  --tensor-size WxH        model input size (default 224x224)\n"
+         << "  --tensor-layout L        nchw (default) or nhwc\n"
+         << "  --tensor-type T          float32 (default) or uint8\n"
+         << "  --tensor-norm N          imagenet (default), unit (0..1) or none (0..255)\n"
+         << "  --batch N                frames per batch for --tensors and --load (default 32)\n"
+         << "  --tensor-out PATH        directory for .npy batches, or shm:NAME (default tensors)\n"
+         << "  --sample FRAMES          decode a sparse frame list one GOP at a time and exit\n"
+         << "  --sample-stride N        sample every Nth frame of the file\n"
+         << "  --sample-every SECS      sample one frame every SECS seconds\n"
+         << "  --sample-out DIR         write sampled frames as JPEGs to DIR\n"
+         << "  --export FRAMES          export a frame range (e.g. 0-17999) as images using all cores and exit\n"
+         << "  --export-format F        png (default) or jpg\n"
+         << "  --export-out DIR         directory for exported images (default frames)\n"
+         << "  --clip IN-OUT            cut frames IN..OUT, copying whole GOPs and re-encoding the edges, and exit\n"
+         << "  --clip-out FILE          output file of --clip (default clip.avi)\n"
+         << "  --proxy [HEIGHT]         scrub on a low-resolution all-intra proxy built in the background (default 360)\n"
+         << "  --proxy-dir DIR          proxy cache directory (default <temp>/vmix_proxies)\n"
+         << "  --build-proxy            build the proxy and exit\n"
+         << "  --playlist FILE          play the files listed in FILE (one per line) gaplessly\n"
+         << "  --follow [SECS]          follow a file that is still being recorded, SECS behind the live edge (default 1)\n"
+         << "  --probe-size BYTES       limit the bytes read to find stream info before the first frame\n"
+         << "  --analyze-ms MS          limit the stream time analysed to find stream info\n"
+         << "  --sidecar                cache stream info and keyframes in INPUT.vmixidx and reuse them on later opens\n"
+         << "  --angle FILE[@SECS]      add a camera angle starting SECS into FILE; repeat to play several in sync, tiled\n"
+         << "  --layer FILE[@X,Y]       composite FILE (with its alpha channel) over the video at X,Y; repeat for more layers\n"
+         << "  --bench-compositor [SECS] time the layer premultiply and blend kernels on 1080p frames (default 2 s)\n"
+         << "  --transition FILE[@SECS] press t to transition to FILE (SECS into it at the start of the video) and back\n"
+         << "  --transition-type T      mix (default), wipe or fade through black\n"
+         << "  --transition-frames N    transition length in frames (default 25)\n"
+         << "  --bench-transition [SECS] time the transition kernels on 1080p frames (default 3 s)\n"
+         << "  --deinterlace MODE       auto (default: frames flagged interlaced), on or off\n"
+         << "  --bench-deinterlace [SECS] time bwdif and the bob on 1080i frames (default 3 s)\n"
+         << "  --raw-out PATH|-         write every frame as raw video to a FIFO, file or stdout, headless, and exit\n"
+         << "  --raw-format FMT         pixel format for --raw-out (default yuv420p)\n"
+         << "  --raw-size WxH           scale --raw-out frames (0 keeps the aspect ratio, default source size)\n"
+         << "  --record FILE            record what is shown (composited, angles or wall) to FILE on an encoder thread\n"
+         << "  --record-queue N         frames buffered for the encoder before frames are dropped (default 8)\n"
+         << "  --wall LIST              show the files listed in LIST (one per line) as a video wall\n"
+         << "  --wall-grid CxR          tiles per wall page (default all tiles on one page)\n"
+         << "  --bench-wall [SECS]      measure how many wall tiles play in real time per worker count (default 5 s per run)\n"
+         << "  --load LIST              load \"path frame\" lines like a training data loader and exit\n"
+         << "  --load-workers N         loader worker threads (default one per scheduler worker)\n"
+         << "  --seed N                 shuffle the --load list deterministically\n"
+         << "  ROLE is one of decode, display, worker\n";
+}
+
+bool parse_int_list(const string &text, vector<int64_t> &out, size_t max_items) {
+    out.clear();
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        char *end = nullptr;
+        errno = 0;
+        const long long first = strtoll(item.c_str(), &end, 10);
+        if (end == item.c_str() || first < 0 || errno == ERANGE) return false;
+        long long last = first;
+        if (*end == '-') {
+            last = strtoll(end + 1, &end, 10);
+            if (last < first || errno == ERANGE) return false;
+        }
+        if (*end != '\0') return false;
+        if (static_cast<unsigned long long>(last - first) >= max_items - out.size()) return false;
+        for (long long v = first; v <= last; ++v) out.push_back(v);
+    }
+    return !out.empty();
+}
+
+bool parse_player_options(int argc, char *argv[], PlayerOptions &opts) {
+    ThreadPolicies &policies = thread_policies();
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--stats") {
+            opts.print_stats = true;
+        } else if (arg == "--affinity" || arg == "--nice" || arg == "--fifo") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; print_usage(argv[0]); return false; }
+            if (!parse_thread_option(arg, argv[++i], policies)) return false;
+        } else if (arg == "--bench-jitter") {
+            opts.bench_jitter_seconds = 5.0;
+            if (i + 1 < argc && argv[i + 1][0] != '-') opts.bench_jitter_seconds = atof(argv[++i]);
+        } else if (arg == "--fetch") {
+            if (i + 1 >= argc || !parse_int_list(argv[++i], opts.fetch_frames)) {
+                cerr << "--fetch expects a frame list such as 0,10,20-30\n";
+                return false;
+            }
+        } else if (arg == "--decoders") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.decoders = static_cast<size_t>(max(0, atoi(argv[++i])));
+        } else if (arg == "--present") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.present_backend = argv[++i];
+        } else if (arg == "--overlay") {
+            opts.overlay = true;
+        } else if (arg == "--present-log") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.present_log = argv[++i];
+        } else if (arg == "--refresh-hz") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.refresh_hz = atof(argv[++i]);
+        } else if (arg == "--shm-out") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.shm_out = argv[++i];
+        } else if (arg == "--shm-slots") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.shm_slots = max(2, atoi(argv[++i]));
+        } else if (arg == "--serve") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.serve_socket = argv[++i];
+        } else if (arg == "--cache-mb") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.cache_mb = static_cast<size_t>(max(0, atoi(argv[++i])));
+        } else if (arg == "--max-files") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.max_files = static_cast<size_t>(max(1, atoi(argv[++i])));
+        } else if (arg == "--control") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.control_socket = argv[++i];
+        } else if (arg == "--tensors") {
+            if (i + 1 >= argc || !parse_int_list(argv[++i], opts.tensor_frames)) {
+                cerr << "--tensors expects a frame list such as 0-999\n";
+                return false;
+            }
+        } else if (arg == "--tensor-stride") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.tensor_stride = max(1, atoi(argv[++i]));
+        } else if (arg == "--tensor-size") {
+            if (i + 1 >= argc || sscanf(argv[++i], "%dx%d", &opts.tensor_width, &opts.tensor_height) != 2
+                || opts.tensor_width <= 0 || opts.tensor_height <= 0) {
+                cerr << "--tensor-size expects a size such as 224x224\n";
+                return false;
+            }
+        } else if (arg == "--tensor-layout") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.tensor_layout = argv[++i];
+            if (opts.tensor_layout != "nchw" && opts.tensor_layout != "nhwc") { cerr << "--tensor-layout is nchw or nhwc\n"; return false; }
+        } else if (arg == "--tensor-type") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.tensor_type = argv[++i];
+            if (opts.tensor_type != "float32" && opts.tensor_type != "uint8") { cerr << "--tensor-type is float32 or uint8\n"; return false; }
+        } else if (arg == "--tensor-norm") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.tensor_norm = argv[++i];
+        } else if (arg == "--batch") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.tensor_batch = static_cast<size_t>(max(1, atoi(argv[++i])));
+        } else if (arg == "--tensor-out") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.tensor_out = argv[++i];
+        } else if (arg == "--sample") {
+            if (i + 1 >= argc || !parse_int_list(argv[++i], opts.sample_frames)) {
+                cerr << "--sample expects a frame list such as 0,500,1000-1010\n";
+                return false;
+            }
+        } else if (arg == "--sample-stride") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.sample_stride = max(1LL, atoll(argv[++i]));
+        } else if (arg == "--sample-every") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.sample_every = atof(argv[++i]);
+            if (opts.sample_every <= 0.0) { cerr << "--sample-every expects a positive number of seconds\n"; return false; }
+        } else if (arg == "--sample-out") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.sample_out = argv[++i];
+        } else if (arg == "--export") {
+            if (i + 1 >= argc || !parse_int_list(argv[++i], opts.export_frames)) {
+                cerr << "--export expects a frame range such as 0-17999\n";
+                return false;
+            }
+        } else if (arg == "--export-format") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.export_format = argv[++i];
+        } else if (arg == "--export-out") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.export_out = argv[++i];
+        } else if (arg == "--clip") {
+            long long in = -1, out = -1;
+            if (i + 1 >= argc || sscanf(argv[++i], "%lld-%lld", &in, &out) != 2 || in < 0 || out < in) {
+                cerr << "--clip expects a frame range such as 1500-2250\n";
+                return false;
+            }
+            opts.clip_in = in;
+            opts.clip_out = out;
+        } else if (arg == "--clip-out") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.clip_file = argv[++i];
+        } else if (arg == "--proxy") {
+            opts.proxy_height = 360;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atoi(argv[i + 1]) > 0) opts.proxy_height = atoi(argv[++i]);
+        } else if (arg == "--proxy-dir") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.proxy_dir = argv[++i];
+        } else if (arg == "--build-proxy") {
+            opts.build_proxy = true;
+            if (opts.proxy_height <= 0) opts.proxy_height = 360;
+        } else if (arg == "--playlist") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.playlist = argv[++i];
+        } else if (arg == "--follow") {
+            opts.follow_delay = 1.0;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && (isdigit(static_cast<unsigned char>(argv[i + 1][0])) || argv[i + 1][0] == '.'))
+                opts.follow_delay = atof(argv[++i]);
+        } else if (arg == "--probe-size") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.probe_size = max(0LL, atoll(argv[++i]));
+        } else if (arg == "--analyze-ms") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.analyze_ms = max(0LL, atoll(argv[++i]));
+        } else if (arg == "--sidecar") {
+            opts.sidecar = true;
+        } else if (arg == "--angle") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.angles.push_back(argv[++i]);
+        } else if (arg == "--layer") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.layers.push_back(argv[++i]);
+        } else if (arg == "--transition") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.transition_to = argv[++i];
+        } else if (arg == "--transition-type") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.transition_type = argv[++i];
+        } else if (arg == "--transition-frames") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.transition_frames = max(1, atoi(argv[++i]));
+        } else if (arg == "--bench-compositor") {
+            opts.bench_compositor = 2.0;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atof(argv[i + 1]) > 0.0) opts.bench_compositor = atof(argv[++i]);
+        } else if (arg == "--bench-transition") {
+            opts.bench_transition = 3.0;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atof(argv[i + 1]) > 0.0) opts.bench_transition = atof(argv[++i]);
+        } else if (arg == "--bench-deinterlace") {
+            opts.bench_deinterlace = 3.0;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atof(argv[i + 1]) > 0.0) opts.bench_deinterlace = atof(argv[++i]);
+        } else if (arg == "--deinterlace") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.deinterlace = argv[++i];
+        } else if (arg == "--raw-out") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.raw_out = argv[++i];
+        } else if (arg == "--raw-format") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.raw_format = argv[++i];
+        } else if (arg == "--raw-size") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            if (sscanf(argv[++i], "%dx%d", &opts.raw_width, &opts.raw_height) != 2 || opts.raw_width < 0 || opts.raw_height < 0) {
+                cerr << "Invalid --raw-size " << argv[i] << " (expected WxH)\n";
+                return false;
+            }
+        } else if (arg == "--record") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.record_path = argv[++i];
+        } else if (arg == "--record-queue") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.record_queue = max(1, atoi(argv[++i]));
+        } else if (arg == "--wall") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.wall_list = argv[++i];
+        } else if (arg == "--wall-grid") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            if (sscanf(argv[++i], "%dx%d", &opts.wall_cols, &opts.wall_rows) != 2 || opts.wall_cols <= 0 || opts.wall_rows <= 0) {
+                cerr << "Invalid --wall-grid " << argv[i] << " (expected CxR)\n";
+                return false;
+            }
+        } else if (arg == "--bench-wall") {
+            opts.bench_wall_seconds = 5.0;
+            if (i + 1 < argc && argv[i + 1][0] != '-' && atof(argv[i + 1]) > 0.0) opts.bench_wall_seconds = atof(argv[++i]);
+        } else if (arg == "--load") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.load_list = argv[++i];
+        } else if (arg == "--load-workers") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.load_workers = static_cast<size_t>(max(0, atoi(argv[++i])));
+        } else if (arg == "--seed") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return false; }
+            opts.seed = max(0LL, atoll(argv[++i]));
+        } else if (!arg.empty() && arg[0] == '-') {
+            cerr << "Unknown option " << arg << '\n';
+            print_usage(argv[0]);
+            return false;
+        } else {
+            opts.input = arg;
+        }
+    }
+
+    // Workers without an explicit affinity stay on the decode thread's NUMA
+    // node so conversion touches memory local to the decoder.
+    ThreadPolicy &workers = policies[ThreadRole::Worker];
+    if (workers.cpus.empty()) {
+        const int node = numa_node_of_role(ThreadRole::Decode);
+        if (node >= 0) workers.cpus = numa_node_cpus(node);
+    }
+
+    if (opts.input.empty() && opts.bench_jitter_seconds <= 0.0 && opts.bench_transition <= 0.0 && opts.bench_compositor <= 0.0
+        && opts.bench_deinterlace <= 0.0 && opts.serve_socket.empty() && opts.load_list.empty() && opts.playlist.empty() && opts.angles.empty() && opts.wall_list.empty()) {
+        print_usage(argv[0]);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PlayerOptions {
+    std::string input;
+    bool print_stats = false;
+    double bench_jitter_seconds = 0.0; // > 0 runs the jitter benchmark instead of playing
+    std::vector<int64_t> fetch_frames;  // --fetch: decode these frames concurrently and exit
+    size_t decoders = 0;                // decoder instances per file, 0 = one per worker
+    std::string present_backend = "highgui";
+    bool overlay = false;               // live presentation counters on the video
+    std::string present_log;            // CSV of every present, empty = off
+    double refresh_hz = 0.0;            // display refresh override, 0 = ask the backend
+    std::string shm_out;                // POSIX shared-memory ring name, empty = off
+    int shm_slots = 4;
+    std::string serve_socket;           // --serve: run the frame-grab daemon on this Unix socket
+    size_t cache_mb = 512;              // frame cache budget of the daemon
+    size_t max_files = 8;               // files the daemon keeps open
+    std::string control_socket;         // --control: remote control channel, empty = off
+    std::vector<int64_t> tensor_frames; // --tensors: export these frames as model input tensors and exit
+    int tensor_stride = 1;
+    int tensor_width = 224;
+    int tensor_height = 224;
+    std::string tensor_layout = "nchw";   // nchw or nhwc
+    std::string tensor_type = "float32";  // float32 or uint8
+    std::string tensor_norm = "imagenet"; // imagenet, unit or none
+    size_t tensor_batch = 32;
+    std::string tensor_out = "tensors";   // directory of .npy batches, or shm:NAME
+    std::vector<int64_t> sample_frames; // --sample: decode these frames GOP by GOP and exit
+    int64_t sample_stride = 0;          // --sample-stride: every Nth frame of the file
+    double sample_every = 0.0;          // --sample-every: one frame every N seconds
+    std::string sample_out;             // JPEG directory for sampled frames, empty = decode only
+    std::vector<int64_t> export_frames; // --export: write these frames as an image sequence and exit
+    std::string export_format = "png";  // png or jpg
+    std::string export_out = "frames";
+    int64_t clip_in = -1;               // --clip IN-OUT: cut these frames to clip_out and exit
+    int64_t clip_out = -1;
+    std::string clip_file = "clip.avi";
+    int proxy_height = 0;               // --proxy: scrub on a proxy of this height, 0 = off
+    std::string proxy_dir;              // proxy cache, empty = <temp>/vmix_proxies
+    bool build_proxy = false;           // --build-proxy: build the proxy and exit
+    std::string playlist;               // --playlist: play these files back to back
+    double follow_delay = -1.0;         // --follow: play a growing file this many seconds behind its end, < 0 = off
+    int64_t probe_size = 0;             // --probe-size: bytes read to find stream info, 0 = FFmpeg default
+    int64_t analyze_ms = 0;             // --analyze-ms: stream time analysed for stream info, 0 = FFmpeg default
+    bool sidecar = false;               // --sidecar: reuse stream info and keyframes cached next to the input
+    std::vector<std::string> angles;    // --angle FILE[@SECS]: play these files in sync, tiled
+    std::vector<std::string> layers;    // --layer FILE[@X,Y]: composite these over the input, bottom to top
+    double bench_compositor = 0.0;      // --bench-compositor: time the layer kernels for this long and exit
+    std::string transition_to;          // --transition FILE[@SECS]: second source for t-triggered transitions
+    std::string transition_type = "mix";
+    int transition_frames = 25;
+    double bench_transition = 0.0;      // --bench-transition: time the blend kernels for this long and exit
+    std::string deinterlace = "auto";   // --deinterlace off|auto|on
+    double bench_deinterlace = 0.0;     // --bench-deinterlace: time bwdif and the bob on 1080i frames for this long and exit
+    std::string raw_out;                // --raw-out PATH|-: write raw frames to a FIFO, file or stdout and exit
+    std::string raw_format = "yuv420p";
+    int raw_width = 0;                  // --raw-size WxH, 0 = source size or in proportion
+    int raw_height = 0;
+    std::string record_path;            // --record FILE: encode the program output to FILE
+    int record_queue = 8;               // frames buffered for the encoder before frames are dropped
+    std::string wall_list;              // --wall: show the listed files as a video wall
+    int wall_cols = 0;                  // --wall-grid CxR: tiles per page, 0 = all on one page
+    int wall_rows = 0;
+    double bench_wall_seconds = 0.0;    // --bench-wall: tiles sustained in real time per worker count
+    std::string load_list;              // --load: "path frame" list for the training data loader
+    size_t load_workers = 0;            // loader worker threads, 0 = one per scheduler worker
+    int64_t seed = -1;                  // shuffle the --load list with this seed, -1 = keep order
+};
+
+// Fills `opts` from argv (thread policy flags go straight to thread_policies()).
+// Prints usage and returns false on invalid input.
+bool parse_player_options(int argc, char *argv[], PlayerOptions &opts);
+void print_usage(const char *argv0);
+
+// Parses "1,5,10-20" style lists of at most `max_items` values; longer lists
+// (e.g. "0-2000000000") are rejected before anything is expanded.
+bool parse_int_list(const std::string &text, std::vector<int64_t> &out, size_t max_items = 1000000);
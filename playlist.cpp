@@ -0,0 +1,100 @@
+#include "playlist.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+
+bool load_playlist(const string &list_file, vector<string> &items) {
+    ifstream in(list_file);
+    if (!in) { cerr << "Cannot read playlist " << list_file << '\n'; return false; }
+    const filesystem::path base = filesystem::path(list_file).parent_path();
+    string line;
+    while (getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        const size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#') continue;
+        filesystem::path item(line.substr(first));
+        if (item.is_relative()) item = base / item;
+        items.push_back(item.string());
+    }
+    if (items.empty()) { cerr << "Playlist " << list_file << " is empty\n"; return false; }
+    return true;
+}
+
+Playlist::Playlist(vector<string> items, int primed_frames) : items(move(items)), primed_frames(max(0, primed_frames)) {}
+
+Playlist::~Playlist() {
+    if (preparing) preparing->wait();
+    if (spare_decoder) avcodec_free_context(&spare_decoder);
+}
+
+void Playlist::prepare_next() {
+    if (position + 1 >= items.size()) return;
+    next = make_unique<Prepared>();
+    next->item = position + 1;
+    preparing = make_unique<TaskGroup>(TaskScheduler::global(), TaskClass::Prefetch);
+    // The spare decoder belongs to the task until advance() waits for it.
+    AVCodecContext *spare = spare_decoder;
+    spare_decoder = nullptr;
+    preparing->run([this, spare, n = next.get()]() mutable {
+        const auto start = chrono::steady_clock::now();
+        n->player = make_unique<FFPlayer>();
+        const bool had_spare = spare != nullptr;
+        n->ok = open_player(*n->player, items[n->item], &spare) >= 0;
+        n->reused_decoder = had_spare && spare == nullptr && n->ok;
+        if (spare) avcodec_free_context(&spare);
+        if (n->ok) {
+            build_frame_index(*n->player, n->index);
+            n->ok = prime_frames(*n->player, primed_frames) > 0 || primed_frames == 0;
+        }
+        n->prepare_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    });
+}
+
+bool Playlist::advance(FFPlayer &player) {
+    if (!next) return false;
+    const auto start = chrono::steady_clock::now();
+    preparing->wait();
+    unique_ptr<Prepared> ready = move(next);
+    total_prepare_ms += ready->prepare_ms;
+    if (!ready->ok) {
+        cerr << "Skipping " << items[ready->item] << '\n';
+        position = ready->item;
+        prepare_next();
+        return advance(player);
+    }
+
+    swap_media(player, *ready->player);
+    position = ready->item;
+    // Keyframes the demuxer did not index itself (e.g. MPEG-TS) came from the
+    // scan; with them seeks in this item land on a keyframe directly.
+    if (!ready->index.from_container) {
+        for (const FrameIndexEntry &e : ready->index.entries) {
+            if (e.key && e.pos >= 0) av_add_index_entry(player.video_stream, e.pos, e.ts, e.size, 0, AVINDEX_KEYFRAME);
+        }
+    }
+    ++transitions;
+    if (ready->reused_decoder) ++reused;
+
+    // The finished item's decoder becomes the spare for the item after this
+    // one; closing its file can be slow, so that happens on a worker.
+    FFPlayer *old = ready->player.release();
+    spare_decoder = old->dec_ctx;
+    old->dec_ctx = nullptr;
+    if (spare_decoder) avcodec_flush_buffers(spare_decoder);
+    TaskScheduler::global().submit(TaskClass::Background, [old] { delete old; });
+
+    max_switch_ms = max(max_switch_ms, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+    cout << "Playing " << items[position] << " (" << position + 1 << '/' << items.size() << ")\n";
+    prepare_next();
+    return true;
+}
+
+void Playlist::print_summary(ostream &os) const {
+    os << "Playlist: " << transitions << " transitions, longest switch " << max_switch_ms << " ms, decoders reused "
+       << reused << '/' << transitions << ", average preparation "
+       << (transitions ? total_prepare_ms / static_cast<double>(transitions) : 0.0) << " ms\n";
+}
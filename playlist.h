@@ -0,0 +1,66 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ff_player.h"
+#include "frame_index.h"
+#include "task_scheduler.h"
+
+// Reads a playlist: one path per line (M3U style), blank lines and lines
+// starting with '#' ignored, relative paths resolved against the list's
+// directory. Returns false if the list cannot be read or is empty.
+bool load_playlist(const std::string &list_file, std::vector<std::string> &items);
+
+// Gapless playback of several files through one PlaybackPipeline. While an
+// item plays, the next one is opened, probed, indexed and its first frames
+// decoded on the task scheduler; at the end of the item advance() swaps the
+// prepared file into the pipeline's player without a pause, with the
+// keyframes found while indexing handed to its demuxer. The decoder of
+// the finished item is kept and reused for the item after next when the
+// codec parameters match.
+class Playlist {
+public:
+    explicit Playlist(std::vector<std::string> items, int primed_frames = 2);
+    ~Playlist();
+    Playlist(const Playlist &) = delete;
+    Playlist &operator=(const Playlist &) = delete;
+
+    size_t size() const { return items.size(); }
+    size_t current() const { return position; }
+    const std::string &current_path() const { return items[position]; }
+
+    // Starts preparing the item after the current one.
+    void prepare_next();
+    // Decode thread, at the end of the current item: swaps the prepared item
+    // into `player`. Returns false after the last item or if it failed to open.
+    bool advance(FFPlayer &player);
+
+    void print_summary(std::ostream &os) const;
+
+private:
+    struct Prepared {
+        std::unique_ptr<FFPlayer> player;
+        FrameIndex index;
+        size_t item = 0;
+        bool ok = false;
+        bool reused_decoder = false;
+        double prepare_ms = 0.0;
+    };
+
+    std::vector<std::string> items;
+    int primed_frames;
+    size_t position = 0;
+    std::unique_ptr<Prepared> next;
+    std::unique_ptr<TaskGroup> preparing;
+    AVCodecContext *spare_decoder = nullptr; // from the last finished item
+
+    size_t transitions = 0;
+    size_t reused = 0;
+    double max_switch_ms = 0.0;
+    double total_prepare_ms = 0.0;
+};
@@ -0,0 +1,166 @@
+#include "presentation_stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <sstream>
+
+#include "playback_pipeline.h"
+
+using namespace std;
+
+static double seconds_between(PresentationStats::Clock::time_point a, PresentationStats::Clock::time_point b) {
+    return chrono::duration<double>(b - a).count();
+}
+
+PresentationStats::PresentationStats(double content_fps, double refresh_hz)
+    : fps(max(1.0, content_fps)),
+      hz(refresh_hz),
+      frame_period_s(1.0 / max(1.0, content_fps)),
+      late_threshold_s(refresh_hz > 0.0 ? 1.0 / refresh_hz : 0.5 / max(1.0, content_fps)),
+      start(Clock::now()),
+      window_start(start) {}
+
+bool PresentationStats::open_log(const string &path) {
+    log.open(path);
+    if (!log) return false;
+    log << "seq,frame,pts,paced,deadline_ms,present_ms,lateness_ms,interval_ms,refreshes\n";
+    return true;
+}
+
+void PresentationStats::on_present(const PresentFrame &frame, Clock::time_point presented) {
+    const double lateness_s = seconds_between(frame.deadline, presented);
+    double interval_s = 0.0;
+    double refreshes = 0.0;
+    if (have_prev) {
+        interval_s = seconds_between(prev_present, presented);
+        if (hz > 0.0) refreshes = interval_s * hz;
+    }
+
+    if (frame.paced) {
+        ++window.presented;
+        if (lateness_s > late_threshold_s) ++window.late;
+        max_lateness_ms = max(max_lateness_ms, lateness_s * 1000.0);
+        if (have_prev && prev_paced && frame.frame_number > prev_frame) {
+            const int64_t step = frame.frame_number - prev_frame;
+            if (step > 1) window.dropped += static_cast<uint64_t>(step - 1);
+            // At 2x the frames are due twice as often.
+            const double expected_s = static_cast<double>(step) * frame_period_s / max(0.01, frame.speed);
+            const double err_ms = (interval_s - expected_s) * 1000.0;
+            window.judder_sq_ms += err_ms * err_ms;
+            ++window.judder_samples;
+            if (hz > 0.0) {
+                // The previous frame stayed up for more refreshes than its
+                // cadence allows.
+                const double held = round(interval_s * hz);
+                const double allowed = ceil(expected_s * hz - 1e-3);
+                if (held > allowed) window.repeated += static_cast<uint64_t>(held - allowed);
+            }
+        }
+    }
+
+    if (log) {
+        log << frame.seq << ',' << frame.frame_number << ',' << frame.pts << ',' << (frame.paced ? 1 : 0) << ','
+            << fixed << setprecision(3)
+            << seconds_between(start, frame.deadline) * 1000.0 << ','
+            << seconds_between(start, presented) * 1000.0 << ','
+            << lateness_s * 1000.0 << ','
+            << interval_s * 1000.0 << ','
+            << setprecision(2) << refreshes << '\n';
+        log.unsetf(ios::fixed);
+    }
+
+    have_prev = true;
+    prev_paced = frame.paced;
+    prev_frame = frame.frame_number;
+    prev_present = presented;
+    roll_window(presented);
+}
+
+void PresentationStats::roll_window(Clock::time_point now) {
+    const double span = seconds_between(window_start, now);
+    if (span < 1.0) return;
+    rates.presented = static_cast<double>(window.presented) / span;
+    rates.late = static_cast<double>(window.late) / span;
+    rates.repeated = static_cast<double>(window.repeated) / span;
+    rates.dropped = static_cast<double>(window.dropped) / span;
+    rates.judder_ms = window.judder_samples ? sqrt(window.judder_sq_ms / static_cast<double>(window.judder_samples)) : 0.0;
+
+    total.presented += window.presented;
+    total.late += window.late;
+    total.repeated += window.repeated;
+    total.dropped += window.dropped;
+    total.judder_samples += window.judder_samples;
+    total.judder_sq_ms += window.judder_sq_ms;
+    window = Counters{};
+    window_start = now;
+}
+
+string PresentationStats::cadence_report() const {
+    if (hz <= 0.0) return {};
+    const double ratio = hz / fps;
+    ostringstream os;
+    os << fixed << setprecision(2) << fps << " fps content on " << hz << " Hz display: ";
+    if (ratio < 1.0 - 1e-3) {
+        os << "the display cannot show every frame, about " << setprecision(0) << (1.0 - ratio) * 100.0 << "% are skipped";
+        return os.str();
+    }
+    const double whole = floor(ratio + 1e-3);
+    const double frac = ratio - whole;
+    if (frac < 1e-2 || frac > 1.0 - 1e-2) return {};
+    os << setprecision(2) << ratio << " refreshes per frame, frames alternate between "
+       << setprecision(0) << whole << " and " << whole + 1 << " refreshes (about "
+       << frac * 100.0 << "% held longer), expect judder";
+    return os.str();
+}
+
+void PresentationStats::draw_overlay(cv::Mat &image) const {
+    ostringstream os;
+    os << fixed << setprecision(1)
+       << "fps " << rates.presented
+       << "  late/s " << rates.late
+       << "  rep/s " << rates.repeated
+       << "  drop/s " << rates.dropped
+       << "  judder " << rates.judder_ms << " ms";
+    const string line = os.str();
+    const string cadence = cadence_report();
+
+    const double scale = max(0.5, image.rows / 1080.0);
+    const int thickness = max(1, static_cast<int>(round(scale * 1.5)));
+    int baseline = 0;
+    const cv::Size size = cv::getTextSize(line, cv::FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline);
+    const int line_h = size.height + baseline + 6;
+    const int lines = cadence.empty() ? 1 : 2;
+    int box_w = size.width;
+    if (!cadence.empty()) box_w = max(box_w, cv::getTextSize(cadence, cv::FONT_HERSHEY_SIMPLEX, scale, thickness, &baseline).width);
+
+    cv::rectangle(image, cv::Rect(0, 0, min(image.cols, box_w + 16), min(image.rows, line_h * lines + 8)), cv::Scalar(0, 0, 0, 255), cv::FILLED);
+    cv::putText(image, line, cv::Point(8, line_h), cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(255, 255, 255, 255), thickness, cv::LINE_AA);
+    if (!cadence.empty()) {
+        cv::putText(image, cadence, cv::Point(8, line_h * 2), cv::FONT_HERSHEY_SIMPLEX, scale, cv::Scalar(0, 200, 255, 255), thickness, cv::LINE_AA);
+    }
+}
+
+void PresentationStats::print_summary(ostream &os) const {
+    Counters all = total;
+    all.presented += window.presented;
+    all.late += window.late;
+    all.repeated += window.repeated;
+    all.dropped += window.dropped;
+    all.judder_samples += window.judder_samples;
+    all.judder_sq_ms += window.judder_sq_ms;
+
+    os << "Presentation (" << fps << " fps content, ";
+    if (hz > 0.0) os << hz << " Hz display)\n";
+    else os << "unknown refresh rate)\n";
+    os << fixed << setprecision(2)
+       << "  paced frames " << all.presented
+       << " late " << all.late
+       << " repeated " << all.repeated
+       << " dropped " << all.dropped
+       << " judder " << (all.judder_samples ? sqrt(all.judder_sq_ms / static_cast<double>(all.judder_samples)) : 0.0) << " ms"
+       << " max lateness " << max_lateness_ms << " ms\n";
+    os.unsetf(ios::fixed);
+    const string cadence = cadence_report();
+    if (!cadence.empty()) os << "  cadence: " << cadence << '\n';
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <ostream>
+#include <string>
+
+#include <opencv2/opencv.hpp>
+
+struct PresentFrame;
+
+// Per-second rates from the last complete one-second window.
+struct PresentationRates {
+    double presented = 0.0;
+    double late = 0.0;
+    double repeated = 0.0;
+    double dropped = 0.0;
+    double judder_ms = 0.0; // RMS deviation of present intervals from frame intervals at the playback speed
+};
+
+// Compares actual present times on the display thread with the PTS
+// deadlines set by the decode thread. Only paced (playing) frames count
+// towards late/repeated/dropped/judder; every present goes to the log.
+class PresentationStats {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    PresentationStats(double content_fps, double refresh_hz);
+
+    bool open_log(const std::string &path);
+    void on_present(const PresentFrame &frame, Clock::time_point presented);
+
+    // Draws the live counters into the top-left corner of `image`.
+    void draw_overlay(cv::Mat &image) const;
+
+    // Describes cadence problems such as 50 fps content on a 60 Hz display;
+    // empty if the cadence is even or the refresh rate is unknown.
+    std::string cadence_report() const;
+    void print_summary(std::ostream &os) const;
+
+private:
+    void roll_window(Clock::time_point now);
+
+    double fps;
+    double hz;
+    double frame_period_s;
+    double late_threshold_s;
+    Clock::time_point start;
+    std::ofstream log;
+
+    bool have_prev = false;
+    int64_t prev_frame = 0;
+    bool prev_paced = false;
+    Clock::time_point prev_present{};
+
+    struct Counters {
+        uint64_t presented = 0;
+        uint64_t late = 0;
+        uint64_t repeated = 0;
+        uint64_t dropped = 0;
+        uint64_t judder_samples = 0;
+        double judder_sq_ms = 0.0;
+    };
+    Counters window;
+    Counters total;
+    Clock::time_point window_start;
+    PresentationRates rates;
+    double max_lateness_ms = 0.0;
+};
@@ -0,0 +1,270 @@
+#include "presenter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#ifdef VMIX_HAVE_XSHM
+#include <sys/ipc.h>
+#include <sys/select.h>
+#include <sys/shm.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+#include <X11/keysym.h>
+#include <X11/extensions/XShm.h>
+#ifdef VMIX_HAVE_XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif
+#endif
+
+using namespace std;
+
+class HighGuiPresenter : public Presenter {
+public:
+    ~HighGuiPresenter() override { cv::destroyAllWindows(); }
+
+    const char *name() const override { return "highgui"; }
+
+    bool open(const string &t, int, int) override {
+        title = t;
+        cv::namedWindow(title, cv::WINDOW_NORMAL);
+        return true;
+    }
+
+    void present(const cv::Mat &image) override { cv::imshow(title, image); }
+    int poll_key(int timeout_ms) override { return cv::waitKey(max(1, timeout_ms)); }
+
+private:
+    string title;
+};
+
+#ifdef VMIX_HAVE_XSHM
+
+// MIT-SHM backend: the decode thread converts straight into shared-memory
+// XImages, which the X server reads without a socket copy. Plain X11 has no
+// vblank event, so refresh_hz() comes from XRandR and XSync() after each put
+// guarantees the server is done with a surface before it is recycled.
+// Frames are put unscaled while the window keeps their size; once it is
+// resized they are scaled to fit, keeping their aspect ratio like the HighGUI
+// window, into a window-sized segment.
+class XShmPresenter : public Presenter {
+public:
+    ~XShmPresenter() override {
+        if (!dpy) return;
+        for (Segment &s : segments) destroy_segment(s);
+        destroy_segment(spare);
+        destroy_segment(scaled);
+        if (gc) XFreeGC(dpy, gc);
+        if (win) XDestroyWindow(dpy, win);
+        XCloseDisplay(dpy);
+    }
+
+    const char *name() const override { return "xshm"; }
+    int surface_type() const override { return CV_8UC4; }
+    double refresh_hz() const override { return hz; }
+
+    bool open(const string &title, int w, int h) override {
+        dpy = XOpenDisplay(nullptr);
+        if (!dpy) { cerr << "xshm: cannot open X display\n"; return false; }
+        if (!XShmQueryExtension(dpy)) { cerr << "xshm: MIT-SHM extension not available\n"; return false; }
+
+        const int screen = DefaultScreen(dpy);
+        visual = DefaultVisual(dpy, screen);
+        depth = DefaultDepth(dpy, screen);
+        // Surfaces are filled as BGRX, which matches 24/32-bit TrueColor on
+        // little-endian servers.
+        if ((depth != 24 && depth != 32) || visual->red_mask != 0xff0000 || visual->blue_mask != 0xff
+            || ImageByteOrder(dpy) != LSBFirst) {
+            cerr << "xshm: unsupported visual (depth " << depth << ")\n";
+            return false;
+        }
+
+        width = w;
+        height = h;
+        win = XCreateSimpleWindow(dpy, RootWindow(dpy, screen), 0, 0, static_cast<unsigned>(w), static_cast<unsigned>(h), 0,
+                                  BlackPixel(dpy, screen), BlackPixel(dpy, screen));
+        XStoreName(dpy, win, title.c_str());
+        XSelectInput(dpy, win, KeyPressMask | ExposureMask | StructureNotifyMask);
+        wm_delete = XInternAtom(dpy, "WM_DELETE_WINDOW", False);
+        XSetWMProtocols(dpy, win, &wm_delete, 1);
+        gc = XCreateGC(dpy, win, 0, nullptr);
+        XMapWindow(dpy, win);
+
+#ifdef VMIX_HAVE_XRANDR
+        if (XRRScreenConfiguration *conf = XRRGetScreenInfo(dpy, RootWindow(dpy, screen))) {
+            hz = XRRConfigCurrentRate(conf);
+            XRRFreeScreenConfigInfo(conf);
+        }
+#endif
+        XSync(dpy, False);
+        return true;
+    }
+
+    vector<cv::Mat> create_surfaces(int count, int w, int h) override {
+        vector<cv::Mat> out;
+        for (int i = 0; i < count; ++i) {
+            Segment s;
+            if (!create_segment(s, w, h)) break;
+            segments.push_back(s);
+            out.push_back(as_mat(s));
+        }
+        if (static_cast<int>(out.size()) != count) return {};
+        return out;
+    }
+
+    void present(const cv::Mat &image) override {
+        if (image.empty()) return;
+        Segment *seg = nullptr;
+        for (Segment &s : segments) {
+            if (reinterpret_cast<unsigned char *>(s.image->data) == image.data && s.image->width == image.cols && s.image->height == image.rows) {
+                seg = &s;
+                break;
+            }
+        }
+        if (!seg) {
+            // Frame not in one of our surfaces (e.g. after a resolution
+            // change): one copy into the spare segment.
+            if (!spare.image || spare.image->width != image.cols || spare.image->height != image.rows) {
+                destroy_segment(spare);
+                if (!create_segment(spare, image.cols, image.rows)) return;
+            }
+            cv::Mat dst = as_mat(spare);
+            if (image.type() == CV_8UC3) cv::cvtColor(image, dst, cv::COLOR_BGR2BGRA);
+            else image.copyTo(dst);
+            seg = &spare;
+        }
+        shown = seg;
+        show(*seg);
+    }
+
+    int poll_key(int timeout_ms) override {
+        if (!XPending(dpy) && timeout_ms > 0) {
+            const int fd = ConnectionNumber(dpy);
+            fd_set fds;
+            FD_ZERO(&fds);
+            FD_SET(fd, &fds);
+            timeval tv{timeout_ms / 1000, (timeout_ms % 1000) * 1000};
+            select(fd + 1, &fds, nullptr, nullptr, &tv);
+        }
+        while (XPending(dpy)) {
+            XEvent ev;
+            XNextEvent(dpy, &ev);
+            if (ev.type == Expose && ev.xexpose.count == 0 && shown) {
+                show(*shown);
+            } else if (ev.type == ConfigureNotify) {
+                width = max(1, ev.xconfigure.width);
+                height = max(1, ev.xconfigure.height);
+            } else if (ev.type == ClientMessage && static_cast<Atom>(ev.xclient.data.l[0]) == wm_delete) {
+                return 27;
+            } else if (ev.type == KeyPress) {
+                char text[8] = {0};
+                KeySym sym = 0;
+                const int n = XLookupString(&ev.xkey, text, sizeof(text), &sym, nullptr);
+                if (sym == XK_Escape) return 27;
+                if (sym == XK_Left) return 81;
+                if (sym == XK_Right) return 83;
+                if (n > 0) return static_cast<unsigned char>(text[0]);
+            }
+        }
+        return -1;
+    }
+
+private:
+    struct Segment {
+        XShmSegmentInfo info{};
+        XImage *image = nullptr;
+    };
+
+    bool create_segment(Segment &s, int w, int h) {
+        s.image = XShmCreateImage(dpy, visual, static_cast<unsigned>(depth), ZPixmap, nullptr, &s.info,
+                                  static_cast<unsigned>(w), static_cast<unsigned>(h));
+        if (!s.image) return false;
+        s.info.shmid = shmget(IPC_PRIVATE, static_cast<size_t>(s.image->bytes_per_line) * static_cast<size_t>(h), IPC_CREAT | 0600);
+        if (s.info.shmid < 0) { XDestroyImage(s.image); s.image = nullptr; return false; }
+        void *addr = shmat(s.info.shmid, nullptr, 0);
+        if (addr == reinterpret_cast<void *>(-1)) {
+            shmctl(s.info.shmid, IPC_RMID, nullptr);
+            XDestroyImage(s.image);
+            s.image = nullptr;
+            return false;
+        }
+        s.info.shmaddr = s.image->data = static_cast<char *>(addr);
+        s.info.readOnly = False;
+        XShmAttach(dpy, &s.info);
+        XSync(dpy, False);
+        // Removed once both sides have detached.
+        shmctl(s.info.shmid, IPC_RMID, nullptr);
+        return true;
+    }
+
+    void destroy_segment(Segment &s) {
+        if (!s.image) return;
+        XShmDetach(dpy, &s.info);
+        shmdt(s.info.shmaddr);
+        s.image->data = nullptr;
+        XDestroyImage(s.image);
+        s.image = nullptr;
+    }
+
+    static cv::Mat as_mat(Segment &s) {
+        return cv::Mat(s.image->height, s.image->width, CV_8UC4, s.image->data, static_cast<size_t>(s.image->bytes_per_line));
+    }
+
+    // Puts `s` on screen, through `scaled` when the window is another size.
+    void show(Segment &s) {
+        if (s.image->width == width && s.image->height == height) {
+            put(s);
+            return;
+        }
+        if (!scaled.image || scaled.image->width != width || scaled.image->height != height) {
+            destroy_segment(scaled);
+            if (!create_segment(scaled, width, height)) return;
+        }
+        const double k = min(static_cast<double>(width) / s.image->width, static_cast<double>(height) / s.image->height);
+        const int w = clamp(static_cast<int>(lround(s.image->width * k)), 1, width);
+        const int h = clamp(static_cast<int>(lround(s.image->height * k)), 1, height);
+        cv::Mat dst = as_mat(scaled);
+        dst.setTo(cv::Scalar::all(0));
+        cv::Mat fit = dst(cv::Rect((width - w) / 2, (height - h) / 2, w, h));
+        cv::resize(as_mat(s), fit, cv::Size(w, h), 0, 0, cv::INTER_LINEAR);
+        put(scaled);
+    }
+
+    void put(Segment &s) {
+        XShmPutImage(dpy, win, gc, s.image, 0, 0, 0, 0, static_cast<unsigned>(s.image->width), static_cast<unsigned>(s.image->height), False);
+        XSync(dpy, False);
+    }
+
+    Display *dpy = nullptr;
+    Visual *visual = nullptr;
+    int depth = 0;
+    Window win = 0;
+    GC gc = nullptr;
+    Atom wm_delete = 0;
+    int width = 0;                 // of the window
+    int height = 0;
+    double hz = 0.0;
+    vector<Segment> segments;
+    Segment spare;
+    Segment scaled;
+    Segment *shown = nullptr;      // last frame presented, before scaling
+};
+
+#endif
+
+unique_ptr<Presenter> make_presenter(const string &backend, const string &title, int width, int height) {
+    if (backend == "xshm") {
+#ifdef VMIX_HAVE_XSHM
+        unique_ptr<Presenter> p = make_unique<XShmPresenter>();
+        if (p->open(title, width, height)) return p;
+        cerr << "Falling back to HighGUI presentation\n";
+#else
+        cerr << "This build has no MIT-SHM support, using HighGUI\n";
+#endif
+    } else if (backend != "highgui") {
+        cerr << "Unknown presentation backend '" << backend << "', using HighGUI\n";
+    }
+    unique_ptr<Presenter> p = make_unique<HighGuiPresenter>();
+    p->open(title, width, height);
+    return p;
+}
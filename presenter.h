@@ -0,0 +1,36 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+// Puts converted frames on screen and reports key presses using the same
+// codes as cv::waitKey (27 = Esc, 81/83 = left/right arrow).
+class Presenter {
+public:
+    virtual ~Presenter() = default;
+
+    virtual const char *name() const = 0;
+    virtual bool open(const std::string &title, int width, int height) = 0;
+
+    // Presents `image`. When the image lives in one of the backend's own
+    // surfaces it is shown without any further copy.
+    virtual void present(const cv::Mat &image) = 0;
+    virtual int poll_key(int timeout_ms) = 0;
+
+    // Backends with their own frame memory hand out surfaces for the decode
+    // thread to convert into directly, of type surface_type(): CV_8UC3
+    // (BGR24) or CV_8UC4 (BGRX). An empty vector means conversion should use
+    // ordinary heap buffers.
+    virtual std::vector<cv::Mat> create_surfaces(int /*count*/, int /*width*/, int /*height*/) { return {}; }
+    virtual int surface_type() const { return CV_8UC3; }
+
+    // Display refresh rate in Hz, 0 if unknown.
+    virtual double refresh_hz() const { return 0.0; }
+};
+
+// "highgui" (default) or "xshm". Falls back to HighGUI, with a warning, if the
+// requested backend is unavailable on this build or display.
+std::unique_ptr<Presenter> make_presenter(const std::string &backend, const std::string &title, int width, int height);
@@ -0,0 +1,231 @@
+#include "program_recorder.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <memory>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+#include <libswscale/swscale.h>
+}
+
+#include "ff_player.h"
+#include "thread_policy.h"
+
+using namespace std;
+
+struct ProgramRecorder::Encoder {
+    AVFormatContext *oc = nullptr;
+    AVStream *ost = nullptr;
+    AVCodecContext *ctx = nullptr;
+    SwsContext *sws = nullptr;
+    unique_ptr<AVFrame, AVFrameDeleter> frame{av_frame_alloc()};
+    unique_ptr<AVPacket, AVPacketDeleter> pkt{av_packet_alloc()};
+
+    ~Encoder() {
+        if (sws) sws_freeContext(sws);
+        if (ctx) avcodec_free_context(&ctx);
+        if (!oc) return;
+        if (!(oc->oformat->flags & AVFMT_NOFILE)) avio_closep(&oc->pb);
+        avformat_free_context(oc);
+    }
+
+    bool open(const RecorderOptions &opts, int width, int height, double fps);
+    bool drain(int64_t &bytes);
+};
+
+// The container follows the file extension and the codec is its default
+// video codec, MPEG-4 Part 2 when it has none or no encoder for it exists.
+bool ProgramRecorder::Encoder::open(const RecorderOptions &opts, int width, int height, double fps) {
+    int ret = avformat_alloc_output_context2(&oc, nullptr, nullptr, opts.path.c_str());
+    if (ret < 0 || !oc) { print_error("Cannot create recording " + opts.path, ret); return false; }
+    const AVCodec *codec = oc->oformat->video_codec != AV_CODEC_ID_NONE ? avcodec_find_encoder(oc->oformat->video_codec) : nullptr;
+    if (!codec) codec = avcodec_find_encoder(AV_CODEC_ID_MPEG4);
+    if (!codec) { cerr << "No video encoder available for " << opts.path << '\n'; return false; }
+    ctx = avcodec_alloc_context3(codec);
+    if (!ctx || !frame || !pkt) return false;
+
+    const AVRational rate = av_d2q(fps > 0.0 ? fps : 25.0, 100000);
+    ctx->width = max(2, width & ~1); // 4:2:0 needs even sizes
+    ctx->height = max(2, height & ~1);
+    ctx->pix_fmt = AV_PIX_FMT_YUV420P;
+    if (codec->pix_fmts) {
+        const AVPixelFormat *f = codec->pix_fmts;
+        while (*f != AV_PIX_FMT_NONE && *f != AV_PIX_FMT_YUV420P) ++f;
+        if (*f == AV_PIX_FMT_NONE) ctx->pix_fmt = codec->pix_fmts[0];
+    }
+    ctx->time_base = av_inv_q(rate); // one tick per program frame
+    ctx->framerate = rate;
+    ctx->gop_size = max(1, static_cast<int>(lround(av_q2d(rate) * 2.0)));
+    ctx->bit_rate = opts.bit_rate > 0 ? opts.bit_rate : static_cast<int64_t>(0.15 * ctx->width * ctx->height * av_q2d(rate));
+    ctx->thread_count = 0;
+    // Encoders with speed presets (x264, x265) must keep up with real time.
+    av_opt_set(ctx->priv_data, "preset", "veryfast", 0);
+    if (oc->oformat->flags & AVFMT_GLOBALHEADER) ctx->flags |= AV_CODEC_FLAG_GLOBAL_HEADER;
+    ret = avcodec_open2(ctx, codec, nullptr);
+    if (ret < 0) { print_error("Cannot open the recording encoder", ret); return false; }
+
+    frame->format = ctx->pix_fmt;
+    frame->width = ctx->width;
+    frame->height = ctx->height;
+    if (av_frame_get_buffer(frame.get(), 0) < 0) return false;
+
+    ost = avformat_new_stream(oc, nullptr);
+    if (!ost) return false;
+    avcodec_parameters_from_context(ost->codecpar, ctx);
+    ost->time_base = ctx->time_base;
+    ost->avg_frame_rate = rate;
+    if (!(oc->oformat->flags & AVFMT_NOFILE)) {
+        ret = avio_open(&oc->pb, opts.path.c_str(), AVIO_FLAG_WRITE);
+        if (ret < 0) { print_error("Cannot open " + opts.path, ret); return false; }
+    }
+    ret = avformat_write_header(oc, nullptr);
+    if (ret < 0) { print_error("Cannot write the recording header", ret); return false; }
+    return true;
+}
+
+bool ProgramRecorder::Encoder::drain(int64_t &bytes) {
+    int ret;
+    while ((ret = avcodec_receive_packet(ctx, pkt.get())) >= 0) {
+        pkt->stream_index = ost->index;
+        av_packet_rescale_ts(pkt.get(), ctx->time_base, ost->time_base);
+        bytes += pkt->size;
+        ret = av_interleaved_write_frame(oc, pkt.get());
+        av_packet_unref(pkt.get());
+        if (ret < 0) return false;
+    }
+    return ret == AVERROR(EAGAIN) || ret == AVERROR_EOF;
+}
+
+ProgramRecorder::ProgramRecorder(RecorderOptions opts) : opts(move(opts)) {}
+
+ProgramRecorder::~ProgramRecorder() { close(); }
+
+bool ProgramRecorder::open(int width, int height, double fps) {
+    if (thread.joinable()) return running.load();
+    program_fps = fps > 0.0 ? fps : 25.0;
+    slots.resize(max<size_t>(1, opts.queue_frames));
+    for (size_t i = 0; i < slots.size(); ++i) free_slots.push_back(i);
+    thread = std::thread([this, width, height] { encode_loop(width, height, program_fps); });
+    unique_lock<mutex> lk(mtx);
+    cv.wait(lk, [this] { return opened; });
+    if (running) cout << "Recording program output to " << opts.path << " (" << codec_name << ")\n";
+    return running.load();
+}
+
+void ProgramRecorder::submit(const cv::Mat &image, Clock::time_point due) {
+    if (!running.load() || image.empty() || (image.type() != CV_8UC3 && image.type() != CV_8UC4)) return;
+    if (last_pts < 0) epoch = due;
+    const int64_t pts = llround(chrono::duration<double>(due - epoch).count() * program_fps);
+    if (pts <= last_pts) {
+        ++skipped;
+        return;
+    }
+    size_t slot;
+    {
+        lock_guard<mutex> lk(mtx);
+        const size_t depth = ready.size();
+        ++submitted;
+        depth_sum += depth;
+        depth_max = max(depth_max, depth);
+        if (free_slots.empty()) {
+            ++dropped;
+            return;
+        }
+        slot = free_slots.front();
+        free_slots.pop_front();
+    }
+    // Slots keep their buffers, so this is one copy into memory the encoder
+    // thread has already touched.
+    image.copyTo(slots[slot].image);
+    slots[slot].pts = pts;
+    last_pts = pts;
+    {
+        lock_guard<mutex> lk(mtx);
+        ready.push_back(slot);
+    }
+    cv.notify_all();
+}
+
+bool ProgramRecorder::encode_slot(Encoder &e, const Slot &slot) {
+    const cv::Mat &img = slot.image;
+    const AVPixelFormat src_fmt = img.type() == CV_8UC4 ? AV_PIX_FMT_BGRA : AV_PIX_FMT_BGR24;
+    e.sws = sws_getCachedContext(e.sws, img.cols, img.rows, src_fmt, e.ctx->width, e.ctx->height, e.ctx->pix_fmt, SWS_BILINEAR,
+                                 nullptr, nullptr, nullptr);
+    // The encoder may still reference the previous picture.
+    if (!e.sws || av_frame_make_writable(e.frame.get()) < 0) return false;
+    const uint8_t *src[4] = {img.data, nullptr, nullptr, nullptr};
+    const int src_stride[4] = {static_cast<int>(img.step[0]), 0, 0, 0};
+    sws_scale(e.sws, src, src_stride, 0, img.rows, e.frame->data, e.frame->linesize);
+    e.frame->pts = slot.pts;
+    return avcodec_send_frame(e.ctx, e.frame.get()) >= 0 && e.drain(bytes_written);
+}
+
+void ProgramRecorder::encode_loop(int width, int height, double fps) {
+    // Off the display cores; the codec's threads inherit the policy.
+    apply_thread_policy(ThreadRole::Worker);
+    Encoder e;
+    const bool ok = e.open(opts, width, height, fps);
+    {
+        lock_guard<mutex> lk(mtx);
+        if (ok) codec_name = e.ctx->codec->name;
+        running = ok;
+        opened = true;
+    }
+    cv.notify_all();
+    if (!ok) return;
+
+    bool good = true;
+    while (true) {
+        size_t slot;
+        {
+            unique_lock<mutex> lk(mtx);
+            cv.wait(lk, [this] { return quit || !ready.empty(); });
+            if (ready.empty()) break;
+            slot = ready.front();
+            ready.pop_front();
+        }
+        if (good) {
+            const auto t0 = Clock::now();
+            good = encode_slot(e, slots[slot]);
+            const double ms = chrono::duration<double, milli>(Clock::now() - t0).count();
+            ++encoded;
+            encode_ms += ms;
+            max_encode_ms = max(max_encode_ms, ms);
+            if (!good) {
+                running = false;
+                cerr << "Recording to " << opts.path << " stopped after an encoder error\n";
+            }
+        }
+        lock_guard<mutex> lk(mtx);
+        free_slots.push_back(slot);
+    }
+    if (good && avcodec_send_frame(e.ctx, nullptr) >= 0) good = e.drain(bytes_written);
+    if (good && av_write_trailer(e.oc) < 0) good = false;
+    if (!good) cerr << "Recording " << opts.path << " is incomplete\n";
+}
+
+void ProgramRecorder::close() {
+    if (!thread.joinable()) return;
+    {
+        lock_guard<mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    thread.join();
+    running = false;
+    if (dropped) cerr << "Recording dropped " << dropped << " of " << submitted << " frames, the encoder fell behind\n";
+}
+
+void ProgramRecorder::print_stats(ostream &os) const {
+    if (!submitted) return;
+    const double speed = encode_ms > 0.0 ? 1000.0 * static_cast<double>(encoded) / encode_ms : 0.0;
+    os << "Recording: " << encoded << " frames to " << opts.path << " (" << codec_name << ", "
+       << static_cast<double>(bytes_written) / (1024.0 * 1024.0) << " MiB), queue depth "
+       << static_cast<double>(depth_sum) / static_cast<double>(submitted) << " mean, " << depth_max << " max of " << slots.size()
+       << ", encoder " << speed << " fps (" << speed / program_fps << "x real time), " << max_encode_ms << " ms max, " << dropped
+       << " dropped, " << skipped << " repeats skipped\n";
+}
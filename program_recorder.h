@@ -0,0 +1,89 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+struct RecorderOptions {
+    std::string path;          // container from the extension, its default video codec
+    size_t queue_frames = 8;   // frames waiting for the encoder before new ones are dropped
+    int64_t bit_rate = 0;      // 0 = about 0.15 bit per pixel
+};
+
+// Records the program output, i.e. the frames as they are presented, to a
+// file. The display thread only copies each presented image into a free slot
+// of a bounded queue; scaling to the encoder's format, encoding and muxing
+// run on a dedicated encoder thread with the Worker thread policy (which the
+// codec's own threads inherit). When the encoder falls behind and the queue
+// is full, new frames are dropped and counted instead of stalling the
+// display. Frames are stamped with the time they were due on screen, in
+// ticks of the program frame rate, so holds and pauses keep their length.
+class ProgramRecorder {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit ProgramRecorder(RecorderOptions opts);
+    ~ProgramRecorder();
+    ProgramRecorder(const ProgramRecorder &) = delete;
+    ProgramRecorder &operator=(const ProgramRecorder &) = delete;
+
+    // Starts the encoder thread for a program of width x height at `fps` and
+    // waits until the encoder and the file are open.
+    bool open(int width, int height, double fps);
+
+    // Display thread: queues a BGR24 (CV_8UC3) or BGRA/BGR0 (CV_8UC4) frame
+    // that was due on screen at `due`. Never waits for the encoder.
+    void submit(const cv::Mat &image, Clock::time_point due);
+
+    // Encodes what is queued, flushes the encoder and finishes the file.
+    void close();
+
+    void print_stats(std::ostream &os) const;
+
+private:
+    struct Slot {
+        cv::Mat image;
+        int64_t pts = 0;
+    };
+
+    struct Encoder;
+    void encode_loop(int width, int height, double fps);
+    bool encode_slot(Encoder &e, const Slot &slot);
+
+    RecorderOptions opts;
+    std::vector<Slot> slots;
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::deque<size_t> free_slots;
+    std::deque<size_t> ready;
+    bool quit = false;
+    bool opened = false;
+    std::atomic<bool> running{false}; // open and not failed
+
+    // Display thread.
+    Clock::time_point epoch{};
+    int64_t last_pts = -1;
+    double program_fps = 25.0;
+    uint64_t submitted = 0;
+    uint64_t dropped = 0;
+    uint64_t skipped = 0;      // due within the tick of the previous frame
+    uint64_t depth_sum = 0;
+    size_t depth_max = 0;
+
+    // Encoder thread.
+    std::string codec_name;
+    uint64_t encoded = 0;
+    double encode_ms = 0.0;
+    double max_encode_ms = 0.0;
+    int64_t bytes_written = 0;
+};
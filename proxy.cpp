@@ -0,0 +1,290 @@
+#include "proxy.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <vector>
+
+#include "file_fingerprint.h"
+#include "frame_index.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+string default_proxy_dir() {
+    error_code ec;
+    const filesystem::path tmp = filesystem::temp_directory_path(ec);
+    return ((ec ? filesystem::path(".") : tmp) / "vmix_proxies").string();
+}
+
+string proxy_path_for(const string &source, const ProxyOptions &opts) {
+    const string fp = file_fingerprint(source);
+    if (fp.empty()) return {};
+    const string dir = opts.cache_dir.empty() ? default_proxy_dir() : opts.cache_dir;
+    return (filesystem::path(dir) / (fp + "_" + to_string(opts.height) + "p.avi")).string();
+}
+
+namespace {
+
+using PacketPtr = unique_ptr<AVPacket, AVPacketDeleter>;
+
+struct ProxyChunk {
+    int64_t first = 0;
+    int64_t end = -1; // exclusive, -1 = end of file
+    vector<PacketPtr> packets;
+    bool finished = false;
+    bool ok = false;
+};
+
+struct ProxyFormat {
+    int width = 0;
+    int height = 0;
+    AVRational time_base{1, 25};
+    int quality = 5;
+};
+
+// Decoders for the chunk tasks, opened on demand and reused.
+class DecoderPool {
+public:
+    explicit DecoderPool(string path) : path(move(path)) {}
+
+    unique_ptr<FFPlayer> lease() {
+        {
+            lock_guard<mutex> lk(mtx);
+            if (!idle.empty()) {
+                unique_ptr<FFPlayer> p = move(idle.back());
+                idle.pop_back();
+                return p;
+            }
+        }
+        unique_ptr<FFPlayer> p = make_unique<FFPlayer>();
+        p->convert_class = TaskClass::Background;
+        if (open_player(*p, path) < 0) return nullptr;
+        return p;
+    }
+
+    void release(unique_ptr<FFPlayer> p) {
+        lock_guard<mutex> lk(mtx);
+        idle.push_back(move(p));
+    }
+
+private:
+    string path;
+    mutex mtx;
+    vector<unique_ptr<FFPlayer>> idle;
+};
+
+}
+
+static AVCodecContext *open_proxy_encoder(const ProxyFormat &fmt) {
+    const AVCodec *codec = avcodec_find_encoder(AV_CODEC_ID_MJPEG);
+    if (!codec) { cerr << "No MJPEG encoder available for proxies\n"; return nullptr; }
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    if (!enc) return nullptr;
+    enc->width = fmt.width;
+    enc->height = fmt.height;
+    enc->pix_fmt = AV_PIX_FMT_YUVJ420P;
+    enc->time_base = fmt.time_base;
+    enc->flags |= AV_CODEC_FLAG_QSCALE;
+    enc->global_quality = FF_QP2LAMBDA * fmt.quality;
+    const int ret = avcodec_open2(enc, codec, nullptr);
+    if (ret < 0) {
+        print_error("Cannot open the proxy encoder", ret);
+        avcodec_free_context(&enc);
+    }
+    return enc;
+}
+
+// Decodes the chunk's frames, scales them and encodes each as a JPEG with
+// pts = frame number.
+static bool encode_chunk(DecoderPool &pool, const FrameIndex &index, const ProxyFormat &fmt, ProxyChunk &chunk,
+                         const atomic<bool> &abort, const atomic<bool> *cancel) {
+    unique_ptr<FFPlayer> p = pool.lease();
+    if (!p) return false;
+    AVCodecContext *enc = open_proxy_encoder(fmt);
+    if (!enc) return false;
+    unique_ptr<AVFrame, AVFrameDeleter> small(av_frame_alloc());
+    small->format = AV_PIX_FMT_YUVJ420P;
+    small->width = fmt.width;
+    small->height = fmt.height;
+    SwsContext *sws = nullptr;
+    PacketPtr pkt(av_packet_alloc());
+    bool ok = av_frame_get_buffer(small.get(), 0) >= 0;
+
+    int64_t last = chunk.first - 1;
+    unique_ptr<AVFrame, AVFrameDeleter> f = ok ? decode_frame_indexed(*p, index, chunk.first) : nullptr;
+    while (ok && f && !abort && !(cancel && cancel->load())) {
+        const int64_t n = pts_to_frame_number(p->last_shown_pts, p->video_stream);
+        if (chunk.end >= 0 && n >= chunk.end) break;
+        if (n > last) {
+            sws = sws_getCachedContext(sws, f->width, f->height, static_cast<AVPixelFormat>(f->format), fmt.width, fmt.height,
+                                       AV_PIX_FMT_YUVJ420P, SWS_FAST_BILINEAR, nullptr, nullptr, nullptr);
+            ok = sws && av_frame_make_writable(small.get()) >= 0;
+            if (!ok) break;
+            sws_scale(sws, f->data, f->linesize, 0, f->height, small->data, small->linesize);
+            small->pts = n;
+            ok = avcodec_send_frame(enc, small.get()) >= 0;
+            while (ok && avcodec_receive_packet(enc, pkt.get()) >= 0) {
+                chunk.packets.emplace_back(av_packet_clone(pkt.get()));
+                av_packet_unref(pkt.get());
+            }
+            last = n;
+        }
+        f = decode_next_frame(*p);
+    }
+    sws_freeContext(sws);
+    avcodec_free_context(&enc);
+    pool.release(move(p));
+    return ok && !abort && !(cancel && cancel->load());
+}
+
+bool build_proxy(const string &source, const string &proxy_file, const ProxyOptions &opts, const atomic<bool> *cancel) {
+    FFPlayer probe;
+    if (open_player(probe, source) < 0) return false;
+    FrameIndex index;
+    build_frame_index(probe, index);
+
+    ProxyFormat fmt;
+    fmt.height = max(16, opts.height) & ~1;
+    fmt.width = max(16, static_cast<int>(static_cast<int64_t>(probe.dec_ctx->width) * fmt.height / max(1, probe.dec_ctx->height))) & ~1;
+    fmt.time_base = av_inv_q(probe.avg_frame_rate);
+    fmt.quality = clamp(opts.quality, 2, 31);
+
+    // GOP-aligned chunks of at least chunk_frames frames.
+    vector<ProxyChunk> chunks;
+    int64_t chunk_start = 0;
+    for (int64_t key : index.keyframes) {
+        const int64_t n = pts_to_frame_number(key, probe.video_stream);
+        if (n - chunk_start < opts.chunk_frames) continue;
+        chunks.emplace_back();
+        chunks.back().first = chunk_start;
+        chunks.back().end = n;
+        chunk_start = n;
+    }
+    chunks.emplace_back();
+    chunks.back().first = chunk_start;
+
+    AVCodecContext *params = open_proxy_encoder(fmt);
+    if (!params) return false;
+    const string part = proxy_file + ".part";
+    AVFormatContext *oc = nullptr;
+    int ret = avformat_alloc_output_context2(&oc, nullptr, "avi", part.c_str());
+    AVStream *ost = ret >= 0 && oc ? avformat_new_stream(oc, nullptr) : nullptr;
+    if (ost) {
+        avcodec_parameters_from_context(ost->codecpar, params);
+        ost->time_base = fmt.time_base;
+        ost->avg_frame_rate = probe.avg_frame_rate;
+        ret = avio_open(&oc->pb, part.c_str(), AVIO_FLAG_WRITE);
+        if (ret >= 0) ret = avformat_write_header(oc, nullptr);
+    }
+    const AVRational enc_tb = params->time_base;
+    avcodec_free_context(&params);
+    if (!ost || ret < 0) {
+        print_error("Cannot create proxy " + part, ret);
+        if (oc) {
+            avio_closep(&oc->pb);
+            avformat_free_context(oc);
+        }
+        return false;
+    }
+
+    DecoderPool pool(source);
+    TaskScheduler &sched = TaskScheduler::global();
+    // Enough chunks in flight to keep every background slot busy without
+    // buffering much of the file in memory.
+    const size_t window = max<size_t>(2, sched.worker_count());
+    mutex mtx;
+    condition_variable cv;
+    atomic<bool> abort{false}; // stops the remaining chunks after an error
+    bool ok = true;
+    {
+        TaskGroup group(sched, TaskClass::Background);
+        size_t submitted = 0;
+        for (size_t next = 0; next < chunks.size() && ok; ++next) {
+            for (; submitted < chunks.size() && submitted < next + window; ++submitted) {
+                ProxyChunk *c = &chunks[submitted];
+                group.run([&, c] {
+                    const bool good = encode_chunk(pool, index, fmt, *c, abort, cancel);
+                    lock_guard<mutex> lk(mtx);
+                    c->ok = good;
+                    c->finished = true;
+                    cv.notify_all();
+                });
+            }
+            ProxyChunk &c = chunks[next];
+            {
+                unique_lock<mutex> lk(mtx);
+                cv.wait(lk, [&] { return c.finished; });
+            }
+            ok = c.ok;
+            for (PacketPtr &pkt : c.packets) {
+                if (!ok) break;
+                pkt->stream_index = ost->index;
+                av_packet_rescale_ts(pkt.get(), enc_tb, ost->time_base);
+                ok = av_interleaved_write_frame(oc, pkt.get()) >= 0;
+            }
+            c.packets.clear();
+            if (cancel && cancel->load()) ok = false;
+            if (!ok) abort = true;
+        }
+        group.wait();
+    }
+    if (ok) ok = av_write_trailer(oc) >= 0;
+    avio_closep(&oc->pb);
+    avformat_free_context(oc);
+
+    error_code ec;
+    if (ok) filesystem::rename(part, proxy_file, ec);
+    if (!ok || ec) filesystem::remove(part, ec);
+    return ok && !ec;
+}
+
+ProxyBuilder::ProxyBuilder(string source, ProxyOptions opts) : source(move(source)), opts(move(opts)) {}
+
+ProxyBuilder::~ProxyBuilder() {
+    cancel = true;
+    if (thread.joinable()) thread.join();
+}
+
+void ProxyBuilder::start() {
+    proxy_file = proxy_path_for(source, opts);
+    if (proxy_file.empty()) { cerr << "Cannot fingerprint " << source << ", no proxy\n"; return; }
+    error_code ec;
+    if (filesystem::exists(proxy_file, ec)) {
+        done = true;
+        return;
+    }
+    filesystem::create_directories(filesystem::path(proxy_file).parent_path(), ec);
+    thread = std::thread([this] {
+        const auto start = chrono::steady_clock::now();
+        if (!build_proxy(source, proxy_file, opts, &cancel)) return;
+        cout << "Proxy ready after " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s: " << proxy_file << '\n';
+        done = true;
+    });
+}
+
+unique_ptr<FFPlayer> ProxyBuilder::take_player() {
+    if (taken || !done) return nullptr;
+    taken = true;
+    unique_ptr<FFPlayer> p = make_unique<FFPlayer>();
+    if (open_player(*p, proxy_file) < 0) return nullptr;
+    return p;
+}
+
+int run_proxy_build(const string &input, const ProxyOptions &opts) {
+    const string path = proxy_path_for(input, opts);
+    if (path.empty()) { cerr << "Cannot read " << input << '\n'; return -1; }
+    error_code ec;
+    if (filesystem::exists(path, ec)) {
+        cout << "Proxy already cached: " << path << '\n';
+        return 0;
+    }
+    filesystem::create_directories(filesystem::path(path).parent_path(), ec);
+    const auto start = chrono::steady_clock::now();
+    if (!build_proxy(input, path, opts)) { cerr << "Proxy build failed\n"; return -1; }
+    cout << "Built " << path << " in " << chrono::duration<double>(chrono::steady_clock::now() - start).count() << " s\n";
+    return 0;
+}
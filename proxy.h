@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "ff_player.h"
+
+struct ProxyOptions {
+    int height = 360;
+    int quality = 5;            // MJPEG qscale, 2 (best) .. 31
+    std::string cache_dir;      // empty = default_proxy_dir()
+    int64_t chunk_frames = 240; // frames per background encode task, rounded to GOPs
+};
+
+// <temp>/vmix_proxies
+std::string default_proxy_dir();
+// <cache_dir>/<fingerprint>_<height>p.avi
+std::string proxy_path_for(const std::string &source, const ProxyOptions &opts);
+
+// Transcodes `source` to an all-intra MJPEG AVI of opts.height lines in
+// which frame n is frame n of the source, so the proxy can stand in for any
+// frame and seeks on it never decode more than one frame. The file is cut
+// into GOP-aligned chunks that decode and encode as Background tasks on the
+// task scheduler, i.e. only on cores the player does not need; a writer
+// muxes finished chunks in order. Writes to a .part file and renames it when
+// complete. Returns false on error or when `cancel` was set.
+bool build_proxy(const std::string &source, const std::string &proxy_file, const ProxyOptions &opts,
+                 const std::atomic<bool> *cancel = nullptr);
+
+// Finds the cached proxy of a file or builds it on a background thread.
+class ProxyBuilder {
+public:
+    ProxyBuilder(std::string source, ProxyOptions opts);
+    ~ProxyBuilder();
+    ProxyBuilder(const ProxyBuilder &) = delete;
+    ProxyBuilder &operator=(const ProxyBuilder &) = delete;
+
+    void start();
+    bool ready() const { return done.load(); }
+    const std::string &path() const { return proxy_file; }
+
+    // Opens the proxy once it is ready. Returns null before that, on error,
+    // and after the first successful call.
+    std::unique_ptr<FFPlayer> take_player();
+
+private:
+    std::string source;
+    ProxyOptions opts;
+    std::string proxy_file;
+    std::thread thread;
+    std::atomic<bool> cancel{false};
+    std::atomic<bool> done{false};
+    bool taken = false;
+};
+
+// --build-proxy: builds (or finds) the proxy of `input` and exits.
+int run_proxy_build(const std::string &input, const ProxyOptions &opts);
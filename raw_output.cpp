@@ -0,0 +1,308 @@
+#include "raw_output.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VMIX_HAVE_POSIX_IO 1
+#endif
+#if defined(__linux__)
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#endif
+
+extern "C" {
+#include <libavutil/imgutils.h>
+#include <libavutil/pixdesc.h>
+}
+
+#include "ff_player.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+#ifdef VMIX_HAVE_POSIX_IO
+
+using Clock = chrono::steady_clock;
+
+namespace {
+
+enum class SlotState { Free, Converting, Ready, Failed, InPipe };
+
+struct RawSlot {
+    uint8_t *data = nullptr;
+    SwsContext *sws = nullptr;    // one per slot, slots convert in parallel
+    SlotState state = SlotState::Free;
+    int64_t frame = -1;
+    uint64_t end_offset = 0;      // output offset after this frame, once written
+
+    ~RawSlot() {
+        if (sws) sws_freeContext(sws);
+        av_free(data);
+    }
+};
+
+struct RawStats {
+    int64_t frames = 0;
+    uint64_t bytes = 0;
+    double write_s = 0.0;         // writer in write()/vmsplice(), i.e. mostly waiting for the reader
+    double starved_s = 0.0;       // writer waiting for decode and conversion
+};
+
+}
+
+// Sizes of 0 keep the source's, or follow its aspect ratio when only the
+// other one is given; odd results are rounded up for 4:2:0 formats.
+static void output_size(const RawOutputOptions &opts, int src_w, int src_h, int &w, int &h) {
+    w = opts.width;
+    h = opts.height;
+    if (w <= 0 && h <= 0) {
+        w = src_w;
+        h = src_h;
+    } else if (w <= 0) {
+        w = static_cast<int>(static_cast<int64_t>(src_w) * h / max(1, src_h));
+    } else if (h <= 0) {
+        h = static_cast<int>(static_cast<int64_t>(src_h) * w / max(1, src_w));
+    }
+    w = max(2, w + (w & 1));
+    h = max(2, h + (h & 1));
+}
+
+// Writes all of [p, p + n), waiting for the reader when the pipe is full.
+// `splice` is cleared for good if the kernel refuses vmsplice on this fd.
+static bool write_all(int fd, const uint8_t *p, size_t n, bool &splice) {
+    while (n > 0) {
+        ssize_t r;
+#if defined(__linux__)
+        if (splice) {
+            iovec iov{const_cast<uint8_t *>(p), n};
+            r = vmsplice(fd, &iov, 1, 0);
+            if (r < 0 && (errno == EINVAL || errno == ENOSYS || errno == EBADF)) {
+                splice = false;
+                continue;
+            }
+        } else {
+            r = write(fd, p, n);
+        }
+#else
+        r = write(fd, p, n);
+#endif
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) return false;
+            pollfd pfd{fd, POLLOUT, 0}; // stdout may be non-blocking
+            poll(&pfd, 1, -1);
+            continue;
+        }
+        p += r;
+        n -= static_cast<size_t>(r);
+    }
+    return true;
+}
+
+#if defined(__linux__)
+// vmsplice'd frames are still the slots' own pages while they sit in the
+// pipe, so the slots must outlive the pipe's contents. Returns once the
+// reader has taken everything or has gone away.
+static void wait_for_drain(int fd) {
+    for (;;) {
+        int queued = 0;
+        if (ioctl(fd, FIONREAD, &queued) < 0 || queued <= 0) return;
+        pollfd pfd{fd, 0, 0}; // POLLERR once the read end is closed
+        poll(&pfd, 1, 10);
+        if (pfd.revents & (POLLERR | POLLHUP)) return;
+    }
+}
+#endif
+
+int run_raw_output(const string &input, const RawOutputOptions &opts) {
+    const AVPixelFormat dst_fmt = av_get_pix_fmt(opts.pix_fmt.c_str());
+    const AVPixFmtDescriptor *dst_desc = av_pix_fmt_desc_get(dst_fmt);
+    if (dst_fmt == AV_PIX_FMT_NONE || !dst_desc || (dst_desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM))) {
+        cerr << "Unknown or unsupported --raw-format " << opts.pix_fmt << '\n';
+        return -1;
+    }
+
+    FFPlayer p;
+    if (open_player(p, input) < 0) return -1;
+    int w = 0, h = 0;
+    output_size(opts, p.dec_ctx->width, p.dec_ctx->height, w, h);
+    const int frame_bytes = av_image_get_buffer_size(dst_fmt, w, h, 1);
+    if (frame_bytes <= 0) {
+        cerr << "Cannot output " << w << 'x' << h << ' ' << opts.pix_fmt << '\n';
+        return -1;
+    }
+
+    const bool to_stdout = opts.output == "-";
+    if (!to_stdout) {
+        struct stat st{};
+        if (stat(opts.output.c_str(), &st) == 0 && S_ISFIFO(st.st_mode)) cerr << "Waiting for a reader on " << opts.output << '\n';
+    }
+    const int fd = to_stdout ? STDOUT_FILENO : open(opts.output.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        cerr << "Cannot open " << opts.output << " : " << strerror(errno) << '\n';
+        return -1;
+    }
+    // A reader that goes away ends the run with EPIPE instead of killing it.
+    signal(SIGPIPE, SIG_IGN);
+
+    vector<RawSlot> slots(static_cast<size_t>(max(2, opts.slots)));
+    for (RawSlot &s : slots) {
+        s.data = static_cast<uint8_t *>(av_malloc(static_cast<size_t>(frame_bytes)));
+        if (!s.data) {
+            cerr << "Out of memory for " << slots.size() << " output frames\n";
+            if (!to_stdout) close(fd);
+            return -1;
+        }
+    }
+
+    // vmsplice hands the pages themselves to the pipe, so a buffer may only
+    // be refilled once more than a pipe's worth of later data has been
+    // written: the pipe cannot still hold any of it then. The ring has to
+    // be deep enough for that, or the decoder would wait forever. For the
+    // same reason the slots are only freed once the pipe has drained.
+    struct stat out_st{};
+    const bool is_pipe = fstat(fd, &out_st) == 0 && S_ISFIFO(out_st.st_mode);
+    bool splice = false;
+    uint64_t pipe_size = 0;
+#if defined(__linux__)
+    if (is_pipe) {
+        fcntl(fd, F_SETPIPE_SZ, 1 << 20); // fewer wake-ups; capped by /proc/sys/fs/pipe-max-size
+        const int sz = fcntl(fd, F_GETPIPE_SZ);
+        pipe_size = sz > 0 ? static_cast<uint64_t>(sz) : 0;
+        splice = pipe_size > 0 && static_cast<uint64_t>(frame_bytes) * (slots.size() - 1) >= pipe_size;
+    }
+#endif
+    const bool spliced_at_start = splice;
+
+    cerr << "Writing " << w << 'x' << h << ' ' << dst_desc->name << " (" << frame_bytes << " bytes per frame) from " << input
+         << " to " << (to_stdout ? "stdout" : opts.output) << (is_pipe ? (splice ? ", pipe via vmsplice" : ", pipe via write") : "")
+         << '\n';
+
+    mutex mtx;
+    condition_variable cv;
+    bool failed = false;
+    bool reader_gone = false;
+    bool decode_done = false;
+    int64_t decoded = 0;
+    RawStats stats;
+    const Clock::time_point started = Clock::now();
+
+    std::thread writer([&] {
+        for (int64_t k = 0;; ++k) {
+            RawSlot &s = slots[static_cast<size_t>(k) % slots.size()];
+            const auto t0 = Clock::now();
+            {
+                unique_lock<mutex> lk(mtx);
+                cv.wait(lk, [&] { return (s.state == SlotState::Ready && s.frame == k) || (decode_done && k >= decoded) || failed; });
+                // A slot whose conversion failed is never written.
+                if (s.state != SlotState::Ready || s.frame != k) return;
+            }
+            const auto t1 = Clock::now();
+            const bool ok = write_all(fd, s.data, static_cast<size_t>(frame_bytes), splice);
+            const int err = errno;
+            stats.write_s += chrono::duration<double>(Clock::now() - t1).count();
+            stats.starved_s += chrono::duration<double>(t1 - t0).count();
+            lock_guard<mutex> lk(mtx);
+            if (!ok) {
+                failed = true;
+                reader_gone = err == EPIPE;
+                if (!reader_gone) cerr << "Write failed : " << strerror(err) << '\n';
+                cv.notify_all();
+                return;
+            }
+            ++stats.frames;
+            stats.bytes += static_cast<uint64_t>(frame_bytes);
+            s.end_offset = stats.bytes;
+            s.state = splice ? SlotState::InPipe : SlotState::Free;
+            for (RawSlot &o : slots) {
+                if (o.state == SlotState::InPipe && (!splice || stats.bytes - o.end_offset >= pipe_size)) o.state = SlotState::Free;
+            }
+            cv.notify_all();
+        }
+    });
+
+    const AVPixelFormat src_fmt = p.dec_ctx->pix_fmt;
+    {
+        TaskGroup convert(TaskScheduler::global(), TaskClass::Prefetch);
+        for (int64_t k = 0;; ++k) {
+            unique_ptr<AVFrame, AVFrameDeleter> f = decode_next_frame(p);
+            if (!f) break;
+            RawSlot *s = &slots[static_cast<size_t>(k) % slots.size()];
+            {
+                unique_lock<mutex> lk(mtx);
+                cv.wait(lk, [&] { return s->state == SlotState::Free || failed; });
+                if (failed) break;
+                s->state = SlotState::Converting;
+                s->frame = k;
+                decoded = k + 1;
+            }
+            AVFrame *frame = f.release();
+            convert.run([&, s, frame] {
+                unique_ptr<AVFrame, AVFrameDeleter> owned(frame);
+                const AVPixelFormat fmt = static_cast<AVPixelFormat>(frame->format);
+                bool ok = true;
+                if (fmt == dst_fmt && frame->width == w && frame->height == h) {
+                    ok = av_image_copy_to_buffer(s->data, frame_bytes, frame->data, frame->linesize, dst_fmt, w, h, 1) >= 0;
+                } else {
+                    s->sws = sws_getCachedContext(s->sws, frame->width, frame->height, fmt, w, h, dst_fmt, SWS_BILINEAR, nullptr, nullptr,
+                                                  nullptr);
+                    uint8_t *dst[4];
+                    int dst_linesize[4];
+                    ok = s->sws && av_image_fill_arrays(dst, dst_linesize, s->data, dst_fmt, w, h, 1) >= 0;
+                    if (ok) sws_scale(s->sws, frame->data, frame->linesize, 0, frame->height, dst, dst_linesize);
+                }
+                lock_guard<mutex> lk(mtx);
+                if (!ok && !failed) {
+                    cerr << "Cannot convert " << av_get_pix_fmt_name(fmt) << " to " << dst_desc->name << '\n';
+                    failed = true;
+                }
+                s->state = ok ? SlotState::Ready : SlotState::Failed;
+                cv.notify_all();
+            });
+        }
+        convert.wait();
+    }
+    {
+        lock_guard<mutex> lk(mtx);
+        decode_done = true;
+    }
+    cv.notify_all();
+    writer.join();
+#if defined(__linux__)
+    if (spliced_at_start) wait_for_drain(fd);
+#endif
+    if (!to_stdout) close(fd);
+
+    const double secs = max(1e-9, chrono::duration<double>(Clock::now() - started).count());
+    const double mb = static_cast<double>(stats.bytes) / 1e6;
+    if (reader_gone) cerr << "Reader closed the pipe after " << stats.frames << " frames\n";
+    cerr << "Wrote " << stats.frames << " frames (" << mb << " MB) in " << secs << " s: " << static_cast<double>(stats.frames) / secs
+         << " frames/s, " << mb / secs << " MB/s sustained";
+    if (spliced_at_start) cerr << (splice ? ", vmsplice" : ", vmsplice refused, write");
+    cerr << "; writer busy writing " << 100.0 * stats.write_s / secs << "% of the time, waiting for "
+         << av_get_pix_fmt_name(src_fmt) << " decode and conversion " << 100.0 * stats.starved_s / secs << "%\n";
+    return failed && !reader_gone ? -1 : 0;
+}
+
+#else
+
+int run_raw_output(const string &, const RawOutputOptions &) {
+    cerr << "Raw frame output needs POSIX file descriptors, which this build does not support\n";
+    return -1;
+}
+
+#endif
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+
+struct RawOutputOptions {
+    std::string output = "-";        // FIFO or file path, "-" = stdout
+    std::string pix_fmt = "yuv420p"; // any FFmpeg pixel format name
+    int width = 0;                   // 0 = source size, or in proportion when only the other is set
+    int height = 0;
+    int slots = 4;                   // converted frames in flight between decode and the writer
+};
+
+// --raw-out: decodes `input` as fast as possible, without a window, and
+// writes every frame as tightly packed rawvideo in opts.pix_fmt (the layout
+// of ffmpeg -f rawvideo) to a FIFO, file or stdout. Conversions run on the
+// task scheduler into a ring of frame buffers while the next frame decodes;
+// a writer thread drains the ring in order. Pipes get vmsplice() on Linux,
+// mapping the buffers into the pipe instead of copying them, when the ring
+// is deep enough that a buffer is never reused before the reader has
+// consumed it; everything else gets whole-frame write()s. A slow reader
+// blocks the writer, which stalls decoding through the ring, so nothing is
+// ever dropped. Progress and the sustained MB/s go to stderr.
+int run_raw_output(const std::string &input, const RawOutputOptions &opts);
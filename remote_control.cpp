@@ -0,0 +1,303 @@
+#include "remote_control.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define VMIX_HAVE_UNIX_SOCKETS 1
+#endif
+
+using namespace std;
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Position-only updates while playing are limited to this interval.
+static const auto kStatePushInterval = chrono::milliseconds(100);
+// A client that stops reading is dropped once this much output is queued.
+static const size_t kMaxQueuedOutput = 1 << 20;
+
+static string state_line(const PlaybackState &s) {
+    ostringstream os;
+    os.setf(ios::fixed);
+    os.precision(3);
+    os << "STATE playing=" << s.playing << " frame=" << s.frame << " speed=" << s.speed << " loop=" << s.loop
+       << " in=" << s.loop_in << " out=" << s.loop_out << '\n';
+    return os.str();
+}
+
+void RemoteControl::send_to(uint64_t client_id, const string &msg) {
+    {
+        lock_guard<mutex> lk(mtx);
+        outbox.emplace_back(client_id, msg);
+    }
+#ifdef VMIX_HAVE_UNIX_SOCKETS
+    const char b = 1;
+    if (wake_fds[1] >= 0 && write(wake_fds[1], &b, 1) < 0) {
+        // Pipe full: the control thread is already due to wake up.
+    }
+#endif
+}
+
+void RemoteControl::complete(uint64_t id, int64_t frame, Clock::time_point issued, Clock::time_point done) {
+    uint64_t client = 0;
+    const double ms = chrono::duration<double, milli>(done - issued).count();
+    {
+        lock_guard<mutex> lk(mtx);
+        auto it = pending.find(id);
+        if (it == pending.end()) return;
+        client = it->second.first;
+        latency_ms[it->second.second].push_back(ms);
+        pending.erase(it);
+    }
+    ostringstream os;
+    os.setf(ios::fixed);
+    os.precision(3);
+    os << "DONE " << id << ' ' << frame << ' ' << ms << '\n';
+    send_to(client, os.str());
+}
+
+void RemoteControl::on_state(const PlaybackState &state) {
+    if (!running) return;
+    const Clock::time_point now = Clock::now();
+    bool push = true;
+    {
+        lock_guard<mutex> lk(mtx);
+        const bool only_frame = state.playing == last_state.playing && state.speed == last_state.speed
+            && state.loop == last_state.loop && state.loop_in == last_state.loop_in && state.loop_out == last_state.loop_out;
+        if (only_frame && state.playing && now - last_push < kStatePushInterval) push = false;
+        if (only_frame && state.frame == last_state.frame && !state.applied_command) push = false;
+        last_state = state;
+        if (push) last_push = now;
+    }
+    if (push) send_to(0, state_line(state));
+    if (state.applied_command) complete(state.applied_command, -1, state.applied_issued, now);
+}
+
+void RemoteControl::on_presented(const PresentFrame &frame, Clock::time_point presented) {
+    if (frame.command_id) complete(frame.command_id, frame.frame_number, frame.command_issued, presented);
+}
+
+string RemoteControl::stats_text() {
+    lock_guard<mutex> lk(mtx);
+    ostringstream os;
+    os.setf(ios::fixed);
+    os.precision(3);
+    for (auto &[name, samples] : latency_ms) {
+        if (samples.empty()) continue;
+        vector<double> v = samples;
+        sort(v.begin(), v.end());
+        double sum = 0.0;
+        for (double x : v) sum += x;
+        os << name << ": " << v.size() << " commands, command-to-frame ms mean " << sum / static_cast<double>(v.size())
+           << ", p50 " << v[v.size() / 2] << ", p99 " << v[min(v.size() - 1, v.size() * 99 / 100)] << ", max " << v.back() << '\n';
+    }
+    return os.str();
+}
+
+void RemoteControl::print_summary(ostream &os) {
+    const string text = stats_text();
+    if (!text.empty()) os << "Remote control latency:\n" << text;
+}
+
+void RemoteControl::handle_line(Client &c, const string &line) {
+    istringstream in(line);
+    string name;
+    in >> name;
+    if (name.empty()) return;
+    transform(name.begin(), name.end(), name.begin(), [](unsigned char ch) { return static_cast<char>(toupper(ch)); });
+
+    PlaybackCommand cmd{PlaybackCommandType::Play};
+    cmd.issued = Clock::now();
+    if (name == "PLAY") {
+        cmd.type = PlaybackCommandType::Play;
+    } else if (name == "PAUSE") {
+        cmd.type = PlaybackCommandType::Pause;
+    } else if (name == "TOGGLE") {
+        cmd.type = PlaybackCommandType::Toggle;
+    } else if (name == "STEP" || name == "BACK") {
+        cmd.type = name == "STEP" ? PlaybackCommandType::StepForward : PlaybackCommandType::StepBackward;
+        if (!(in >> cmd.frame)) cmd.frame = 1;
+    } else if (name == "SEEK") {
+        cmd.type = PlaybackCommandType::Seek;
+        if (!(in >> cmd.frame) || cmd.frame < 0) { c.out += "ERR SEEK needs a frame number\n"; return; }
+    } else if (name == "SPEED") {
+        cmd.type = PlaybackCommandType::SetSpeed;
+        if (!(in >> cmd.speed) || !isfinite(cmd.speed) || cmd.speed <= 0.0) { c.out += "ERR SPEED needs a positive factor\n"; return; }
+    } else if (name == "LOOP") {
+        cmd.type = PlaybackCommandType::SetLoop;
+        string mode;
+        in >> mode;
+        transform(mode.begin(), mode.end(), mode.begin(), [](unsigned char ch) { return static_cast<char>(tolower(ch)); });
+        cmd.loop = mode == "on" || mode == "1";
+        if (cmd.loop && (in >> cmd.loop_in) && !(in >> cmd.loop_out)) cmd.loop_out = -1;
+    } else if (name == "STATE") {
+        lock_guard<mutex> lk(mtx);
+        c.out += state_line(last_state);
+        return;
+    } else if (name == "STATS") {
+        const string text = stats_text();
+        c.out += "STATS " + to_string(text.size()) + "\n" + text;
+        return;
+    } else if (name == "QUIT") {
+        quit = true;
+        c.out += "OK 0\n";
+        return;
+    } else {
+        c.out += "ERR unknown command " + name + "\n";
+        return;
+    }
+
+    cmd.id = next_id++;
+    {
+        // Registered before posting: the decode thread may finish it at once.
+        lock_guard<mutex> lk(mtx);
+        pending[cmd.id] = {c.id, name};
+    }
+    c.out += "OK " + to_string(cmd.id) + "\n";
+    pipeline.post(cmd);
+}
+
+#ifdef VMIX_HAVE_UNIX_SOCKETS
+
+bool RemoteControl::start(const string &socket_path) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(addr.sun_path)) {
+        cerr << "Control socket path too long: " << socket_path << '\n';
+        return false;
+    }
+    memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) { cerr << "socket failed : " << strerror(errno) << '\n'; return false; }
+    unlink(socket_path.c_str());
+    if (bind(listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listen_fd, 8) != 0 || pipe(wake_fds) != 0) {
+        cerr << "Cannot listen on " << socket_path << " : " << strerror(errno) << '\n';
+        close(listen_fd);
+        listen_fd = -1;
+        return false;
+    }
+    fcntl(wake_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(wake_fds[1], F_SETFL, O_NONBLOCK);
+    path = socket_path;
+    running = true;
+    thread = std::thread([this] { run(); });
+    cout << "Remote control on " << path << '\n';
+    return true;
+}
+
+void RemoteControl::stop() {
+    if (!running.exchange(false)) return;
+    send_to(0, string());
+    if (thread.joinable()) thread.join();
+    for (auto &[id, c] : clients) close(c.fd);
+    clients.clear();
+    close(listen_fd);
+    close(wake_fds[0]);
+    close(wake_fds[1]);
+    listen_fd = wake_fds[0] = wake_fds[1] = -1;
+    unlink(path.c_str());
+}
+
+void RemoteControl::run() {
+    vector<pollfd> fds;
+    vector<uint64_t> ids;
+    while (running) {
+        fds.assign({{listen_fd, POLLIN, 0}, {wake_fds[0], POLLIN, 0}});
+        ids.assign(2, 0);
+        for (auto &[id, c] : clients) {
+            fds.push_back({c.fd, static_cast<short>(POLLIN | (c.out.empty() ? 0 : POLLOUT)), 0});
+            ids.push_back(id);
+        }
+        if (poll(fds.data(), fds.size(), 250) < 0 && errno != EINTR) break;
+
+        char drain[64];
+        while (read(wake_fds[0], drain, sizeof(drain)) > 0) {}
+
+        if (fds[0].revents & POLLIN) {
+            const int fd = accept(listen_fd, nullptr, nullptr);
+            if (fd >= 0) {
+                fcntl(fd, F_SETFL, O_NONBLOCK);
+                Client c;
+                c.id = next_client++;
+                c.fd = fd;
+                {
+                    lock_guard<mutex> lk(mtx);
+                    c.out = state_line(last_state);
+                }
+                clients.emplace(c.id, move(c));
+            }
+        }
+
+        for (size_t i = 2; i < fds.size(); ++i) {
+            if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+            Client &c = clients[ids[i]];
+            char buf[4096];
+            const ssize_t n = recv(c.fd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                if (n < 0 && (errno == EAGAIN || errno == EINTR)) continue;
+                close(c.fd);
+                clients.erase(ids[i]);
+                continue;
+            }
+            c.in.append(buf, static_cast<size_t>(n));
+            size_t nl;
+            while ((nl = c.in.find('\n')) != string::npos) {
+                string line = c.in.substr(0, nl);
+                c.in.erase(0, nl + 1);
+                if (!line.empty() && line.back() == '\r') line.pop_back();
+                handle_line(c, line);
+            }
+            if (c.in.size() > 4096) c.in.clear();
+        }
+
+        vector<pair<uint64_t, string>> msgs;
+        {
+            lock_guard<mutex> lk(mtx);
+            msgs.swap(outbox);
+        }
+        for (auto &[to, msg] : msgs) {
+            if (msg.empty()) continue;
+            if (to == 0) for (auto &[id, c] : clients) c.out += msg;
+            else if (auto it = clients.find(to); it != clients.end()) it->second.out += msg;
+        }
+
+        for (auto it = clients.begin(); it != clients.end();) {
+            Client &c = it->second;
+            while (!c.out.empty()) {
+                const ssize_t n = send(c.fd, c.out.data(), c.out.size(), MSG_NOSIGNAL);
+                if (n <= 0) break;
+                c.out.erase(0, static_cast<size_t>(n));
+            }
+            if (c.out.size() > kMaxQueuedOutput) {
+                close(c.fd);
+                it = clients.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+#else
+
+bool RemoteControl::start(const string &) {
+    cerr << "Remote control needs Unix domain sockets, which this build does not support\n";
+    return false;
+}
+
+void RemoteControl::stop() {}
+void RemoteControl::run() {}
+
+#endif
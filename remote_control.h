@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "playback_pipeline.h"
+
+// Line-based control channel on a Unix domain socket for external control
+// surfaces. Commands go straight to the decode thread, independent of the
+// display's key polling:
+//
+//   PLAY | PAUSE | TOGGLE | STEP [N] | BACK [N] | SEEK <frame>
+//   SPEED <factor> | LOOP on [<in> <out>] | LOOP off | STATE | STATS | QUIT
+//
+// Every accepted command is answered with `OK <id>` right away and with
+// `DONE <id> <frame> <ms>` once its effect is visible: when its first frame has
+// been presented, or, for commands without a new frame (pause, speed, loop),
+// when the decode thread applied it (frame -1). All clients receive
+//
+//   STATE playing=<0|1> frame=<n> speed=<x> loop=<0|1> in=<n> out=<n>
+//
+// on every change, and about ten times a second during playback.
+class RemoteControl {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit RemoteControl(PlaybackPipeline &pipeline) : pipeline(pipeline) {}
+    ~RemoteControl() { stop(); }
+
+    bool start(const std::string &socket_path);
+    void stop();
+
+    // Decode thread (PlaybackPipeline state listener).
+    void on_state(const PlaybackState &state);
+    // Display thread, right after a frame was presented.
+    void on_presented(const PresentFrame &frame, Clock::time_point presented);
+
+    bool quit_requested() const { return quit.load(); }
+    void print_summary(std::ostream &os);
+
+private:
+    struct Client {
+        uint64_t id = 0;
+        int fd = -1;
+        std::string in;
+        std::string out;
+    };
+
+    void run();
+    void handle_line(Client &c, const std::string &line);
+    void send_to(uint64_t client_id, const std::string &msg); // 0 = all clients
+    void complete(uint64_t id, int64_t frame, Clock::time_point issued, Clock::time_point done);
+    std::string stats_text();
+
+    PlaybackPipeline &pipeline;
+    std::string path;
+    int listen_fd = -1;
+    int wake_fds[2] = {-1, -1};
+    std::thread thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> quit{false};
+    std::atomic<uint64_t> next_id{1};
+
+    // Control thread only.
+    std::unordered_map<uint64_t, Client> clients;
+    uint64_t next_client = 1;
+
+    std::mutex mtx; // everything below
+    std::vector<std::pair<uint64_t, std::string>> outbox;
+    std::unordered_map<uint64_t, std::pair<uint64_t, std::string>> pending; // command id -> client, command
+    std::map<std::string, std::vector<double>> latency_ms; // per command
+    PlaybackState last_state;
+    Clock::time_point last_push{};
+};
@@ -0,0 +1,73 @@
+#include "segment_export.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+
+#include <opencv2/opencv.hpp>
+
+#include "gop_sampler.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+int run_segment_export(const string &input, const SegmentExportOptions &opts) {
+    const bool jpeg = opts.format == "jpg" || opts.format == "jpeg";
+    if (!jpeg && opts.format != "png") { cerr << "Unknown export format " << opts.format << " (png or jpg)\n"; return -1; }
+    error_code ec;
+    filesystem::create_directories(opts.output, ec);
+    if (ec) { cerr << "Cannot create " << opts.output << '\n'; return -1; }
+
+    TaskScheduler &sched = TaskScheduler::global();
+    const size_t decoders = opts.decoders ? opts.decoders : max<size_t>(1, sched.worker_count() / 2);
+    GopSampler sampler(input, decoders, sched);
+    if (sampler.open() < 0) return -1;
+
+    // PNG at the lowest zlib level: the encode is the expensive half of the
+    // export, and the size difference to level 3 is small for video frames.
+    const vector<int> params = jpeg ? vector<int>{cv::IMWRITE_JPEG_QUALITY, opts.jpeg_quality}
+                                    : vector<int>{cv::IMWRITE_PNG_COMPRESSION, 1};
+    const string ext = jpeg ? ".jpg" : ".png";
+    const filesystem::path dir(opts.output);
+    atomic<uint64_t> written{0}, failed{0}, inline_encodes{0};
+    atomic<int64_t> queued{0};
+    const int64_t max_queued = 2 * static_cast<int64_t>(max(1u, sched.worker_count()));
+
+    const auto start = chrono::steady_clock::now();
+    SamplerStats s;
+    {
+        TaskGroup encoders(sched, TaskClass::Prefetch);
+        s = sampler.run(opts.frames, [&](const SampledFrame &f) {
+            auto img = make_shared<cv::Mat>();
+            convert_frame_into(f.frame, *f.decoder, *img);
+            char name[48];
+            snprintf(name, sizeof(name), "frame_%08lld", static_cast<long long>(f.frame_number));
+            auto encode = [&, img, path = (dir / (name + ext)).string()] {
+                if (cv::imwrite(path, *img, params)) ++written;
+                else ++failed;
+            };
+            if (queued.load() >= max_queued) {
+                ++inline_encodes;
+                encode();
+                return;
+            }
+            ++queued;
+            encoders.run([&, encode] {
+                encode();
+                --queued;
+            });
+        });
+        encoders.wait();
+    }
+    const double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    cout << "Exported " << written << " of " << s.targets << " frames as " << ext.substr(1) << " to " << opts.output << " in "
+         << secs << " s (" << (secs > 0.0 ? static_cast<double>(written) / secs : 0.0) << " frames/s)\n"
+         << s.gops_decoded << " GOPs on " << decoders << " decoders, " << inline_encodes
+         << " frames encoded by decoders while the encoders were busy, " << failed << " writes failed\n";
+    return written == s.targets ? 0 : -1;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct SegmentExportOptions {
+    std::vector<int64_t> frames; // e.g. a range 0-17999
+    std::string format = "png";  // png or jpg
+    int jpeg_quality = 95;
+    std::string output = "frames";
+    size_t decoders = 0;         // 0 = half the scheduler workers
+};
+
+// --export: writes frames as an image sequence. The range is cut at
+// keyframes and the segments are decoded concurrently by separate decoder
+// instances (GopSampler); every converted frame is handed to an encode task
+// on the scheduler and written to its own file, frame_00001234.png, so
+// nothing waits for frames to arrive in order. When encoding falls behind,
+// decoders encode their own frames instead of queueing more.
+int run_segment_export(const std::string &input, const SegmentExportOptions &opts);
@@ -0,0 +1,238 @@
+#include "shm_frame_ring.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define VMIX_HAVE_POSIX_SHM 1
+#endif
+
+using namespace std;
+
+static size_t round_up(size_t v, size_t align) {
+    return (v + align - 1) / align * align;
+}
+
+string shm_object_name(const string &name) {
+    return !name.empty() && name[0] == '/' ? name : "/" + name;
+}
+
+#ifdef VMIX_HAVE_POSIX_SHM
+
+static ShmSlotHeader *slot_at(void *base, const ShmRingHeader *h, uint64_t i) {
+    uint8_t *p = static_cast<uint8_t *>(base) + round_up(sizeof(ShmRingHeader), 4096) + i * h->slot_stride;
+    return reinterpret_cast<ShmSlotHeader *>(p);
+}
+
+ShmFrameWriter::~ShmFrameWriter() {
+    if (!header) return;
+    header->producer_open.store(0, memory_order_release);
+    munmap(base, mapped);
+    // Readers keep their mapping; unlinking only removes the name.
+    shm_unlink(name.c_str());
+}
+
+bool ShmFrameWriter::create(const string &shm_name, uint32_t slots, size_t max_frame_bytes) {
+    name = shm_object_name(shm_name);
+    slots = max<uint32_t>(2, slots);
+    const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    const size_t payload_offset = round_up(sizeof(ShmSlotHeader), 64);
+    // Page-aligned slots keep payloads aligned for SIMD consumers.
+    const size_t stride = round_up(payload_offset + max_frame_bytes, page);
+    const size_t header_bytes = round_up(sizeof(ShmRingHeader), 4096);
+    mapped = header_bytes + stride * slots;
+
+    shm_unlink(name.c_str());
+    const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) { cerr << "shm_open " << name << " failed : " << strerror(errno) << '\n'; return false; }
+    if (ftruncate(fd, static_cast<off_t>(mapped)) != 0) {
+        cerr << "ftruncate " << name << " failed : " << strerror(errno) << '\n';
+        close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+    base = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        cerr << "mmap " << name << " failed : " << strerror(errno) << '\n';
+        base = nullptr;
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    header = new (base) ShmRingHeader{};
+    header->magic = kShmRingMagic;
+    header->version = kShmRingVersion;
+    header->slot_count = slots;
+    header->payload_offset = static_cast<uint32_t>(payload_offset);
+    header->slot_stride = stride;
+    header->payload_capacity = stride - payload_offset;
+    for (uint32_t i = 0; i < slots; ++i) new (slot_at(base, header, i)) ShmSlotHeader{};
+    header->frames_written.store(0, memory_order_relaxed);
+    header->replaced.store(0, memory_order_relaxed);
+    header->producer_open.store(1, memory_order_release);
+    return true;
+}
+
+// The new ring is complete before the old one is flagged, so a reader that
+// reopens on the flag never maps a half-initialised object.
+bool ShmFrameWriter::grow(size_t frame_bytes) {
+    ShmRingHeader *old = header;
+    void *old_base = base;
+    const size_t old_mapped = mapped;
+    const uint64_t written = old->frames_written.load(memory_order_relaxed);
+    header = nullptr;
+    base = nullptr;
+    if (!create(name, old->slot_count, frame_bytes)) {
+        // The name is gone, but attached readers keep the old ring.
+        header = old;
+        base = old_base;
+        mapped = old_mapped;
+        return false;
+    }
+    header->frames_written.store(written, memory_order_release);
+    cerr << "Shared-memory ring " << name << " re-created for " << frame_bytes << "-byte frames\n";
+    old->replaced.store(1, memory_order_release);
+    old->producer_open.store(0, memory_order_release);
+    munmap(old_base, old_mapped);
+    return true;
+}
+
+uint8_t *ShmFrameWriter::begin_write(const ShmFrameInfo &info, size_t bytes) {
+    if (!header || writing) return nullptr;
+    if (bytes > header->payload_capacity && !grow(bytes)) return nullptr;
+
+    const uint64_t index = header->frames_written.load(memory_order_relaxed) + 1;
+    ShmSlotHeader *slot = slot_at(base, header, (index - 1) % header->slot_count);
+    writing_seq = slot->seq.load(memory_order_relaxed);
+    slot->seq.store(writing_seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    slot->frame_index = index;
+    slot->frame_number = info.frame_number;
+    slot->pts = info.pts;
+    slot->time_base_num = info.time_base_num;
+    slot->time_base_den = info.time_base_den;
+    slot->width = info.width;
+    slot->height = info.height;
+    slot->stride = info.stride;
+    slot->pix_fmt = info.pix_fmt;
+    strncpy(slot->pix_fmt_name, info.pix_fmt_name ? info.pix_fmt_name : "", sizeof(slot->pix_fmt_name) - 1);
+    slot->pix_fmt_name[sizeof(slot->pix_fmt_name) - 1] = '\0';
+    slot->payload_size = bytes;
+    writing = slot;
+    return reinterpret_cast<uint8_t *>(slot) + header->payload_offset;
+}
+
+void ShmFrameWriter::commit() {
+    if (!writing) return;
+    writing->seq.store(writing_seq + 2, memory_order_release);
+    header->frames_written.store(writing->frame_index, memory_order_release);
+    writing = nullptr;
+}
+
+bool ShmFrameWriter::publish(const ShmFrameInfo &info, const uint8_t *data, size_t src_stride, size_t row_bytes, int rows) {
+    if (rows <= 0) return false;
+    ShmFrameInfo packed = info;
+    packed.stride = static_cast<int32_t>(row_bytes);
+    uint8_t *dst = begin_write(packed, row_bytes * static_cast<size_t>(rows));
+    if (!dst) return false;
+    if (src_stride == row_bytes) {
+        memcpy(dst, data, row_bytes * static_cast<size_t>(rows));
+    } else {
+        for (int y = 0; y < rows; ++y) memcpy(dst + y * row_bytes, data + y * src_stride, row_bytes);
+    }
+    commit();
+    return true;
+}
+
+ShmFrameReader::~ShmFrameReader() { close(); }
+
+void ShmFrameReader::close() {
+    if (base) munmap(base, mapped);
+    base = nullptr;
+    mapped = 0;
+    header = nullptr;
+}
+
+bool ShmFrameReader::open(const string &shm_name) {
+    close();
+    name = shm_object_name(shm_name);
+    const int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) { cerr << "shm_open " << name << " failed : " << strerror(errno) << '\n'; return false; }
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(ShmRingHeader)) {
+        cerr << name << " is not a frame ring\n";
+        ::close(fd);
+        return false;
+    }
+    const size_t size = static_cast<size_t>(st.st_size);
+    void *p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) { cerr << "mmap " << name << " failed : " << strerror(errno) << '\n'; return false; }
+    base = p;
+    mapped = size;
+    const auto *h = static_cast<const ShmRingHeader *>(base);
+    if (h->magic != kShmRingMagic || h->version != kShmRingVersion || h->slot_count == 0 ||
+        round_up(sizeof(ShmRingHeader), 4096) + h->slot_count * h->slot_stride > mapped) {
+        cerr << name << " has an unknown layout\n";
+        close();
+        return false;
+    }
+    header = h;
+    return true;
+}
+
+bool ShmFrameReader::reopen_if_replaced() {
+    if (!header || !header->replaced.load(memory_order_acquire)) return false;
+    const string current = name;
+    return open(current);
+}
+
+bool ShmFrameReader::latest(uint64_t after_index, ShmFrameView &view) const {
+    if (!header) return false;
+    const uint64_t n = header->frames_written.load(memory_order_acquire);
+    if (n == 0 || n <= after_index) return false;
+    const ShmSlotHeader *slot = slot_at(base, header, (n - 1) % header->slot_count);
+    const uint64_t seq = slot->seq.load(memory_order_acquire);
+    if (seq & 1) return false; // being rewritten; the caller simply polls again
+    view.slot = slot;
+    view.data = reinterpret_cast<const uint8_t *>(slot) + header->payload_offset;
+    view.seq = seq;
+    return true;
+}
+
+bool ShmFrameReader::still_valid(const ShmFrameView &view) const {
+    atomic_thread_fence(memory_order_acquire);
+    return view.slot && view.slot->seq.load(memory_order_relaxed) == view.seq;
+}
+
+bool ShmFrameReader::producer_open() const {
+    return header && header->producer_open.load(memory_order_acquire) != 0;
+}
+
+#else
+
+ShmFrameWriter::~ShmFrameWriter() {}
+bool ShmFrameWriter::create(const string &, uint32_t, size_t) {
+    cerr << "Shared-memory frame output is not supported on this platform\n";
+    return false;
+}
+bool ShmFrameWriter::publish(const ShmFrameInfo &, const uint8_t *, size_t, size_t, int) { return false; }
+uint8_t *ShmFrameWriter::begin_write(const ShmFrameInfo &, size_t) { return nullptr; }
+void ShmFrameWriter::commit() {}
+ShmFrameReader::~ShmFrameReader() {}
+void ShmFrameReader::close() {}
+bool ShmFrameReader::open(const string &) { return false; }
+bool ShmFrameReader::reopen_if_replaced() { return false; }
+bool ShmFrameReader::latest(uint64_t, ShmFrameView &) const { return false; }
+bool ShmFrameReader::still_valid(const ShmFrameView &) const { return false; }
+bool ShmFrameReader::producer_open() const { return false; }
+
+#endif
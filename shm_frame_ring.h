@@ -0,0 +1,143 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// POSIX shared-memory ring of converted frames. The player is the only
+// writer; any number of local processes map the object read-only and read
+// frames in place. Deliberately free of FFmpeg/OpenCV so consumers only need
+// this header and shm_frame_ring.cpp.
+//
+// Layout: ShmRingHeader, then slot_count slots of slot_stride bytes, each a
+// ShmSlotHeader followed by the pixel payload at ShmRingHeader::payload_offset.
+// Every slot is a seqlock: `seq` is odd while the producer writes it and
+// even once complete, so a reader validates a frame by reading `seq` before
+// and after using it.
+//
+// A frame larger than the slots makes the producer create a bigger ring
+// under the same name and set `replaced` in the old one; readers then map
+// the name again (ShmFrameReader::reopen_if_replaced). frames_written keeps
+// counting across rings.
+
+constexpr uint32_t kShmRingMagic = 0x46584d56; // "VMXF"
+constexpr uint32_t kShmRingVersion = 2;
+
+struct alignas(64) ShmRingHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t payload_offset;   // from the start of a slot
+    uint64_t slot_stride;
+    uint64_t payload_capacity;
+    std::atomic<uint64_t> frames_written; // latest frame is in slot (frames_written - 1) % slot_count
+    std::atomic<uint32_t> producer_open;  // cleared when the player exits
+    std::atomic<uint32_t> replaced;       // set once a larger ring has taken over the name
+};
+
+struct alignas(64) ShmSlotHeader {
+    std::atomic<uint64_t> seq;
+    uint64_t frame_index;      // value of frames_written when this frame was published
+    int64_t frame_number;
+    int64_t pts;
+    int32_t time_base_num;
+    int32_t time_base_den;
+    int32_t width;
+    int32_t height;
+    int32_t stride;
+    int32_t pix_fmt;           // AVPixelFormat value
+    char pix_fmt_name[16];     // e.g. "bgr24", for consumers without FFmpeg
+    uint64_t payload_size;
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared-memory ring needs lock-free 64-bit atomics");
+
+struct ShmFrameInfo {
+    int64_t frame_number = 0;
+    int64_t pts = 0;
+    int32_t time_base_num = 0;
+    int32_t time_base_den = 1;
+    int32_t width = 0;
+    int32_t height = 0;
+    int32_t stride = 0;
+    int32_t pix_fmt = -1;
+    const char *pix_fmt_name = "";
+};
+
+// Producer side, used by the player's decode thread.
+class ShmFrameWriter {
+public:
+    ShmFrameWriter() = default;
+    ~ShmFrameWriter();
+    ShmFrameWriter(const ShmFrameWriter &) = delete;
+    ShmFrameWriter &operator=(const ShmFrameWriter &) = delete;
+
+    // Creates (or replaces) the object `name` with `slots` slots of up to
+    // `max_frame_bytes` each.
+    bool create(const std::string &name, uint32_t slots, size_t max_frame_bytes);
+
+    // Copies `rows` rows of `row_bytes` from `data` (with `src_stride`) into
+    // the next slot. Never waits for readers; slow readers see overruns.
+    // Frames that do not fit the slots re-create the ring with room for them
+    // (see above), so the first frame's size is not a limit.
+    bool publish(const ShmFrameInfo &info, const uint8_t *data, size_t src_stride, size_t row_bytes, int rows);
+
+    // Zero-copy variant: begin_write() returns the next slot's payload (at
+    // least `bytes` long, growing the ring like publish() does; nullptr if
+    // that fails) for the caller to fill, commit() publishes it. Readers skip
+    // the slot in between.
+    uint8_t *begin_write(const ShmFrameInfo &info, size_t bytes);
+    void commit();
+
+    bool is_open() const { return header != nullptr; }
+
+private:
+    bool grow(size_t frame_bytes);
+
+    std::string name;
+    void *base = nullptr;
+    size_t mapped = 0;
+    ShmRingHeader *header = nullptr;
+    ShmSlotHeader *writing = nullptr;
+    uint64_t writing_seq = 0;
+};
+
+struct ShmFrameView {
+    const ShmSlotHeader *slot = nullptr;
+    const uint8_t *data = nullptr;
+    uint64_t seq = 0;
+};
+
+// Consumer side. Frames are read in place; call still_valid() after using
+// the pixels to make sure the producer did not overwrite them meanwhile.
+class ShmFrameReader {
+public:
+    ShmFrameReader() = default;
+    ~ShmFrameReader();
+    ShmFrameReader(const ShmFrameReader &) = delete;
+    ShmFrameReader &operator=(const ShmFrameReader &) = delete;
+
+    // On failure the reader is left closed.
+    bool open(const std::string &name);
+    // Maps the name again if the producer has moved to a larger ring.
+    // Returns true if it did; frame indices continue where they were.
+    bool reopen_if_replaced();
+
+    // Latest complete frame newer than `after_index` (0 = any). Returns false
+    // if nothing new has been published.
+    bool latest(uint64_t after_index, ShmFrameView &view) const;
+    bool still_valid(const ShmFrameView &view) const;
+    bool producer_open() const;
+
+private:
+    void close();
+
+    std::string name;
+    void *base = nullptr;
+    size_t mapped = 0;
+    const ShmRingHeader *header = nullptr;
+};
+
+// Adds the leading '/' POSIX shm names need.
+std::string shm_object_name(const std::string &name);
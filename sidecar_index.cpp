@@ -0,0 +1,169 @@
+#include "sidecar_index.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+extern "C" {
+#include <libavutil/mem.h>
+}
+
+#include "file_fingerprint.h"
+
+using namespace std;
+
+static const char kSidecarMagic[] = "vmixidx";
+static const int kSidecarVersion = 1;
+
+string sidecar_path_for(const string &input) {
+    return input + ".vmixidx";
+}
+
+static string to_hex(const uint8_t *data, int size) {
+    string s;
+    s.reserve(static_cast<size_t>(size) * 2);
+    char buf[3];
+    for (int i = 0; i < size; ++i) {
+        snprintf(buf, sizeof(buf), "%02x", data[i]);
+        s += buf;
+    }
+    return s;
+}
+
+static bool from_hex(const string &hex, vector<uint8_t> &out) {
+    if (hex == "-") { out.clear(); return true; }
+    if (hex.size() % 2) return false;
+    out.resize(hex.size() / 2);
+    for (size_t i = 0; i < out.size(); ++i) {
+        unsigned v = 0;
+        if (sscanf(hex.c_str() + 2 * i, "%2x", &v) != 1) return false;
+        out[i] = static_cast<uint8_t>(v);
+    }
+    return true;
+}
+
+bool save_sidecar(const string &input, const FFPlayer &p, const FrameIndex &index) {
+    if (!p.video_stream) return false;
+    const string fp = file_fingerprint(input);
+    if (fp.empty()) return false;
+    const AVCodecParameters *par = p.video_stream->codecpar;
+
+    const string path = sidecar_path_for(input);
+    const string part = path + ".part";
+    {
+        ofstream out(part);
+        if (!out) return false;
+        out << kSidecarMagic << ' ' << kSidecarVersion << '\n'
+            << "fingerprint " << fp << '\n'
+            << "stream " << p.video_stream_idx << '\n'
+            << "codec " << par->codec_id << ' ' << par->codec_tag << ' ' << par->format << ' ' << par->width << ' ' << par->height << ' '
+            << par->profile << ' ' << par->level << ' ' << par->bit_rate << ' ' << par->field_order << ' ' << par->video_delay << '\n'
+            << "sar " << par->sample_aspect_ratio.num << ' ' << par->sample_aspect_ratio.den << '\n'
+            << "time_base " << p.video_stream->time_base.num << ' ' << p.video_stream->time_base.den << '\n'
+            << "frame_rate " << p.avg_frame_rate.num << ' ' << p.avg_frame_rate.den << '\n'
+            << "extradata " << (par->extradata_size > 0 ? to_hex(par->extradata, par->extradata_size) : string("-")) << '\n'
+            << "keyframes " << count_if(index.entries.begin(), index.entries.end(), [](const FrameIndexEntry &e) { return e.key; })
+            << '\n';
+        for (const FrameIndexEntry &e : index.entries) {
+            if (e.key) out << e.ts << ' ' << e.pos << ' ' << e.size << '\n';
+        }
+        if (!out) return false;
+    }
+    error_code ec;
+    filesystem::rename(part, path, ec);
+    if (ec) {
+        filesystem::remove(part, ec);
+        return false;
+    }
+    return true;
+}
+
+bool load_sidecar(const string &input, StreamSidecar &out) {
+    ifstream in(sidecar_path_for(input));
+    if (!in) return false;
+    string word;
+    int version = 0;
+    if (!(in >> word >> version) || word != kSidecarMagic || version != kSidecarVersion) return false;
+
+    unique_ptr<AVCodecParameters, AVCodecParametersDeleter> par(avcodec_parameters_alloc());
+    if (!par) return false;
+    par->codec_type = AVMEDIA_TYPE_VIDEO;
+    string fingerprint, extradata;
+    int stream = -1, codec_id = 0, field_order = 0;
+    size_t keyframes = 0;
+    in >> word >> fingerprint >> word >> stream >> word >> codec_id >> par->codec_tag >> par->format >> par->width >> par->height
+       >> par->profile >> par->level >> par->bit_rate >> field_order >> par->video_delay >> word >> par->sample_aspect_ratio.num
+       >> par->sample_aspect_ratio.den >> word >> out.time_base.num >> out.time_base.den >> word >> out.frame_rate.num
+       >> out.frame_rate.den >> word >> extradata >> word >> keyframes;
+    if (!in || word != "keyframes" || stream < 0) return false;
+    // Stale once the file was rewritten or appended to.
+    if (fingerprint != file_fingerprint(input)) return false;
+    par->codec_id = static_cast<AVCodecID>(codec_id);
+    par->field_order = static_cast<AVFieldOrder>(field_order);
+
+    vector<uint8_t> bytes;
+    if (!from_hex(extradata, bytes)) return false;
+    if (!bytes.empty()) {
+        par->extradata = static_cast<uint8_t *>(av_mallocz(bytes.size() + AV_INPUT_BUFFER_PADDING_SIZE));
+        if (!par->extradata) return false;
+        copy(bytes.begin(), bytes.end(), par->extradata);
+        par->extradata_size = static_cast<int>(bytes.size());
+    }
+
+    out.index = FrameIndex{};
+    out.index.time_base = out.time_base;
+    out.index.entries.reserve(keyframes);
+    for (size_t i = 0; i < keyframes; ++i) {
+        FrameIndexEntry e;
+        e.key = true;
+        if (!(in >> e.ts >> e.pos >> e.size)) return false;
+        out.index.entries.push_back(e);
+    }
+    out.index.finalize();
+    out.fingerprint = fingerprint;
+    out.stream = stream;
+    out.params = move(par);
+    return true;
+}
+
+void use_sidecar(const StreamSidecar &s, OpenOptions &opts) {
+    opts.known_params = s.params.get();
+    opts.known_stream = s.stream;
+    opts.known_frame_rate = s.frame_rate;
+}
+
+void apply_sidecar_index(FFPlayer &p, const StreamSidecar &s) {
+    if (!p.video_stream || p.video_stream_idx != s.stream) return;
+    // Entries the demuxer already has are replaced, not duplicated.
+    for (const FrameIndexEntry &e : s.index.entries) {
+        if (e.pos >= 0) av_add_index_entry(p.video_stream, e.pos, e.ts, e.size, 0, AVINDEX_KEYFRAME);
+    }
+}
+
+static int analysis_interrupted(void *cancel) {
+    return static_cast<const atomic<bool> *>(cancel)->load() ? 1 : 0;
+}
+
+bool analyze_to_sidecar(const string &input, const atomic<bool> *cancel) {
+    FFPlayer p;
+    if (cancel) {
+        // Interrupts probing and the index scan as soon as `cancel` is set.
+        p.fmt_ctx = avformat_alloc_context();
+        if (!p.fmt_ctx) return false;
+        p.fmt_ctx->interrupt_callback = {analysis_interrupted, const_cast<atomic<bool> *>(cancel)};
+    }
+    if (open_player(p, input) < 0) return false;
+    FrameIndex index;
+    if (!build_frame_index(p, index)) return false;
+    // An interrupted scan ends like a short file; do not cache its index.
+    if (cancel && cancel->load()) return false;
+    if (!save_sidecar(input, p, index)) {
+        cerr << "Could not write " << sidecar_path_for(input) << '\n';
+        return false;
+    }
+    return true;
+}
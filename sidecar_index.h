@@ -0,0 +1,50 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+}
+
+#include "ff_player.h"
+#include "frame_index.h"
+
+struct AVCodecParametersDeleter {
+    void operator()(AVCodecParameters *p) const { avcodec_parameters_free(&p); }
+};
+
+// What a full avformat_find_stream_info pass and an index scan found out
+// about a file's video stream, cached next to the file so later opens can
+// skip both.
+struct StreamSidecar {
+    std::string fingerprint;
+    int stream = -1;
+    std::unique_ptr<AVCodecParameters, AVCodecParametersDeleter> params;
+    AVRational time_base{0, 1};
+    AVRational frame_rate{0, 1};
+    FrameIndex index; // keyframes only
+};
+
+// <input>.vmixidx
+std::string sidecar_path_for(const std::string &input);
+
+// Reads the sidecar of `input`. False if there is none or it was written for
+// a different version of the file.
+bool load_sidecar(const std::string &input, StreamSidecar &out);
+// Writes the stream parameters of `p` and the keyframes of `index`.
+bool save_sidecar(const std::string &input, const FFPlayer &p, const FrameIndex &index);
+
+// Points `opts` at the cached parameters; `s` must outlive the open.
+void use_sidecar(const StreamSidecar &s, OpenOptions &opts);
+// Hands the cached keyframes to the demuxer so the first seeks do not
+// have to wait for it to find them.
+void apply_sidecar_index(FFPlayer &p, const StreamSidecar &s);
+
+// Opens `input` with FFmpeg's full analysis, builds its index and writes the
+// sidecar. Meant to run as a Background task while playback has already
+// started on a quickly probed player. Setting `cancel` makes it return
+// false promptly, without writing anything.
+bool analyze_to_sidecar(const std::string &input, const std::atomic<bool> *cancel = nullptr);
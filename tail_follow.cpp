@@ -0,0 +1,85 @@
+#include "tail_follow.h"
+
+#include <algorithm>
+#include <iostream>
+
+using namespace std;
+
+TailFollower::TailFollower(string path, double delay_seconds, chrono::milliseconds poll)
+    : path(move(path)), delay_seconds(max(0.0, delay_seconds)), poll(poll) {}
+
+bool TailFollower::start() {
+    if (open_player(reader, path) < 0) return false;
+    delay_frames = static_cast<int64_t>(delay_seconds * reader.fps + 0.5);
+    read_available();
+    running = true;
+    thread = std::thread([this] { run(); });
+    return true;
+}
+
+void TailFollower::stop() {
+    running = false;
+    if (thread.joinable()) thread.join();
+}
+
+bool TailFollower::growing() const {
+    const int64_t last = last_growth_ns.load();
+    return last && Clock::now().time_since_epoch() - chrono::nanoseconds(last) < chrono::seconds(2);
+}
+
+// Reads packets up to the current end of the file. Returns true if any were new.
+bool TailFollower::read_available() {
+    unique_ptr<AVPacket, AVPacketDeleter> pkt(av_packet_alloc());
+    vector<FrameIndexEntry> found;
+    int64_t newest = edge.load();
+    while (av_read_frame(reader.fmt_ctx, pkt.get()) >= 0) {
+        if (pkt->stream_index != reader.video_stream_idx) {
+            av_packet_unref(pkt.get());
+            continue;
+        }
+        if (pkt->flags & AV_PKT_FLAG_CORRUPT) {
+            // Cut short by the end of the file: read it again once it is complete.
+            const int64_t pos = pkt->pos;
+            av_packet_unref(pkt.get());
+            if (pos >= 0) av_seek_frame(reader.fmt_ctx, -1, pos, AVSEEK_FLAG_BYTE);
+            break;
+        }
+        const int64_t ts = pkt->pts != AV_NOPTS_VALUE ? pkt->pts : pkt->dts;
+        if (ts != AV_NOPTS_VALUE) {
+            found.push_back({ts, pkt->pos, pkt->size, (pkt->flags & AV_PKT_FLAG_KEY) != 0});
+            newest = max(newest, pts_to_frame_number(ts, reader.video_stream));
+        }
+        av_packet_unref(pkt.get());
+    }
+    // The demuxer stopped at the current end; let the next read try again.
+    if (reader.fmt_ctx->pb) reader.fmt_ctx->pb->eof_reached = 0;
+    if (found.empty()) return false;
+
+    {
+        lock_guard<mutex> lk(mtx);
+        for (const FrameIndexEntry &e : found) {
+            if (e.key) unsynced.push_back(e);
+        }
+    }
+    edge = newest;
+    last_growth_ns = chrono::duration_cast<chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+    return true;
+}
+
+void TailFollower::run() {
+    while (running) {
+        if (!read_available()) this_thread::sleep_for(poll);
+    }
+}
+
+void TailFollower::sync(FFPlayer &p) {
+    vector<FrameIndexEntry> keys;
+    {
+        lock_guard<mutex> lk(mtx);
+        keys.swap(unsynced);
+    }
+    for (const FrameIndexEntry &e : keys) {
+        if (e.pos >= 0) av_add_index_entry(p.video_stream, e.pos, e.ts, e.size, 0, AVINDEX_KEYFRAME);
+    }
+    if (p.fmt_ctx && p.fmt_ctx->pb) p.fmt_ctx->pb->eof_reached = 0;
+}
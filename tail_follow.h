@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ff_player.h"
+#include "frame_index.h"
+
+// Follows a file that is still being recorded (AVI without idx1, MPEG-TS,
+// fragmented MP4/MKV). A thread with its own demuxer reads packet headers up
+// to the current end of the file, waits for it to grow and reads on, so the
+// player's seek index grows with the recording and the file is never
+// reopened. The live edge is the newest frame whose packet is complete.
+class TailFollower {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    TailFollower(std::string path, double delay_seconds, std::chrono::milliseconds poll = std::chrono::milliseconds(100));
+    ~TailFollower() { stop(); }
+    TailFollower(const TailFollower &) = delete;
+    TailFollower &operator=(const TailFollower &) = delete;
+
+    // Indexes what is written so far and starts following. Returns false if
+    // the file cannot be opened.
+    bool start();
+    void stop();
+
+    int64_t live_edge() const { return edge.load(); }
+    // Last frame playback may show: the live edge minus the configured delay.
+    int64_t playable_edge() const { return edge.load() - delay_frames; }
+    // True while the file grew within the last two seconds.
+    bool growing() const;
+
+    // Decode thread of `p`: hands the keyframes found since the last call to
+    // p's demuxer so av_seek_frame reaches them, and clears its end-of-file
+    // state so reading continues into the new data.
+    void sync(FFPlayer &p);
+
+private:
+    void run();
+    bool read_available();
+
+    std::string path;
+    double delay_seconds;
+    std::chrono::milliseconds poll;
+    FFPlayer reader;
+    int64_t delay_frames = 0;
+    std::atomic<int64_t> edge{-1};
+    std::atomic<int64_t> last_growth_ns{0};
+    std::atomic<bool> running{false};
+    std::thread thread;
+
+    std::mutex mtx; // unsynced
+    std::vector<FrameIndexEntry> unsynced; // keyframes not yet given to sync()
+};
@@ -0,0 +1,243 @@
+#include "task_scheduler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+using namespace std;
+
+namespace {
+thread_local TaskScheduler *tls_scheduler = nullptr;
+thread_local unsigned tls_worker_index = 0;
+// Background tasks running on this thread, counting nested ones that a
+// waiting background task runs itself.
+thread_local int tls_background_depth = 0;
+
+function<void(unsigned)> &worker_init_hook() {
+    static function<void(unsigned)> hook;
+    return hook;
+}
+
+uint64_t to_ns(chrono::steady_clock::duration d) {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(d).count());
+}
+}
+
+const char *task_class_name(TaskClass cls) {
+    switch (cls) {
+    case TaskClass::DisplayCritical: return "display-critical";
+    case TaskClass::Prefetch: return "prefetch";
+    case TaskClass::Background: return "background";
+    }
+    return "unknown";
+}
+
+TaskScheduler::TaskScheduler(unsigned num_workers) : started(Clock::now()) {
+    if (num_workers == 0) num_workers = max(1u, thread::hardware_concurrency());
+    background_limit = num_workers > 1 ? static_cast<int>(num_workers) - 1 : 1;
+    for (unsigned i = 0; i < num_workers; ++i) workers.push_back(make_unique<Worker>());
+    for (unsigned i = 0; i < num_workers; ++i) {
+        workers[i]->thread = thread([this, i] { worker_loop(i); });
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        lock_guard<mutex> lk(sleep_mtx);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto &w : workers) {
+        if (w->thread.joinable()) w->thread.join();
+    }
+}
+
+void TaskScheduler::set_worker_init(function<void(unsigned)> fn) {
+    worker_init_hook() = move(fn);
+}
+
+TaskScheduler &TaskScheduler::global() {
+    static TaskScheduler instance;
+    return instance;
+}
+
+void TaskScheduler::submit(TaskClass cls, function<void()> fn) {
+    const int c = static_cast<int>(cls);
+    unsigned target;
+    if (tls_scheduler == this) target = tls_worker_index;
+    else target = next_victim.fetch_add(1, memory_order_relaxed) % workers.size();
+
+    {
+        lock_guard<mutex> lk(workers[target]->mtx);
+        workers[target]->queues[c].push_back(Task{move(fn), Clock::now()});
+    }
+    counters[c].submitted.fetch_add(1, memory_order_relaxed);
+    pending.fetch_add(1);
+    {
+        lock_guard<mutex> lk(sleep_mtx);
+    }
+    sleep_cv.notify_one();
+}
+
+bool TaskScheduler::try_pop(unsigned self, int cls, Task &out) {
+    Worker &w = *workers[self];
+    lock_guard<mutex> lk(w.mtx);
+    auto &q = w.queues[cls];
+    if (q.empty()) return false;
+    out = move(q.back());
+    q.pop_back();
+    return true;
+}
+
+bool TaskScheduler::try_steal(unsigned self, int cls, Task &out) {
+    const unsigned n = static_cast<unsigned>(workers.size());
+    for (unsigned k = 1; k <= n; ++k) {
+        const unsigned victim = (self + k) % n;
+        if (victim == self) continue;
+        Worker &w = *workers[victim];
+        lock_guard<mutex> lk(w.mtx);
+        auto &q = w.queues[cls];
+        if (q.empty()) continue;
+        out = move(q.front());
+        q.pop_front();
+        counters[cls].stolen.fetch_add(1, memory_order_relaxed);
+        return true;
+    }
+    return false;
+}
+
+bool TaskScheduler::take_task(unsigned self, int max_cls, Task &out, int &out_cls) {
+    for (int c = 0; c <= max_cls; ++c) {
+        // A thread already inside a background task (waiting on a group of
+        // its own) runs more of them on the slot it holds, so nested
+        // background groups cannot deadlock on background_limit.
+        const bool slot = c == static_cast<int>(TaskClass::Background) && tls_background_depth == 0;
+        if (slot) {
+            if (background_running.fetch_add(1) >= background_limit) {
+                background_running.fetch_sub(1);
+                return false;
+            }
+        }
+        const bool local = self < workers.size() && tls_scheduler == this;
+        if ((local && try_pop(self, c, out)) || try_steal(self, c, out)) {
+            pending.fetch_sub(1);
+            out_cls = c;
+            return true;
+        }
+        if (slot) background_running.fetch_sub(1);
+    }
+    return false;
+}
+
+void TaskScheduler::execute(Task &task, int cls) {
+    ClassCounters &cc = counters[cls];
+    const Clock::time_point begin = Clock::now();
+    const uint64_t wait = to_ns(begin - task.enqueued);
+    cc.wait_ns.fetch_add(wait, memory_order_relaxed);
+    uint64_t prev_max = cc.max_wait_ns.load(memory_order_relaxed);
+    while (wait > prev_max && !cc.max_wait_ns.compare_exchange_weak(prev_max, wait, memory_order_relaxed)) {}
+
+    const bool background = cls == static_cast<int>(TaskClass::Background);
+    if (background) ++tls_background_depth;
+    task.fn();
+    task.fn = nullptr;
+    if (background) --tls_background_depth;
+
+    cc.busy_ns.fetch_add(to_ns(Clock::now() - begin), memory_order_relaxed);
+    cc.completed.fetch_add(1, memory_order_relaxed);
+    // Only the outermost background task on a thread took a slot.
+    if (background && tls_background_depth == 0) {
+        background_running.fetch_sub(1);
+        sleep_cv.notify_one();
+    }
+}
+
+bool TaskScheduler::run_one(TaskClass max_cls) {
+    // Non-worker threads get an index past the worker range so try_steal
+    // visits every deque, starting from a rotating victim.
+    const unsigned n = static_cast<unsigned>(workers.size());
+    const unsigned self = tls_scheduler == this
+        ? tls_worker_index
+        : n + next_victim.fetch_add(1, memory_order_relaxed) % n;
+    Task task;
+    int cls = 0;
+    if (!take_task(self, static_cast<int>(max_cls), task, cls)) return false;
+    execute(task, cls);
+    return true;
+}
+
+void TaskScheduler::worker_loop(unsigned index) {
+    tls_scheduler = this;
+    tls_worker_index = index;
+    if (worker_init_hook()) worker_init_hook()(index);
+
+    const int lowest = static_cast<int>(TaskClass::Background);
+    while (true) {
+        Task task;
+        int cls = 0;
+        if (take_task(index, lowest, task, cls)) {
+            execute(task, cls);
+            continue;
+        }
+        unique_lock<mutex> lk(sleep_mtx);
+        if (stopping) break;
+        // The timeout covers background tasks held back by background_limit.
+        sleep_cv.wait_for(lk, chrono::milliseconds(2), [this] { return stopping || pending.load() > 0; });
+        if (stopping && pending.load() == 0) break;
+    }
+}
+
+array<TaskClassStats, kTaskClassCount> TaskScheduler::stats() const {
+    array<TaskClassStats, kTaskClassCount> out;
+    const double elapsed_ns = static_cast<double>(to_ns(Clock::now() - started));
+    const double capacity_ns = max(1.0, elapsed_ns * static_cast<double>(workers.size()));
+    for (int c = 0; c < kTaskClassCount; ++c) {
+        const ClassCounters &cc = counters[c];
+        TaskClassStats &s = out[c];
+        s.submitted = cc.submitted.load();
+        s.completed = cc.completed.load();
+        s.stolen = cc.stolen.load();
+        const double busy = static_cast<double>(cc.busy_ns.load());
+        s.busy_ms = busy / 1e6;
+        s.avg_wait_ms = s.completed ? static_cast<double>(cc.wait_ns.load()) / 1e6 / static_cast<double>(s.completed) : 0.0;
+        s.max_wait_ms = static_cast<double>(cc.max_wait_ns.load()) / 1e6;
+        s.utilisation = busy / capacity_ns;
+    }
+    return out;
+}
+
+void TaskScheduler::print_stats(ostream &os) const {
+    const auto all = stats();
+    os << "Task scheduler (" << workers.size() << " workers)\n";
+    for (int c = 0; c < kTaskClassCount; ++c) {
+        const TaskClassStats &s = all[c];
+        os << "  " << left << setw(17) << task_class_name(static_cast<TaskClass>(c)) << right
+           << " submitted " << s.submitted
+           << " completed " << s.completed
+           << " stolen " << s.stolen
+           << fixed << setprecision(2)
+           << " busy " << s.busy_ms << " ms"
+           << " wait avg " << s.avg_wait_ms << " ms max " << s.max_wait_ms << " ms"
+           << " util " << s.utilisation * 100.0 << "%\n";
+        os.unsetf(ios::fixed);
+    }
+}
+
+void TaskGroup::run(function<void()> fn) {
+    outstanding.fetch_add(1);
+    sched.submit(cls, [this, fn = move(fn)] {
+        fn();
+        lock_guard<mutex> lk(mtx);
+        if (outstanding.fetch_sub(1) == 1) cv.notify_all();
+    });
+}
+
+void TaskGroup::wait() {
+    while (outstanding.load() > 0) {
+        if (sched.run_one(cls)) continue;
+        unique_lock<mutex> lk(mtx);
+        cv.wait_for(lk, chrono::microseconds(200), [this] { return outstanding.load() == 0; });
+    }
+    // The last task decrements under mtx; taking it here keeps the group
+    // alive until that task has released the lock.
+    lock_guard<mutex> lk(mtx);
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+// Priority classes, highest first. Workers always drain a higher class
+// (locally or by stealing) before touching a lower one.
+enum class TaskClass : int {
+    DisplayCritical = 0,
+    Prefetch = 1,
+    Background = 2,
+};
+
+constexpr int kTaskClassCount = 3;
+
+const char *task_class_name(TaskClass cls);
+
+struct TaskClassStats {
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t stolen = 0;
+    double busy_ms = 0.0;
+    double avg_wait_ms = 0.0;
+    double max_wait_ms = 0.0;
+    double utilisation = 0.0; // busy time / (elapsed time * workers)
+};
+
+// Work-stealing pool shared by every subsystem around FFPlayer. Each worker
+// owns one deque per class; owners pop LIFO, thieves steal FIFO. Background
+// work never occupies every worker so display-critical tasks always find a
+// free thread; a background task waiting on a background TaskGroup runs the
+// group's tasks itself, on the slot it already holds.
+class TaskScheduler {
+public:
+    explicit TaskScheduler(unsigned num_workers = 0);
+    ~TaskScheduler();
+
+    TaskScheduler(const TaskScheduler &) = delete;
+    TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+    void submit(TaskClass cls, std::function<void()> fn);
+
+    // Runs one pending task of class <= max_cls on the calling thread.
+    // Used by waiters so they help instead of blocking.
+    bool run_one(TaskClass max_cls = TaskClass::Background);
+
+    unsigned worker_count() const { return static_cast<unsigned>(workers.size()); }
+    std::array<TaskClassStats, kTaskClassCount> stats() const;
+    void print_stats(std::ostream &os) const;
+
+    // Called on every worker thread before it starts taking tasks.
+    static void set_worker_init(std::function<void(unsigned)> fn);
+    static TaskScheduler &global();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Task {
+        std::function<void()> fn;
+        Clock::time_point enqueued;
+    };
+
+    struct Worker {
+        std::mutex mtx;
+        std::array<std::deque<Task>, kTaskClassCount> queues;
+        std::thread thread;
+    };
+
+    struct ClassCounters {
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> completed{0};
+        std::atomic<uint64_t> stolen{0};
+        std::atomic<uint64_t> busy_ns{0};
+        std::atomic<uint64_t> wait_ns{0};
+        std::atomic<uint64_t> max_wait_ns{0};
+    };
+
+    bool try_pop(unsigned self, int cls, Task &out);
+    bool try_steal(unsigned self, int cls, Task &out);
+    bool take_task(unsigned self, int max_cls, Task &out, int &out_cls);
+    void execute(Task &task, int cls);
+    void worker_loop(unsigned index);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::array<ClassCounters, kTaskClassCount> counters;
+    std::atomic<unsigned> next_victim{0};
+    std::atomic<int64_t> pending{0};
+    std::atomic<int> background_running{0};
+    int background_limit = 1;
+    std::mutex sleep_mtx;
+    std::condition_variable sleep_cv;
+    std::atomic<bool> stopping{false};
+    Clock::time_point started;
+};
+
+// Fork/join helper: run() submits, wait() helps execute queued tasks of the
+// same or higher priority until every task of the group has finished.
+class TaskGroup {
+public:
+    TaskGroup(TaskScheduler &sched, TaskClass cls) : sched(sched), cls(cls) {}
+    ~TaskGroup() { wait(); }
+
+    TaskGroup(const TaskGroup &) = delete;
+    TaskGroup &operator=(const TaskGroup &) = delete;
+
+    void run(std::function<void()> fn);
+    void wait();
+
+private:
+    TaskScheduler &sched;
+    TaskClass cls;
+    std::atomic<int> outstanding{0};
+    std::mutex mtx;
+    std::condition_variable cv;
+};
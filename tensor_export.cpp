@@ -0,0 +1,236 @@
+#include "tensor_export.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+
+#include "ff_player.h"
+#include "frame_index.h"
+#include "pixel_kernels.h"
+#include "shm_frame_ring.h"
+#include "task_scheduler.h"
+
+using namespace std;
+
+bool set_tensor_norm(const string &name, TensorSpec &spec) {
+    static const float kImageNetMean[3] = {0.485f, 0.456f, 0.406f};
+    static const float kImageNetStd[3] = {0.229f, 0.224f, 0.225f};
+    for (int c = 0; c < 3; ++c) {
+        if (name == "imagenet") {
+            spec.scale[c] = 1.0f / (255.0f * kImageNetStd[c]);
+            spec.bias[c] = -kImageNetMean[c] / kImageNetStd[c];
+        } else if (name == "unit") {
+            spec.scale[c] = 1.0f / 255.0f;
+            spec.bias[c] = 0.0f;
+        } else if (name == "none") {
+            spec.scale[c] = 1.0f;
+            spec.bias[c] = 0.0f;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+size_t tensor_item_bytes(const TensorSpec &spec) {
+    const size_t elem = spec.type == TensorType::Float32 ? sizeof(float) : 1;
+    return static_cast<size_t>(spec.width) * spec.height * 3 * elem;
+}
+
+const char *tensor_npy_descr(const TensorSpec &spec) {
+    return spec.type == TensorType::Float32 ? "<f4" : "|u1";
+}
+
+string tensor_format_name(const TensorSpec &spec) {
+    return string(spec.layout == TensorLayout::NCHW ? "nchw" : "nhwc") + (spec.type == TensorType::Float32 ? "_f32" : "_u8");
+}
+
+TensorConverter::~TensorConverter() {
+    for (SwsContext *c : pool) sws_freeContext(c);
+}
+
+SwsContext *TensorConverter::acquire(const AVFrame *frame, AVPixelFormat dst_fmt) {
+    SwsContext *ctx = nullptr;
+    {
+        lock_guard<mutex> lk(mtx);
+        if (!pool.empty()) {
+            ctx = pool.back();
+            pool.pop_back();
+        }
+    }
+    // Reuses the context unless the source format or size changed.
+    return sws_getCachedContext(ctx, frame->width, frame->height, static_cast<AVPixelFormat>(frame->format),
+                                spec.width, spec.height, dst_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
+}
+
+void TensorConverter::release(SwsContext *ctx) {
+    lock_guard<mutex> lk(mtx);
+    pool.push_back(ctx);
+}
+
+bool TensorConverter::convert(const AVFrame *frame, uint8_t *dst) {
+    const int w = spec.width;
+    const size_t plane = static_cast<size_t>(w) * spec.height;
+    const bool planar = spec.layout == TensorLayout::NCHW;
+    SwsContext *ctx = acquire(frame, planar ? AV_PIX_FMT_GBRP : AV_PIX_FMT_RGB24);
+    if (!ctx) return false;
+
+    // uint8 output is written by swscale in place; float output goes through
+    // an 8-bit scratch image in the same layout first, so normalising is a
+    // straight pass over it (see pixel_kernels.h). GBRP planes are G, B, R.
+    thread_local vector<uint8_t> scratch;
+    uint8_t *rgb = dst;
+    if (spec.type == TensorType::Float32) {
+        scratch.resize(plane * 3);
+        rgb = scratch.data();
+    }
+    uint8_t *planes[4] = {rgb + plane, rgb + 2 * plane, rgb, nullptr};
+    int linesizes[4] = {w, w, w, 0};
+    if (!planar) {
+        planes[0] = rgb;
+        planes[1] = planes[2] = nullptr;
+        linesizes[0] = w * 3;
+        linesizes[1] = linesizes[2] = 0;
+    }
+    sws_scale(ctx, frame->data, frame->linesize, 0, frame->height, planes, linesizes);
+    release(ctx);
+
+    if (spec.type == TensorType::Float32) {
+        float *out = reinterpret_cast<float *>(dst);
+        if (spec.layout == TensorLayout::NCHW) {
+            for (int c = 0; c < 3; ++c) normalise_plane(rgb + c * plane, out + c * plane, plane, spec.scale[c], spec.bias[c]);
+        } else {
+            normalise_packed(rgb, out, plane, spec.scale, spec.bias);
+        }
+    }
+    return true;
+}
+
+static bool write_npy(const string &path, const char *descr, const vector<size_t> &shape, const uint8_t *data, size_t bytes) {
+    string dict = string("{'descr': '") + descr + "', 'fortran_order': False, 'shape': (";
+    for (size_t i = 0; i < shape.size(); ++i) dict += to_string(shape[i]) + (i + 1 < shape.size() ? ", " : ",");
+    dict += "), }";
+    // Magic, version and length take 10 bytes; the header is padded so the
+    // data starts 64-byte aligned.
+    const size_t used = 10 + dict.size() + 1;
+    dict.append((64 - used % 64) % 64, ' ');
+    dict += '\n';
+
+    ofstream out(path, ios::binary);
+    if (!out) return false;
+    const unsigned char preamble[10] = {0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0,
+                                        static_cast<unsigned char>(dict.size() & 0xff), static_cast<unsigned char>(dict.size() >> 8)};
+    out.write(reinterpret_cast<const char *>(preamble), sizeof(preamble));
+    out.write(dict.data(), static_cast<streamsize>(dict.size()));
+    out.write(reinterpret_cast<const char *>(data), static_cast<streamsize>(bytes));
+    return static_cast<bool>(out);
+}
+
+int run_tensor_export(const string &input, const TensorExportOptions &opts) {
+    FFPlayer p;
+    p.convert_class = TaskClass::Prefetch;
+    if (open_player(p, input) < 0) return -1;
+    FrameIndex index;
+    if (!build_frame_index(p, index)) cerr << input << ": no keyframe index, every frame will seek\n";
+
+    vector<int64_t> targets = opts.frames;
+    sort(targets.begin(), targets.end());
+    targets.erase(unique(targets.begin(), targets.end()), targets.end());
+    if (opts.stride > 1) {
+        vector<int64_t> kept;
+        for (size_t i = 0; i < targets.size(); i += static_cast<size_t>(opts.stride)) kept.push_back(targets[i]);
+        targets.swap(kept);
+    }
+
+    const TensorSpec &spec = opts.spec;
+    const size_t item = tensor_item_bytes(spec);
+    const size_t batch = max<size_t>(1, opts.batch);
+    const bool to_shm = opts.output.rfind("shm:", 0) == 0;
+
+    ShmFrameWriter shm;
+    vector<uint8_t> heap;
+    ofstream index_csv;
+    if (to_shm) {
+        if (!shm.create(opts.output.substr(4), 4, batch * item)) return -1;
+        cout << "Publishing tensor batches to shared memory " << shm_object_name(opts.output.substr(4)) << '\n';
+    } else {
+        error_code ec;
+        filesystem::create_directories(opts.output, ec);
+        index_csv.open(filesystem::path(opts.output) / "frames.csv");
+        if (ec || !index_csv) { cerr << "Cannot write to " << opts.output << '\n'; return -1; }
+        index_csv << "batch,item,requested,frame,pts\n";
+        heap.resize(batch * item);
+    }
+
+    TensorConverter converter(spec);
+    TaskScheduler &sched = TaskScheduler::global();
+    const auto start = chrono::steady_clock::now();
+    size_t converted = 0, failed = 0;
+
+    for (size_t b0 = 0, batch_no = 0; b0 < targets.size(); b0 += batch, ++batch_no) {
+        const size_t n = min(batch, targets.size() - b0);
+        ShmFrameInfo info;
+        info.frame_number = targets[b0];
+        info.pts = frame_number_to_stream_ts(targets[b0], p.video_stream);
+        info.time_base_num = p.video_stream->time_base.num;
+        info.time_base_den = p.video_stream->time_base.den;
+        info.width = spec.width;
+        info.height = spec.height;
+        info.stride = static_cast<int32_t>(spec.layout == TensorLayout::NCHW ? item / 3 / spec.height : item / spec.height);
+        const string fmt_name = tensor_format_name(spec);
+        info.pix_fmt_name = fmt_name.c_str();
+        // Converted straight into the shared-memory slot when publishing there.
+        uint8_t *buf = to_shm ? shm.begin_write(info, n * item) : heap.data();
+        if (!buf) { cerr << "Tensor batch does not fit the shared-memory slot\n"; return -1; }
+
+        vector<char> ok(n, 0);
+        vector<int64_t> got_frame(n, -1), got_pts(n, AV_NOPTS_VALUE);
+        {
+            // Decoding stays on this thread, in order; conversion of the
+            // decoded frames runs in parallel on the workers meanwhile.
+            TaskGroup group(sched, TaskClass::Prefetch);
+            for (size_t i = 0; i < n; ++i) {
+                uint8_t *dst = buf + i * item;
+                unique_ptr<AVFrame, AVFrameDeleter> f = decode_frame_indexed(p, index, targets[b0 + i]);
+                if (!f) {
+                    memset(dst, 0, item);
+                    continue;
+                }
+                got_frame[i] = pts_to_frame_number(p.last_shown_pts, p.video_stream);
+                got_pts[i] = p.last_shown_pts;
+                shared_ptr<AVFrame> frame(f.release(), [](AVFrame *x) { av_frame_free(&x); });
+                group.run([&converter, &ok, frame, dst, i] { ok[i] = converter.convert(frame.get(), dst); });
+            }
+            group.wait();
+        }
+
+        for (size_t i = 0; i < n; ++i) {
+            if (ok[i]) ++converted;
+            else ++failed;
+            if (index_csv) index_csv << batch_no << ',' << i << ',' << targets[b0 + i] << ',' << got_frame[i] << ',' << got_pts[i] << '\n';
+        }
+
+        if (to_shm) {
+            shm.commit();
+        } else {
+            char name[32];
+            snprintf(name, sizeof(name), "batch_%05zu.npy", batch_no);
+            const vector<size_t> shape = spec.layout == TensorLayout::NCHW
+                ? vector<size_t>{n, 3, static_cast<size_t>(spec.height), static_cast<size_t>(spec.width)}
+                : vector<size_t>{n, static_cast<size_t>(spec.height), static_cast<size_t>(spec.width), 3};
+            const string path = (filesystem::path(opts.output) / name).string();
+            if (!write_npy(path, tensor_npy_descr(spec), shape, buf, n * item)) { cerr << "Cannot write " << path << '\n'; return -1; }
+        }
+    }
+
+    const double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << converted << " frames as " << tensor_format_name(spec) << ' ' << spec.width << 'x' << spec.height << " in " << secs << " s ("
+         << (secs > 0.0 ? static_cast<double>(converted) / secs : 0.0) << " frames/s, "
+         << (secs > 0.0 ? static_cast<double>(converted * item) / secs / 1e6 : 0.0) << " MB/s), " << failed << " failed\n";
+    return failed ? -1 : 0;
+}
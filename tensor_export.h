@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+enum class TensorLayout { NCHW, NHWC };
+enum class TensorType { Float32, UInt8 };
+
+// Model input description. Channels are RGB; float values are
+// (v / 255 - mean) / std per channel, i.e. v * scale + bias.
+struct TensorSpec {
+    int width = 224;
+    int height = 224;
+    TensorLayout layout = TensorLayout::NCHW;
+    TensorType type = TensorType::Float32;
+    float scale[3] = {1.0f / 255.0f, 1.0f / 255.0f, 1.0f / 255.0f};
+    float bias[3] = {0.0f, 0.0f, 0.0f};
+};
+
+// "imagenet", "unit" (v / 255) or "none" (0..255 as float).
+bool set_tensor_norm(const std::string &name, TensorSpec &spec);
+size_t tensor_item_bytes(const TensorSpec &spec);
+// numpy dtype string ("<f4", "|u1") and a short name for shared memory ("nchw_f32").
+const char *tensor_npy_descr(const TensorSpec &spec);
+std::string tensor_format_name(const TensorSpec &spec);
+
+// Turns decoded frames into model inputs. Resize and YUV->RGB happen in one
+// swscale pass straight from the decoder's planes at model size; uint8
+// tensors are written by that pass directly, float tensors get one more
+// vectorised normalise pass over the small image. Thread-safe: scaling
+// contexts come from a pool, so frames can be converted in parallel.
+class TensorConverter {
+public:
+    explicit TensorConverter(const TensorSpec &spec) : spec(spec) {}
+    ~TensorConverter();
+    TensorConverter(const TensorConverter &) = delete;
+    TensorConverter &operator=(const TensorConverter &) = delete;
+
+    // Writes one item of tensor_item_bytes(spec) bytes to `dst`.
+    bool convert(const AVFrame *frame, uint8_t *dst);
+
+private:
+    SwsContext *acquire(const AVFrame *frame, AVPixelFormat dst_fmt);
+    void release(SwsContext *ctx);
+
+    TensorSpec spec;
+    std::mutex mtx;
+    std::vector<SwsContext *> pool;
+};
+
+struct TensorExportOptions {
+    std::vector<int64_t> frames; // sorted ascending
+    int stride = 1;              // keep every stride-th frame of the list
+    size_t batch = 32;
+    std::string output;          // directory for .npy batches, or shm:NAME
+    TensorSpec spec;
+};
+
+// --tensors: decodes the frames, converts them in parallel on the task
+// scheduler and writes batches of N items. Returns 0 on success.
+int run_tensor_export(const std::string &input, const TensorExportOptions &opts);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <iostream>
+
+// Minimal checks for the test executables: a failed CHECK prints the
+// expression and its location and the test carries on, so one run reports
+// every failure. main() returns check_result().
+
+inline int &check_failures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(cond)                                                                              \
+    do {                                                                                         \
+        if (!(cond)) {                                                                           \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK(" #cond ") failed\n";           \
+            ++check_failures();                                                                  \
+        }                                                                                        \
+    } while (0)
+
+#define CHECK_EQ(a, b)                                                                           \
+    do {                                                                                         \
+        const auto check_a_ = (a);                                                               \
+        const auto check_b_ = (b);                                                               \
+        if (!(check_a_ == check_b_)) {                                                           \
+            std::cerr << __FILE__ << ':' << __LINE__ << ": CHECK_EQ(" #a ", " #b ") failed: "     \
+                      << check_a_ << " != " << check_b_ << '\n';                                 \
+            ++check_failures();                                                                  \
+        }                                                                                        \
+    } while (0)
+
+// Exit status for ctest: 0 when every check passed.
+inline int check_result(const char *test) {
+    if (check_failures() == 0) {
+        std::cout << test << ": all checks passed\n";
+        return 0;
+    }
+    std::cerr << test << ": " << check_failures() << " checks failed\n";
+    return 1;
+}
+
+// Exit status that tests/CMakeLists.txt registers as "skipped", for tests
+// whose prerequisites (e.g. an H.264 encoder) are missing from this build.
+constexpr int kTestSkipped = 77;
@@ -0,0 +1,191 @@
+// Round trip for --clip: encodes a synthetic H.264 MP4 with B-frames whose
+// frames each have their own brightness, cuts a range that starts and ends
+// inside a GOP, and decodes every frame of the clip. The splices between
+// re-encoded edges and copied GOPs must decode without errors, DTS must
+// strictly increase, and each frame must be the source frame it claims to be.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <libavcodec/avcodec.h>
+#include <libavformat/avformat.h>
+#include <libavutil/opt.h>
+}
+
+#include "../clip_export.h"
+#include "../ff_player.h"
+#include "check.h"
+
+using namespace std;
+
+constexpr int kWidth = 320;
+constexpr int kHeight = 240;
+constexpr int kFrames = 60;
+constexpr int kGop = 12;
+
+static int luma_of(int64_t frame) { return 20 + 3 * static_cast<int>(frame); }
+
+// Writes kFrames flat frames as H.264 (GOP kGop, two B-frames) to `path`.
+// Returns false if no H.264 encoder is available.
+static bool write_source(const string &path) {
+    const AVCodec *codec = avcodec_find_encoder_by_name("libx264");
+    if (!codec) codec = avcodec_find_encoder(AV_CODEC_ID_H264);
+    if (!codec) return false;
+    AVFormatContext *oc = nullptr;
+    if (avformat_alloc_output_context2(&oc, nullptr, nullptr, path.c_str()) < 0 || !oc) return false;
+    AVCodecContext *enc = avcodec_alloc_context3(codec);
+    enc->width = kWidth;
+    enc->height = kHeight;
+    enc->pix_fmt = AV_PIX_FMT_YUV420P;
+    enc->time_base = AVRational{1, 25};
+    enc->framerate = AVRational{25, 1};
+    enc->gop_size = kGop;
+    enc->max_b_frames = 2;
+    enc->flags |= AV_CODEC_FLAG_GLOBAL_HEADER; // avcC extradata, as MP4 sources have
+    av_opt_set(enc->priv_data, "x264-params", "keyint_min=12:scenecut=0", 0);
+    bool ok = avcodec_open2(enc, codec, nullptr) >= 0;
+    AVStream *st = ok ? avformat_new_stream(oc, nullptr) : nullptr;
+    ok = st && avcodec_parameters_from_context(st->codecpar, enc) >= 0;
+    if (ok) {
+        st->time_base = enc->time_base;
+        ok = avio_open(&oc->pb, path.c_str(), AVIO_FLAG_WRITE) >= 0 && avformat_write_header(oc, nullptr) >= 0;
+    }
+
+    unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+    unique_ptr<AVPacket, AVPacketDeleter> pkt(av_packet_alloc());
+    frame->format = enc->pix_fmt;
+    frame->width = kWidth;
+    frame->height = kHeight;
+    ok = ok && av_frame_get_buffer(frame.get(), 0) >= 0;
+    auto drain = [&] {
+        while (avcodec_receive_packet(enc, pkt.get()) >= 0) {
+            av_packet_rescale_ts(pkt.get(), enc->time_base, st->time_base);
+            pkt->stream_index = st->index;
+            av_interleaved_write_frame(oc, pkt.get());
+        }
+    };
+    for (int n = 0; ok && n < kFrames; ++n) {
+        av_frame_make_writable(frame.get());
+        for (int y = 0; y < kHeight; ++y) memset(frame->data[0] + y * frame->linesize[0], luma_of(n), kWidth);
+        for (int p = 1; p < 3; ++p) {
+            for (int y = 0; y < kHeight / 2; ++y) memset(frame->data[p] + y * frame->linesize[p], 128, kWidth / 2);
+        }
+        frame->pts = n;
+        ok = avcodec_send_frame(enc, frame.get()) >= 0;
+        drain();
+    }
+    if (ok) {
+        avcodec_send_frame(enc, nullptr);
+        drain();
+        ok = av_write_trailer(oc) >= 0;
+    }
+    avcodec_free_context(&enc);
+    avio_closep(&oc->pb);
+    avformat_free_context(oc);
+    CHECK(ok);
+    return true;
+}
+
+static double mean_luma(const AVFrame *f) {
+    double sum = 0.0;
+    for (int y = 0; y < f->height; ++y) {
+        for (int x = 0; x < f->width; ++x) sum += f->data[0][y * f->linesize[0] + x];
+    }
+    return sum / (static_cast<double>(f->width) * f->height);
+}
+
+// Decodes every packet and frame of `path`, including the decoder's delayed
+// frames at the end, and checks them against the source frames from `first`.
+static void check_clip(const string &path, int64_t first, int64_t last) {
+    AVFormatContext *ic = nullptr;
+    CHECK(avformat_open_input(&ic, path.c_str(), nullptr, nullptr) >= 0);
+    if (!ic) return;
+    CHECK(avformat_find_stream_info(ic, nullptr) >= 0);
+    const int si = av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+    CHECK(si >= 0);
+    if (si < 0) { avformat_close_input(&ic); return; }
+    const AVCodecParameters *par = ic->streams[si]->codecpar;
+    AVCodecContext *dec = avcodec_alloc_context3(avcodec_find_decoder(par->codec_id));
+    avcodec_parameters_to_context(dec, par);
+    dec->err_recognition = AV_EF_EXPLODE | AV_EF_CRCCHECK | AV_EF_BITSTREAM;
+    CHECK(avcodec_open2(dec, dec->codec, nullptr) >= 0);
+
+    unique_ptr<AVPacket, AVPacketDeleter> pkt(av_packet_alloc());
+    unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+    int64_t last_dts = AV_NOPTS_VALUE;
+    int64_t decoded = 0;
+    int errors = 0;
+    auto receive = [&] {
+        while (avcodec_receive_frame(dec, frame.get()) >= 0) {
+            const int64_t expected = first + decoded;
+            if (frame->decode_error_flags || (frame->flags & AV_FRAME_FLAG_CORRUPT)) ++errors;
+            const double luma = mean_luma(frame.get());
+            if (fabs(luma - luma_of(expected)) > 1.5) {
+                fprintf(stderr, "clip frame %lld: mean luma %.1f, source frame %lld has %d\n", static_cast<long long>(decoded), luma,
+                        static_cast<long long>(expected), luma_of(expected));
+                ++errors;
+            }
+            ++decoded;
+            av_frame_unref(frame.get());
+        }
+    };
+    while (av_read_frame(ic, pkt.get()) >= 0) {
+        if (pkt->stream_index == si) {
+            if (pkt->dts != AV_NOPTS_VALUE) {
+                CHECK(last_dts == AV_NOPTS_VALUE || pkt->dts > last_dts);
+                last_dts = pkt->dts;
+            }
+            if (avcodec_send_packet(dec, pkt.get()) < 0) ++errors;
+            receive();
+        }
+        av_packet_unref(pkt.get());
+    }
+    avcodec_send_packet(dec, nullptr);
+    receive();
+
+    CHECK_EQ(decoded, last - first + 1);
+    CHECK_EQ(errors, 0);
+    avcodec_free_context(&dec);
+    avformat_close_input(&ic);
+}
+
+int main() {
+    const filesystem::path dir = filesystem::temp_directory_path() / "vmix_clip_test";
+    filesystem::create_directories(dir);
+    const string source = (dir / "source.mp4").string();
+    if (!write_source(source)) {
+        cout << "No H.264 encoder in this FFmpeg build, skipping\n";
+        return kTestSkipped;
+    }
+
+    // In and out points inside GOPs: both edges are re-encoded around copied GOPs.
+    const string mid = (dir / "mid_gop.mp4").string();
+    CHECK_EQ(run_clip_export(source, 5, 40, mid), 0);
+    check_clip(mid, 5, 40);
+
+    // On GOP boundaries: a pure stream copy.
+    const string aligned = (dir / "aligned.mp4").string();
+    CHECK_EQ(run_clip_export(source, kGop, 3 * kGop - 1, aligned), 0);
+    check_clip(aligned, kGop, 3 * kGop - 1);
+
+    // Inside a single GOP: one re-encoded run, no copy.
+    const string inner = (dir / "inner.mp4").string();
+    CHECK_EQ(run_clip_export(source, 26, 31, inner), 0);
+    check_clip(inner, 26, 31);
+
+    // Up to the last frame: the out edge needs the frames the decoder only
+    // gives up when it is drained at the end of the file.
+    const string tail = (dir / "tail.mp4").string();
+    CHECK_EQ(run_clip_export(source, 50, kFrames - 1, tail), 0);
+    check_clip(tail, 50, kFrames - 1);
+
+    filesystem::remove_all(dir);
+    return check_result("test_clip_export");
+}
@@ -0,0 +1,82 @@
+// Checks that cancelling a FrameEngine request that is queued for a decoder
+// completes it at once, even though nothing else in flight can make
+// progress: the scheduler's only worker is held, so the request ahead of it
+// cannot finish and hand over its decoder.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "../frame_requests.h"
+#include "check.h"
+
+using namespace std;
+
+static detail::DetachedTask start(FrameEngine &engine, int64_t frame, CancellationToken token, FrameResult &out, atomic<bool> &done) {
+    out = co_await engine.frame_at(frame, move(token));
+    done = true;
+}
+
+static bool wait_until(const atomic<bool> &flag, chrono::milliseconds timeout) {
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    while (!flag.load()) {
+        if (chrono::steady_clock::now() > deadline) return false;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return true;
+}
+
+int main() {
+    TaskScheduler sched(1);
+    mutex gate_mtx;
+    condition_variable gate_cv;
+    bool gate_open = false;
+    atomic<bool> blocked{false};
+    sched.submit(TaskClass::DisplayCritical, [&] {
+        blocked = true;
+        unique_lock<mutex> lk(gate_mtx);
+        gate_cv.wait(lk, [&] { return gate_open; });
+    });
+    CHECK(wait_until(blocked, chrono::seconds(5)));
+
+    // One decoder slot and no file: the first request takes the slot and its
+    // task waits behind the held worker; the second one queues.
+    FrameEngine engine(1, sched);
+    FrameResult first, second;
+    atomic<bool> first_done{false}, second_done{false};
+    CancellationToken first_token, second_token;
+    start(engine, 10, first_token, first, first_done);
+    start(engine, 20, second_token, second, second_done);
+    this_thread::sleep_for(chrono::milliseconds(20));
+    CHECK(!first_done.load());
+    CHECK(!second_done.load());
+
+    second_token.cancel();
+    CHECK(second_done.load()); // completed within cancel()
+    CHECK(second.cancelled);
+    CHECK(!second.ok);
+    CHECK_EQ(second.requested, 20);
+    CHECK(!first_done.load());
+
+    // A request cancelled before it would queue does not suspend at all.
+    FrameResult third;
+    atomic<bool> third_done{false};
+    CancellationToken third_token;
+    third_token.cancel();
+    start(engine, 30, third_token, third, third_done);
+    CHECK(third_done.load());
+    CHECK(third.cancelled);
+
+    {
+        lock_guard<mutex> lk(gate_mtx);
+        gate_open = true;
+    }
+    gate_cv.notify_all();
+    // The first request finds no file to open and fails, uncancelled.
+    CHECK(wait_until(first_done, chrono::seconds(5)));
+    CHECK(!first.ok);
+    CHECK(!first.cancelled);
+    return check_result("test_frame_requests");
+}
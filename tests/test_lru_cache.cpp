@@ -0,0 +1,96 @@
+// Checks LruCache's eviction order and cost accounting: the least recently
+// used entries go first, get() refreshes an entry, costs are summed against
+// the budget, and values evicted while shared stay valid for their holders.
+
+#include <memory>
+#include <string>
+
+#include "../lru_cache.h"
+#include "check.h"
+
+using namespace std;
+
+static void test_eviction_order() {
+    LruCache<int, string> cache(3);
+    cache.put(1, "one");
+    cache.put(2, "two");
+    cache.put(3, "three");
+    CHECK_EQ(cache.size(), 3u);
+
+    string v;
+    CHECK(cache.get(1, v)); // 1 is now the most recent; 2 is the coldest
+    CHECK_EQ(v, string("one"));
+    cache.put(4, "four");
+    CHECK(!cache.contains(2));
+    CHECK(cache.contains(1));
+    CHECK(cache.contains(3));
+    CHECK(cache.contains(4));
+
+    // Replacing a value refreshes it too.
+    cache.put(3, "THREE");
+    cache.put(5, "five");
+    CHECK(!cache.contains(1));
+    CHECK(cache.get(3, v));
+    CHECK_EQ(v, string("THREE"));
+    CHECK_EQ(cache.size(), 3u);
+
+    CHECK(!cache.get(2, v));
+    CHECK_EQ(cache.hit_count(), 2u);
+    CHECK_EQ(cache.miss_count(), 1u);
+}
+
+static void test_costs() {
+    LruCache<int, int> cache(100);
+    cache.put(1, 1, 40);
+    cache.put(2, 2, 40);
+    CHECK_EQ(cache.cost(), 80u);
+    cache.put(3, 3, 30); // 110 > 100: 1 goes
+    CHECK(!cache.contains(1));
+    CHECK_EQ(cache.cost(), 70u);
+
+    cache.put(2, 2, 10); // a replaced entry takes its new cost
+    CHECK_EQ(cache.cost(), 40u);
+
+    cache.put(4, 4, 101); // over the whole budget: not kept, nothing evicted
+    CHECK(!cache.contains(4));
+    CHECK_EQ(cache.size(), 2u);
+    CHECK_EQ(cache.cost(), 40u);
+
+    cache.put(5, 5, 100); // exactly the budget: everything else goes
+    CHECK(cache.contains(5));
+    CHECK_EQ(cache.size(), 1u);
+
+    cache.set_capacity(200);
+    cache.put(6, 6, 20);
+    CHECK(cache.contains(5));
+    cache.set_capacity(30); // shrinking evicts the coldest
+    CHECK(!cache.contains(5));
+    CHECK(cache.contains(6));
+    CHECK_EQ(cache.max_cost(), 30u);
+
+    cache.erase(6);
+    CHECK_EQ(cache.size(), 0u);
+    CHECK_EQ(cache.cost(), 0u);
+    cache.put(7, 7, 5);
+    cache.clear();
+    CHECK_EQ(cache.size(), 0u);
+    CHECK_EQ(cache.cost(), 0u);
+}
+
+static void test_shared_values() {
+    LruCache<string, shared_ptr<string>> cache(1);
+    cache.put("a", make_shared<string>("frame a"));
+    shared_ptr<string> held;
+    CHECK(cache.get("a", held));
+    cache.put("b", make_shared<string>("frame b")); // evicts a
+    CHECK(!cache.contains("a"));
+    CHECK_EQ(*held, string("frame a"));
+    CHECK_EQ(held.use_count(), 1);
+}
+
+int main() {
+    test_eviction_order();
+    test_costs();
+    test_shared_values();
+    return check_result("test_lru_cache");
+}
@@ -0,0 +1,188 @@
+// Checks the row kernels of pixel_kernels.h against straightforward
+// per-element formulas. Lengths and start offsets vary so that the
+// vectorised body, its remainder and unaligned starts are all covered.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "../pixel_kernels.h"
+#include "check.h"
+
+using namespace std;
+
+static const size_t kLengths[] = {0, 1, 3, 7, 15, 16, 17, 31, 33, 64, 100, 1920};
+
+static vector<uint8_t> random_bytes(size_t n, mt19937 &rng) {
+    vector<uint8_t> v(n);
+    for (uint8_t &b : v) b = static_cast<uint8_t>(rng());
+    return v;
+}
+
+static void test_normalise(mt19937 &rng) {
+    const float scale[3] = {1.0f / (255.0f * 0.229f), 1.0f / (255.0f * 0.224f), 1.0f / (255.0f * 0.225f)};
+    const float bias[3] = {-0.485f / 0.229f, -0.456f / 0.224f, -0.406f / 0.225f};
+    for (size_t n : kLengths) {
+        for (size_t offset = 0; offset < 3; ++offset) {
+            const vector<uint8_t> src = random_bytes(3 * n + offset, rng);
+            vector<float> dst(n + 1, -1.0f);
+            normalise_plane(src.data() + offset, dst.data(), n, scale[0], bias[0]);
+            int bad = 0;
+            for (size_t i = 0; i < n; ++i) bad += fabs(dst[i] - (src[offset + i] * scale[0] + bias[0])) > 1e-5f;
+            CHECK_EQ(bad, 0);
+            CHECK_EQ(dst[n], -1.0f); // nothing written past the end
+
+            vector<float> packed(3 * n + 1, -1.0f);
+            normalise_packed(src.data() + offset, packed.data(), n, scale, bias);
+            bad = 0;
+            for (size_t i = 0; i < 3 * n; ++i) bad += fabs(packed[i] - (src[offset + i] * scale[i % 3] + bias[i % 3])) > 1e-5f;
+            CHECK_EQ(bad, 0);
+            CHECK_EQ(packed[3 * n], -1.0f);
+        }
+    }
+}
+
+// x * m / 255, rounded to nearest.
+static unsigned scale255(unsigned x, unsigned m) {
+    return (x * m + 127) / 255;
+}
+
+static void test_premultiply_blend(mt19937 &rng) {
+    for (size_t n : kLengths) {
+        vector<uint8_t> px = random_bytes(4 * n, rng);
+        const vector<uint8_t> orig = px;
+        uint8_t lo = 0, hi = 0;
+        premultiply_row(px.data(), static_cast<int>(n), lo, hi);
+        int bad = 0;
+        uint8_t want_lo = 255, want_hi = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const unsigned a = orig[4 * i + 3];
+            want_lo = min<uint8_t>(want_lo, static_cast<uint8_t>(a));
+            want_hi = max<uint8_t>(want_hi, static_cast<uint8_t>(a));
+        }
+        CHECK_EQ(+lo, +want_lo);
+        CHECK_EQ(+hi, +want_hi);
+        const bool uniform = want_lo == 255 || want_hi == 0;
+        for (size_t i = 0; i < n; ++i) {
+            const unsigned a = orig[4 * i + 3];
+            for (int c = 0; c < 3; ++c) bad += px[4 * i + c] != (uniform ? orig[4 * i + c] : scale255(orig[4 * i + c], a));
+            bad += px[4 * i + 3] != a;
+        }
+        CHECK_EQ(bad, 0);
+
+        vector<uint8_t> dst = random_bytes(4 * n + 4, rng);
+        const vector<uint8_t> under = dst;
+        blend_row(px.data(), dst.data(), static_cast<int>(n));
+        bad = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const unsigned inv = 255u - px[4 * i + 3];
+            for (int c = 0; c < 4; ++c) bad += dst[4 * i + c] != px[4 * i + c] + scale255(under[4 * i + c], inv);
+        }
+        CHECK_EQ(bad, 0);
+        for (int c = 0; c < 4; ++c) CHECK_EQ(+dst[4 * n + c], +under[4 * n + c]);
+    }
+
+    // Every colour and alpha value, where exact rounding matters most.
+    vector<uint8_t> all(4 * 256 * 256);
+    for (unsigned a = 0; a < 256; ++a) {
+        for (unsigned v = 0; v < 256; ++v) {
+            uint8_t *p = &all[4 * (a * 256 + v)];
+            p[0] = p[1] = p[2] = static_cast<uint8_t>(v);
+            p[3] = static_cast<uint8_t>(a);
+        }
+    }
+    const vector<uint8_t> all_orig = all;
+    uint8_t lo = 0, hi = 0;
+    premultiply_row(all.data(), 256 * 256, lo, hi);
+    int bad = 0;
+    for (size_t i = 0; i < 256 * 256; ++i) bad += all[4 * i] != scale255(all_orig[4 * i], all_orig[4 * i + 3]);
+    CHECK_EQ(bad, 0);
+
+    // A fully opaque row is left as it is.
+    vector<uint8_t> opaque = random_bytes(4 * 37, rng);
+    for (size_t i = 0; i < 37; ++i) opaque[4 * i + 3] = 255;
+    vector<uint8_t> copy = opaque;
+    premultiply_row(copy.data(), 37, lo, hi);
+    CHECK(copy == opaque);
+    CHECK_EQ(+lo, 255);
+}
+
+static void test_transitions(mt19937 &rng) {
+    for (size_t n : kLengths) {
+        const vector<uint8_t> a = random_bytes(n, rng), b = random_bytes(n, rng);
+        for (unsigned w : {0u, 1u, 64u, 128u, 200u, 255u, 256u}) {
+            vector<uint8_t> dst(n + 1, 0xAB);
+            mix_row(a.data(), b.data(), dst.data(), static_cast<int>(n), w);
+            int bad = 0;
+            for (size_t i = 0; i < n; ++i) bad += dst[i] != (a[i] * (256 - w) + b[i] * w + 128) >> 8;
+            CHECK_EQ(bad, 0);
+            CHECK_EQ(+dst[n], 0xAB);
+
+            fade_row(a.data(), dst.data(), static_cast<int>(n), w, 16);
+            bad = 0;
+            for (size_t i = 0; i < n; ++i) bad += dst[i] != (a[i] * w + 16 * (256 - w) + 128) >> 8;
+            CHECK_EQ(bad, 0);
+            CHECK_EQ(+dst[n], 0xAB);
+        }
+    }
+    // The ends of a transition are exactly A and B.
+    const vector<uint8_t> a = random_bytes(100, rng), b = random_bytes(100, rng);
+    vector<uint8_t> dst(100);
+    mix_row(a.data(), b.data(), dst.data(), 100, 0);
+    CHECK(dst == a);
+    mix_row(a.data(), b.data(), dst.data(), 100, 256);
+    CHECK(dst == b);
+    fade_row(a.data(), dst.data(), 100, 0, 16);
+    CHECK(all_of(dst.begin(), dst.end(), [](uint8_t v) { return v == 16; }));
+}
+
+static void test_bob(mt19937 &rng) {
+    for (size_t n : kLengths) {
+        const vector<uint8_t> a = random_bytes(n, rng), b = random_bytes(n, rng);
+        vector<uint8_t> dst(n + 1, 0xAB);
+        average_row(a.data(), b.data(), dst.data(), static_cast<int>(n));
+        int bad = 0;
+        for (size_t i = 0; i < n; ++i) bad += dst[i] != (a[i] + b[i] + 1) / 2;
+        CHECK_EQ(bad, 0);
+        CHECK_EQ(+dst[n], 0xAB);
+    }
+
+    // Kept rows are copied, the others are the mean of their neighbours, or
+    // the nearest row at the edges; bands give the same picture as one pass.
+    for (int height : {1, 2, 5, 8, 11}) {
+        const int width = 37, src_stride = 40, dst_stride = 48;
+        const vector<uint8_t> src = random_bytes(static_cast<size_t>(src_stride) * height, rng);
+        for (int keep = 0; keep < 2; ++keep) {
+            vector<uint8_t> whole(static_cast<size_t>(dst_stride) * height, 0xAB), banded = whole;
+            bob_rows(src.data(), src_stride, whole.data(), dst_stride, width, height, keep, 0, height);
+            for (int r0 = 0; r0 < height; r0 += 2) {
+                bob_rows(src.data(), src_stride, banded.data(), dst_stride, width, height, keep, r0, min(height, r0 + 2));
+            }
+            CHECK(whole == banded);
+            int bad = 0;
+            for (int r = 0; r < height; ++r) {
+                const uint8_t *s = &src[static_cast<size_t>(r) * src_stride];
+                const uint8_t *d = &whole[static_cast<size_t>(r) * dst_stride];
+                const uint8_t *above = r > 0 ? s - src_stride : s + src_stride;
+                const uint8_t *below = r + 1 < height ? s + src_stride : s - src_stride;
+                for (int x = 0; x < width; ++x) {
+                    const int want = (r & 1) == keep || height == 1 ? s[x] : (above[x] + below[x] + 1) / 2;
+                    bad += d[x] != want;
+                }
+                for (int x = width; x < dst_stride; ++x) bad += d[x] != 0xAB; // padding untouched
+            }
+            CHECK_EQ(bad, 0);
+        }
+    }
+}
+
+int main() {
+    mt19937 rng(1);
+    test_normalise(rng);
+    test_premultiply_blend(rng);
+    test_transitions(rng);
+    test_bob(rng);
+    return check_result("test_pixel_kernels");
+}
@@ -0,0 +1,166 @@
+// Checks the shared-memory frame ring between a writer and a reader in one
+// process: frames arrive with their metadata, a view stops validating once
+// its slot is rewritten, oversized frames move readers to a larger ring,
+// and a reader racing the writer never accepts a torn frame.
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "../shm_frame_ring.h"
+#include "check.h"
+
+using namespace std;
+
+static ShmFrameInfo frame_info(int64_t n, int width, int height) {
+    ShmFrameInfo info;
+    info.frame_number = n;
+    info.pts = n * 512;
+    info.time_base_num = 1;
+    info.time_base_den = 12800;
+    info.width = width;
+    info.height = height;
+    info.stride = width;
+    info.pix_fmt = 8; // gray
+    info.pix_fmt_name = "gray";
+    return info;
+}
+
+// A width x height frame whose bytes all hold the low byte of `n`.
+static bool publish_flat(ShmFrameWriter &w, int64_t n, int width, int height) {
+    const vector<uint8_t> px(static_cast<size_t>(width) * height, static_cast<uint8_t>(n));
+    return w.publish(frame_info(n, width, height), px.data(), static_cast<size_t>(width), static_cast<size_t>(width), height);
+}
+
+static bool all_bytes(const uint8_t *p, size_t n, uint8_t v) {
+    for (size_t i = 0; i < n; ++i) {
+        if (p[i] != v) return false;
+    }
+    return true;
+}
+
+static void test_publish_and_overrun(const string &name) {
+    ShmFrameWriter w;
+    CHECK(w.create(name, 3, 64 * 16));
+    ShmFrameReader r;
+    CHECK(r.open(name));
+    CHECK(r.producer_open());
+
+    ShmFrameView view;
+    CHECK(!r.latest(0, view));
+    CHECK(publish_flat(w, 7, 64, 16));
+    CHECK(r.latest(0, view));
+    CHECK_EQ(view.slot->frame_index, 1u);
+    CHECK_EQ(view.slot->frame_number, 7);
+    CHECK_EQ(view.slot->pts, 7 * 512);
+    CHECK_EQ(view.slot->width, 64);
+    CHECK_EQ(view.slot->height, 16);
+    CHECK_EQ(view.slot->payload_size, 64u * 16u);
+    CHECK_EQ(string(view.slot->pix_fmt_name), string("gray"));
+    CHECK(all_bytes(view.data, 64 * 16, 7));
+    CHECK(r.still_valid(view));
+    ShmFrameView again;
+    CHECK(!r.latest(view.slot->frame_index, again)); // nothing newer
+
+    // Later frames go to the other slots; the view holds until its own slot
+    // is rewritten, and turns invalid as soon as that starts.
+    CHECK(publish_flat(w, 8, 64, 16));
+    CHECK(publish_flat(w, 9, 64, 16));
+    CHECK(r.still_valid(view));
+    uint8_t *p = w.begin_write(frame_info(10, 64, 16), 64 * 16);
+    CHECK(p != nullptr);
+    CHECK(!r.still_valid(view));
+    ShmFrameView newest;
+    CHECK(r.latest(0, newest));
+    CHECK_EQ(newest.slot->frame_number, 9); // the slot being written is skipped
+    if (p) memset(p, 10, 64 * 16);
+    w.commit();
+    CHECK(r.latest(newest.slot->frame_index, newest));
+    CHECK_EQ(newest.slot->frame_number, 10);
+    CHECK_EQ(newest.slot->frame_index, 4u);
+    CHECK(all_bytes(newest.data, 64 * 16, 10));
+}
+
+static void test_grow(const string &name) {
+    ShmFrameReader r;
+    uint64_t last_index = 0;
+    {
+        ShmFrameWriter w;
+        CHECK(w.create(name, 2, 32 * 8));
+        CHECK(r.open(name));
+        CHECK(publish_flat(w, 1, 32, 8));
+        ShmFrameView view;
+        CHECK(r.latest(0, view));
+        last_index = view.slot->frame_index;
+        CHECK(!r.reopen_if_replaced());
+
+        // Far larger than the slots: the writer moves to a new ring.
+        CHECK(publish_flat(w, 2, 1920, 1080));
+        CHECK(r.reopen_if_replaced());
+        CHECK(r.producer_open());
+        CHECK(r.latest(last_index, view));
+        CHECK_EQ(view.slot->frame_index, last_index + 1); // indices carry on
+        CHECK_EQ(view.slot->width, 1920);
+        CHECK(all_bytes(view.data, 1920u * 1080u, 2));
+    }
+    CHECK(!r.producer_open()); // the writer has gone
+}
+
+// The writer publishes as fast as it can while the reader copies the latest
+// frame and keeps it only if still_valid() says the slot was not touched.
+static void test_concurrent(const string &name) {
+    constexpr int kSize = 64 * 1024;
+    constexpr int64_t kFrames = 20000;
+    ShmFrameWriter w;
+    CHECK(w.create(name, 2, kSize));
+    ShmFrameReader r;
+    CHECK(r.open(name));
+    atomic<bool> done{false};
+    thread writer([&] {
+        vector<uint8_t> px(kSize);
+        for (int64_t n = 1; n <= kFrames; ++n) {
+            memset(px.data(), static_cast<uint8_t>(n), px.size());
+            w.publish(frame_info(n, kSize, 1), px.data(), kSize, kSize, 1);
+        }
+        done = true;
+    });
+
+    vector<uint8_t> copy(kSize);
+    int64_t accepted = 0, torn = 0;
+    uint64_t after = 0;
+    while (!done.load()) {
+        ShmFrameView view;
+        if (!r.latest(after, view)) continue;
+        const int64_t n = view.slot->frame_number;
+        // Copied in two halves with a yield between, to give the writer
+        // every chance to lap the ring mid-copy.
+        memcpy(copy.data(), view.data, kSize / 2);
+        this_thread::yield();
+        memcpy(copy.data() + kSize / 2, view.data + kSize / 2, kSize / 2);
+        if (!r.still_valid(view)) continue;
+        ++accepted;
+        after = view.slot->frame_index;
+        torn += !all_bytes(copy.data(), copy.size(), static_cast<uint8_t>(n));
+    }
+    writer.join();
+    CHECK_EQ(torn, 0);
+    CHECK(accepted > 0);
+}
+
+int main() {
+    const string base = "vmix_test_ring_" + to_string(getpid());
+    ShmFrameWriter probe;
+    if (!probe.create(base + "_probe", 2, 16)) {
+        cout << "POSIX shared memory is not available here, skipping\n";
+        return kTestSkipped;
+    }
+    test_publish_and_overrun(base + "_a");
+    test_grow(base + "_b");
+    test_concurrent(base + "_c");
+    return check_result("test_shm_frame_ring");
+}
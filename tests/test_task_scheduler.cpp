@@ -0,0 +1,173 @@
+// Checks the priority rules of TaskScheduler: a worker takes queued tasks
+// highest class first, waiters only help with their own class or higher,
+// background work never occupies every worker yet nested background groups
+// finish, and TaskGroup runs every task exactly once across stealing workers.
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "../task_scheduler.h"
+#include "check.h"
+
+using namespace std;
+
+// Holds tasks until open() is called.
+class Gate {
+public:
+    void wait() {
+        unique_lock<mutex> lk(mtx);
+        cv.wait(lk, [this] { return is_open; });
+    }
+    void open() {
+        lock_guard<mutex> lk(mtx);
+        is_open = true;
+        cv.notify_all();
+    }
+
+private:
+    mutex mtx;
+    condition_variable cv;
+    bool is_open = false;
+};
+
+static bool wait_until(const atomic<bool> &flag, chrono::milliseconds timeout) {
+    const auto deadline = chrono::steady_clock::now() + timeout;
+    while (!flag.load()) {
+        if (chrono::steady_clock::now() > deadline) return false;
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    return true;
+}
+
+// One worker, blocked while tasks of every class queue up behind it, lowest
+// class first: once released it runs them highest class first.
+static void test_class_order() {
+    TaskScheduler sched(1);
+    Gate gate;
+    atomic<bool> blocked{false};
+    sched.submit(TaskClass::DisplayCritical, [&] {
+        blocked = true;
+        gate.wait();
+    });
+    CHECK(wait_until(blocked, chrono::seconds(5)));
+
+    mutex order_mtx;
+    vector<TaskClass> order;
+    atomic<int> done{0};
+    for (TaskClass cls : {TaskClass::Background, TaskClass::Prefetch, TaskClass::DisplayCritical}) {
+        for (int i = 0; i < 2; ++i) {
+            sched.submit(cls, [&, cls] {
+                lock_guard<mutex> lk(order_mtx);
+                order.push_back(cls);
+                ++done;
+            });
+        }
+    }
+    gate.open();
+    const auto deadline = chrono::steady_clock::now() + chrono::seconds(5);
+    while (done.load() < 6 && chrono::steady_clock::now() < deadline) this_thread::sleep_for(chrono::milliseconds(1));
+    lock_guard<mutex> lk(order_mtx);
+    const vector<TaskClass> want = {TaskClass::DisplayCritical, TaskClass::DisplayCritical, TaskClass::Prefetch,
+                                    TaskClass::Prefetch, TaskClass::Background, TaskClass::Background};
+    CHECK(order == want);
+}
+
+// run_one() from a thread outside the pool takes nothing below max_cls.
+static void test_run_one_limit() {
+    TaskScheduler sched(1);
+    Gate gate;
+    atomic<bool> blocked{false};
+    sched.submit(TaskClass::DisplayCritical, [&] {
+        blocked = true;
+        gate.wait();
+    });
+    CHECK(wait_until(blocked, chrono::seconds(5)));
+
+    atomic<int> ran_background{0}, ran_prefetch{0};
+    sched.submit(TaskClass::Background, [&] { ++ran_background; });
+    CHECK(!sched.run_one(TaskClass::DisplayCritical));
+    CHECK(!sched.run_one(TaskClass::Prefetch));
+    CHECK_EQ(ran_background.load(), 0);
+    sched.submit(TaskClass::Prefetch, [&] { ++ran_prefetch; });
+    CHECK(sched.run_one(TaskClass::Prefetch));
+    CHECK_EQ(ran_prefetch.load(), 1);
+    CHECK_EQ(ran_background.load(), 0);
+    CHECK(sched.run_one(TaskClass::Background));
+    CHECK_EQ(ran_background.load(), 1);
+    gate.open();
+}
+
+// With every background task blocked, a display-critical task still runs.
+static void test_background_limit() {
+    TaskScheduler sched(3);
+    Gate gate;
+    atomic<int> running{0}, max_running{0};
+    for (int i = 0; i < 6; ++i) {
+        sched.submit(TaskClass::Background, [&] {
+            const int now = ++running;
+            int prev = max_running.load();
+            while (now > prev && !max_running.compare_exchange_weak(prev, now)) {}
+            gate.wait();
+            --running;
+        });
+    }
+    this_thread::sleep_for(chrono::milliseconds(50));
+    atomic<bool> critical_ran{false};
+    sched.submit(TaskClass::DisplayCritical, [&] { critical_ran = true; });
+    CHECK(wait_until(critical_ran, chrono::seconds(5)));
+    CHECK(max_running.load() <= 2);
+    gate.open();
+}
+
+// A background task waiting on a background group of its own finishes,
+// even with one worker and so a single background slot.
+static void test_nested_background() {
+    for (unsigned workers : {1u, 2u}) {
+        TaskScheduler sched(workers);
+        atomic<int> inner{0};
+        atomic<bool> finished{false};
+        sched.submit(TaskClass::Background, [&] {
+            TaskGroup group(sched, TaskClass::Background);
+            for (int i = 0; i < 8; ++i) group.run([&] { ++inner; });
+            group.wait();
+            finished = true;
+        });
+        CHECK(wait_until(finished, chrono::seconds(5)));
+        CHECK_EQ(inner.load(), 8);
+
+        // The slot is released again afterwards.
+        atomic<bool> later{false};
+        sched.submit(TaskClass::Background, [&] { later = true; });
+        CHECK(wait_until(later, chrono::seconds(5)));
+    }
+}
+
+// Tasks spread over the workers by stealing all run, exactly once.
+static void test_group() {
+    TaskScheduler sched(4);
+    constexpr int kTasks = 2000;
+    vector<atomic<int>> runs(kTasks);
+    {
+        TaskGroup group(sched, TaskClass::Prefetch);
+        for (int i = 0; i < kTasks; ++i) group.run([&runs, i] { ++runs[i]; });
+        group.wait();
+    }
+    int bad = 0;
+    for (const atomic<int> &r : runs) bad += r.load() != 1;
+    CHECK_EQ(bad, 0);
+    const auto stats = sched.stats();
+    CHECK_EQ(stats[static_cast<int>(TaskClass::Prefetch)].submitted, static_cast<uint64_t>(kTasks));
+}
+
+int main() {
+    test_class_order();
+    test_run_one_limit();
+    test_background_limit();
+    test_nested_background();
+    test_group();
+    return check_result("test_task_scheduler");
+}
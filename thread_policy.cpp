@@ -0,0 +1,341 @@
+#include "thread_policy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+using namespace std;
+
+const char *thread_role_name(ThreadRole role) {
+    switch (role) {
+    case ThreadRole::Decode: return "decode";
+    case ThreadRole::Display: return "display";
+    case ThreadRole::Worker: return "worker";
+    }
+    return "unknown";
+}
+
+ThreadPolicies &thread_policies() {
+    static ThreadPolicies policies;
+    return policies;
+}
+
+static bool parse_role(const string &name, ThreadRole &role) {
+    for (int r = 0; r < kThreadRoleCount; ++r) {
+        if (name == thread_role_name(static_cast<ThreadRole>(r))) {
+            role = static_cast<ThreadRole>(r);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whole-string base-10 integer in [lo, hi]; no trailing junk, no overflow.
+static bool parse_long(const string &text, long lo, long hi, long &out) {
+    if (text.empty() || isspace(static_cast<unsigned char>(text[0]))) return false;
+    char *end = nullptr;
+    errno = 0;
+    const long v = strtol(text.c_str(), &end, 10);
+    if (errno == ERANGE || end != text.c_str() + text.size() || v < lo || v > hi) return false;
+    out = v;
+    return true;
+}
+
+// Upper bound for CPU numbers, matching the kernel's default NR_CPUS limit.
+constexpr long kMaxCpu = 4095;
+
+static bool parse_cpu_list(const string &text, vector<int> &cpus) {
+    cpus.clear();
+    stringstream ss(text);
+    string item;
+    while (getline(ss, item, ',')) {
+        if (item.empty()) continue;
+        const size_t dash = item.find('-');
+        long first = 0;
+        long last = 0;
+        if (!parse_long(item.substr(0, dash), 0, kMaxCpu, first)) return false;
+        last = first;
+        if (dash != string::npos && (!parse_long(item.substr(dash + 1), 0, kMaxCpu, last) || last < first)) return false;
+        for (long c = first; c <= last; ++c) cpus.push_back(static_cast<int>(c));
+    }
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return !cpus.empty();
+}
+
+bool parse_thread_option(const string &option, const string &value, ThreadPolicies &policies) {
+    const size_t eq = value.find('=');
+    ThreadRole role;
+    if (eq == string::npos || !parse_role(value.substr(0, eq), role)) {
+        cerr << option << " expects <decode|display|worker>=<value>, got '" << value << "'\n";
+        return false;
+    }
+    const string arg = value.substr(eq + 1);
+    ThreadPolicy &pol = policies[role];
+    long v = 0;
+    if (option == "--affinity") {
+        if (!parse_cpu_list(arg, pol.cpus)) {
+            cerr << "Invalid CPU list '" << arg << "', expected e.g. 0-3,8 with CPUs up to " << kMaxCpu << '\n';
+            return false;
+        }
+    } else if (option == "--nice") {
+        if (!parse_long(arg, -20, 19, v)) {
+            cerr << "Invalid nice value '" << arg << "', expected -20 to 19\n";
+            return false;
+        }
+        pol.set_nice = true;
+        pol.nice = static_cast<int>(v);
+    } else if (option == "--fifo") {
+        if (!parse_long(arg, 0, 99, v)) {
+            cerr << "Invalid SCHED_FIFO priority '" << arg << "', expected 1 to 99 (0 = off)\n";
+            return false;
+        }
+        pol.fifo_priority = static_cast<int>(v);
+    } else {
+        return false;
+    }
+    return true;
+}
+
+#if defined(__linux__)
+
+bool apply_thread_policy(ThreadRole role, const ThreadPolicies &policies) {
+    const ThreadPolicy &pol = policies[role];
+    bool ok = true;
+
+    if (!pol.cpus.empty()) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int c : pol.cpus) {
+            if (c < CPU_SETSIZE) CPU_SET(c, &set);
+        }
+        const int err = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (err != 0) {
+            cerr << "Could not set " << thread_role_name(role) << " affinity : " << strerror(err) << '\n';
+            ok = false;
+        }
+    }
+
+    if (pol.set_nice) {
+        const pid_t tid = static_cast<pid_t>(syscall(SYS_gettid));
+        if (setpriority(PRIO_PROCESS, static_cast<id_t>(tid), pol.nice) != 0) {
+            cerr << "Could not set " << thread_role_name(role) << " nice " << pol.nice << " : " << strerror(errno) << '\n';
+            ok = false;
+        }
+    }
+
+    if (pol.fifo_priority > 0) {
+        sched_param sp{};
+        sp.sched_priority = min(pol.fifo_priority, sched_get_priority_max(SCHED_FIFO));
+        const int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &sp);
+        if (err != 0) {
+            // Usually EPERM without CAP_SYS_NICE or an rtprio limit; keep SCHED_OTHER.
+            cerr << "SCHED_FIFO not permitted for " << thread_role_name(role) << " thread : " << strerror(err) << '\n';
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+int numa_node_of_cpu(int cpu) {
+    const string dir = "/sys/devices/system/cpu/cpu" + to_string(cpu);
+    DIR *d = opendir(dir.c_str());
+    if (!d) return -1;
+    int node = -1;
+    while (dirent *e = readdir(d)) {
+        if (strncmp(e->d_name, "node", 4) == 0 && isdigit(static_cast<unsigned char>(e->d_name[4]))) {
+            node = atoi(e->d_name + 4);
+            break;
+        }
+    }
+    closedir(d);
+    return node;
+}
+
+vector<int> numa_node_cpus(int node) {
+    vector<int> cpus;
+    if (node < 0) return cpus;
+    ifstream in("/sys/devices/system/node/node" + to_string(node) + "/cpulist");
+    string line;
+    if (getline(in, line)) parse_cpu_list(line, cpus);
+    return cpus;
+}
+
+void place_buffer_on_node(void *ptr, size_t size, int node) {
+    if (!ptr || size == 0 || node < 0 || node >= 64) return;
+    const uintptr_t page = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const uintptr_t begin = reinterpret_cast<uintptr_t>(ptr) & ~(page - 1);
+    const uintptr_t end = reinterpret_cast<uintptr_t>(ptr) + size;
+    const unsigned long mask = 1ul << node;
+    const int kMpolPreferred = 1;
+    // Best effort: fails harmlessly on kernels without NUMA support.
+    syscall(SYS_mbind, begin, end - begin, kMpolPreferred, &mask, sizeof(mask) * 8, 0);
+}
+
+#elif defined(_WIN32)
+
+bool apply_thread_policy(ThreadRole role, const ThreadPolicies &policies) {
+    const ThreadPolicy &pol = policies[role];
+    bool ok = true;
+    HANDLE self = GetCurrentThread();
+    if (!pol.cpus.empty()) {
+        DWORD_PTR mask = 0;
+        for (int c : pol.cpus) {
+            if (c < static_cast<int>(sizeof(DWORD_PTR) * 8)) mask |= DWORD_PTR(1) << c;
+        }
+        if (!SetThreadAffinityMask(self, mask)) ok = false;
+    }
+    int prio = THREAD_PRIORITY_NORMAL;
+    if (pol.fifo_priority > 0) prio = THREAD_PRIORITY_TIME_CRITICAL;
+    else if (pol.set_nice && pol.nice < -10) prio = THREAD_PRIORITY_HIGHEST;
+    else if (pol.set_nice && pol.nice < 0) prio = THREAD_PRIORITY_ABOVE_NORMAL;
+    else if (pol.set_nice && pol.nice > 10) prio = THREAD_PRIORITY_LOWEST;
+    else if (pol.set_nice && pol.nice > 0) prio = THREAD_PRIORITY_BELOW_NORMAL;
+    if (prio != THREAD_PRIORITY_NORMAL && !SetThreadPriority(self, prio)) ok = false;
+    if (!ok) cerr << "Could not apply " << thread_role_name(role) << " thread policy\n";
+    return ok;
+}
+
+int numa_node_of_cpu(int) { return -1; }
+vector<int> numa_node_cpus(int) { return {}; }
+void place_buffer_on_node(void *, size_t, int) {}
+
+#else
+
+bool apply_thread_policy(ThreadRole, const ThreadPolicies &) { return true; }
+int numa_node_of_cpu(int) { return -1; }
+vector<int> numa_node_cpus(int) { return {}; }
+void place_buffer_on_node(void *, size_t, int) {}
+
+#endif
+
+bool apply_thread_policy(ThreadRole role) {
+    return apply_thread_policy(role, thread_policies());
+}
+
+int numa_node_of_role(ThreadRole role) {
+    const ThreadPolicy &pol = thread_policies()[role];
+    if (pol.cpus.empty()) return -1;
+    return numa_node_of_cpu(pol.cpus.front());
+}
+
+struct JitterResult {
+    double mean_us = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    double max_us = 0.0;
+    int late_frames = 0;
+    int frames = 0;
+};
+
+// One 60 Hz "decode" loop with ~2 ms of work per tick while every core is
+// saturated by load threads.
+static JitterResult measure_jitter(const ThreadPolicies &policies, bool pinned, double seconds) {
+    using Clock = chrono::steady_clock;
+    const unsigned load_threads = max(1u, thread::hardware_concurrency());
+    atomic<bool> stop{false};
+    vector<thread> load;
+    for (unsigned i = 0; i < load_threads; ++i) {
+        load.emplace_back([&] {
+            if (pinned) apply_thread_policy(ThreadRole::Worker, policies);
+            volatile uint64_t sink = 0;
+            while (!stop.load(memory_order_relaxed)) {
+                for (int k = 0; k < 10000; ++k) sink = sink + static_cast<uint64_t>(k);
+            }
+        });
+    }
+
+    vector<double> lateness;
+    thread loop([&] {
+        if (pinned) apply_thread_policy(ThreadRole::Decode, policies);
+        const auto period = chrono::microseconds(16667);
+        const int frames = static_cast<int>(seconds * 60.0);
+        lateness.reserve(static_cast<size_t>(frames));
+        Clock::time_point deadline = Clock::now() + period;
+        for (int f = 0; f < frames; ++f) {
+            this_thread::sleep_until(deadline);
+            const auto woke = Clock::now();
+            lateness.push_back(chrono::duration<double, micro>(woke - deadline).count());
+            volatile uint64_t sink = 0;
+            while (Clock::now() - woke < chrono::milliseconds(2)) sink = sink + 1;
+            deadline += period;
+        }
+    });
+    loop.join();
+    stop = true;
+    for (auto &t : load) t.join();
+
+    JitterResult r;
+    r.frames = static_cast<int>(lateness.size());
+    if (lateness.empty()) return r;
+    for (double v : lateness) {
+        r.mean_us += v;
+        if (v > 1000.0) ++r.late_frames;
+    }
+    r.mean_us /= static_cast<double>(lateness.size());
+    sort(lateness.begin(), lateness.end());
+    r.p50_us = lateness[lateness.size() / 2];
+    r.p99_us = lateness[min(lateness.size() - 1, lateness.size() * 99 / 100)];
+    r.max_us = lateness.back();
+    return r;
+}
+
+static void print_jitter(const char *label, const JitterResult &r) {
+    cout << "  " << left << setw(10) << label << right << fixed << setprecision(1)
+         << " frames " << r.frames
+         << " mean " << r.mean_us << " us"
+         << " p50 " << r.p50_us << " us"
+         << " p99 " << r.p99_us << " us"
+         << " max " << r.max_us << " us"
+         << " late(>1ms) " << r.late_frames << '\n';
+    cout.unsetf(ios::fixed);
+}
+
+int run_jitter_benchmark(const ThreadPolicies &policies, double seconds) {
+    ThreadPolicies pinned = policies;
+    const unsigned ncpu = max(1u, thread::hardware_concurrency());
+    // Without explicit decode settings, pin decode to CPU 0 at the highest
+    // priority we can get and keep the load off it.
+    if (pinned[ThreadRole::Decode].cpus.empty()) pinned[ThreadRole::Decode].cpus = {0};
+    if (!pinned[ThreadRole::Decode].set_nice) {
+        pinned[ThreadRole::Decode].set_nice = true;
+        pinned[ThreadRole::Decode].nice = -10;
+    }
+    if (pinned[ThreadRole::Decode].fifo_priority == 0) pinned[ThreadRole::Decode].fifo_priority = 10;
+    if (pinned[ThreadRole::Worker].cpus.empty() && ncpu > 1) {
+        for (unsigned c = 1; c < ncpu; ++c) pinned[ThreadRole::Worker].cpus.push_back(static_cast<int>(c));
+    }
+    if (!pinned[ThreadRole::Worker].set_nice) {
+        pinned[ThreadRole::Worker].set_nice = true;
+        pinned[ThreadRole::Worker].nice = 10;
+    }
+
+    cout << "Jitter benchmark: 60 Hz loop, " << ncpu << " load threads, " << seconds << " s per run\n";
+    const JitterResult base = measure_jitter(pinned, false, seconds);
+    print_jitter("unpinned", base);
+    const JitterResult tuned = measure_jitter(pinned, true, seconds);
+    print_jitter("pinned", tuned);
+    return 0;
+}
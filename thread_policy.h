@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Pipeline roles that can be pinned and prioritised independently.
+enum class ThreadRole : int {
+    Decode = 0,
+    Display = 1,
+    Worker = 2,
+};
+
+constexpr int kThreadRoleCount = 3;
+
+const char *thread_role_name(ThreadRole role);
+
+struct ThreadPolicy {
+    std::vector<int> cpus;   // empty: let the OS place the thread
+    bool set_nice = false;
+    int nice = 0;
+    int fifo_priority = 0;   // > 0 requests SCHED_FIFO, falls back silently if not permitted
+};
+
+struct ThreadPolicies {
+    ThreadPolicy roles[kThreadRoleCount];
+
+    ThreadPolicy &operator[](ThreadRole r) { return roles[static_cast<int>(r)]; }
+    const ThreadPolicy &operator[](ThreadRole r) const { return roles[static_cast<int>(r)]; }
+};
+
+// Process-wide policies, filled from the command line before any thread starts.
+ThreadPolicies &thread_policies();
+
+// Parses "decode=0-3,8" style values for --affinity / --nice / --fifo.
+bool parse_thread_option(const std::string &option, const std::string &value, ThreadPolicies &policies);
+
+// Applies the policy of `role` to the calling thread. Returns false and
+// prints a warning if any part of it could not be applied.
+bool apply_thread_policy(ThreadRole role, const ThreadPolicies &policies);
+bool apply_thread_policy(ThreadRole role);
+
+// NUMA helpers (Linux only, no libnuma dependency). Nodes are -1 when unknown.
+int numa_node_of_cpu(int cpu);
+int numa_node_of_role(ThreadRole role);
+std::vector<int> numa_node_cpus(int node);
+
+// Prefers `node` for the pages of [ptr, ptr + size). Applies to pages not yet
+// touched, so call it right after allocating a frame buffer.
+void place_buffer_on_node(void *ptr, size_t size, int node);
+
+// Measures wake-up lateness of a 60 Hz loop under full background load, once
+// without and once with the configured policies.
+int run_jitter_benchmark(const ThreadPolicies &policies, double seconds);
@@ -0,0 +1,303 @@
+#include "transition.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+extern "C" {
+#include <libavutil/pixdesc.h>
+}
+
+#include "pixel_kernels.h"
+
+using namespace std;
+
+bool parse_transition_type(const string &name, TransitionType &out) {
+    if (name == "mix") out = TransitionType::Mix;
+    else if (name == "wipe") out = TransitionType::Wipe;
+    else if (name == "fade") out = TransitionType::Fade;
+    else return false;
+    return true;
+}
+
+static const char *transition_name(TransitionType type) {
+    switch (type) {
+    case TransitionType::Mix: return "mix";
+    case TransitionType::Wipe: return "wipe";
+    case TransitionType::Fade: return "fade";
+    }
+    return "?";
+}
+
+// Formats the kernels blend directly: one byte per sample, one sample per
+// byte in every plane. Everything else is converted to yuv420p first.
+static bool blendable(AVPixelFormat fmt) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    if (!desc || !(desc->flags & AV_PIX_FMT_FLAG_PLANAR) || (desc->flags & (AV_PIX_FMT_FLAG_PAL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_HWACCEL)))
+        return false;
+    for (int c = 0; c < desc->nb_components; ++c) {
+        if (desc->comp[c].depth != 8 || desc->comp[c].step != 1) return false;
+    }
+    return true;
+}
+
+struct PlaneLayout {
+    int planes = 0;
+    int log2_h = 0;     // chroma subsampling of rows
+    int width[4] = {};  // bytes per row
+    int height[4] = {};
+    bool chroma[4] = {};
+    uint8_t black[4] = {};
+};
+
+static PlaneLayout plane_layout(AVPixelFormat fmt, int w, int h, bool full_range) {
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(fmt);
+    const bool rgb = (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+    PlaneLayout l;
+    l.planes = min(4, av_pix_fmt_count_planes(fmt));
+    l.log2_h = desc->log2_chroma_h;
+    for (int p = 0; p < l.planes; ++p) {
+        l.chroma[p] = !rgb && (p == 1 || p == 2);
+        l.width[p] = l.chroma[p] ? -((-w) >> desc->log2_chroma_w) : w;
+        l.height[p] = l.chroma[p] ? -((-h) >> desc->log2_chroma_h) : h;
+        // Fades go through black; alpha stays opaque.
+        l.black[p] = rgb ? (p == 3 ? 255 : 0) : p == 0 ? (full_range ? 0 : 16) : p == 3 ? 255 : 128;
+    }
+    return l;
+}
+
+// Blends luma rows [y0, y1) and the chroma rows that belong to them. y0 and
+// y1 are multiples of the chroma row subsampling, except at the bottom.
+static void blend_rows(TransitionType type, const PlaneLayout &l, const AVFrame *from, const AVFrame *to, AVFrame *dst, int y0,
+                       int y1, unsigned w) {
+    for (int p = 0; p < l.planes; ++p) {
+        const int sh = l.chroma[p] ? l.log2_h : 0;
+        const int r0 = y0 >> sh;
+        const int r1 = y1 >= l.height[0] ? l.height[p] : y1 >> sh;
+        const int n = l.width[p];
+        for (int r = r0; r < r1; ++r) {
+            const uint8_t *a = from->data[p] + static_cast<ptrdiff_t>(r) * from->linesize[p];
+            const uint8_t *b = to->data[p] + static_cast<ptrdiff_t>(r) * to->linesize[p];
+            uint8_t *d = dst->data[p] + static_cast<ptrdiff_t>(r) * dst->linesize[p];
+            switch (type) {
+            case TransitionType::Mix:
+                mix_row(a, b, d, n, w);
+                break;
+            case TransitionType::Wipe: {
+                const int edge = static_cast<int>(static_cast<int64_t>(n) * w / 256);
+                memcpy(d, b, static_cast<size_t>(edge));
+                memcpy(d + edge, a + edge, static_cast<size_t>(n - edge));
+                break;
+            }
+            case TransitionType::Fade:
+                if (w < 128) fade_row(a, d, n, 256 - 2 * w, l.black[p]);
+                else fade_row(b, d, n, 2 * w - 256, l.black[p]);
+                break;
+            }
+        }
+    }
+}
+
+static void blend_banded(TaskScheduler &sched, TransitionType type, const PlaneLayout &l, const AVFrame *from, const AVFrame *to,
+                         AVFrame *dst, unsigned w) {
+    const int h = l.height[0];
+    const int align = 1 << l.log2_h;
+    const int bands = max(1, min(h / 32, static_cast<int>(sched.worker_count()) * 2));
+    const int band_h = ((h + bands - 1) / bands + align - 1) / align * align;
+    TaskGroup group(sched, TaskClass::DisplayCritical);
+    for (int y0 = 0; y0 < h; y0 += band_h) {
+        const int y1 = min(h, y0 + band_h);
+        group.run([=, &l] { blend_rows(type, l, from, to, dst, y0, y1, w); });
+    }
+}
+
+static AVFrame *alloc_frame(AVPixelFormat fmt, int w, int h) {
+    AVFrame *f = av_frame_alloc();
+    if (!f) return nullptr;
+    f->format = fmt;
+    f->width = w;
+    f->height = h;
+    if (av_frame_get_buffer(f, 64) < 0) av_frame_free(&f);
+    return f;
+}
+
+TransitionEngine::TransitionEngine(string b_path, double b_offset, TransitionType type, int frames, DeinterlaceMode deinterlace,
+                                   TaskScheduler &sched)
+    : b_path(move(b_path)), b_offset(b_offset), type(type), length(max(1, frames)), sched(sched), deinterlace(deinterlace) {}
+
+TransitionEngine::~TransitionEngine() {
+    if (b_group) b_group->wait();
+    if (a_sws) sws_freeContext(a_sws);
+    if (b_sws) sws_freeContext(b_sws);
+    av_frame_free(&a_work);
+    av_frame_free(&b_work);
+    av_frame_free(&out);
+}
+
+bool TransitionEngine::open(double fps) {
+    a_fps = fps > 0.0 ? fps : 25.0;
+    if (open_player(b, b_path) < 0) return false;
+    if (!build_frame_index(b, b_index)) cerr << b_path << ": no keyframe index, every frame will seek\n";
+    b_group = make_unique<TaskGroup>(sched, TaskClass::DisplayCritical);
+    if (deinterlace != DeinterlaceMode::Off) b_deinterlacer = make_unique<Deinterlacer>(b, deinterlace, sched);
+    cout << "Transition (" << transition_name(type) << ", " << length << " frames) to " << b_path << ", t to trigger\n";
+    return true;
+}
+
+AVFrame *TransitionEngine::decode_b(int64_t frame_number) {
+    auto b_target = [this](int64_t n) { return static_cast<int64_t>(floor((static_cast<double>(n) / a_fps + b_offset) * b.fps + 1e-6)); };
+    b_group->wait();
+    const int64_t target = b_target(frame_number);
+    if (target < 0) return nullptr;
+    if (!b_frame || target != b_frame_number) {
+        if (b_ahead && b_ahead_frame == target) b_frame = move(b_ahead);
+        else b_frame = decode_frame_indexed(b, b_index, target);
+        b_frame_number = b_frame ? target : -1;
+    }
+    // B's next frame decodes on a worker while the decode thread works on A's.
+    const int64_t next = b_target(frame_number + 1);
+    if (b_frame && next != target && !(b_ahead && b_ahead_frame == next)) {
+        b_ahead.reset();
+        b_ahead_frame = next;
+        b_group->run([this, next] { b_ahead = decode_frame_indexed(b, b_index, next); });
+    }
+    return b_frame.get();
+}
+
+// B's lookahead for bwdif is the frame decoding ahead on the worker, when
+// it is the one that follows. Where B runs slower than A it repeats frames;
+// a repeat shows the same output again rather than counting as a jump.
+AVFrame *TransitionEngine::deinterlace_b(AVFrame *f, bool &draft) {
+    if (!b_deinterlacer) return f;
+    if (b_frame_number != b_shown_number || b_shown_draft) {
+        b_shown_draft = false;
+        b_shown = b_deinterlacer->process(f, b_frame_number, b_shown_draft, [this]() -> AVFrame * {
+            b_group->wait();
+            return b_ahead && b_ahead_frame == b_frame_number + 1 ? b_ahead.get() : nullptr;
+        });
+        b_shown_number = b_frame_number;
+    }
+    draft = draft || b_shown_draft;
+    return b_shown;
+}
+
+AVFrame *TransitionEngine::to_work_format(AVFrame *f, AVPixelFormat fmt, int w, int h, SwsContext *&ctx, AVFrame *&buf) {
+    if (f->format == fmt && f->width == w && f->height == h) return f;
+    if (!buf || buf->format != fmt || buf->width != w || buf->height != h) {
+        av_frame_free(&buf);
+        buf = alloc_frame(fmt, w, h);
+        if (!buf) return nullptr;
+    }
+    ctx = sws_getCachedContext(ctx, f->width, f->height, static_cast<AVPixelFormat>(f->format), w, h, fmt, SWS_BILINEAR, nullptr,
+                               nullptr, nullptr);
+    if (!ctx) return nullptr;
+    sws_scale(ctx, f->data, f->linesize, 0, f->height, buf->data, buf->linesize);
+    buf->color_range = f->color_range;
+    return buf;
+}
+
+void TransitionEngine::blend(const AVFrame *from, const AVFrame *to, double progress) {
+    const AVPixelFormat fmt = static_cast<AVPixelFormat>(from->format);
+    if (!out || out->format != fmt || out->width != from->width || out->height != from->height) {
+        av_frame_free(&out);
+        out = alloc_frame(fmt, from->width, from->height);
+        if (!out) return;
+    }
+    const bool full_range = from->color_range == AVCOL_RANGE_JPEG || fmt == AV_PIX_FMT_YUVJ420P || fmt == AV_PIX_FMT_YUVJ422P
+                            || fmt == AV_PIX_FMT_YUVJ444P;
+    const PlaneLayout l = plane_layout(fmt, from->width, from->height, full_range);
+    const unsigned w = static_cast<unsigned>(clamp(lround(progress * 256.0), 0L, 256L));
+    blend_banded(sched, type, l, from, to, out, w);
+    out->color_range = from->color_range;
+    out->sample_aspect_ratio = from->sample_aspect_ratio;
+}
+
+AVFrame *TransitionEngine::process(AVFrame *a, int64_t frame_number, bool &draft) {
+    if (started_at >= 0 && (frame_number < started_at || frame_number - started_at >= length)) {
+        showing_b = !showing_b;
+        started_at = -1;
+    }
+    if (requested.exchange(false) && started_at < 0) {
+        started_at = frame_number;
+        ++transitions;
+    }
+    if (started_at < 0 && !showing_b) return a;
+
+    AVFrame *bf = decode_b(frame_number);
+    if (!bf) return a;
+    bf = deinterlace_b(bf, draft);
+    // Blend in A's format when the kernels can, otherwise in yuv420p. Once
+    // the transition is over B keeps that format and A's size, so the output
+    // geometry does not change under the presenter.
+    const AVPixelFormat a_fmt = static_cast<AVPixelFormat>(a->format);
+    const AVPixelFormat work_fmt = blendable(a_fmt) ? a_fmt : AV_PIX_FMT_YUV420P;
+    if (started_at < 0) {
+        AVFrame *bw = to_work_format(bf, work_fmt, a->width, a->height, b_sws, b_work);
+        return bw ? bw : bf;
+    }
+
+    const auto t0 = chrono::steady_clock::now();
+    AVFrame *aw = to_work_format(a, work_fmt, a->width, a->height, a_sws, a_work);
+    AVFrame *bw = to_work_format(bf, work_fmt, a->width, a->height, b_sws, b_work);
+    if (!aw || !bw) return a;
+    const double progress = static_cast<double>(frame_number - started_at + 1) / length;
+    if (showing_b) blend(bw, aw, progress);
+    else blend(aw, bw, progress);
+    const double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+    ++blended;
+    blend_ms += ms;
+    max_blend_ms = max(max_blend_ms, ms);
+    return out ? out : a;
+}
+
+void TransitionEngine::print_stats(ostream &os) const {
+    os << "Transitions: " << transitions << " (" << transition_name(type) << "), " << blended << " blended frames";
+    if (blended) os << ", " << blend_ms / static_cast<double>(blended) << " ms mean / " << max_blend_ms << " ms max per blend";
+    os << '\n';
+}
+
+int run_transition_benchmark(double seconds) {
+    const int w = 1920, h = 1080;
+    const AVPixelFormat fmt = AV_PIX_FMT_YUV420P;
+    unique_ptr<AVFrame, AVFrameDeleter> a(alloc_frame(fmt, w, h)), b(alloc_frame(fmt, w, h)), dst(alloc_frame(fmt, w, h));
+    if (!a || !b || !dst) return -1;
+    const PlaneLayout l = plane_layout(fmt, w, h, false);
+    mt19937 rng(1);
+    size_t frame_bytes = 0;
+    for (int p = 0; p < l.planes; ++p) {
+        frame_bytes += static_cast<size_t>(l.width[p]) * l.height[p];
+        for (int r = 0; r < l.height[p]; ++r) {
+            for (int x = 0; x < l.width[p]; ++x) {
+                a->data[p][r * a->linesize[p] + x] = static_cast<uint8_t>(rng());
+                b->data[p][r * b->linesize[p] + x] = static_cast<uint8_t>(rng());
+            }
+        }
+    }
+
+    TaskScheduler &sched = TaskScheduler::global();
+    const double per_run = max(0.1, seconds / 6.0);
+    cout << "Transition kernels, 1920x1080 yuv420p, " << per_run << " s per run\n";
+    for (TransitionType type : {TransitionType::Mix, TransitionType::Wipe, TransitionType::Fade}) {
+        for (int banded = 0; banded < 2; ++banded) {
+            uint64_t n = 0;
+            const auto start = chrono::steady_clock::now();
+            double elapsed = 0.0;
+            while (elapsed < per_run) {
+                const unsigned weight = static_cast<unsigned>(n * 7 % 257);
+                if (banded) blend_banded(sched, type, l, a.get(), b.get(), dst.get(), weight);
+                else blend_rows(type, l, a.get(), b.get(), dst.get(), 0, h, weight);
+                ++n;
+                elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+            }
+            const double fps = static_cast<double>(n) / elapsed;
+            // Two frames read and one written per blend.
+            cout << "  " << transition_name(type) << (banded ? ", " : ", 1 thread, ") << (banded ? to_string(sched.worker_count()) + " workers: " : "")
+                 << 1000.0 / fps << " ms/frame, " << fps << " frames/s, " << fps * 3.0 * static_cast<double>(frame_bytes) / 1e9
+                 << " GB/s" << (fps >= 60.0 ? "" : " (below 60 fps)") << '\n';
+        }
+    }
+    return 0;
+}
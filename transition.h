@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+
+extern "C" {
+#include <libavutil/frame.h>
+#include <libswscale/swscale.h>
+}
+
+#include "deinterlace.h"
+#include "ff_player.h"
+#include "frame_index.h"
+#include "task_scheduler.h"
+
+enum class TransitionType { Mix, Wipe, Fade };
+
+// "mix", "wipe" or "fade".
+bool parse_transition_type(const std::string &name, TransitionType &out);
+
+// Transitions between the playing file (A) and a second file (B) that runs
+// in sync with it. The blend works on the decoders' own planes: B is brought
+// to A's format and size by swscale only when they differ, the two frames
+// are blended plane by plane into one output frame, and only that frame is
+// converted for display. Blends are split into row bands on the task
+// scheduler, and B's next frame is decoded on a worker while the decode
+// thread decodes A's. Unless `deinterlace` is off, B has a Deinterlacer of
+// its own, like A's, with that frame as its lookahead. Install process() as
+// the PlaybackPipeline frame stage, after A's deinterlacer.
+class TransitionEngine {
+public:
+    TransitionEngine(std::string b_path, double b_offset, TransitionType type, int frames,
+                     DeinterlaceMode deinterlace = DeinterlaceMode::Off, TaskScheduler &sched = TaskScheduler::global());
+    ~TransitionEngine();
+    TransitionEngine(const TransitionEngine &) = delete;
+    TransitionEngine &operator=(const TransitionEngine &) = delete;
+
+    // Opens B. `a_fps` is the frame rate of the timeline (A).
+    bool open(double a_fps);
+
+    // Starts a transition to the other source at the next frame. Any thread.
+    void trigger() { requested = true; }
+    bool on_b() const { return showing_b.load(); }
+
+    // Frame stage: A's frame in, the frame to show out. Sets `draft` when
+    // B's frame is a bob draft (see Deinterlacer). B's frames come out at
+    // A's size, during the transition and after it.
+    AVFrame *process(AVFrame *a, int64_t frame_number, bool &draft);
+
+    void print_stats(std::ostream &os) const;
+
+private:
+    AVFrame *decode_b(int64_t frame_number);
+    AVFrame *deinterlace_b(AVFrame *f, bool &draft);
+    AVFrame *to_work_format(AVFrame *f, AVPixelFormat fmt, int w, int h, SwsContext *&ctx, AVFrame *&buf);
+    void blend(const AVFrame *from, const AVFrame *to, double progress);
+
+    std::string b_path;
+    double b_offset;
+    TransitionType type;
+    int length;
+    TaskScheduler &sched;
+    double a_fps = 25.0;
+    DeinterlaceMode deinterlace;
+    FFPlayer b;
+    FrameIndex b_index;
+    std::unique_ptr<Deinterlacer> b_deinterlacer;
+
+    std::atomic<bool> requested{false};
+    std::atomic<bool> showing_b{false};
+    int64_t started_at = -1; // frame where the running transition began, -1 = none
+
+    // B decoded one frame ahead on a worker.
+    std::unique_ptr<TaskGroup> b_group;
+    int64_t b_ahead_frame = -1;
+    std::unique_ptr<AVFrame, AVFrameDeleter> b_ahead;
+    std::unique_ptr<AVFrame, AVFrameDeleter> b_frame;
+    int64_t b_frame_number = -1;
+    // B's frame after deinterlacing, reused while B repeats it.
+    AVFrame *b_shown = nullptr;
+    int64_t b_shown_number = -1;
+    bool b_shown_draft = false;
+
+    SwsContext *a_sws = nullptr;
+    SwsContext *b_sws = nullptr;
+    AVFrame *a_work = nullptr;
+    AVFrame *b_work = nullptr;
+    AVFrame *out = nullptr;
+
+    uint64_t transitions = 0;
+    uint64_t blended = 0;
+    double blend_ms = 0.0;
+    double max_blend_ms = 0.0;
+};
+
+// --bench-transition: times the blend kernels on synthetic 1080p yuv420p
+// frames on one thread and banded on every worker.
+int run_transition_benchmark(double seconds);
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Single-producer/single-consumer "latest value" handoff. The writer fills
+// its private back slot and publishes it; the reader takes the newest
+// published slot. Neither side ever waits, allocates, or touches a slot the
+// other side owns, so a reader can never observe a partially written value.
+template <typename T>
+class TripleBuffer {
+public:
+    // Writer side.
+    T &write_slot() { return slots[back]; }
+    void publish() {
+        back = static_cast<uint8_t>(middle.exchange(static_cast<uint8_t>(back | kFresh), std::memory_order_acq_rel) & kIndexMask);
+    }
+
+    // Reader side. Returns true if a newer value than the current read slot
+    // was published since the last call.
+    bool acquire() {
+        if (!(middle.load(std::memory_order_relaxed) & kFresh)) return false;
+        front = static_cast<uint8_t>(middle.exchange(front, std::memory_order_acq_rel) & kIndexMask);
+        return true;
+    }
+    T &read_slot() { return slots[front]; }
+
+    // Not thread-safe; for pre-sizing slots before the threads start.
+    T &slot(int i) { return slots[i]; }
+
+private:
+    static constexpr uint8_t kIndexMask = 0x3;
+    static constexpr uint8_t kFresh = 0x4;
+
+    T slots[3];
+    uint8_t back = 0;              // writer-owned
+    std::atomic<uint8_t> middle{1}; // index of the shared slot plus kFresh
+    uint8_t front = 2;             // reader-owned
+};
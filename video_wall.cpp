@@ -0,0 +1,394 @@
+#include "video_wall.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "presenter.h"
+#include "program_recorder.h"
+
+using namespace std;
+
+using Clock = chrono::steady_clock;
+
+struct VideoWall::Tile {
+    string path;
+    int index = 0;
+    bool ok = false;
+    FFPlayer player;
+    SwsContext *sws = nullptr;
+    cv::Rect rect;
+    AVDiscard loop_filter = AVDISCARD_DEFAULT; // at full quality
+    double period = 0.04;
+
+    mutex image_mtx;
+    cv::Mat image; // shown by compose()
+    cv::Mat back;  // scaled into by the decode task
+
+    // Dispatcher state, under VideoWall::mtx.
+    bool busy = false;
+    bool ended = false;
+    Clock::time_point due{};
+
+    // Owned by the one decode task in flight.
+    Clock::time_point epoch{}; // when frame 0 was due
+    unique_ptr<AVFrame, AVFrameDeleter> pending; // decoded ahead of its time
+    int64_t pending_frame = -1;
+    int64_t last_frame = -1;
+    int level = 0;    // 0 full, 1 non-reference frames skipped, 2 keyframes only
+    int applied = -1; // level set on the decoder
+    int on_time = 0;
+
+    atomic<uint64_t> shown{0}, late{0}, skipped{0}, resyncs{0}, degrades{0}, decode_ns{0};
+
+    ~Tile() {
+        if (sws) sws_freeContext(sws);
+    }
+};
+
+VideoWall::VideoWall(vector<string> files, WallOptions opts, TaskScheduler &sched)
+    : files(move(files)), opts(opts), sched(sched) {}
+
+VideoWall::~VideoWall() {
+    stop();
+}
+
+bool VideoWall::open() {
+    const int n = static_cast<int>(files.size());
+    if (!n) return false;
+    int cols = opts.cols, rows = opts.rows;
+    if (cols <= 0 || rows <= 0) {
+        cols = static_cast<int>(ceil(sqrt(static_cast<double>(n))));
+        rows = (n + cols - 1) / cols;
+    }
+    per_page = cols * rows;
+    tile_w = max(2, (opts.width / cols) & ~1);
+    tile_h = max(2, (opts.height / rows) & ~1);
+
+    OpenOptions open_opts;
+    open_opts.display_width = tile_w;
+    open_opts.display_height = tile_h;
+    // Parallelism comes from the tiles; threaded decoders would only compete.
+    open_opts.decoder_threads = 1;
+    {
+        TaskGroup group(sched, TaskClass::Prefetch);
+        for (int i = 0; i < n; ++i) {
+            auto t = make_unique<Tile>();
+            t->path = files[i];
+            t->index = i;
+            const int cell = i % per_page;
+            t->rect = cv::Rect((cell % cols) * tile_w, (cell / cols) * tile_h, tile_w, tile_h);
+            t->image = cv::Mat::zeros(tile_h, tile_w, CV_8UC3);
+            t->back = cv::Mat::zeros(tile_h, tile_w, CV_8UC3);
+            Tile *tp = t.get();
+            tiles.push_back(move(t));
+            group.run([tp, &open_opts, this] {
+                if (open_player(tp->player, tp->path, nullptr, &open_opts) < 0) {
+                    cerr << "Tile " << tp->index + 1 << ": cannot open " << tp->path << '\n';
+                    return;
+                }
+                AVCodecContext *dec = tp->player.dec_ctx;
+                // Without lowres, a tile shown at half size or less hides the
+                // blocking the loop filter would remove.
+                if (dec->lowres == 0 && dec->width >= 2 * tile_w) tp->loop_filter = AVDISCARD_ALL;
+                tp->period = 1.0 / max(1.0, tp->player.fps);
+                tp->ok = true;
+            });
+        }
+    }
+    return any_of(tiles.begin(), tiles.end(), [](const unique_ptr<Tile> &t) { return t->ok; });
+}
+
+int VideoWall::pages() const {
+    return max<int>(1, (static_cast<int>(tiles.size()) + per_page - 1) / per_page);
+}
+
+void VideoWall::set_page(int page) {
+    current_page = clamp(page, 0, pages() - 1);
+    cv.notify_all();
+}
+
+void VideoWall::start() {
+    started = Clock::now();
+    for (auto &t : tiles) {
+        t->epoch = started;
+        t->due = started;
+    }
+    quit = false;
+    thread = std::thread([this] { dispatch_loop(); });
+}
+
+void VideoWall::stop() {
+    {
+        lock_guard<mutex> lk(mtx);
+        quit = true;
+    }
+    cv.notify_all();
+    if (!thread.joinable()) return;
+    thread.join();
+    stopped_at = Clock::now();
+    unique_lock<mutex> lk(mtx);
+    cv.wait(lk, [this] { return inflight == 0; });
+}
+
+void VideoWall::apply_level(Tile &t, int level) {
+    if (level == t.applied) return;
+    static const AVDiscard kSkipFrame[3] = {AVDISCARD_DEFAULT, AVDISCARD_NONREF, AVDISCARD_NONKEY};
+    t.player.dec_ctx->skip_frame = kSkipFrame[level];
+    t.player.dec_ctx->skip_loop_filter = level ? AVDISCARD_ALL : t.loop_filter;
+    t.applied = level;
+}
+
+// Decodes the tile's next frame, or takes the one decoded ahead of time,
+// shows it and sets t.due to when the tile needs its next decode.
+void VideoWall::decode_tile(Tile &t) {
+    const Clock::time_point t0 = Clock::now();
+    const bool visible = t.index / per_page == current_page.load();
+    // Keyframes-only is left right after a keyframe, so the frames that
+    // follow have their references.
+    apply_level(t, visible ? t.level : 2);
+
+    unique_ptr<AVFrame, AVFrameDeleter> f = move(t.pending);
+    int64_t n = t.pending_frame;
+    if (!f) {
+        f = decode_next_frame(t.player);
+        if (!f && opts.loop) {
+            f = seek_and_decode_frame(t.player, 0);
+            t.epoch = Clock::now();
+            t.last_frame = -1;
+        }
+        if (!f) {
+            lock_guard<mutex> lk(mtx);
+            t.ended = true;
+            return;
+        }
+        n = pts_to_frame_number(t.player.last_shown_pts, t.player.video_stream);
+    }
+    const chrono::duration<double> period(t.period);
+    const Clock::time_point frame_due = t.epoch + chrono::duration_cast<Clock::duration>(period * static_cast<double>(n));
+    Clock::time_point now = Clock::now();
+
+    // Skipping decoders jump ahead; hold such frames until they are due.
+    if (frame_due - now > period / 2) {
+        t.pending = move(f);
+        t.pending_frame = n;
+        t.decode_ns += static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(now - t0).count());
+        lock_guard<mutex> lk(mtx);
+        t.due = frame_due;
+        return;
+    }
+    t.pending_frame = -1;
+    if (t.last_frame >= 0 && n > t.last_frame + 1) t.skipped += static_cast<uint64_t>(n - t.last_frame - 1);
+    t.last_frame = n;
+
+    if (visible) {
+        t.sws = sws_getCachedContext(t.sws, f->width, f->height, static_cast<AVPixelFormat>(f->format), tile_w, tile_h,
+                                     AV_PIX_FMT_BGR24, SWS_BILINEAR, nullptr, nullptr, nullptr);
+        if (t.sws) {
+            uint8_t *dst[4] = {t.back.data, nullptr, nullptr, nullptr};
+            int dst_linesize[4] = {static_cast<int>(t.back.step[0]), 0, 0, 0};
+            sws_scale(t.sws, f->data, f->linesize, 0, f->height, dst, dst_linesize);
+            lock_guard<mutex> lk(t.image_mtx);
+            swap(t.image, t.back);
+        }
+        ++t.shown;
+    }
+
+    now = Clock::now();
+    const double late_s = chrono::duration<double>(now - frame_due).count();
+    if (visible && late_s > t.period) ++t.late;
+    if (late_s > 2.0 * t.period) {
+        t.on_time = 0;
+        if (visible && t.level < 2) {
+            ++t.level;
+            ++t.degrades;
+        } else if (late_s > 1.0) {
+            // Even keyframes alone do not keep up: carry on from here.
+            t.epoch = now - chrono::duration_cast<Clock::duration>(period * static_cast<double>(n));
+            ++t.resyncs;
+        }
+    } else if (late_s <= t.period && t.level > 0 && ++t.on_time >= static_cast<int>(2.0 / t.period)) {
+        --t.level;
+        t.on_time = 0;
+    }
+    t.decode_ns += static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(now - t0).count());
+
+    lock_guard<mutex> lk(mtx);
+    t.due = t.epoch + chrono::duration_cast<Clock::duration>(period * static_cast<double>(n + 1));
+}
+
+void VideoWall::dispatch_loop() {
+    unique_lock<mutex> lk(mtx);
+    while (!quit) {
+        const Clock::time_point now = Clock::now();
+        const int page = current_page.load();
+        Clock::time_point wake = now + chrono::milliseconds(10);
+        vector<Tile *> ready;
+        for (auto &tp : tiles) {
+            Tile &t = *tp;
+            if (!t.ok || t.busy || t.ended) continue;
+            const Clock::time_point start_at = t.due - chrono::duration_cast<Clock::duration>(chrono::duration<double>(t.period / 2));
+            if (start_at <= now) ready.push_back(&t);
+            else wake = min(wake, start_at);
+        }
+        // Visible tiles first, then earliest deadline.
+        sort(ready.begin(), ready.end(), [this, page](const Tile *a, const Tile *b) {
+            const bool va = a->index / per_page == page, vb = b->index / per_page == page;
+            if (va != vb) return va;
+            return a->due < b->due;
+        });
+        // About one task per worker keeps the queue short, so the order
+        // above is the order in which tiles get a core.
+        const int limit = static_cast<int>(max(1u, sched.worker_count()));
+        for (Tile *t : ready) {
+            if (inflight >= limit) break;
+            const bool visible = t->index / per_page == page;
+            const bool behind = now - t->due > chrono::duration<double>(t->period);
+            const TaskClass cls = !visible ? TaskClass::Background : behind ? TaskClass::Prefetch : TaskClass::DisplayCritical;
+            t->busy = true;
+            ++inflight;
+            sched.submit(cls, [this, t] {
+                decode_tile(*t);
+                // Notify while holding the lock: once stop() sees inflight
+                // reach 0 it returns and the wall, cv included, may be gone.
+                lock_guard<mutex> done(mtx);
+                t->busy = false;
+                --inflight;
+                cv.notify_all();
+            });
+        }
+        cv.wait_until(lk, wake);
+    }
+}
+
+void VideoWall::compose(cv::Mat &out) {
+    if (out.rows != opts.height || out.cols != opts.width || out.type() != CV_8UC3) out = cv::Mat::zeros(opts.height, opts.width, CV_8UC3);
+    const int page = current_page.load();
+    if (page != composed_page) {
+        out.setTo(cv::Scalar::all(0));
+        composed_page = page;
+    }
+    for (auto &t : tiles) {
+        if (!t->ok || t->index / per_page != page) continue;
+        cv::Mat dst = out(t->rect);
+        lock_guard<mutex> lk(t->image_mtx);
+        t->image.copyTo(dst);
+    }
+}
+
+WallStats VideoWall::stats() const {
+    WallStats s;
+    s.seconds = chrono::duration<double>((stopped_at > started ? stopped_at : Clock::now()) - started).count();
+    for (const auto &t : tiles) {
+        if (!t->ok) continue;
+        ++s.tiles;
+        s.frames_shown += t->shown;
+        s.frames_late += t->late;
+        s.frames_skipped += t->skipped;
+        s.resyncs += t->resyncs;
+        s.degrades += t->degrades;
+        s.decode_ms += static_cast<double>(t->decode_ns.load()) / 1e6;
+    }
+    return s;
+}
+
+void VideoWall::print_stats(ostream &os) const {
+    const WallStats s = stats();
+    const double secs = max(1e-9, s.seconds);
+    os << "Wall: " << s.tiles << " tiles of " << tile_w << 'x' << tile_h << ", " << static_cast<double>(s.frames_shown) / secs
+       << " frames/s shown, " << s.frames_late << " late, " << s.frames_skipped << " skipped while degraded, " << s.degrades
+       << " degrades, " << s.resyncs << " resyncs, " << s.decode_ms / 1000.0 / secs << " cores busy decoding on average\n";
+}
+
+int run_video_wall(const vector<string> &files, const WallOptions &opts, const string &present_backend, bool print_stats,
+                   ProgramRecorder *recorder) {
+    VideoWall wall(files, opts);
+    if (!wall.open()) return -1;
+    unique_ptr<Presenter> presenter = make_presenter(present_backend, "vMix AVI Player - wall (q to quit)", wall.width(), wall.height());
+    const double refresh = presenter->refresh_hz() > 0.0 ? presenter->refresh_hz() : 60.0;
+    const auto period = chrono::duration_cast<Clock::duration>(chrono::duration<double>(1.0 / refresh));
+    if (wall.pages() > 1) cout << wall.pages() << " pages, n/b to switch\n";
+    if (recorder && !recorder->open(wall.width(), wall.height(), refresh)) return -1;
+    wall.start();
+
+    cv::Mat canvas;
+    Clock::time_point next = Clock::now();
+    while (true) {
+        const Clock::time_point now = Clock::now();
+        if (now >= next) {
+            wall.compose(canvas);
+            presenter->present(canvas);
+            if (recorder) recorder->submit(canvas, next);
+            next += period;
+            if (next < now) next = now + period;
+        }
+        const int key = presenter->poll_key(1);
+        if (key == -1) continue;
+        const char c = static_cast<char>(key & 0xFF);
+        if (key == 27 || c == 'q') break;
+        if (c == 'n' || key == 83 || c == 'b' || key == 81) {
+            const int step = c == 'n' || key == 83 ? 1 : -1;
+            wall.set_page((wall.page() + step + wall.pages()) % wall.pages());
+            cout << "Page " << wall.page() + 1 << '/' << wall.pages() << '\n';
+        }
+    }
+
+    wall.stop();
+    presenter.reset();
+    if (recorder) recorder->close();
+    if (print_stats) {
+        TaskScheduler::global().print_stats(cout);
+        wall.print_stats(cout);
+        if (recorder) recorder->print_stats(cout);
+    }
+    return 0;
+}
+
+int run_wall_benchmark(const vector<string> &files, double seconds) {
+    if (files.empty()) return -1;
+    const unsigned hw = max(1u, std::thread::hardware_concurrency());
+    vector<unsigned> core_counts;
+    for (unsigned c = 1; c < hw; c *= 2) core_counts.push_back(c);
+    core_counts.push_back(hw);
+
+    cout << "Video wall benchmark, " << seconds << " s per run, 1920x1080 wall\n";
+    vector<pair<unsigned, int>> results;
+    for (unsigned cores : core_counts) {
+        TaskScheduler sched(cores);
+        auto realtime = [&](int n) {
+            vector<string> list;
+            for (int i = 0; i < n; ++i) list.push_back(files[static_cast<size_t>(i) % files.size()]);
+            VideoWall wall(list, WallOptions{}, sched);
+            if (!wall.open()) return false;
+            wall.start();
+            this_thread::sleep_for(chrono::duration<double>(seconds));
+            wall.stop();
+            const WallStats s = wall.stats();
+            const bool ok = s.degrades == 0 && s.frames_shown > 0 && s.frames_late * 100 <= s.frames_shown;
+            cout << "  " << cores << " workers, " << n << " tiles: " << static_cast<double>(s.frames_shown) / max(1e-9, s.seconds)
+                 << " frames/s, " << s.frames_late << " late, " << s.degrades << " degrades -> " << (ok ? "real time" : "behind") << '\n';
+            return ok;
+        };
+        // Double until a run falls behind, then narrow down in between.
+        int good = 0, bad = 0;
+        for (int n = 1; n <= 128; n *= 2) {
+            if (!realtime(n)) {
+                bad = n;
+                break;
+            }
+            good = n;
+        }
+        while (bad && bad - good > max(1, good / 8)) {
+            const int mid = (good + bad) / 2;
+            if (realtime(mid)) good = mid;
+            else bad = mid;
+        }
+        results.push_back({cores, good});
+    }
+
+    cout << "Workers  Real-time tiles\n";
+    for (const auto &[cores, n] : results) {
+        cout << "  " << cores << (cores < 10 ? "      " : "     ") << n << (n >= 128 ? "+" : "") << '\n';
+    }
+    return 0;
+}
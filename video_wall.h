@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "ff_player.h"
+#include "task_scheduler.h"
+
+class ProgramRecorder;
+
+struct WallOptions {
+    int width = 1920; // whole wall
+    int height = 1080;
+    int cols = 0;     // tiles per page; 0 = every tile on one near-square page
+    int rows = 0;
+    bool loop = true;
+};
+
+struct WallStats {
+    size_t tiles = 0;
+    double seconds = 0.0;
+    uint64_t frames_shown = 0;
+    uint64_t frames_late = 0;    // decoded more than one frame period after it was due
+    uint64_t frames_skipped = 0; // dropped by the decoder while a tile was degraded
+    uint64_t resyncs = 0;        // tiles that gave up on their clock and restarted it
+    uint64_t degrades = 0;
+    double decode_ms = 0.0;
+};
+
+// Many independent streams in one window. Every tile plays on its own clock
+// and is decoded at about the size it is shown: lowres where the codec has
+// it, no loop filter for tiles shown at half size or less, a single-threaded
+// decoder, and a scale straight from the decoder's planes into the tile. A
+// dispatcher thread submits at most one decode per tile to the shared task
+// scheduler, earliest deadline first, limited to about one task per worker:
+// visible tiles that are on time are DisplayCritical, visible tiles that
+// fell behind are Prefetch, tiles on other pages are Background and decode
+// keyframes only. A tile that falls more than two periods behind degrades,
+// first to skipping non-reference frames, then to keyframes only, and climbs
+// back after two seconds on time.
+class VideoWall {
+public:
+    VideoWall(std::vector<std::string> files, WallOptions opts, TaskScheduler &sched = TaskScheduler::global());
+    ~VideoWall();
+    VideoWall(const VideoWall &) = delete;
+    VideoWall &operator=(const VideoWall &) = delete;
+
+    // Opens every tile in parallel. False if none could be opened.
+    bool open();
+    void start();
+    void stop();
+
+    int width() const { return opts.width; }
+    int height() const { return opts.height; }
+    int pages() const;
+    int page() const { return current_page.load(); }
+    void set_page(int page);
+
+    // Display side: copies the newest image of every visible tile into
+    // `out`, allocating it at the wall size on first use.
+    void compose(cv::Mat &out);
+
+    WallStats stats() const;
+    void print_stats(std::ostream &os) const;
+
+private:
+    struct Tile;
+
+    void dispatch_loop();
+    void decode_tile(Tile &t);
+    void apply_level(Tile &t, int level);
+
+    std::vector<std::string> files;
+    WallOptions opts;
+    TaskScheduler &sched;
+    std::vector<std::unique_ptr<Tile>> tiles;
+    int per_page = 1;
+    int tile_w = 0;
+    int tile_h = 0;
+    std::atomic<int> current_page{0};
+    std::chrono::steady_clock::time_point started{};
+    std::chrono::steady_clock::time_point stopped_at{};
+    int composed_page = -1; // display side
+
+    std::thread thread;
+    std::mutex mtx;
+    std::condition_variable cv;
+    int inflight = 0;
+    bool quit = false;
+};
+
+// --wall: shows the files of LIST as a wall until q; n/b switch pages.
+// `recorder`, if given, is opened at the wall's size and records it.
+int run_video_wall(const std::vector<std::string> &files, const WallOptions &opts, const std::string &present_backend,
+                   bool print_stats, ProgramRecorder *recorder = nullptr);
+
+// --bench-wall: for 1, 2, 4, ... workers up to the machine's core count,
+// finds the largest number of tiles of a 1920x1080 wall that play in real
+// time (no degraded tiles, under 1% of frames late) for `seconds` each.
+int run_wall_benchmark(const std::vector<std::string> &files, double seconds);
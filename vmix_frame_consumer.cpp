@@ -0,0 +1,174 @@
+// Reference consumer for `vmix_player --shm-out NAME`. Maps the frame ring
+// read-only, follows the newest frame and validates each one with the slot's
+// sequence counter. Also benchmarks the ring on its own with a synthetic
+// producer, so throughput can be measured without a video or a display.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "shm_frame_ring.h"
+
+using namespace std;
+using Clock = chrono::steady_clock;
+
+struct ConsumerStats {
+    uint64_t frames = 0;
+    uint64_t bytes = 0;
+    uint64_t overruns = 0; // frames published but never seen
+    uint64_t torn = 0;     // frames overwritten while being read
+    uint64_t checksum = 0;
+};
+
+static void print_usage(const char *argv0) {
+    cerr << "Usage: " << argv0 << " NAME [--bench SECS] [--quiet]\n"
+         << "       " << argv0 << " --synthetic WxH [--slots N] [--bench SECS]\n"
+         << "  NAME                ring published by vmix_player --shm-out NAME\n"
+         << "  --bench SECS        read for SECS seconds and report frames/s and MB/s\n"
+         << "  --quiet             do not print a line per frame\n"
+         << "  --synthetic WxH     benchmark the ring with an in-process BGR24 producer\n"
+         << "  --slots N           ring slots for --synthetic (default 4)\n";
+}
+
+// Touches every cache line like a real consumer would; the sum keeps the loop from
+// being optimised away.
+static uint64_t consume(const uint8_t *data, size_t size) {
+    uint64_t sum = 0;
+    for (size_t i = 0; i < size; i += 64) sum += data[i];
+    return sum;
+}
+
+static ConsumerStats follow(ShmFrameReader &reader, double seconds, bool quiet, const atomic<bool> *stop = nullptr) {
+    ConsumerStats st;
+    uint64_t last_index = 0;
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point end = start + chrono::duration_cast<Clock::duration>(chrono::duration<double>(seconds));
+    while (seconds <= 0.0 || Clock::now() < end) {
+        if (stop && stop->load(memory_order_relaxed)) break;
+        ShmFrameView view;
+        if (!reader.latest(last_index, view)) {
+            if (reader.reopen_if_replaced()) continue;
+            if (!stop && !reader.producer_open()) break;
+            this_thread::yield();
+            continue;
+        }
+        const ShmSlotHeader &h = *view.slot;
+        const uint64_t index = h.frame_index;
+        const int64_t frame_number = h.frame_number;
+        const int64_t pts = h.pts;
+        const int width = h.width, height = h.height, stride = h.stride;
+        const string fmt_name(h.pix_fmt_name, strnlen(h.pix_fmt_name, sizeof(h.pix_fmt_name)));
+        const size_t size = h.payload_size;
+        const uint64_t sum = consume(view.data, size);
+        if (!reader.still_valid(view)) {
+            ++st.torn;
+            continue;
+        }
+        if (last_index && index > last_index + 1) st.overruns += index - last_index - 1;
+        last_index = index;
+        ++st.frames;
+        st.bytes += size;
+        st.checksum += sum;
+        if (!quiet) {
+            cout << "frame " << frame_number << " pts " << pts << ' ' << width << 'x' << height << ' '
+                 << fmt_name << " stride " << stride << '\n';
+        }
+    }
+    return st;
+}
+
+static void report(const ConsumerStats &st, double seconds) {
+    cout << "Frames: " << st.frames << " in " << seconds << " s (" << st.frames / seconds << " fps, "
+         << st.bytes / seconds / 1e6 << " MB/s)\n"
+         << "Overruns: " << st.overruns << "  torn reads: " << st.torn << '\n';
+}
+
+static int run_synthetic(int w, int h, uint32_t slots, double seconds) {
+    const string name = "vmix_ring_bench_" + to_string(static_cast<long long>(Clock::now().time_since_epoch().count()));
+    const size_t row_bytes = static_cast<size_t>(w) * 3;
+    ShmFrameWriter writer;
+    if (!writer.create(name, slots, row_bytes * h)) return -1;
+    ShmFrameReader reader;
+    if (!reader.open(name)) return -1;
+
+    vector<uint8_t> frame(row_bytes * h);
+    for (size_t i = 0; i < frame.size(); ++i) frame[i] = static_cast<uint8_t>(i * 7);
+
+    atomic<bool> stop{false};
+    uint64_t published = 0;
+    thread producer([&] {
+        ShmFrameInfo info;
+        info.width = w;
+        info.height = h;
+        info.pix_fmt_name = "bgr24";
+        info.time_base_den = 25;
+        while (!stop.load(memory_order_relaxed)) {
+            info.frame_number = info.pts = static_cast<int64_t>(published);
+            writer.publish(info, frame.data(), row_bytes, row_bytes, h);
+            ++published;
+        }
+    });
+
+    const Clock::time_point start = Clock::now();
+    ConsumerStats st;
+    thread consumer([&] { st = follow(reader, seconds, true, &stop); });
+    consumer.join();
+    stop = true;
+    producer.join();
+    const double elapsed = chrono::duration<double>(Clock::now() - start).count();
+
+    cout << "Synthetic " << w << 'x' << h << " BGR24, " << slots << " slots\n"
+         << "Published: " << published << " (" << published / elapsed << " fps, "
+         << published * frame.size() / elapsed / 1e6 << " MB/s)\n";
+    report(st, elapsed);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    string name;
+    double bench_seconds = 0.0;
+    bool quiet = false;
+    int synth_w = 0, synth_h = 0;
+    uint32_t slots = 4;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--bench") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return -1; }
+            bench_seconds = atof(argv[++i]);
+            quiet = true;
+        } else if (arg == "--quiet") {
+            quiet = true;
+        } else if (arg == "--synthetic") {
+            if (i + 1 >= argc || sscanf(argv[++i], "%dx%d", &synth_w, &synth_h) != 2 || synth_w <= 0 || synth_h <= 0) {
+                cerr << "--synthetic expects a size such as 1920x1080\n";
+                return -1;
+            }
+        } else if (arg == "--slots") {
+            if (i + 1 >= argc) { cerr << arg << " needs a value\n"; return -1; }
+            slots = static_cast<uint32_t>(max(2, atoi(argv[++i])));
+        } else if (!arg.empty() && arg[0] == '-') {
+            cerr << "Unknown option " << arg << '\n';
+            print_usage(argv[0]);
+            return -1;
+        } else {
+            name = arg;
+        }
+    }
+
+    if (synth_w > 0) return run_synthetic(synth_w, synth_h, slots, bench_seconds > 0.0 ? bench_seconds : 5.0);
+    if (name.empty()) { print_usage(argv[0]); return -1; }
+
+    ShmFrameReader reader;
+    if (!reader.open(name)) return -1;
+    const Clock::time_point start = Clock::now();
+    const ConsumerStats st = follow(reader, bench_seconds, quiet);
+    if (bench_seconds > 0.0 || quiet) report(st, chrono::duration<double>(Clock::now() - start).count());
+    return 0;
+}
@@ -1,4 +1,5 @@
-
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 #include <string>
 #include <memory>
@@ -8,269 +9,413 @@
 extern "C" {
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
-#include <libswscale/swscale.h>
-#include <libavutil/imgutils.h>
 #include <libavutil/avutil.h>
+#include <libavutil/pixdesc.h>
 }
 
 #include <opencv2/opencv.hpp>
 
+#include "ff_player.h"
+#include "clip_export.h"
+#include "compositor.h"
+#include "data_loader.h"
+#include "deinterlace.h"
+#include "frame_requests.h"
+#include "frame_server.h"
+#include "gop_sampler.h"
+#include "multi_angle.h"
+#include "playback_pipeline.h"
+#include "player_options.h"
+#include "playlist.h"
+#include "presentation_stats.h"
+#include "presenter.h"
+#include "program_recorder.h"
+#include "proxy.h"
+#include "raw_output.h"
+#include "remote_control.h"
+#include "segment_export.h"
+#include "shm_frame_ring.h"
+#include "sidecar_index.h"
+#include "tail_follow.h"
+#include "task_scheduler.h"
+#include "tensor_export.h"
+#include "thread_policy.h"
+#include "transition.h"
+#include "video_wall.h"
+
 using namespace std;
 
-struct FFPlayer {
-    AVFormatContext *fmt_ctx = nullptr;
-    AVCodecContext *dec_ctx = nullptr;
-    int video_stream_idx = -1;
-    AVStream *video_stream = nullptr;
-    SwsContext *sws_ctx = nullptr;
-    int sws_src_w = -1;
-    int sws_src_h = -1;
-    AVPixelFormat sws_src_fmt = AV_PIX_FMT_NONE;
-    double fps = 0.0;
-    AVRational avg_frame_rate{0,1};
-    int64_t current_target_ts = 0;
-    int64_t last_shown_pts = AV_NOPTS_VALUE;
-    ~FFPlayer() {
-        if (sws_ctx) sws_freeContext(sws_ctx);
-        if (dec_ctx) avcodec_free_context(&dec_ctx);
-        if (fmt_ctx) avformat_close_input(&fmt_ctx);
+int main(int argc, char* argv[]) {
+    const auto launched = chrono::steady_clock::now();
+    PlayerOptions opts;
+    if (!parse_player_options(argc, argv, opts)) return -1;
+    if (opts.bench_jitter_seconds > 0.0) return run_jitter_benchmark(thread_policies(), opts.bench_jitter_seconds);
+    if (opts.bench_transition > 0.0) return run_transition_benchmark(opts.bench_transition);
+    if (opts.bench_compositor > 0.0) return run_compositor_benchmark(opts.bench_compositor);
+    if (opts.bench_deinterlace > 0.0) return run_deinterlace_benchmark(opts.bench_deinterlace);
+    vector<string> playlist_items;
+    if (!opts.playlist.empty()) {
+        if (!load_playlist(opts.playlist, playlist_items)) return -1;
+        opts.input = playlist_items.front();
     }
-};
+    const string &input_filename = opts.input;
 
-static void print_error(const string &msg, int err) {
-    char buf[1024] = {0};
-    av_strerror(err, buf, sizeof(buf));
-    cerr << msg << " : " << buf << '\n';
-}
+    TaskScheduler::set_worker_init([](unsigned) { apply_thread_policy(ThreadRole::Worker); });
+    apply_thread_policy(ThreadRole::Display);
 
-static cv::Mat avframe_to_cvmat(AVFrame *frame, FFPlayer &p) {
-    const int width = frame->width;
-    const int height = frame->height;
-    const AVPixelFormat src_fmt = (AVPixelFormat)frame->format;
-    const AVPixelFormat dst_pix_fmt = AV_PIX_FMT_BGR24;
+    av_log_set_level(AV_LOG_ERROR);
 
-    if (!p.sws_ctx || p.sws_src_w != width || p.sws_src_h != height || p.sws_src_fmt != src_fmt) {
-        if (p.sws_ctx) {
-            sws_freeContext(p.sws_ctx);
-            p.sws_ctx = nullptr;
-        }
-        p.sws_ctx = sws_getContext(width, height, src_fmt, width, height, dst_pix_fmt, SWS_BILINEAR, nullptr, nullptr, nullptr);
-        p.sws_src_w = width;
-        p.sws_src_h = height;
-        p.sws_src_fmt = src_fmt;
+    if (!opts.fetch_frames.empty()) {
+        const int rc = run_frame_fetch(input_filename, opts.fetch_frames, opts.decoders);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
     }
 
-    int dst_linesize[4] = {0};
-    const int dst_buf_size = av_image_get_buffer_size(dst_pix_fmt, width, height, 1);
-    vector<uint8_t> dstbuf(dst_buf_size);
-    uint8_t *dst_data[4] = { nullptr, nullptr, nullptr, nullptr };
-    av_image_fill_arrays(dst_data, dst_linesize, dstbuf.data(), dst_pix_fmt, width, height, 1);
+    if (!opts.tensor_frames.empty()) {
+        TensorExportOptions tensor_opts;
+        tensor_opts.frames = opts.tensor_frames;
+        tensor_opts.stride = opts.tensor_stride;
+        tensor_opts.batch = opts.tensor_batch;
+        tensor_opts.output = opts.tensor_out;
+        tensor_opts.spec.width = opts.tensor_width;
+        tensor_opts.spec.height = opts.tensor_height;
+        tensor_opts.spec.layout = opts.tensor_layout == "nhwc" ? TensorLayout::NHWC : TensorLayout::NCHW;
+        tensor_opts.spec.type = opts.tensor_type == "uint8" ? TensorType::UInt8 : TensorType::Float32;
+        if (!set_tensor_norm(opts.tensor_norm, tensor_opts.spec)) {
+            cerr << "Unknown --tensor-norm " << opts.tensor_norm << " (imagenet, unit or none)\n";
+            return -1;
+        }
+        const int rc = run_tensor_export(input_filename, tensor_opts);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
+    }
 
-    sws_scale(p.sws_ctx, frame->data, frame->linesize, 0, height, dst_data, dst_linesize);
+    if (!opts.sample_frames.empty() || opts.sample_stride > 0 || opts.sample_every > 0.0) {
+        const int rc = run_gop_sampler(input_filename, opts.sample_frames, opts.sample_stride, opts.sample_every,
+                                       opts.sample_out, opts.decoders);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
+    }
 
-    cv::Mat img(height, width, CV_8UC3, dstbuf.data(), dst_linesize[0]);
-    return img.clone();
-}
+    if (!opts.export_frames.empty()) {
+        SegmentExportOptions export_opts;
+        export_opts.frames = opts.export_frames;
+        export_opts.format = opts.export_format;
+        export_opts.output = opts.export_out;
+        export_opts.decoders = opts.decoders;
+        const int rc = run_segment_export(input_filename, export_opts);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
+    }
 
-static int64_t frame_number_to_stream_ts(int64_t frame_number, AVStream *st) {
-    AVRational afr = st->avg_frame_rate.num != 0 ? st->avg_frame_rate : st->r_frame_rate;
-    if (afr.num == 0 || afr.den == 0) afr = {25,1};
-    AVRational frame_time = av_inv_q(afr);
-    return av_rescale_q(frame_number, frame_time, st->time_base);
-}
+    if (opts.clip_in >= 0) {
+        const int rc = run_clip_export(input_filename, opts.clip_in, opts.clip_out, opts.clip_file);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
+    }
 
-static int64_t pts_to_frame_number(int64_t pts, AVStream *st) {
-    AVRational afr = st->avg_frame_rate.num != 0 ? st->avg_frame_rate : st->r_frame_rate;
-    if (afr.num == 0 || afr.den == 0) afr = {25,1};
-    AVRational frame_time = av_inv_q(afr);
-    return av_rescale_q(pts, st->time_base, frame_time);
-}
+    if (!opts.raw_out.empty()) {
+        RawOutputOptions raw_opts;
+        raw_opts.output = opts.raw_out;
+        raw_opts.pix_fmt = opts.raw_format;
+        raw_opts.width = opts.raw_width;
+        raw_opts.height = opts.raw_height;
+        const int rc = run_raw_output(input_filename, raw_opts);
+        // stdout may be carrying the frames.
+        if (opts.print_stats) TaskScheduler::global().print_stats(cerr);
+        return rc;
+    }
 
-struct AVFrameDeleter { void operator()(AVFrame* f) const { av_frame_free(&f); } };
-struct AVPacketDeleter { void operator()(AVPacket* p) const { av_packet_free(&p); } };
+    ProxyOptions proxy_opts;
+    proxy_opts.height = opts.proxy_height;
+    proxy_opts.cache_dir = opts.proxy_dir;
+    if (opts.build_proxy) {
+        const int rc = run_proxy_build(input_filename, proxy_opts);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
+    }
 
-static unique_ptr<AVFrame, AVFrameDeleter> seek_and_decode_frame(FFPlayer &p, int64_t target_frame_number) {
-    if (!p.fmt_ctx || !p.dec_ctx || !p.video_stream) return nullptr;
+    if (!opts.load_list.empty()) {
+        DataLoaderOptions loader_opts;
+        loader_opts.workers = opts.load_workers;
+        loader_opts.batch = opts.tensor_batch;
+        loader_opts.max_files = opts.max_files;
+        if (opts.decoders) loader_opts.decoders_per_file = opts.decoders;
+        loader_opts.cache_mb = opts.cache_mb;
+        const int rc = run_data_loader(opts.load_list, loader_opts, opts.seed);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
+    }
 
-    const int64_t target_ts = frame_number_to_stream_ts(target_frame_number, p.video_stream);
-    int ret = av_seek_frame(p.fmt_ctx, p.video_stream_idx, target_ts, AVSEEK_FLAG_BACKWARD);
-    if (ret < 0) {
-        print_error("av_seek_frame failed", ret);
-        return nullptr;
+    if (!opts.serve_socket.empty()) {
+        FrameServerOptions server_opts;
+        if (opts.decoders) server_opts.decoders_per_file = opts.decoders;
+        server_opts.cache_mb = opts.cache_mb;
+        server_opts.max_files = opts.max_files;
+        const int rc = run_frame_server(opts.serve_socket, server_opts);
+        if (opts.print_stats) TaskScheduler::global().print_stats(cout);
+        return rc;
     }
 
-    avcodec_flush_buffers(p.dec_ctx);
+    unique_ptr<ProgramRecorder> recorder;
+    if (!opts.record_path.empty()) {
+        RecorderOptions record_opts;
+        record_opts.path = opts.record_path;
+        record_opts.queue_frames = static_cast<size_t>(opts.record_queue);
+        recorder = make_unique<ProgramRecorder>(record_opts);
+    }
 
-    unique_ptr<AVPacket, AVPacketDeleter> packet(av_packet_alloc());
-    unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
-    unique_ptr<AVFrame, AVFrameDeleter> out_frame(nullptr);
+    if (!opts.wall_list.empty() || opts.bench_wall_seconds > 0.0) {
+        vector<string> wall_files;
+        if (opts.wall_list.empty()) wall_files.push_back(input_filename);
+        else if (!load_playlist(opts.wall_list, wall_files)) return -1;
+        if (opts.bench_wall_seconds > 0.0) return run_wall_benchmark(wall_files, opts.bench_wall_seconds);
+        WallOptions wall_opts;
+        wall_opts.cols = opts.wall_cols;
+        wall_opts.rows = opts.wall_rows;
+        return run_video_wall(wall_files, wall_opts, opts.present_backend, opts.print_stats, recorder.get());
+    }
 
-    bool got = false;
-    while (!got) {
-        ret = av_read_frame(p.fmt_ctx, packet.get());
-        if (ret < 0) break;
-        if (packet->stream_index != p.video_stream_idx) {
-            av_packet_unref(packet.get());
-            continue;
-        }
-        ret = avcodec_send_packet(p.dec_ctx, packet.get());
-        av_packet_unref(packet.get());
-        if (ret < 0) continue;
-        while (ret >= 0) {
-            ret = avcodec_receive_frame(p.dec_ctx, frame.get());
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
-            if (ret < 0) { print_error("Error while decoding", ret); break; }
-            int64_t pts = (frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : frame->pts;
-            if (pts == AV_NOPTS_VALUE) pts = p.last_shown_pts + 1;
-            if (pts >= target_ts) {
-                out_frame.reset(av_frame_clone(frame.get()));
-                got = true;
-                p.last_shown_pts = pts;
-                av_frame_unref(frame.get());
-                break;
-            }
-            av_frame_unref(frame.get());
+    if (!opts.angles.empty()) {
+        vector<AngleSource> sources;
+        for (const string &a : opts.angles) {
+            AngleSource s;
+            if (!parse_angle(a, s)) { cerr << "Invalid --angle " << a << '\n'; return -1; }
+            sources.push_back(s);
         }
+        return run_multi_angle(sources, opts.present_backend, opts.print_stats, recorder.get());
     }
-    return out_frame;
-}
 
-static unique_ptr<AVFrame, AVFrameDeleter> decode_next_frame(FFPlayer &p) {
-    if (!p.fmt_ctx || !p.dec_ctx) return nullptr;
+    FFPlayer player;
+    player.buffer_numa_node = numa_node_of_role(ThreadRole::Decode);
+
+    OpenOptions open_opts;
+    open_opts.probesize = opts.probe_size;
+    open_opts.analyzeduration = opts.analyze_ms * 1000;
+    StreamSidecar sidecar;
+    const bool cached = opts.sidecar && load_sidecar(input_filename, sidecar);
+    if (cached) use_sidecar(sidecar, open_opts);
+
+    int ret = open_player(player, input_filename, nullptr, &open_opts);
+    if (ret < 0) return -1;
+    if (cached) apply_sidecar_index(player, sidecar);
+    const auto opened = chrono::steady_clock::now();
+
+    // The first frame comes from the quick open; the full analysis that
+    // fills the sidecar for next time runs behind it. Quitting cancels it,
+    // and so does every early return: the guard is destroyed before the
+    // group, whose destructor waits for the analysis.
+    atomic<bool> cancel_analysis{false};
+    TaskGroup analysis(TaskScheduler::global(), TaskClass::Background);
+    struct CancelOnExit {
+        atomic<bool> &flag;
+        ~CancelOnExit() { flag = true; }
+    } cancel_on_exit{cancel_analysis};
+    if (opts.sidecar && !cached) {
+        analysis.run([input_filename, &cancel_analysis] {
+            if (analyze_to_sidecar(input_filename, &cancel_analysis)) {
+                cout << "Stream info cached in " << sidecar_path_for(input_filename) << '\n';
+            }
+        });
+    }
 
-    unique_ptr<AVPacket, AVPacketDeleter> packet(av_packet_alloc());
-    unique_ptr<AVFrame, AVFrameDeleter> frame(av_frame_alloc());
+    player.last_shown_pts = AV_NOPTS_VALUE;
 
-    int ret = 0;
-    while (true) {
-        ret = av_read_frame(p.fmt_ctx, packet.get());
-        if (ret < 0) break;
-        if (packet->stream_index != p.video_stream_idx) {
-            av_packet_unref(packet.get());
-            continue;
-        }
-        ret = avcodec_send_packet(p.dec_ctx, packet.get());
-        av_packet_unref(packet.get());
-        if (ret < 0) continue;
-        while (ret >= 0) {
-            ret = avcodec_receive_frame(p.dec_ctx, frame.get());
-            if (ret == AVERROR(EAGAIN) || ret == AVERROR_EOF) break;
-            if (ret < 0) { print_error("Error while decoding", ret); break; }
-            int64_t pts = (frame->best_effort_timestamp != AV_NOPTS_VALUE) ? frame->best_effort_timestamp : frame->pts;
-            if (pts == AV_NOPTS_VALUE) pts = p.last_shown_pts + 1;
-            unique_ptr<AVFrame, AVFrameDeleter> out_frame(av_frame_clone(frame.get()));
-            p.last_shown_pts = pts;
-            av_frame_unref(frame.get());
-            return out_frame;
-        }
+    string window_name = "vMix AVI Player (q to quit)";
+    unique_ptr<Presenter> presenter = make_presenter(opts.present_backend, window_name, player.dec_ctx->width, player.dec_ctx->height);
+
+    PlaybackPipeline pipeline(player);
+    // Backends with their own frame memory get the conversion written straight into it.
+    const vector<cv::Mat> surfaces = presenter->create_surfaces(3, player.dec_ctx->width, player.dec_ctx->height);
+    if (!surfaces.empty()) {
+        player.out_fmt = presenter->surface_type() == CV_8UC4 ? AV_PIX_FMT_BGR0 : AV_PIX_FMT_BGR24;
+        pipeline.set_surfaces(surfaces);
     }
-    return nullptr;
-}
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        cerr << "Usage: " << argv[0] << " <input.avi>\n";
+    DeinterlaceMode deinterlace_mode = DeinterlaceMode::Auto;
+    if (!parse_deinterlace_mode(opts.deinterlace, deinterlace_mode)) {
+        cerr << "Unknown --deinterlace " << opts.deinterlace << " (off, auto or on)\n";
         return -1;
     }
-    string input_filename = argv[1];
-
-    av_log_set_level(AV_LOG_ERROR);
-
-    FFPlayer player;
-
-    int ret = avformat_open_input(&player.fmt_ctx, input_filename.c_str(), nullptr, nullptr);
-    if (ret < 0) { print_error("Could not open input", ret); return -1; }
-
-    ret = avformat_find_stream_info(player.fmt_ctx, nullptr);
-    if (ret < 0) { print_error("Failed to retrieve stream info", ret); return -1; }
+    unique_ptr<Deinterlacer> deinterlacer;
+    if (deinterlace_mode != DeinterlaceMode::Off) deinterlacer = make_unique<Deinterlacer>(player, deinterlace_mode);
+
+    unique_ptr<TransitionEngine> transition;
+    if (!opts.transition_to.empty()) {
+        AngleSource b;
+        TransitionType type = TransitionType::Mix;
+        if (!parse_angle(opts.transition_to, b)) { cerr << "Invalid --transition " << opts.transition_to << '\n'; return -1; }
+        if (!parse_transition_type(opts.transition_type, type)) {
+            cerr << "Unknown --transition-type " << opts.transition_type << " (mix, wipe or fade)\n";
+            return -1;
+        }
+        transition = make_unique<TransitionEngine>(b.path, b.offset, type, opts.transition_frames, deinterlace_mode);
+        if (!transition->open(player.fps)) return -1;
+    }
+    if (deinterlacer || transition) {
+        // Deinterlace A first, and the engine deinterlaces B, so transitions
+        // blend progressive frames.
+        pipeline.set_frame_stage([d = deinterlacer.get(), t = transition.get()](AVFrame *f, int64_t n, bool &draft,
+                                                                                 const function<AVFrame *()> &next) {
+            AVFrame *out = d ? d->process(f, n, draft, next) : f;
+            return t ? t->process(out, n, draft) : out;
+        });
+    }
 
-    for (unsigned i = 0; i < player.fmt_ctx->nb_streams; ++i) {
-        if (player.fmt_ctx->streams[i]->codecpar->codec_type == AVMEDIA_TYPE_VIDEO) {
-            player.video_stream_idx = static_cast<int>(i);
-            player.video_stream = player.fmt_ctx->streams[i];
-            break;
+    unique_ptr<Compositor> compositor;
+    if (!opts.layers.empty()) {
+        vector<CompositorLayer> layers;
+        for (const string &l : opts.layers) {
+            CompositorLayer layer;
+            if (!parse_layer(l, layer)) { cerr << "Invalid --layer " << l << '\n'; return -1; }
+            layers.push_back(layer);
         }
+        compositor = make_unique<Compositor>(layers);
+        if (!compositor->open()) return -1;
+        // Blending needs 4-channel frames; BGR0 presenter surfaces are blended into directly.
+        if (surfaces.empty()) player.out_fmt = AV_PIX_FMT_BGRA;
+        const double fps = player.fps > 0.0 ? player.fps : 25.0;
+        pipeline.set_frame_filter([c = compositor.get(), fps](PresentFrame &f) {
+            c->apply(f.image, static_cast<double>(f.frame_number) / fps);
+        });
     }
-    if (player.video_stream_idx < 0) { cerr << "No video stream found\n"; return -1; }
 
-    AVCodecParameters *codecpar = player.video_stream->codecpar;
-    const AVCodec *dec = avcodec_find_decoder(codecpar->codec_id);
-    if (!dec) { cerr << "Decoder not found for codec id " << codecpar->codec_id << '\n'; return -1; }
+    ShmFrameWriter shm_writer;
+    if (!opts.shm_out.empty()) {
+        const size_t max_bytes = static_cast<size_t>(player.dec_ctx->width) * player.dec_ctx->height * 4;
+        if (shm_writer.create(opts.shm_out, static_cast<uint32_t>(opts.shm_slots), max_bytes)) {
+            cout << "Publishing frames to shared memory " << shm_object_name(opts.shm_out) << '\n';
+            const AVRational tb = player.video_stream->time_base;
+            const AVPixelFormat fmt = player.out_fmt;
+            pipeline.set_frame_sink([&shm_writer, tb, fmt](const PresentFrame &f) {
+                const cv::Mat &img = f.image;
+                ShmFrameInfo info;
+                info.frame_number = f.frame_number;
+                info.pts = f.pts;
+                info.time_base_num = tb.num;
+                info.time_base_den = tb.den;
+                info.width = img.cols;
+                info.height = img.rows;
+                info.pix_fmt = img.type() == CV_8UC4 ? fmt : AV_PIX_FMT_BGR24;
+                info.pix_fmt_name = av_get_pix_fmt_name(static_cast<AVPixelFormat>(info.pix_fmt));
+                shm_writer.publish(info, img.data, img.step, img.cols * img.elemSize(), img.rows);
+            });
+        }
+    }
 
-    player.dec_ctx = avcodec_alloc_context3(dec);
-    if (!player.dec_ctx) { cerr << "Failed to allocate codec context\n"; return -1; }
+    if (recorder && !recorder->open(player.dec_ctx->width, player.dec_ctx->height, player.fps)) return -1;
 
-    ret = avcodec_parameters_to_context(player.dec_ctx, codecpar);
-    if (ret < 0) { print_error("avcodec_parameters_to_context failed", ret); return -1; }
+    unique_ptr<ProxyBuilder> proxy;
+    if (opts.proxy_height > 0) {
+        proxy = make_unique<ProxyBuilder>(input_filename, proxy_opts);
+        proxy->start();
+        if (proxy->ready()) cout << "Scrubbing on cached proxy " << proxy->path() << '\n';
+        pipeline.set_proxy_source([p = proxy.get()] { return p->take_player(); });
+    }
 
-    ret = avcodec_open2(player.dec_ctx, dec, nullptr);
-    if (ret < 0) { print_error("Failed to open codec", ret); return -1; }
+    unique_ptr<Playlist> playlist;
+    if (playlist_items.size() > 1) {
+        playlist = make_unique<Playlist>(playlist_items);
+        playlist->prepare_next();
+        pipeline.set_next_item([pl = playlist.get()](FFPlayer &p) { return pl->advance(p); });
+        cout << "Playing " << playlist->current_path() << " (1/" << playlist->size() << ")\n";
+    }
 
-    AVRational afr = player.video_stream->avg_frame_rate.num != 0 ? player.video_stream->avg_frame_rate : player.video_stream->r_frame_rate;
-    if (afr.num == 0 || afr.den == 0) afr = {25,1};
-    player.avg_frame_rate = afr;
-    player.fps = av_q2d(afr);
+    unique_ptr<TailFollower> follower;
+    if (opts.follow_delay >= 0.0) {
+        follower = make_unique<TailFollower>(input_filename, opts.follow_delay);
+        if (follower->start()) {
+            cout << "Following " << input_filename << ", " << follower->live_edge() + 1 << " frames written so far\n";
+            pipeline.set_tail_follower(follower.get());
+        } else {
+            follower.reset();
+        }
+    }
 
-    player.last_shown_pts = AV_NOPTS_VALUE;
-    int64_t current_frame = 0;
+    unique_ptr<RemoteControl> remote;
+    if (!opts.control_socket.empty()) {
+        remote = make_unique<RemoteControl>(pipeline);
+        if (remote->start(opts.control_socket)) pipeline.set_state_listener([r = remote.get()](const PlaybackState &s) { r->on_state(s); });
+        else remote.reset();
+    }
 
-    unique_ptr<AVFrame, AVFrameDeleter> frame = seek_and_decode_frame(player, current_frame);
-    if (!frame) { cerr << "Could not decode first frame\n"; return -1; }
+    if (!pipeline.start(0)) { cerr << "Could not decode first frame\n"; return -1; }
+    const auto first_decoded = chrono::steady_clock::now();
 
-    cv::Mat img = avframe_to_cvmat(frame.get(), player);
-    string window_name = "vMix AVI Player (q to quit)";
-    cv::namedWindow(window_name, cv::WINDOW_NORMAL);
-    cv::imshow(window_name, img);
+    const double refresh_hz = opts.refresh_hz > 0.0 ? opts.refresh_hz : presenter->refresh_hz();
+    PresentationStats present_stats(player.fps, refresh_hz);
+    if (!opts.present_log.empty() && !present_stats.open_log(opts.present_log)) {
+        cerr << "Could not open presentation log " << opts.present_log << '\n';
+    }
+    const string cadence = present_stats.cadence_report();
+    if (!cadence.empty()) cout << "Cadence: " << cadence << '\n';
 
-    bool playing = false;
     bool should_quit = false;
-    const int delay_ms = static_cast<int>(round(1000.0 / max(1.0, player.fps)));
-    current_frame = pts_to_frame_number(player.last_shown_pts, player.video_stream);
+    bool first_shown = false;
 
     while (!should_quit) {
-        int key = cv::waitKey(playing ? delay_ms : 0);
-        if (key == -1 && playing) {
-            unique_ptr<AVFrame, AVFrameDeleter> nf = decode_next_frame(player);
-            if (!nf) {
-                cout << "End of file reached\n";
-                playing = false;
-                continue;
+        if (pipeline.acquire()) {
+            PresentFrame &f = pipeline.front();
+            if (opts.overlay) present_stats.draw_overlay(f.image);
+            presenter->present(f.image);
+            const PresentationStats::Clock::time_point shown = PresentationStats::Clock::now();
+            if (!first_shown) {
+                first_shown = true;
+                auto ms = [](auto d) { return chrono::duration<double, milli>(d).count(); };
+                cout << "Time to first frame: " << ms(shown - launched) << " ms (open " << ms(opened - launched) << " ms"
+                     << (cached ? " from sidecar" : "") << ", setup and first decode " << ms(first_decoded - opened) << " ms)\n";
             }
-            cv::Mat next_img = avframe_to_cvmat(nf.get(), player);
-            current_frame = pts_to_frame_number(player.last_shown_pts, player.video_stream);
-            cv::imshow(window_name, next_img);
+            present_stats.on_present(f, shown);
+            if (recorder) recorder->submit(f.image, f.paced ? f.deadline : shown);
+            if (remote) remote->on_presented(f, shown);
+        }
+        if (remote && remote->quit_requested()) break;
+
+        // Short polls keep the display responsive; pacing happens on the decode
+        // thread. While paused, sleep on the pipeline rather than in the key
+        // poll so frames produced by remote commands show up immediately.
+        int key = presenter->poll_key(1);
+        if (key == -1) {
+            if (!pipeline.playing()) pipeline.wait_for_frame(chrono::milliseconds(9));
             continue;
         }
 
         char c = static_cast<char>(key & 0xFF);
         if (key == 27 || c == 'q') { should_quit = true; break; }
-        else if (c == ' ') { playing = !playing; cout << (playing ? "Play\n" : "Pause\n"); }
-        else if (c == 'n' || key == 83) {
-            int64_t target = current_frame + 1;
-            unique_ptr<AVFrame, AVFrameDeleter> nf = seek_and_decode_frame(player, target);
-            if (!nf) cout << "Could not decode next frame (maybe EOF)\n";
-            else {
-                cv::Mat next_img = avframe_to_cvmat(nf.get(), player);
-                current_frame = pts_to_frame_number(player.last_shown_pts, player.video_stream);
-                cv::imshow(window_name, next_img);
-            }
-            playing = false;
+        else if (c == ' ') { pipeline.post({PlaybackCommandType::Toggle}); cout << "Play/Pause\n"; }
+        else if (c == 'n' || key == 83) pipeline.post({PlaybackCommandType::StepForward});
+        else if (c == 'b' || key == 81) pipeline.post({PlaybackCommandType::StepBackward});
+        else if (c == 's') { pipeline.post({PlaybackCommandType::Play}); cout << "Play\n"; }
+        else if (c == 'p') { pipeline.post({PlaybackCommandType::Pause}); cout << "Pause\n"; }
+        else if (c == 't' && transition) {
+            transition->trigger();
+            cout << "Transition to " << (transition->on_b() ? "A" : "B") << '\n';
         }
-        else if (c == 'b' || key == 81) {
-            int64_t target = (current_frame > 0) ? (current_frame - 1) : 0;
-            unique_ptr<AVFrame, AVFrameDeleter> bf = seek_and_decode_frame(player, target);
-            if (!bf) cout << "Could not decode backward frame\n";
-            else {
-                cv::Mat back_img = avframe_to_cvmat(bf.get(), player);
-                current_frame = pts_to_frame_number(player.last_shown_pts, player.video_stream);
-                cv::imshow(window_name, back_img);
-            }
-            playing = false;
+        else if (c == 'e' && follower) {
+            PlaybackCommand live{PlaybackCommandType::Seek};
+            live.frame = max<int64_t>(0, follower->playable_edge());
+            pipeline.post(live);
+            cout << "Live edge: frame " << live.frame << '\n';
         }
-        else if (c == 's') { playing = true; cout << "Play\n"; }
-        else if (c == 'p') { playing = false; cout << "Pause\n"; }
     }
 
-    cv::destroyAllWindows();
+    pipeline.stop();
+    if (remote) {
+        remote->stop();
+        remote->print_summary(cout);
+    }
+    presenter.reset();
+    if (recorder) recorder->close();
+    cancel_analysis = true;
+    analysis.wait();
+    if (opts.print_stats) {
+        TaskScheduler::global().print_stats(cout);
+        present_stats.print_summary(cout);
+        if (playlist) playlist->print_summary(cout);
+        if (compositor) compositor->print_stats(cout);
+        if (deinterlacer) deinterlacer->print_stats(cout);
+        if (transition) transition->print_stats(cout);
+        if (recorder) recorder->print_stats(cout);
+    }
     return 0;
 }